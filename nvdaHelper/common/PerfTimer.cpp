@@ -1,7 +1,7 @@
 /*
 This file is a part of the NVDA project.
 URL: http://www.nvda-project.org/
-Copyright 2006-2010 NVDA contributers.
+Copyright 2006-2017 NVDA contributers.
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License version 2.0, as published by
     the Free Software Foundation.
@@ -11,52 +11,177 @@ Copyright 2006-2010 NVDA contributers.
 This license can be found at:
 http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
-#include <stdexcept>
+#include <atomic>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <vector>
 #include "PerfTimer.h"
 
-std::map<std::string, PerfResult> PerfTimer::s_results = std::map<std::string, PerfResult>();
+namespace {
 
-PerfTimer::PerfTimer(const std::string& name)
-:m_pcFreq(0.0), m_counterStart(0), m_result(nullptr) {
-	m_result = &(s_results[name]);
-	StartCounter();
+/*
+* The results of one section on one thread, in microseconds.
+* Only the owning thread adds to the counters; the thread reading results exchanges them with 0.
+*/
+struct ThreadSectionResult {
+	std::atomic<unsigned long long> totalTime;
+	std::atomic<unsigned long long> hits;
+	std::atomic<unsigned long long> maxTime;
+	std::atomic<unsigned long long> buckets[LatencyHistogram::bucketCount];
+
+	ThreadSectionResult() {
+		totalTime.store(0);
+		hits.store(0);
+		maxTime.store(0);
+		for(auto& bucket : buckets) bucket.store(0);
+	}
+
+	void add(unsigned long long time) {
+		totalTime.fetch_add(time, std::memory_order_relaxed);
+		hits.fetch_add(1, std::memory_order_relaxed);
+		buckets[LatencyHistogram::getBucket(time)].fetch_add(1, std::memory_order_relaxed);
+		unsigned long long oldMax = maxTime.load(std::memory_order_relaxed);
+		while(time > oldMax && !maxTime.compare_exchange_weak(oldMax, time, std::memory_order_relaxed)) {
+		}
+	}
+
+	/* Moves the counters in to a result, leaving them at 0.
+	*/
+	void collect(PerfResult& result) {
+		unsigned long long collectedHits = hits.exchange(0, std::memory_order_relaxed);
+		result.totalTime += double(totalTime.exchange(0, std::memory_order_relaxed)) / 1000.0;
+		result.numberOfHits += static_cast<unsigned int>(collectedHits);
+		for(int i = 0; i < LatencyHistogram::bucketCount; ++i) {
+			unsigned long long count = buckets[i].exchange(0, std::memory_order_relaxed);
+			if(count > 0) result.latencies.addToBucket(i, count);
+		}
+		result.latencies.addMax(maxTime.exchange(0, std::memory_order_relaxed));
+	}
+};
+
+/*
+* The results of all sections on one thread, allocated per section on first use.
+*/
+struct ThreadResults {
+	std::atomic<ThreadSectionResult*> sections[PerfTimer::maxTimers];
+
+	ThreadResults() {
+		for(auto& section : sections) section.store(nullptr);
+	}
+
+	~ThreadResults() {
+		for(auto& section : sections) delete section.load();
+	}
+
+	ThreadSectionResult* getSection(PerfTimerId id) {
+		ThreadSectionResult* section = sections[id].load(std::memory_order_relaxed);
+		if(!section) {
+			section = new ThreadSectionResult();
+			sections[id].store(section, std::memory_order_release);
+		}
+		return section;
+	}
+};
+
+/*
+* Registered section names and the results of all threads.
+*/
+struct Registry {
+	std::mutex mutex; ///< Guards all other members.
+	std::vector<std::string> names; ///< Section names, indexed by id.
+	std::map<std::string, PerfTimerId> ids;
+	std::set<ThreadResults*> threads; ///< Results of running threads.
+	std::map<std::string, PerfResult> retiredResults; ///< Results collected from threads that have exited.
+
+	void collect(ThreadResults* thread, std::map<std::string, PerfResult>& results) {
+		for(PerfTimerId id = 0; id < names.size(); ++id) {
+			ThreadSectionResult* section = thread->sections[id].load(std::memory_order_acquire);
+			if(section && section->hits.load(std::memory_order_relaxed) > 0) {
+				section->collect(results[names[id]]);
+			}
+		}
+	}
+};
+
+/*
+* The registry is never destroyed, as threads may still be stopping timers while the module is unloaded.
+*/
+Registry& getRegistry() {
+	static Registry* registry = new Registry();
+	return *registry;
 }
 
-void PerfTimer::Stop() {
-	if(m_result) {
-		auto time = GetCounter();
-		m_result->totalTime += time;
-		m_result->numberOfHits += 1;
-		m_result = nullptr;
+/*
+* Owns a thread's results, registering them on the thread's first timer and retiring them when the thread exits.
+*/
+struct ThreadResultsOwner {
+	ThreadResults* results;
+
+	ThreadResultsOwner() : results(new ThreadResults()) {
+		Registry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.threads.insert(results);
 	}
+
+	~ThreadResultsOwner() {
+		Registry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.collect(results, registry.retiredResults);
+		registry.threads.erase(results);
+		delete results;
+	}
+};
+
+thread_local ThreadResultsOwner threadResultsOwner;
+
 }
 
-PerfTimer::~PerfTimer() {
-	Stop();
+PerfTimerId PerfTimer::registerTimer(const std::string& name) {
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	auto i = registry.ids.find(name);
+	if(i != registry.ids.end()) {
+		return i->second;
+	}
+	if(registry.names.size() >= maxTimers) {
+		return maxTimers;
+	}
+	PerfTimerId id = static_cast<PerfTimerId>(registry.names.size());
+	registry.names.push_back(name);
+	registry.ids[name] = id;
+	return id;
 }
 
-std::map<std::string, PerfResult> PerfTimer::GetTimerDataAndReset() {
-	auto result = s_results;
-	s_results.clear();
-	return result;
+PerfTimer::PerfTimer(PerfTimerId id)
+:m_id(id), m_start(std::chrono::steady_clock::now()) {
 }
 
-void PerfTimer::StartCounter() {
-    LARGE_INTEGER li;
-    if(!QueryPerformanceFrequency(&li)) {
-    	throw std::runtime_error("QueryPerformanceFrequency failed");
-    }
+PerfTimer::PerfTimer(const std::string& name)
+:m_id(registerTimer(name)), m_start(std::chrono::steady_clock::now()) {
+}
 
-    m_pcFreq = double(li.QuadPart)/1000.0;
+void PerfTimer::Stop() {
+	if(m_id < maxTimers) {
+		auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+		threadResultsOwner.results->getSection(m_id)->add(time > 0 ? static_cast<unsigned long long>(time) : 0);
+		m_id = maxTimers;
+	}
+}
 
-    QueryPerformanceCounter(&li);
-    m_counterStart = li.QuadPart;
+PerfTimer::~PerfTimer() {
+	Stop();
 }
-double PerfTimer::GetCounter() {
-    LARGE_INTEGER li;
-    QueryPerformanceCounter(&li);
-    return double(li.QuadPart-m_counterStart)/m_pcFreq;
+
+std::map<std::string, PerfResult> PerfTimer::GetTimerDataAndReset() {
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	std::map<std::string, PerfResult> results;
+	results.swap(registry.retiredResults);
+	for(auto thread : registry.threads) {
+		registry.collect(thread, results);
+	}
+	return results;
 }
 
 std::string PerfTimer::GetPerfResults() {
@@ -64,12 +189,16 @@ std::string PerfTimer::GetPerfResults() {
 	std::stringstream sstream;
 	sstream << "Perf Results\n";
 	for(auto& result : perfResults){
-		sstream << result.first << " Total time: " << result.second.totalTime 
+		sstream << result.first << " Total time: " << result.second.totalTime
 		<< " Hit count: " << result.second.numberOfHits;
 		if(result.second.totalTime > 0 && result.second.numberOfHits > 0) {
 			sstream << " Average Time: " << result.second.totalTime / result.second.numberOfHits;
 		}
+		const LatencyHistogram& latencies = result.second.latencies;
+		sstream << " p50 (us): " << latencies.getPercentile(50)
+		<< " p99 (us): " << latencies.getPercentile(99)
+		<< " Max (us): " << latencies.getMax();
 		sstream << '\n';
 	}
 	return sstream.str();
-}
\ No newline at end of file
+}
@@ -1,7 +1,7 @@
 /*
 This file is a part of the NVDA project.
 URL: http://www.nvda-project.org/
-Copyright 2006-2010 NVDA contributers.
+Copyright 2006-2017 NVDA contributers.
     This program is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License version 2.0, as published by
     the Free Software Foundation.
@@ -14,8 +14,15 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #ifndef NVDAHELPER_COMMON_PERFTIMER_H
 #define NVDAHELPER_COMMON_PERFTIMER_H
 
-#include <windows.h>
+#include <chrono>
 #include <map>
+#include <string>
+#include "latencyHistogram.h"
+
+/*
+* Identifies a section of code being timed, as returned by PerfTimer::registerTimer.
+*/
+typedef unsigned int PerfTimerId;
 
 /*
 * Holds the results of monitoring performance for a section of code.
@@ -23,22 +30,46 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 class PerfResult{
 public:
 	PerfResult()
-	: totalTime(0), numberOfHits(0)
+	: totalTime(0), numberOfHits(0), latencies()
 	{ }
-	double totalTime; ///< The total time spend in the monitored section of code
+	double totalTime; ///< The total time spend in the monitored section of code, in milliseconds
 	unsigned int numberOfHits; ///< The total number of times that the section is hit.
+	LatencyHistogram latencies; ///< The time of each hit, in microseconds.
 };
 
 /*
 * Allows performance of a section of code to be monitored.
 * Supports RAII based timing, ie will start on construction and stop on destruction.
+* Each thread accumulates its results separately without locking, and results are merged when read,
+* so timers are cheap enough to leave in hot paths.
+* Sections should be registered once, E.g. in a static, and timed by id:
+*   static const PerfTimerId renderTimerId = PerfTimer::registerTimer("render");
+*   PerfTimer timer(renderTimerId);
+* Per-thread results live in implicit thread local storage, which is not set up for DLLs loaded with LoadLibrary on Windows XP,
+* so PerfTimer is for profiling builds and tests, and is not linked in to nvdaHelperRemote.
 */
 class PerfTimer {
 public:
+	/* The most sections that can be registered in a process.
+	*/
+	static const PerfTimerId maxTimers = 256;
+
+	/* Registers a section of code to be timed. Thread safe.
+	* @param name the name for the section of code to be timed. Registering the same name again returns the same id.
+	* @return the id to time the section with, or maxTimers if too many sections have been registered, in which case timers with that id do nothing.
+	*/
+	static PerfTimerId registerTimer(const std::string& name);
+
+	/* Ctor. Starts the timer, will store the result against the given id
+	* @param id the id of the section, as returned by registerTimer.
+	*/
+	explicit PerfTimer(PerfTimerId id);
+
 	/* Ctor. Starts the timer, will store the result against the name given in the parameter
+	* This looks up the name on every construction; prefer registering the name once and using the id.
 	* @param name the name for the section of code to be timed. Use different names for different sections.
 	*/
-	PerfTimer(const std::string& name);
+	explicit PerfTimer(const std::string& name);
 
 	/* Dtor. Stops the timer if it is not already stopped.
 	*/
@@ -48,24 +79,22 @@ public:
 	*/
 	void Stop();
 
-	/* Get the timer results, and resets the currently stored results.
-	* Ensure that all created timers have been stopped (or destructed) before calling.
+	/* Get the timer results merged from all threads, and resets the currently stored results.
+	* Timers still running are not included. A hit that stops while results are being reset may be partly counted in either period.
 	*/
 	static std::map<std::string, PerfResult> GetTimerDataAndReset();
 
 	/* Get the performance results pre formated, clears the results
-	* Ensure that all created timers have been stopped (or destructed) before calling.
+	* Timers still running are not included.
 	*/
 	static std::string GetPerfResults();
 
 private:
-	void StartCounter();
-	double GetCounter();
+	PerfTimer(const PerfTimer&);
+	PerfTimer& operator=(const PerfTimer&);
 
-	double m_pcFreq; ///< CPU frequency as reported by Windows.
-	unsigned __int64 m_counterStart; ///< Windows performance timer value when the timer was started.
-	PerfResult* m_result; ///< The result for this instance of the timer.
-	static std::map<std::string, PerfResult> s_results; ///< The results being collected.
+	PerfTimerId m_id; ///< The id of the section being timed, or maxTimers if stopped.
+	std::chrono::steady_clock::time_point m_start; ///< When the timer was started.
 };
 
-#endif
\ No newline at end of file
+#endif
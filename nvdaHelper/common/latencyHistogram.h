@@ -0,0 +1,110 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2017 NV Access Limited
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef NVDAHELPER_COMMON_LATENCYHISTOGRAM_H
+#define NVDAHELPER_COMMON_LATENCYHISTOGRAM_H
+
+/*
+* Counts latencies in power of 2 buckets, so that percentiles can be estimated in constant memory.
+* Bucket 0 holds values of 0, bucket n values of at least 2^(n-1) but less than 2^n.
+* The unit of the values is up to the user.
+* This class has no Windows dependencies and is not thread safe.
+*/
+class LatencyHistogram {
+public:
+	static const int bucketCount=64;
+
+	LatencyHistogram() {
+		reset();
+	}
+
+	/* Gets the bucket a value would be counted in.
+	*/
+	static int getBucket(unsigned long long value) {
+		int bucket=0;
+		for(;value>0;value>>=1) ++bucket;
+		return bucket<bucketCount?bucket:bucketCount-1;
+	}
+
+	/* Counts a value.
+	*/
+	void add(unsigned long long value) {
+		++buckets[getBucket(value)];
+		++count;
+		if(value>maxValue) maxValue=value;
+	}
+
+	/* Adds an already counted number of values to a bucket, E.g. when merging counts kept elsewhere.
+	* @param bucket the bucket, as returned by getBucket.
+	* @param valueCount the number of values to add to the bucket.
+	*/
+	void addToBucket(int bucket, unsigned long long valueCount) {
+		buckets[bucket]+=valueCount;
+		count+=valueCount;
+	}
+
+	/* Records a maximum value seen elsewhere, E.g. when merging counts kept elsewhere.
+	*/
+	void addMax(unsigned long long value) {
+		if(value>maxValue) maxValue=value;
+	}
+
+	/* Adds all the values counted by another histogram to this one.
+	*/
+	void merge(const LatencyHistogram& other) {
+		for(int i=0;i<bucketCount;++i) buckets[i]+=other.buckets[i];
+		count+=other.count;
+		addMax(other.maxValue);
+	}
+
+	void reset() {
+		for(int i=0;i<bucketCount;++i) buckets[i]=0;
+		count=0;
+		maxValue=0;
+	}
+
+	unsigned long long getCount() const {
+		return count;
+	}
+
+	unsigned long long getMax() const {
+		return maxValue;
+	}
+
+	/* Estimates a percentile of the counted values.
+	* @param percentile the percentile, from 0 to 100.
+	* @return the upper bound of the bucket holding the value at the requested percentile, but never more than the largest value counted, or 0 if nothing has been counted.
+	*/
+	unsigned long long getPercentile(int percentile) const {
+		if(count==0) return 0;
+		// The rank of the value at the requested percentile, rounded up.
+		unsigned long long rank=(count*percentile+99)/100;
+		unsigned long long seen=0;
+		for(int i=0;i<bucketCount;++i) {
+			seen+=buckets[i];
+			if(seen>=rank) {
+				unsigned long long upperBound=(i<bucketCount-1)?(1ULL<<i)-1:~0ULL;
+				return upperBound<maxValue?upperBound:maxValue;
+			}
+		}
+		return maxValue;
+	}
+
+private:
+	unsigned long long buckets[bucketCount];
+	unsigned long long count;
+	unsigned long long maxValue;
+};
+
+#endif
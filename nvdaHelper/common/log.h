@@ -15,6 +15,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #ifndef NVDAHELPER_LOG_H
 #define NVDAHELPER_LOG_H
 
+#include <atomic>
 #include <string>
 #include <sstream>
 #include <common/lock.h>
@@ -23,6 +24,27 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 
 void logMessage(int level, const wchar_t* msg);
 
+/**
+ * A message passed on by the log queue.
+ */
+struct LogRecord_t {
+	int level;
+	unsigned long threadID;
+/**
+ * The system time at which the message was logged, as a FILETIME.
+ */
+	long long timestamp;
+	const wchar_t* message;
+};
+
+/**
+ * Passes on many messages at once, oldest first.
+ * Like logMessage, this is defined by each module that uses the log queue.
+ */
+void logMessages(const LogRecord_t* records, unsigned int count);
+
+void logQueue_enqueue(int level, const wchar_t* msg);
+
 int NVDALogCrtReportHook(int reportType, const wchar_t* msg, int* returnVal);
 
 #define LOGLEVEL_NONE 60
@@ -33,18 +55,76 @@ int NVDALogCrtReportHook(int reportType, const wchar_t* msg, int* returnVal);
 #define LOGLEVEL_DEBUGWARNING 15
 #define LOGLEVEL_DEBUG 10
 
+/**
+ * Categories of log messages, each with its own level that can be changed at runtime.
+ * A file chooses its category by defining LOG_CATEGORY before including any headers, otherwise its messages are in the general category.
+ */
+#define LOGCATEGORY_GENERAL 0
+#define LOGCATEGORY_STORAGE 1
+#define LOGCATEGORY_BACKEND 2
+#define LOGCATEGORY_GECKO 3
+#define LOGCATEGORY_MSHTML 4
+#define LOGCATEGORY_GDIHOOKS 5
+#define LOGCATEGORY_WINWORD 6
+#define LOGCATEGORY_IME 7
+#define LOGCATEGORY_COUNT 8
+
+#ifndef LOG_CATEGORY
+#define LOG_CATEGORY LOGCATEGORY_GENERAL
+#endif
+
+/**
+ * The level at which each category starts, matching what was logged before levels could be changed at runtime.
+ */
+#define LOGLEVEL_DEFAULT LOGLEVEL_DEBUGWARNING
+
+/**
+ * Fetches the current level of each category, indexed by category.
+ * Messages below their category's level are not logged.
+ * Each file fetches the levels once, so that deciding whether to log a message is a couple of loads and branches rather than a call.
+ */
+std::atomic<int>* logLevels_getCategoryLevels();
+
+/**
+ * Changes the level of a category.
+ * @param category one of the LOGCATEGORY_* constants.
+ * @param level the lowest level of message to log, one of the LOGLEVEL_* constants.
+ * @return false if the category is not known.
+ */
+bool logLevels_set(int category, int level);
+
+namespace {
+
+/**
+ * This module's copy of the pointer to the category levels.
+ * It is set by a dynamic initializer, so it is still NULL while static constructors that run before it log.
+ */
+std::atomic<int>* _logCategoryLevels=logLevels_getCategoryLevels();
+
+}
+
+/**
+ * @return the category levels, fetching them again if this module's copy of the pointer has not been set yet.
+ */
+inline std::atomic<int>* _logGetCategoryLevels() {
+	std::atomic<int>* levels=_logCategoryLevels;
+	return levels?levels:logLevels_getCategoryLevels();
+}
+
 #define __STR2WSTR(x) L##x
 #define _STR2WSTR(x) __STR2WSTR(x)
 
-static std::wostringstream _logStringStream;
-static LockableObject _logLock;
-
+/**
+ * Each message is formatted in its own stream, so threads logging at the same time do not wait for each other.
+ * This header is used in DLLs injected in to other processes, where thread_local can not be relied on, so there is no per-thread stream to reuse.
+ * The formatted message is queued and shipped by a background thread, see logQueue.h.
+ */
 #define _LOG_MSG_MACRO(level,message) {\
-	_logLock.acquire();\
-	_logStringStream.str(L"");\
-	_logStringStream<<L"Thread "<<GetCurrentThreadId()<<L", "<<_STR2WSTR(__FILE__)<<L", "<<_STR2WSTR(__FUNCTION__)<<L", "<<__LINE__<<L":"<<std::endl<<message<<std::endl;\
-	logMessage(level,_logStringStream.str().c_str());\
-	_logLock.release();\
+	if(level>=_logGetCategoryLevels()[LOG_CATEGORY].load(std::memory_order_relaxed)) {\
+		std::wostringstream _logStringStream;\
+		_logStringStream<<L"Thread "<<GetCurrentThreadId()<<L", "<<_STR2WSTR(__FILE__)<<L", "<<_STR2WSTR(__FUNCTION__)<<L", "<<__LINE__<<L":"<<std::endl<<message<<std::endl;\
+		logQueue_enqueue(level,_logStringStream.str().c_str());\
+	}\
 }
 
 #ifndef LOGLEVEL
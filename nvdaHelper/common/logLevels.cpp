@@ -0,0 +1,44 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2017 NV Access Limited
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+
+#include <atomic>
+#include "log.h"
+
+using namespace std;
+
+/**
+ * The level of each category, one entry per LOGCATEGORY_* constant.
+ * Initialized without running any code, so that messages logged while modules are still being initialized are filtered correctly.
+ */
+atomic<int> logLevels_categoryLevels[LOGCATEGORY_COUNT]={
+	{LOGLEVEL_DEFAULT}, // general
+	{LOGLEVEL_DEFAULT}, // storage
+	{LOGLEVEL_DEFAULT}, // backend
+	{LOGLEVEL_DEFAULT}, // gecko
+	{LOGLEVEL_DEFAULT}, // mshtml
+	{LOGLEVEL_DEFAULT}, // gdiHooks
+	{LOGLEVEL_DEFAULT}, // winword
+	{LOGLEVEL_DEFAULT}, // ime
+};
+
+atomic<int>* logLevels_getCategoryLevels() {
+	return logLevels_categoryLevels;
+}
+
+bool logLevels_set(int category, int level) {
+	if(category<0||category>=LOGCATEGORY_COUNT) return false;
+	logLevels_categoryLevels[category].store(level,memory_order_relaxed);
+	return true;
+}
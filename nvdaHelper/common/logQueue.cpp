@@ -0,0 +1,264 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2017 NV Access Limited
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <windows.h>
+#include "lock.h"
+#include "log.h"
+#include "logQueue.h"
+
+using namespace std;
+
+// Nothing in this file may use the LOG_* macros, as they would queue messages from within the queue.
+
+namespace {
+
+/**
+ * A slot in the ring.
+ * sequence equals the slot's position when it is free for that position to be written,
+ * and the position plus 1 once a message for that position has been written.
+ */
+struct LogQueueCell_t {
+	atomic<size_t> sequence;
+	int level;
+	DWORD threadID;
+	long long timestamp;
+	wstring message;
+};
+
+// Must be a power of 2.
+const size_t logQueue_capacity=4096;
+LogQueueCell_t logQueue_cells[logQueue_capacity];
+
+/**
+ * The most messages passed to a single call of logMessages.
+ */
+const size_t logQueue_maxBatchSize=256;
+
+/**
+ * The next position producers will claim. Producers claim positions with compare and swap,
+ * so messages are passed on in the order their positions were claimed, which preserves the order of each thread's messages.
+ */
+atomic<size_t> logQueue_enqueuePos(0);
+
+/**
+ * The next position the consumer will read. Only touched while holding logQueue_consumerLock.
+ */
+size_t logQueue_dequeuePos=0;
+
+/**
+ * Held while draining, so that the background thread and logQueue_flush never drain at the same time.
+ */
+LockableObject logQueue_consumerLock;
+
+/**
+ * Messages are moved out of the ring in to these before being passed on, so that slots are freed straight away and producers are not held up by a slow sink.
+ * Only touched while holding logQueue_consumerLock.
+ */
+wstring logQueue_batchMessages[logQueue_maxBatchSize+1];
+vector<LogRecord_t> logQueue_batchRecords;
+
+atomic<unsigned long long> logQueue_droppedCount(0);
+unsigned long long logQueue_reportedDroppedCount=0;
+
+atomic<bool> logQueue_running(false);
+
+/**
+ * The number of producers that may have seen logQueue_running as true and not yet finished publishing.
+ * logQueue_stop waits for this to reach 0 before its final drain, so that no message is published after it.
+ */
+atomic<long> logQueue_producerCount(0);
+
+atomic<bool> logQueue_stopRequested(false);
+
+/**
+ * true while the consumer is about to wait, or waiting, for the wake event.
+ */
+atomic<bool> logQueue_consumerWaiting(false);
+
+HANDLE logQueue_wakeEvent=NULL;
+HANDLE logQueue_thread=NULL;
+DWORD logQueue_threadID=0;
+
+struct LogQueueInitializer_t {
+	LogQueueInitializer_t() {
+		for(size_t i=0;i<logQueue_capacity;++i) {
+			logQueue_cells[i].sequence.store(i,memory_order_relaxed);
+		}
+	}
+} logQueue_initializer;
+
+bool logQueue_isEmpty() {
+	logQueue_consumerLock.acquire();
+	LogQueueCell_t& cell=logQueue_cells[logQueue_dequeuePos&(logQueue_capacity-1)];
+	bool empty=cell.sequence.load(memory_order_acquire)!=logQueue_dequeuePos+1;
+	logQueue_consumerLock.release();
+	return empty;
+}
+
+long long logQueue_getTimestamp() {
+	FILETIME fileTime;
+	GetSystemTimeAsFileTime(&fileTime);
+	return (static_cast<long long>(fileTime.dwHighDateTime)<<32)|fileTime.dwLowDateTime;
+}
+
+/**
+ * Passes on all messages queued so far, in batches of up to logQueue_maxBatchSize.
+ */
+void logQueue_drain() {
+	logQueue_consumerLock.acquire();
+	vector<LogRecord_t>& records=logQueue_batchRecords;
+	for(;;) {
+		records.clear();
+		while(records.size()<logQueue_maxBatchSize) {
+			LogQueueCell_t& cell=logQueue_cells[logQueue_dequeuePos&(logQueue_capacity-1)];
+			if(cell.sequence.load(memory_order_acquire)!=logQueue_dequeuePos+1) break;
+			wstring& message=logQueue_batchMessages[records.size()];
+			message.swap(cell.message);
+			cell.message.clear();
+			LogRecord_t record={cell.level,cell.threadID,cell.timestamp,NULL};
+			cell.sequence.store(logQueue_dequeuePos+logQueue_capacity,memory_order_release);
+			++logQueue_dequeuePos;
+			record.message=message.c_str();
+			records.push_back(record);
+		}
+		bool full=(records.size()==logQueue_maxBatchSize);
+		unsigned long long droppedCount=logQueue_droppedCount.load(memory_order_relaxed);
+		if(!full&&droppedCount!=logQueue_reportedDroppedCount) {
+			wostringstream s;
+			s<<L"Log queue full, dropped "<<(droppedCount-logQueue_reportedDroppedCount)<<L" messages"<<endl;
+			logQueue_reportedDroppedCount=droppedCount;
+			wstring& message=logQueue_batchMessages[records.size()];
+			message=s.str();
+			LogRecord_t record={LOGLEVEL_WARNING,GetCurrentThreadId(),logQueue_getTimestamp(),message.c_str()};
+			records.push_back(record);
+		}
+		if(!records.empty()) {
+			logMessages(&records[0],static_cast<unsigned int>(records.size()));
+		}
+		if(!full) break;
+	}
+	logQueue_consumerLock.release();
+}
+
+DWORD WINAPI logQueue_threadFunc(LPVOID data) {
+	for(;;) {
+		logQueue_drain();
+		if(logQueue_stopRequested.load()) break;
+		logQueue_consumerWaiting.store(true);
+		if(!logQueue_isEmpty()) {
+			logQueue_consumerWaiting.store(false);
+			continue;
+		}
+		// The timeout is only a safety net, producers set the event when they see the consumer waiting.
+		WaitForSingleObject(logQueue_wakeEvent,1000);
+		logQueue_consumerWaiting.store(false);
+	}
+	return 0;
+}
+
+/**
+ * Claims a slot and publishes a message in it, or counts the message as dropped if the ring is full.
+ */
+void logQueue_publish(int level, const wchar_t* msg) {
+	size_t pos=logQueue_enqueuePos.load(memory_order_relaxed);
+	LogQueueCell_t* cell=NULL;
+	for(;;) {
+		cell=&logQueue_cells[pos&(logQueue_capacity-1)];
+		size_t sequence=cell->sequence.load(memory_order_acquire);
+		ptrdiff_t diff=static_cast<ptrdiff_t>(sequence)-static_cast<ptrdiff_t>(pos);
+		if(diff==0) {
+			if(logQueue_enqueuePos.compare_exchange_weak(pos,pos+1,memory_order_relaxed)) break;
+		} else if(diff<0) {
+			// The consumer has not yet freed this slot from the previous time around, so the ring is full.
+			logQueue_droppedCount.fetch_add(1,memory_order_relaxed);
+			return;
+		} else {
+			pos=logQueue_enqueuePos.load(memory_order_relaxed);
+		}
+	}
+	cell->level=level;
+	cell->threadID=GetCurrentThreadId();
+	cell->timestamp=logQueue_getTimestamp();
+	cell->message.assign(msg);
+	cell->sequence.store(pos+1,memory_order_release);
+	// Order the publish above before checking whether the consumer is waiting, so a wake up can not be missed.
+	atomic_thread_fence(memory_order_seq_cst);
+	if(logQueue_consumerWaiting.load(memory_order_relaxed)&&logQueue_consumerWaiting.exchange(false)) {
+		SetEvent(logQueue_wakeEvent);
+	}
+}
+
+}
+
+void logQueue_enqueue(int level, const wchar_t* msg) {
+	// Announce this producer before checking whether the queue is running.
+	// Both this and logQueue_stop's clearing of logQueue_running are sequentially consistent,
+	// so either this producer sees the queue stopped, or logQueue_stop sees this producer and waits for it.
+	logQueue_producerCount.fetch_add(1);
+	if(logQueue_running.load()) {
+		logQueue_publish(level,msg);
+		logQueue_producerCount.fetch_sub(1,memory_order_release);
+		return;
+	}
+	logQueue_producerCount.fetch_sub(1,memory_order_relaxed);
+	logMessage(level,msg);
+}
+
+bool logQueue_start() {
+	if(logQueue_running.load()) return true;
+	logQueue_wakeEvent=CreateEvent(NULL,FALSE,FALSE,NULL);
+	if(!logQueue_wakeEvent) return false;
+	logQueue_stopRequested.store(false);
+	logQueue_thread=CreateThread(NULL,0,logQueue_threadFunc,NULL,0,&logQueue_threadID);
+	if(!logQueue_thread) {
+		CloseHandle(logQueue_wakeEvent);
+		logQueue_wakeEvent=NULL;
+		return false;
+	}
+	logQueue_running.store(true,memory_order_release);
+	return true;
+}
+
+void logQueue_stop() {
+	if(!logQueue_running.load()) return;
+	logQueue_running.store(false);
+	// Producers that saw the queue running may still be publishing, and may still set the wake event.
+	while(logQueue_producerCount.load()>0) {
+		Sleep(1);
+	}
+	logQueue_stopRequested.store(true);
+	SetEvent(logQueue_wakeEvent);
+	WaitForSingleObject(logQueue_thread,INFINITE);
+	CloseHandle(logQueue_thread);
+	logQueue_thread=NULL;
+	logQueue_threadID=0;
+	CloseHandle(logQueue_wakeEvent);
+	logQueue_wakeEvent=NULL;
+	// Pass on anything published by producers that saw the queue running just before it stopped.
+	logQueue_drain();
+}
+
+void logQueue_flush() {
+	// The background thread may be in the middle of draining, in which case it will finish by itself.
+	if(GetCurrentThreadId()==logQueue_threadID) return;
+	logQueue_drain();
+}
+
+unsigned long long logQueue_getDroppedCount() {
+	return logQueue_droppedCount.load(memory_order_relaxed);
+}
@@ -0,0 +1,61 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2017 NV Access Limited
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef NVDAHELPER_LOGQUEUE_H
+#define NVDAHELPER_LOGQUEUE_H
+
+/**
+ * Hands messages logged by any thread to a background thread, which passes them on in batches to logMessages.
+ * Each message keeps the id of the thread that logged it and the time it was logged.
+ * Logging threads only copy the message in to a bounded ring buffer, without taking a lock,
+ * so they are not held up by each other or by the cost of shipping messages to NVDA.
+ * Messages from a single thread are always passed on in the order they were logged.
+ * If the ring is full the message is dropped and counted, and the number dropped is logged once there is room.
+ * While the background thread is not running, messages are passed straight to logMessage on the logging thread.
+ */
+
+/**
+ * Queues a message to be passed on by the background thread.
+ * The message is copied, so it need not outlive the call.
+ * @param level the level of the message, one of the LOGLEVEL_* constants.
+ * @param msg the message.
+ */
+void logQueue_enqueue(int level, const wchar_t* msg);
+
+/**
+ * Starts the background thread, if not already started.
+ * Must not be called from DllMain.
+ * @return true if the thread is running.
+ */
+bool logQueue_start();
+
+/**
+ * Passes on all queued messages and stops the background thread.
+ * Must be called before the module containing the queue is unloaded, and not from DllMain.
+ */
+void logQueue_stop();
+
+/**
+ * Passes on all queued messages from the calling thread, without waiting for the background thread.
+ * Used when the process is about to die, such as from an unhandled exception filter.
+ * Does nothing if called by the background thread itself.
+ */
+void logQueue_flush();
+
+/**
+ * @return the number of messages dropped so far because the ring was full.
+ */
+unsigned long long logQueue_getDroppedCount();
+
+#endif
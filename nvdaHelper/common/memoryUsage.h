@@ -0,0 +1,83 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2017 NV Access Limited
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef NVDAHELPER_COMMON_MEMORYUSAGE_H
+#define NVDAHELPER_COMMON_MEMORYUSAGE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <deque>
+
+/*
+* Functions giving the bytes allocated on the heap by standard library containers, for reporting memory use.
+* They follow the layout of the Visual C++ standard library.
+* The heap's own overhead for each allocation is not included.
+* This file has no Windows dependencies.
+*/
+
+/*
+* @return the bytes allocated by a string for its characters, which is 0 for a string short enough to be held in the string object itself.
+*/
+template<typename T> inline size_t memoryUsage_string(const std::basic_string<T>& str) {
+	const size_t inlineCapacity=(16/sizeof(T))-1;
+	return (str.capacity()>inlineCapacity)?(str.capacity()+1)*sizeof(T):0;
+}
+
+/*
+* @return the bytes allocated for each entry of a std::map or std::set holding values of type T.
+* Each entry is a tree node with three links, two flags and the value, padded to the alignment of a pointer.
+*/
+template<typename T> inline size_t memoryUsage_treeEntry() {
+	const size_t size=3*sizeof(void*)+2+sizeof(T);
+	return ((size+sizeof(void*)-1)/sizeof(void*))*sizeof(void*);
+}
+
+/*
+* @return the bytes allocated by a std::map or std::set with the given number of entries holding values of type T, including its head node.
+*/
+template<typename T> inline size_t memoryUsage_tree(size_t entryCount) {
+	return (entryCount+1)*memoryUsage_treeEntry<T>();
+}
+
+/*
+* @return the bytes allocated by a std::vector for its elements, including any capacity not yet used.
+*/
+template<typename T> inline size_t memoryUsage_vector(const std::vector<T>& v) {
+	return v.capacity()*sizeof(T);
+}
+
+/*
+* @return the bytes allocated for each entry of a std::list holding values of type T.
+*/
+template<typename T> inline size_t memoryUsage_listEntry() {
+	const size_t size=2*sizeof(void*)+sizeof(T);
+	return ((size+sizeof(void*)-1)/sizeof(void*))*sizeof(void*);
+}
+
+/*
+* @return the bytes allocated by a std::deque for its elements and the map of its blocks.
+* Blocks hold 16 bytes of elements, or one element if it is larger.
+*/
+template<typename T> inline size_t memoryUsage_deque(const std::deque<T>& d) {
+	const size_t elementsPerBlock=(sizeof(T)<=16)?16/sizeof(T):1;
+	size_t blockCount=(d.size()+elementsPerBlock-1)/elementsPerBlock;
+	if(blockCount==0) return 0;
+	// The map of blocks starts with 8 entries and doubles as needed.
+	size_t mapSize=8;
+	while(mapSize<blockCount+1) mapSize*=2;
+	return blockCount*elementsPerBlock*sizeof(T)+mapSize*sizeof(void*);
+}
+
+#endif
@@ -35,6 +35,11 @@ error_status_t __stdcall nvdaControllerInternal_logMessage(const long level, con
 	return _nvdaControllerInternal_logMessage(level,processID,message);
 }
 
+error_status_t(__stdcall *_nvdaControllerInternal_logMessages)(const long, const long, const nvdaLogRecord_t*);
+error_status_t __stdcall nvdaControllerInternal_logMessages(const long processID, const long recordCount, const nvdaLogRecord_t* records) {
+	return _nvdaControllerInternal_logMessages(processID,recordCount,records);
+}
+
 error_status_t(__stdcall *_nvdaControllerInternal_displayModelTextChangeNotify)(const long, const long, const long, const long, const long);
 error_status_t __stdcall nvdaControllerInternal_displayModelTextChangeNotify(const long hwnd, const long left, const long top, const long right, const long bottom) { 
 	return _nvdaControllerInternal_displayModelTextChangeNotify(hwnd,left,top,right,bottom);
@@ -16,9 +16,11 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <sstream>
 #include <algorithm>
 #include <set>
+#include <vector>
 #include <rpc.h>
 #include <sddl.h>
 #include <common/log.h>
+#include <common/logQueue.h>
 #include "nvdaControllerInternal.h"
 #include "nvdaHelperLocal.h"
 #include "dllImportTableHooks.h"
@@ -233,6 +235,7 @@ LRESULT WINAPI fake_SendMessageTimeoutW(HWND hwnd, UINT Msg, WPARAM wParam, LPAR
 }
 
 void nvdaHelperLocal_initialize() {
+	logQueue_start();
 	startServer();
 	mainThreadId = GetCurrentThreadId();
 	cancelCallEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
@@ -275,12 +278,24 @@ void nvdaHelperLocal_terminate() {
 	SetEvent(bgSendMessageData.execEvent);
 	CloseHandle(cancelCallEvent);
 	stopServer();
+	logQueue_stop();
 }
 
 void logMessage(int level, const wchar_t* msg) {
 	nvdaControllerInternal_logMessage(level,0,msg);
 }
 
+void logMessages(const LogRecord_t* records, unsigned int count) {
+	std::vector<nvdaLogRecord_t> rpcRecords(count);
+	for(unsigned int i=0;i<count;++i) {
+		rpcRecords[i].level=records[i].level;
+		rpcRecords[i].threadID=records[i].threadID;
+		rpcRecords[i].timestamp=records[i].timestamp;
+		rpcRecords[i].message=const_cast<wchar_t*>(records[i].message);
+	}
+	if(count>0) nvdaControllerInternal_logMessages(0,count,&rpcRecords[0]);
+}
+
 typedef struct {
 	wchar_t wantedClass[256];
 	BOOL checkVisible;
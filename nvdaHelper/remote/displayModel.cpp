@@ -21,7 +21,9 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <common/xml.h>
 #include "nvdaControllerInternal.h"
 #include <common/log.h>
+#include <common/memoryUsage.h>
 #include "displayModel.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -84,6 +86,15 @@ size_t displayModel_t::getChunkCount() {
 	return chunksByYX.size();
 }
 
+size_t displayModel_t::getMemoryUsage() {
+	size_t usage=sizeof(displayModel_t)+memoryUsage_tree<displayModelChunksByPointMap_t::value_type>(chunksByYX.size());
+	if(focusRect) usage+=sizeof(RECT);
+	for(displayModelChunksByPointMap_t::const_iterator i=chunksByYX.begin();i!=chunksByYX.end();++i) {
+		usage+=sizeof(displayModelChunk_t)+memoryUsage_string(i->second->text)+memoryUsage_deque(i->second->characterXArray);
+	}
+	return usage;
+}
+
 void displayModel_t::insertChunk(const RECT& rect, int baseline, const wstring& text, POINT* characterExtents, const displayModelFormatInfo_t& formatInfo, int direction, const RECT* clippingRect) {
 	displayModelChunk_t* chunk=new displayModelChunk_t;
 	LOG_DEBUG(L"created new chunk at "<<chunk);
@@ -303,6 +314,7 @@ void displayModel_t::generateWhitespaceXML(HWND hwnd, long baseline, wstring& te
 }
 
 void displayModel_t::renderText(const RECT& rect, const int minHorizontalWhitespace, const int minVerticalWhitespace, const bool stripOuterWhitespace, wstring& text, deque<RECT>& characterLocations) {
+	TRACE_SCOPE("displayModel_t::renderText");
 	RECT tempCharLocation;
 	RECT tempRect;
 	wstring curLineText;
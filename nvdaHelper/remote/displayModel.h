@@ -88,6 +88,12 @@ class displayModel_t: public LockableAutoFreeObject  {
  */
 	size_t getChunkCount();
 
+/**
+ * Measures the memory used by this model, its chunks and their text, in bytes.
+ * The sizes of strings and containers are estimated from the layout of the Visual C++ standard library, see common/memoryUsage.h.
+ */
+	size_t getMemoryUsage();
+
 /**
  * Inserts a text chunk in to the model.
  * @param rect the rectangle bounding the text.
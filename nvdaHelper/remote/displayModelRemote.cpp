@@ -127,6 +127,11 @@ error_status_t displayModelRemote_getCaretRect(handle_t bindingHandle, const lon
 	return 0;
 }
 
+error_status_t displayModelRemote_getMemoryUsage(handle_t bindingHandle, unsigned hyper* displayChunkBytes, unsigned hyper* glyphTableBytes) {
+	gdiHooks_getMemoryUsage(displayChunkBytes,glyphTableBytes);
+	return 0;
+}
+
 error_status_t displayModelRemote_requestTextChangeNotificationsForWindow(handle_t bindingHandle, const unsigned long windowHandle, const BOOL enable) {
 	if(enable) windowsForTextChangeNotifications[(HWND)UlongToHandle(windowHandle)]+=1; else windowsForTextChangeNotifications[(HWND)UlongToHandle(windowHandle)]-=1;
 	return 0;
@@ -12,6 +12,8 @@ This license can be found at:
 http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
+#define LOG_CATEGORY LOGCATEGORY_GDIHOOKS
+
 #include <map>
 #include <set>
 #include <list>
@@ -22,9 +24,11 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include "apiHook.h"
 #include "displayModel.h"
 #include <common/log.h>
+#include <common/memoryUsage.h>
 #include "nvdaControllerInternal.h"
 #include <common/lock.h>
 #include "gdiHooks.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -287,6 +291,8 @@ class GlyphTranslator {
 
 	bool hasMapping() { return !_glyphs.empty(); }
 
+	size_t getMemoryUsage() { return sizeof(GlyphTranslator)+memoryUsage_tree<map<int,wchar_t>::value_type>(_glyphs.size()); }
+
 	bool translateGlyphs(const wchar_t* lpString, int cbCount, wstring& newString) {
 		if(!hasMapping()) return false;
 		wchar_t* newStr=(wchar_t*)calloc(cbCount,sizeof(wchar_t));
@@ -330,6 +336,16 @@ class GlyphTranslatorCache : protected LockableObject {
 		return gt;
 	}
 
+	size_t getMemoryUsage() {
+		acquire();
+		size_t usage=memoryUsage_tree<map<int,GlyphTranslator*>::value_type>(_glyphTranslatorsByFontChecksum.size());
+		for(map<int,GlyphTranslator*>::iterator i=_glyphTranslatorsByFontChecksum.begin();i!=_glyphTranslatorsByFontChecksum.end();++i) {
+			usage+=i->second->getMemoryUsage();
+		}
+		release();
+		return usage;
+	}
+
 	void cleanup() {
 		acquire();
 		map<int,GlyphTranslator*>::iterator i=_glyphTranslatorsByFontChecksum.begin();
@@ -538,6 +554,7 @@ template<typename charType> class hookClass_TextOut {
 template<typename charType> typename hookClass_TextOut<charType>::funcType hookClass_TextOut<charType>::realFunction=NULL;
 
 template<typename charType> int  WINAPI hookClass_TextOut<charType>::fakeFunction(HDC hdc, int x, int y, const charType* lpString, int cbCount) {
+	TRACE_SCOPE("hookClass_TextOut::fakeFunction");
 	UINT textAlign=GetTextAlign(hdc);
 	POINT pos={x,y};
 	if(textAlign&TA_UPDATECP) GetCurrentPositionEx(hdc,&pos);
@@ -571,6 +588,7 @@ template<typename WA_POLYTEXT> class hookClass_PolyTextOut {
 template<typename WA_POLYTEXT> typename hookClass_PolyTextOut<WA_POLYTEXT>::funcType hookClass_PolyTextOut<WA_POLYTEXT>::realFunction=NULL;
 
 template<typename WA_POLYTEXT> BOOL WINAPI hookClass_PolyTextOut<WA_POLYTEXT>::fakeFunction(HDC hdc,const WA_POLYTEXT* pptxt,int cStrings) {
+	TRACE_SCOPE("hookClass_PolyTextOut::fakeFunction");
 	//Collect text alignment and possibly current position
 	UINT textAlign=GetTextAlign(hdc);
 	POINT curPos;
@@ -616,6 +634,7 @@ template<typename WA_POLYTEXT> BOOL WINAPI hookClass_PolyTextOut<WA_POLYTEXT>::f
 typedef int(WINAPI *FillRect_funcType)(HDC,const RECT*,HBRUSH);
 FillRect_funcType real_FillRect=NULL;
 int WINAPI fake_FillRect(HDC hdc, const RECT* lprc, HBRUSH hBrush) {
+	TRACE_SCOPE("fake_FillRect");
 	//Call the real FillRectangle
 	int res=real_FillRect(hdc,lprc,hBrush);
 	//IfThe fill was successull we can go on.
@@ -634,6 +653,7 @@ int WINAPI fake_FillRect(HDC hdc, const RECT* lprc, HBRUSH hBrush) {
 typedef BOOL(WINAPI *DrawFocusRect_funcType)(HDC,const RECT*);
 DrawFocusRect_funcType real_DrawFocusRect=NULL;
 BOOL WINAPI fake_DrawFocusRect(HDC hdc, const RECT* lprc) {
+	TRACE_SCOPE("fake_DrawFocusRect");
 	//Call the real DrawFocusRect
 	BOOL res=real_DrawFocusRect(hdc,lprc);
 	//If the draw was successfull we can go on.
@@ -676,6 +696,7 @@ BOOL WINAPI fake_DrawFocusRect(HDC hdc, const RECT* lprc) {
 typedef BOOL(WINAPI *PatBlt_funcType)(HDC,int,int,int,int,DWORD);
 PatBlt_funcType real_PatBlt=NULL;
 BOOL WINAPI fake_PatBlt(HDC hdc, int nxLeft, int nxTop, int nWidth, int nHeight, DWORD dwRop) {
+	TRACE_SCOPE("fake_PatBlt");
 	//Call the real PatBlt
 	BOOL res=real_PatBlt(hdc,nxLeft,nxTop,nWidth,nHeight,dwRop);
 	//IfPatBlt was successfull we can go on
@@ -694,6 +715,7 @@ BOOL WINAPI fake_PatBlt(HDC hdc, int nxLeft, int nxTop, int nWidth, int nHeight,
 typedef HDC(WINAPI *BeginPaint_funcType)(HWND,LPPAINTSTRUCT);
 BeginPaint_funcType real_BeginPaint=NULL;
 HDC WINAPI fake_BeginPaint(HWND hwnd, LPPAINTSTRUCT lpPaint) {
+	TRACE_SCOPE("fake_BeginPaint");
 	//Call the real BeginPaint
 	HDC res=real_BeginPaint(hwnd,lpPaint);
 	//If beginPaint was successfull we can go on
@@ -721,6 +743,7 @@ template<typename charType> class hookClass_ExtTextOut {
 template<typename charType> typename hookClass_ExtTextOut<charType>::funcType hookClass_ExtTextOut<charType>::realFunction=NULL;
 
 template<typename charType> BOOL __stdcall hookClass_ExtTextOut<charType>::fakeFunction(HDC hdc, int x, int y, UINT fuOptions, const RECT* lprc, const charType* lpString, UINT cbCount, const INT* lpDx) {
+	TRACE_SCOPE("hookClass_ExtTextOut::fakeFunction");
 	UINT textAlign=GetTextAlign(hdc);
 	POINT pos={x,y};
 	if(textAlign&TA_UPDATECP) GetCurrentPositionEx(hdc,&pos);
@@ -755,6 +778,7 @@ template<typename charType> BOOL __stdcall hookClass_ExtTextOut<charType>::fakeF
 typedef HDC(WINAPI *CreateCompatibleDC_funcType)(HDC);
 CreateCompatibleDC_funcType real_CreateCompatibleDC=NULL;
 HDC WINAPI fake_CreateCompatibleDC(HDC hdc) {
+	TRACE_SCOPE("fake_CreateCompatibleDC");
 	//Call the real CreateCompatibleDC
 	HDC newHdc=real_CreateCompatibleDC(hdc);
 	//If the creation was successful, and the DC that was used in the creation process is a window DC, 
@@ -773,6 +797,7 @@ HDC WINAPI fake_CreateCompatibleDC(HDC hdc) {
 typedef HGDIOBJ(WINAPI *SelectObject_funcType)(HDC,HGDIOBJ);
 SelectObject_funcType real_SelectObject=NULL;
 HGDIOBJ WINAPI fake_SelectObject(HDC hdc, HGDIOBJ hGdiObj) {
+	TRACE_SCOPE("fake_SelectObject");
 	//Call the real SelectObject
 	HGDIOBJ res=real_SelectObject(hdc,hGdiObj);
 	//If The select was successfull, and the object is a bitmap,  we can go on.
@@ -790,6 +815,7 @@ HGDIOBJ WINAPI fake_SelectObject(HDC hdc, HGDIOBJ hGdiObj) {
 typedef BOOL(WINAPI *DeleteDC_funcType)(HDC);
 DeleteDC_funcType real_DeleteDC=NULL;
 BOOL WINAPI fake_DeleteDC(HDC hdc) {
+	TRACE_SCOPE("fake_DeleteDC");
 	//Call the real DeleteDC
 	BOOL res=real_DeleteDC(hdc);
 	if(res==0) return res;
@@ -858,6 +884,7 @@ void StretchBlt_helper(HDC hdcDest, int nXDest, int nYDest, int nWidthDest, int
 typedef BOOL(WINAPI *BitBlt_funcType)(HDC,int,int,int,int,HDC,int,int,DWORD);
 BitBlt_funcType real_BitBlt=NULL;
 BOOL WINAPI fake_BitBlt(HDC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HDC hdcSrc, int nXSrc, int nYSrc, DWORD dwRop) {
+	TRACE_SCOPE("fake_BitBlt");
 	//Call the real BitBlt
 	BOOL res=real_BitBlt(hdcDest,nXDest,nYDest,nWidth,nHeight,hdcSrc,nXSrc,nYSrc,dwRop);
 	//If bit blit didn't work, or its not a simple copy, we don't want to know about it
@@ -870,6 +897,7 @@ BOOL WINAPI fake_BitBlt(HDC hdcDest, int nXDest, int nYDest, int nWidth, int nHe
 typedef BOOL(WINAPI *StretchBlt_funcType)(HDC,int,int,int,int,HDC,int,int,int,int,DWORD);
 StretchBlt_funcType real_StretchBlt=NULL;
 BOOL WINAPI fake_StretchBlt(HDC hdcDest, int nXDest, int nYDest, int nWidthDest, int nHeightDest, HDC hdcSrc, int nXSrc, int nYSrc, int nWidthSrc, int nHeightSrc, DWORD dwRop) {
+	TRACE_SCOPE("fake_StretchBlt");
 	//Call the real StretchBlt
 	BOOL res=real_StretchBlt(hdcDest,nXDest,nYDest,nWidthDest,nHeightDest,hdcSrc,nXSrc,nYSrc,nWidthSrc,nHeightSrc,dwRop);
 	if(!res) return res;
@@ -888,6 +916,7 @@ BOOL WINAPI fake_StretchBlt(HDC hdcDest, int nXDest, int nYDest, int nWidthDest,
 typedef BOOL(WINAPI *GdiTransparentBlt_funcType)(HDC,int,int,int,int,HDC,int,int,int,int,UINT);
 GdiTransparentBlt_funcType real_GdiTransparentBlt=NULL;
 BOOL WINAPI fake_GdiTransparentBlt(HDC hdcDest, int nXDest, int nYDest, int nWidthDest, int nHeightDest, HDC hdcSrc, int nXSrc, int nYSrc, int nWidthSrc, int nHeightSrc, UINT crTransparent) {
+	TRACE_SCOPE("fake_GdiTransparentBlt");
 	//Call the real StretchBlt
 	BOOL res=real_GdiTransparentBlt(hdcDest,nXDest,nYDest,nWidthDest,nHeightDest,hdcSrc,nXSrc,nYSrc,nWidthSrc,nHeightSrc,crTransparent);
 	if(!res) return res;
@@ -954,6 +983,7 @@ BOOL allow_ScriptStringAnalyseArgsByAnalysis=FALSE;
 typedef HRESULT(WINAPI *ScriptStringAnalyse_funcType)(HDC,const void*,int,int,int,DWORD,int,SCRIPT_CONTROL*,SCRIPT_STATE*,const int*,SCRIPT_TABDEF*,const BYTE*,SCRIPT_STRING_ANALYSIS*);
 ScriptStringAnalyse_funcType real_ScriptStringAnalyse=NULL;
 HRESULT WINAPI fake_ScriptStringAnalyse(HDC hdc,const void* pString, int cString, int cGlyphs, int iCharset, DWORD dwFlags, int iRectWidth, SCRIPT_CONTROL* psControl, SCRIPT_STATE* psState, const int* piDx, SCRIPT_TABDEF* pTabdef, const BYTE* pbInClass, SCRIPT_STRING_ANALYSIS* pssa) {
+	TRACE_SCOPE("fake_ScriptStringAnalyse");
 	//Call the real ScriptStringAnalyse
 	HRESULT res=real_ScriptStringAnalyse(hdc,pString,cString,cGlyphs,iCharset,dwFlags,iRectWidth,psControl,psState,piDx,pTabdef,pbInClass,pssa);
 	//We only want to go on if  there's safe arguments
@@ -976,6 +1006,7 @@ HRESULT WINAPI fake_ScriptStringAnalyse(HDC hdc,const void* pString, int cString
 typedef HRESULT(WINAPI *ScriptStringFree_funcType)(SCRIPT_STRING_ANALYSIS*);
 ScriptStringFree_funcType real_ScriptStringFree=NULL;
 HRESULT WINAPI fake_ScriptStringFree(SCRIPT_STRING_ANALYSIS* pssa) {
+	TRACE_SCOPE("fake_ScriptStringFree");
 	//Call the real ScriptStringFree
 	HRESULT res=real_ScriptStringFree(pssa);
 	//If it worked, and arguments seem sane, we go on.
@@ -997,6 +1028,7 @@ HRESULT WINAPI fake_ScriptStringFree(SCRIPT_STRING_ANALYSIS* pssa) {
 typedef HRESULT(WINAPI *ScriptStringOut_funcType)(SCRIPT_STRING_ANALYSIS,int,int,UINT,const RECT*,int,int,BOOL);
 ScriptStringOut_funcType real_ScriptStringOut=NULL;
 HRESULT WINAPI fake_ScriptStringOut(SCRIPT_STRING_ANALYSIS ssa,int iX,int iY,UINT uOptions,const RECT *prc,int iMinSel,int iMaxSel,BOOL fDisabled) {
+	TRACE_SCOPE("fake_ScriptStringOut");
 	//Call the real ScriptStringOut
 	HRESULT res;
 	{
@@ -1043,6 +1075,7 @@ HRESULT WINAPI fake_ScriptStringOut(SCRIPT_STRING_ANALYSIS ssa,int iX,int iY,UIN
 typedef HRESULT(WINAPI *ScriptTextOut_funcType)(const HDC,SCRIPT_CACHE*,int,int,UINT,const RECT*,const SCRIPT_ANALYSIS*,const WCHAR*,int,const WORD*,int,const int*,const int*,const GOFFSET*);
 ScriptTextOut_funcType real_ScriptTextOut=NULL;
 HRESULT WINAPI fake_ScriptTextOut(const HDC hdc, SCRIPT_CACHE* psc, int x, int y, UINT fuOptions, const RECT* lprc, const SCRIPT_ANALYSIS* psa, const WCHAR* pwcReserved, int iReserved, const WORD* pwGlyphs, int cGlyphs, const int* piAdvanced, const int* piJustify, const GOFFSET* pGoffset) {
+	TRACE_SCOPE("fake_ScriptTextOut");
 	TlsSetValue(tls_index_curScriptTextOutScriptAnalysis,(LPVOID)psa);
 	HRESULT res=real_ScriptTextOut(hdc, psc, x, y, fuOptions, lprc, psa, pwcReserved, iReserved, pwGlyphs, cGlyphs, piAdvanced, piJustify, pGoffset);
 	TlsSetValue(tls_index_curScriptTextOutScriptAnalysis,NULL);
@@ -1053,6 +1086,7 @@ HRESULT WINAPI fake_ScriptTextOut(const HDC hdc, SCRIPT_CACHE* psc, int x, int y
 typedef BOOL(WINAPI *ScrollWindow_funcType)(HWND,int,int,const RECT*, const RECT*);
 ScrollWindow_funcType real_ScrollWindow=NULL;
 BOOL WINAPI fake_ScrollWindow(HWND hwnd, int XAmount, int YAmount, const RECT* lpRect, const RECT* lpClipRect) {
+	TRACE_SCOPE("fake_ScrollWindow");
 	BOOL res=real_ScrollWindow(hwnd,XAmount,YAmount,lpRect,lpClipRect);
 	if(!res) return res;
 	displayModel_t* model=NULL;
@@ -1082,6 +1116,7 @@ BOOL WINAPI fake_ScrollWindow(HWND hwnd, int XAmount, int YAmount, const RECT* l
 typedef BOOL(WINAPI *ScrollWindowEx_funcType)(HWND,int,int,const RECT*, const RECT*, HRGN, LPRECT,UINT);
 ScrollWindowEx_funcType real_ScrollWindowEx=NULL;
 BOOL WINAPI fake_ScrollWindowEx(HWND hwnd, int dx, int dy, const RECT* prcScroll, const RECT* prcClip, HRGN hrgnUpdate, LPRECT prcUpdate, UINT flags) {
+	TRACE_SCOPE("fake_ScrollWindowEx");
 	BOOL res=real_ScrollWindowEx(hwnd,dx,dy,prcScroll,prcClip,hrgnUpdate,prcUpdate,flags);
 	if(!res) return res;
 	displayModel_t* model=NULL;
@@ -1112,6 +1147,7 @@ BOOL WINAPI fake_ScrollWindowEx(HWND hwnd, int dx, int dy, const RECT* prcScroll
 typedef BOOL(WINAPI *DestroyWindow_funcType)(HWND);
 DestroyWindow_funcType real_DestroyWindow=NULL;
 BOOL WINAPI fake_DestroyWindow(HWND hwnd) {
+	TRACE_SCOPE("fake_DestroyWindow");
 	//Call the real DestroyWindow
 	BOOL res=real_DestroyWindow(hwnd);
 	if(res==0) return res;
@@ -1161,6 +1197,27 @@ void gdiHooks_inProcess_initialize() {
 	real_ScriptTextOut=apiHook_hookFunction_safe("USP10.dll",ScriptTextOut,fake_ScriptTextOut);
 }
 
+/**
+ * Adds up the memory used by the display models in the given map.
+ */
+template<typename t> unsigned __int64 getDisplayModelsMemoryUsage(displayModelsMap_t<t>& displayModels) {
+	unsigned __int64 usage=0;
+	displayModels.acquire();
+	usage+=memoryUsage_tree<typename displayModelsMap_t<t>::value_type>(displayModels.size());
+	for(typename displayModelsMap_t<t>::iterator i=displayModels.begin();i!=displayModels.end();++i) {
+		i->second->acquire();
+		usage+=i->second->getMemoryUsage();
+		i->second->release();
+	}
+	displayModels.release();
+	return usage;
+}
+
+void gdiHooks_getMemoryUsage(unsigned __int64* displayChunkBytes, unsigned __int64* glyphTableBytes) {
+	*displayChunkBytes=getDisplayModelsMemoryUsage(displayModelsByWindow)+getDisplayModelsMemoryUsage(displayModelsByMemoryDC);
+	*glyphTableBytes=glyphTranslatorCache.getMemoryUsage();
+}
+
 void gdiHooks_inProcess_terminate() {
 	//Kill the text change notification timer
 	KillTimer(0,textChangeNotifyTimerID);
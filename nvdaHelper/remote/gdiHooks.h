@@ -32,6 +32,13 @@ extern displayModelsMap_t<HWND> displayModelsByWindow;
 void gdiHooks_inProcess_initialize();
 void gdiHooks_inProcess_terminate();
 
+/**
+ * Measures the memory used by the display models of all windows and memory device contexts, and by the cached glyph tables used to translate glyph indexes to characters.
+ * @param displayChunkBytes memory where the bytes used by the display models will be placed.
+ * @param glyphTableBytes memory where the bytes used by the glyph tables will be placed.
+ */
+void gdiHooks_getMemoryUsage(unsigned __int64* displayChunkBytes, unsigned __int64* glyphTableBytes);
+
 //These structures were taken from http://www.microsoft.com/typography/OTSPEC/cmap.htm
 //All TTF structures must be byte-aligned.
 #pragma pack(push,1)
@@ -29,6 +29,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include "gdiHooks.h"
 #include "nvdaHelperRemote.h"
 #include "inProcess.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -158,6 +159,7 @@ void CALLBACK inProcess_winEventCallback(HWINEVENTHOOK hookID, DWORD eventID, HW
 }
 
 bool execInThread(long threadID, execInThread_funcType func) {
+	TRACE_SCOPE("execInThread");
 	// If we were to Use SendMessage to execute code in the UI thread,  this would cause outgoing cross-process COM calls to fail with RPC_E_CANTCALLOUT_ININPUTSYNCCALL,
 	// which breaks us for Firefox multi-process. See Mozilla bug 1297549 comments 14 and 18.
 	// Using SendMessageCallback could get around this problem, but:
@@ -27,10 +27,12 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include "nvdaControllerInternal.h"
 #include <common/lock.h>
 #include <common/winIPCUtils.h>
+#include <common/logQueue.h>
 #include "dllmain.h"
 #include "nvdaHelperRemote.h"
 #include "inProcess.h"
 #include "rpcSrv.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -163,6 +165,8 @@ DWORD WINAPI inprocMgrThreadFunc(LPVOID data) {
 		return 0;
 	}
 	nhAssert(dllHandle==tempHandle);
+	//Ship log messages from a background thread while injected
+	logQueue_start();
 	//Register for all winEvents in this process.
 	inprocWinEventHookID=SetWinEventHook(EVENT_MIN,EVENT_MAX,dllHandle,inproc_winEventCallback,GetCurrentProcessId(),0,WINEVENT_INCONTEXT);
 	if(inprocWinEventHookID==0) {
@@ -214,6 +218,8 @@ if(isSecureModeNVDAProcess) real_OpenClipboard=apiHook_hookFunction_safe("USER32
 	inProcess_terminate();
 	//Unregister any windows hooks registered so far
 	killRunningWindowsHooks();
+	//Ship any remaining log messages and stop the log thread, as it can not outlive this dll
+	logQueue_stop();
 	//Release and close the thread mutex
 	ReleaseMutex(threadMutex);
 	CloseHandle(threadMutex);
@@ -354,6 +360,7 @@ BOOL WINAPI DllMain(HINSTANCE hModule,DWORD reason,LPVOID lpReserved) {
 		Beep(220,75);
 		#endif
 		tlsIndex_inThreadInjectionID=TlsAlloc();
+		trace_initialize();
 		dllHandle=hModule;
 		GetModuleFileName(dllHandle,dllDirectory,MAX_PATH);
 		PathRemoveFileSpec(dllDirectory);
@@ -389,6 +396,7 @@ BOOL WINAPI DllMain(HINSTANCE hModule,DWORD reason,LPVOID lpReserved) {
 			}
 		} else { //The dll is being unloaded from this process
 			TlsFree(tlsIndex_inThreadInjectionID);
+			trace_terminate();
 			//cleanup some RPC binding handles
 			RpcBindingFree(&nvdaControllerBindingHandle);
 			RpcBindingFree(&nvdaControllerInternalBindingHandle);
@@ -397,6 +405,7 @@ BOOL WINAPI DllMain(HINSTANCE hModule,DWORD reason,LPVOID lpReserved) {
 		long threadID=GetCurrentThreadId();
 		getMessageHooksByThread.erase(threadID);
 		callWndProcHooksByThread.erase(threadID);
+		trace_threadExit();
 	}
 	return TRUE;
 }
@@ -12,15 +12,36 @@ This license can be found at:
 http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
+#include <vector>
 #include <crtdbg.h>
 #include "nvdaControllerInternal.h"
+#include "nvdaInProcUtils.h"
 #include <common/log.h>
 
+using namespace std;
+
 void logMessage(int level, const wchar_t* msg) {
-	if(level>LOGLEVEL_DEBUG) nvdaControllerInternal_logMessage(level,GetCurrentProcessId(),msg);
+	nvdaControllerInternal_logMessage(level,GetCurrentProcessId(),msg);
 	OutputDebugString(msg);
 }
 
+void logMessages(const LogRecord_t* records, unsigned int count) {
+	vector<nvdaLogRecord_t> rpcRecords(count);
+	for(unsigned int i=0;i<count;++i) {
+		OutputDebugString(records[i].message);
+		rpcRecords[i].level=records[i].level;
+		rpcRecords[i].threadID=records[i].threadID;
+		rpcRecords[i].timestamp=records[i].timestamp;
+		rpcRecords[i].message=const_cast<wchar_t*>(records[i].message);
+	}
+	if(count>0) nvdaControllerInternal_logMessages(GetCurrentProcessId(),count,&rpcRecords[0]);
+}
+
+error_status_t nvdaInProcUtils_setLogLevel(handle_t bindingHandle, const long category, const long level) {
+	if(!logLevels_set(category,level)) return E_INVALIDARG;
+	return S_OK;
+}
+
 int NVDALogCrtReportHook(int reportType,const wchar_t *message,int *returnValue) {
 	bool doDebugBreak=false;
 	int level=LOGLEVEL_WARNING;
@@ -19,6 +19,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <DbgHelp.h>
 #include "nvdaControllerInternal.h"
 #include <common/log.h>
+#include <common/logQueue.h>
 #include "vbufRemote.h"
 #include "displayModelRemote.h"
 #include "NvdaInProcUtils.h"
@@ -133,6 +134,8 @@ error_status_t nvdaInProcUtils_getActiveObject(handle_t bindingHandle, const wch
 std::wstring minidumpPath;
 
 LONG WINAPI crashHandler(LPEXCEPTION_POINTERS exceptionInfo) {
+	// Ship any queued log messages, as they may explain the crash and would otherwise be lost with the process.
+	logQueue_flush();
 	HANDLE mdf = CreateFile(minidumpPath.c_str(), GENERIC_WRITE, 0, NULL,
 		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
 	if (mdf == INVALID_HANDLE_VALUE)
@@ -0,0 +1,259 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2017 NV Access Limited
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <atomic>
+#include <cstdio>
+#include <list>
+#include <string>
+#include <vector>
+#include <windows.h>
+#include "nvdaInProcUtils.h"
+#include <common/log.h>
+#include <common/lock.h>
+#include "trace.h"
+
+using namespace std;
+
+volatile long trace_enabled=0;
+
+/**
+ * An event recorded by a thread.
+ */
+struct TraceEvent_t {
+	long long timestamp;
+	char phase;
+	char name[47];
+};
+
+/**
+ * The most recent events recorded by a single thread.
+ * Only the owning thread writes events. Other threads read them, discarding any that may have been overwritten while reading.
+ */
+class TraceRing_t {
+	public:
+	static const unsigned int capacity=4096;
+	const DWORD threadID;
+
+/**
+ * The number of events ever written to the ring.
+ */
+	atomic<unsigned long long> writeIndex;
+
+/**
+ * The writeIndex when recording was last started, events before this are not written out.
+ */
+	atomic<unsigned long long> startIndex;
+
+/**
+ * true once the owning thread has exited.
+ */
+	atomic<bool> retired;
+
+	TraceEvent_t events[capacity];
+
+	TraceRing_t(): threadID(GetCurrentThreadId()) {
+		writeIndex.store(0);
+		startIndex.store(0);
+		retired.store(false);
+	}
+
+	void record(char phase, const char* name) {
+		unsigned long long index=writeIndex.load(memory_order_relaxed);
+		TraceEvent_t& event=events[index%capacity];
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		event.timestamp=counter.QuadPart;
+		event.phase=phase;
+		strncpy_s(event.name,name,_TRUNCATE);
+		writeIndex.store(index+1,memory_order_release);
+	}
+
+/**
+ * Copies the events recorded since recording started, oldest first.
+ */
+	void copyEvents(vector<TraceEvent_t>& copiedEvents) {
+		unsigned long long end=writeIndex.load(memory_order_acquire);
+		unsigned long long start=max(startIndex.load(memory_order_relaxed),(end>capacity)?end-capacity:0);
+		vector<TraceEvent_t> tempEvents;
+		for(unsigned long long i=start;i<end;++i) {
+			tempEvents.push_back(events[i%capacity]);
+		}
+		// The owning thread may have overwritten the oldest events while they were being copied.
+		unsigned long long newEnd=writeIndex.load(memory_order_acquire);
+		unsigned long long firstIntact=(newEnd>capacity)?newEnd-capacity:0;
+		for(unsigned long long i=start;i<end;++i) {
+			if(i>=firstIntact) copiedEvents.push_back(tempEvents[static_cast<size_t>(i-start)]);
+		}
+	}
+
+};
+
+/**
+ * The rings of all threads that have recorded events.
+ * The list and its lock are never destroyed, as threads may still be exiting while the module is unloaded.
+ */
+LockableObject& trace_ringsLock=*(new LockableObject());
+list<TraceRing_t*>& trace_rings=*(new list<TraceRing_t*>());
+
+/**
+ * The thread local storage slot holding each thread's ring.
+ * Explicit thread local storage is used as implicit (__declspec(thread)) storage is not set up for DLLs loaded in to a process with LoadLibrary on Windows XP.
+ */
+DWORD trace_tlsIndex=TLS_OUT_OF_INDEXES;
+
+/**
+ * Fetches the calling thread's ring, creating it on the thread's first event.
+ * Threads that never record an event never get a ring.
+ * @return the ring, or NULL if there is no thread local storage slot to keep it in.
+ */
+TraceRing_t* trace_getRing() {
+	if(trace_tlsIndex==TLS_OUT_OF_INDEXES) return NULL;
+	TraceRing_t* ring=static_cast<TraceRing_t*>(TlsGetValue(trace_tlsIndex));
+	if(!ring) {
+		ring=new TraceRing_t();
+		TlsSetValue(trace_tlsIndex,ring);
+		trace_ringsLock.acquire();
+		trace_rings.push_back(ring);
+		trace_ringsLock.release();
+	}
+	return ring;
+}
+
+void trace_initialize() {
+	trace_tlsIndex=TlsAlloc();
+	if(trace_tlsIndex==TLS_OUT_OF_INDEXES) {
+		LOG_ERROR(L"Could not allocate thread local storage for trace events");
+	}
+}
+
+void trace_terminate() {
+	TlsFree(trace_tlsIndex);
+	trace_tlsIndex=TLS_OUT_OF_INDEXES;
+}
+
+void trace_threadExit() {
+	if(trace_tlsIndex==TLS_OUT_OF_INDEXES) return;
+	TraceRing_t* ring=static_cast<TraceRing_t*>(TlsGetValue(trace_tlsIndex));
+	if(ring) ring->retired.store(true);
+}
+
+const volatile long* trace_getEnabledFlag() {
+	return &trace_enabled;
+}
+
+void trace_begin(const char* name) {
+	TraceRing_t* ring=trace_getRing();
+	if(ring) ring->record('B',name);
+}
+
+void trace_end(const char* name) {
+	TraceRing_t* ring=trace_getRing();
+	if(ring) ring->record('E',name);
+}
+
+void trace_instant(const char* name) {
+	TraceRing_t* ring=trace_getRing();
+	if(ring) ring->record('i',name);
+}
+
+void trace_setEnabled(bool enable) {
+	trace_ringsLock.acquire();
+	if(enable&&!trace_enabled) {
+		// Discard everything recorded so far.
+		for(list<TraceRing_t*>::iterator i=trace_rings.begin();i!=trace_rings.end();) {
+			TraceRing_t* ring=*i;
+			if(ring->retired.load()) {
+				delete ring;
+				i=trace_rings.erase(i);
+			} else {
+				ring->startIndex.store(ring->writeIndex.load());
+				++i;
+			}
+		}
+	}
+	InterlockedExchange(&trace_enabled,enable?1:0);
+	trace_ringsLock.release();
+	LOG_INFO(L"Trace recording "<<(enable?L"started":L"stopped"));
+}
+
+/**
+ * Appends a string to JSON output, escaping characters as needed.
+ */
+void trace_appendJSONString(string& output, const char* text) {
+	output+='"';
+	for(const char* c=text;*c;++c) {
+		if(*c=='"'||*c=='\\') {
+			output+='\\';
+			output+=*c;
+		} else if(static_cast<unsigned char>(*c)<0x20) {
+			char escaped[8];
+			sprintf_s(escaped,"\\u%04x",static_cast<unsigned char>(*c));
+			output+=escaped;
+		} else {
+			output+=*c;
+		}
+	}
+	output+='"';
+}
+
+bool trace_writeFile(const wchar_t* path) {
+	LARGE_INTEGER frequency;
+	if(!QueryPerformanceFrequency(&frequency)||frequency.QuadPart==0) {
+		LOG_ERROR(L"Could not get performance counter frequency");
+		return false;
+	}
+	DWORD processID=GetCurrentProcessId();
+	string output="{\"traceEvents\":[\n";
+	bool first=true;
+	vector<TraceEvent_t> events;
+	trace_ringsLock.acquire();
+	for(list<TraceRing_t*>::iterator i=trace_rings.begin();i!=trace_rings.end();++i) {
+		events.clear();
+		(*i)->copyEvents(events);
+		for(vector<TraceEvent_t>::iterator j=events.begin();j!=events.end();++j) {
+			char fields[128];
+			// Chrome expects timestamps in microseconds.
+			long long timestamp=(j->timestamp/frequency.QuadPart)*1000000+((j->timestamp%frequency.QuadPart)*1000000)/frequency.QuadPart;
+			sprintf_s(fields,",\"ph\":\"%c\",\"ts\":%lld,\"pid\":%lu,\"tid\":%lu%s}",j->phase,timestamp,processID,(*i)->threadID,(j->phase=='i')?",\"s\":\"t\"":"");
+			if(!first) output+=",\n";
+			first=false;
+			output+="{\"name\":";
+			trace_appendJSONString(output,j->name);
+			output+=fields;
+		}
+	}
+	trace_ringsLock.release();
+	output+="\n]}\n";
+	FILE* file=NULL;
+	if(_wfopen_s(&file,path,L"wb")!=0||!file) {
+		LOG_ERROR(L"Could not open trace file "<<path);
+		return false;
+	}
+	bool res=fwrite(output.c_str(),1,output.size(),file)==output.size();
+	fclose(file);
+	if(!res) {
+		LOG_ERROR(L"Could not write trace file "<<path);
+	}
+	return res;
+}
+
+error_status_t nvdaInProcUtils_trace_setEnabled(handle_t bindingHandle, const boolean enable) {
+	trace_setEnabled(enable!=false);
+	return S_OK;
+}
+
+error_status_t nvdaInProcUtils_trace_writeFile(handle_t bindingHandle, const wchar_t* path) {
+	if(!path) return E_FAIL;
+	return trace_writeFile(path)?S_OK:E_FAIL;
+}
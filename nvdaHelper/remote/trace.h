@@ -0,0 +1,132 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2017 NV Access Limited
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef NVDAHELPER_REMOTE_TRACE_H
+#define NVDAHELPER_REMOTE_TRACE_H
+
+/**
+ * An opt-in recorder of begin, end and instant events, for diagnosing stalls in nvdaHelperRemote and the virtual buffer backends.
+ * Each thread records in to its own ring buffer, so only the most recent events of each thread are kept.
+ * The recorded events can be written out in Chrome's trace event format, which can be loaded in chrome://tracing.
+ * Event names are copied when recorded, so names from modules that are later unloaded are safe to use, but long names are truncated.
+ */
+
+extern "C" {
+
+/**
+ * Fetches the flag that is non-zero while events are being recorded.
+ * Each file fetches it once, so that deciding whether to record an event is a couple of loads and branches rather than a call.
+ */
+const volatile long* trace_getEnabledFlag();
+
+/**
+ * Records the start of a section of code on the calling thread.
+ * Only call while recording is enabled, or use TRACE_SCOPE.
+ */
+void trace_begin(const char* name);
+
+/**
+ * Records the end of a section of code on the calling thread.
+ */
+void trace_end(const char* name);
+
+/**
+ * Records that something happened at this moment on the calling thread.
+ */
+void trace_instant(const char* name);
+
+/**
+ * Allocates the thread local storage slot for each thread's events.
+ * Called when nvdaHelperRemote is loaded, before any events are recorded.
+ */
+void trace_initialize();
+
+/**
+ * Frees the thread local storage slot allocated by trace_initialize.
+ * Called when nvdaHelperRemote is unloaded.
+ */
+void trace_terminate();
+
+/**
+ * Marks the calling thread's events as belonging to an exited thread, so they are discarded when recording is next started.
+ * Called as each thread exits.
+ */
+void trace_threadExit();
+
+/**
+ * Starts or stops recording. Starting discards any previously recorded events.
+ */
+void trace_setEnabled(bool enable);
+
+/**
+ * Writes all recorded events to a file in Chrome's trace event format.
+ * @param path the path of the file to write.
+ * @return true if the file was written.
+ */
+bool trace_writeFile(const wchar_t* path);
+
+}
+
+namespace {
+
+/**
+ * This module's copy of the pointer to the enabled flag.
+ * Like the log levels pointer in log.h, it is NULL until its dynamic initializer runs, which may be after other static constructors have started tracing.
+ */
+const volatile long* trace_enabledFlag=trace_getEnabledFlag();
+
+}
+
+/**
+ * @return true if events are being recorded.
+ */
+inline bool trace_isEnabled() {
+	const volatile long* flag=trace_enabledFlag;
+	if(!flag) flag=trace_getEnabledFlag();
+	return *flag!=0;
+}
+
+/**
+ * Records a begin event when constructed and the matching end event when destructed, if recording was enabled when constructed.
+ */
+class TraceScope {
+	private:
+	const char* name;
+	const bool active;
+	TraceScope(const TraceScope&);
+	TraceScope& operator=(const TraceScope&);
+
+	public:
+
+	TraceScope(const char* nameArg): name(nameArg), active(trace_isEnabled()) {
+		if(active) trace_begin(name);
+	}
+
+	~TraceScope() {
+		if(active) trace_end(name);
+	}
+
+};
+
+/**
+ * Traces the rest of the enclosing scope as a section with the given name.
+ */
+#define TRACE_SCOPE(name) TraceScope _traceScope(name)
+
+/**
+ * Records an instant event with the given name.
+ */
+#define TRACE_INSTANT(name) { if(trace_isEnabled()) trace_instant(name); }
+
+#endif
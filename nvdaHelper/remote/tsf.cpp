@@ -12,6 +12,8 @@ This license can be found at:
 http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
+#define LOG_CATEGORY LOGCATEGORY_IME
+
 #include <map>
 #include <windows.h>
 #include <wchar.h>
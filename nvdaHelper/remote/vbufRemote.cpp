@@ -13,8 +13,11 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
 #include <map>
+#include <string>
+#include <sstream>
 #include "vbufRemote.h"
 #include <vbufBase/backend.h>
+#include <common/log.h>
 #include "dllmain.h"
 
 using namespace std;
@@ -62,7 +65,7 @@ void VBufRemote_destroyBuffer(VBufRemote_bufferHandle_t* buffer) {
 int VBufRemote_getFieldNodeOffsets(VBufRemote_bufferHandle_t buffer, VBufRemote_nodeHandle_t node, int *startOffset, int *endOffset) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
 	VBufStorage_fieldNode_t* realNode=(VBufStorage_fieldNode_t*)node;
-	backend->lock.acquire();
+	backend->acquireForQuery();
 	int res=backend->getFieldNodeOffsets(realNode,startOffset,endOffset);
 	backend->lock.release();
 	return res;
@@ -71,7 +74,7 @@ int VBufRemote_getFieldNodeOffsets(VBufRemote_bufferHandle_t buffer, VBufRemote_
 int VBufRemote_isFieldNodeAtOffset(VBufRemote_bufferHandle_t buffer, VBufRemote_nodeHandle_t node, int offset) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
 	VBufStorage_fieldNode_t* realNode=(VBufStorage_fieldNode_t*)node;
-	backend->lock.acquire();
+	backend->acquireForQuery();
 	int res=backend->isFieldNodeAtOffset(realNode,offset);
 	backend->lock.release();
 	return res;
@@ -79,7 +82,7 @@ int VBufRemote_isFieldNodeAtOffset(VBufRemote_bufferHandle_t buffer, VBufRemote_
 
 int VBufRemote_locateTextFieldNodeAtOffset(VBufRemote_bufferHandle_t buffer, int offset, int *nodeStartOffset, int *nodeEndOffset, VBufRemote_nodeHandle_t* foundNode) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
+	backend->acquireForQuery();
 	*foundNode=(VBufRemote_nodeHandle_t)(backend->locateTextFieldNodeAtOffset(offset,nodeStartOffset,nodeEndOffset));
 	backend->lock.release();
 	return (*foundNode)!=NULL;
@@ -87,7 +90,7 @@ int VBufRemote_locateTextFieldNodeAtOffset(VBufRemote_bufferHandle_t buffer, int
 
 int VBufRemote_locateControlFieldNodeAtOffset(VBufRemote_bufferHandle_t buffer, int offset, int *nodeStartOffset, int *nodeEndOffset, int *docHandle, int *ID, VBufRemote_nodeHandle_t* foundNode) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
+	backend->acquireForQuery();
 	*foundNode=(VBufRemote_nodeHandle_t)(backend->locateControlFieldNodeAtOffset(offset,nodeStartOffset,nodeEndOffset,docHandle,ID));
 	backend->lock.release();
 	return (*foundNode)!=0;
@@ -95,7 +98,7 @@ int VBufRemote_locateControlFieldNodeAtOffset(VBufRemote_bufferHandle_t buffer,
 
 int VBufRemote_getControlFieldNodeWithIdentifier(VBufRemote_bufferHandle_t buffer, int docHandle, int ID, VBufRemote_nodeHandle_t* foundNode) { 
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
+	backend->acquireForQuery();
 	*foundNode=(VBufRemote_nodeHandle_t)(backend->getControlFieldNodeWithIdentifier(docHandle,ID));
 	backend->lock.release();
 	return (*foundNode)!=0;
@@ -103,7 +106,7 @@ int VBufRemote_getControlFieldNodeWithIdentifier(VBufRemote_bufferHandle_t buffe
 
 int VBufRemote_getIdentifierFromControlFieldNode(VBufRemote_bufferHandle_t buffer, VBufRemote_nodeHandle_t node, int* docHandle, int* ID) { 
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
+	backend->acquireForQuery();
 	int res=backend->getIdentifierFromControlFieldNode((VBufStorage_controlFieldNode_t*)node,docHandle,ID);
 	backend->lock.release();
 	return res;
@@ -111,15 +114,74 @@ int VBufRemote_getIdentifierFromControlFieldNode(VBufRemote_bufferHandle_t buffe
 
 int VBufRemote_findNodeByAttributes(VBufRemote_bufferHandle_t buffer, int offset, int direction, const wchar_t* attribs, const wchar_t* regexp, int *startOffset, int *endOffset, VBufRemote_nodeHandle_t* foundNode) { 
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
+	backend->acquireForQuery();
+	backend->startQueryDeadline();
 	*foundNode=(VBufRemote_nodeHandle_t)(backend->findNodeByAttributes(offset,(VBufStorage_findDirection_t)direction,attribs,regexp,startOffset,endOffset));
+	bool timedOut=backend->stopQueryDeadline();
 	backend->lock.release();
+	if(timedOut) {
+		return VBUFREMOTE_TIMEDOUT;
+	}
 	return (*foundNode)!=0;
 }
 
+int VBufRemote_findText(VBufRemote_bufferHandle_t buffer, int offset, const wchar_t* text, boolean reverse, boolean caseSensitive, int *startOffset, int *endOffset) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	backend->acquireForQuery();
+	backend->startQueryDeadline();
+	bool res=backend->findText(offset,text,reverse!=false,caseSensitive!=false,startOffset,endOffset);
+	bool timedOut=backend->stopQueryDeadline();
+	backend->lock.release();
+	if(timedOut) {
+		return VBUFREMOTE_TIMEDOUT;
+	}
+	return res;
+}
+
+int VBufRemote_getTableCell(VBufRemote_bufferHandle_t buffer, const wchar_t* tableID, int row, int column, int *startOffset, int *endOffset, VBufRemote_nodeHandle_t* foundNode) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	backend->acquireForQuery();
+	*foundNode=(VBufRemote_nodeHandle_t)(backend->getTableCell(tableID,row,column,startOffset,endOffset));
+	backend->lock.release();
+	return (*foundNode)!=0;
+}
+
+int VBufRemote_addOutlineCategory(VBufRemote_bufferHandle_t buffer, const wchar_t* attribs, const wchar_t* regexp) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	backend->acquireForQuery();
+	int res=backend->addOutlineCategory(attribs,regexp);
+	backend->lock.release();
+	return res;
+}
+
+int VBufRemote_getOutline(VBufRemote_bufferHandle_t buffer, unsigned int categories, int firstEntry, int maxEntries, int* entryCount, VBufRemote_outlineEntry_t* entries, int* totalEntryCount, unsigned int* version) {
+	*entryCount=0;
+	*totalEntryCount=0;
+	*version=0;
+	if(firstEntry<0||maxEntries<=0||maxEntries>VBUFREMOTE_OUTLINE_MAXENTRIES) {
+		return false;
+	}
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	VBufStorage_fieldNode_t* nodes[VBUFREMOTE_OUTLINE_MAXENTRIES];
+	unsigned int nodeCategories[VBUFREMOTE_OUTLINE_MAXENTRIES];
+	int startOffsets[VBUFREMOTE_OUTLINE_MAXENTRIES];
+	int endOffsets[VBUFREMOTE_OUTLINE_MAXENTRIES];
+	backend->acquireForQuery();
+	backend->getOutline(categories,firstEntry,maxEntries,entryCount,nodes,nodeCategories,startOffsets,endOffsets,totalEntryCount);
+	*version=backend->getVersion();
+	backend->lock.release();
+	for(int i=0;i<*entryCount;++i) {
+		entries[i].node=(VBufRemote_nodeHandle_t)nodes[i];
+		entries[i].categories=nodeCategories[i];
+		entries[i].startOffset=startOffsets[i];
+		entries[i].endOffset=endOffsets[i];
+	}
+	return true;
+}
+
 int VBufRemote_getSelectionOffsets(VBufRemote_bufferHandle_t buffer, int *startOffset, int *endOffset) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
+	backend->acquireForQuery();
 	int res=backend->getSelectionOffsets(startOffset,endOffset);
 	backend->lock.release();
 	return res;
@@ -127,7 +189,7 @@ int VBufRemote_getSelectionOffsets(VBufRemote_bufferHandle_t buffer, int *startO
 
 int VBufRemote_setSelectionOffsets(VBufRemote_bufferHandle_t buffer, int startOffset, int endOffset) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
+	backend->acquireForQuery();
 	int res=backend->setSelectionOffsets(startOffset,endOffset);
 	backend->lock.release();
 	return res;
@@ -135,7 +197,7 @@ int VBufRemote_setSelectionOffsets(VBufRemote_bufferHandle_t buffer, int startOf
 
 int VBufRemote_getTextLength(VBufRemote_bufferHandle_t buffer) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
+	backend->acquireForQuery();
 	int res=backend->getTextLength();
 	backend->lock.release();
 	return res;
@@ -143,25 +205,230 @@ int VBufRemote_getTextLength(VBufRemote_bufferHandle_t buffer) {
 
 int VBufRemote_getTextInRange(VBufRemote_bufferHandle_t buffer, int startOffset, int endOffset, wchar_t** text, boolean useMarkup) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
+	backend->acquireForQuery();
+	backend->startQueryDeadline();
 	VBufStorage_textContainer_t* textContainer=backend->getTextInRange(startOffset,endOffset,useMarkup!=false);
+	bool timedOut=backend->stopQueryDeadline();
 	backend->lock.release();
 	if(textContainer==NULL) {
-		return false;
+		return timedOut?VBUFREMOTE_TIMEDOUT:false;
 	}
 	*text=SysAllocString(textContainer->getString().c_str());
 	textContainer->destroy();
 	return true;
 }
 
+int VBufRemote_getTextInRangeToSection(VBufRemote_bufferHandle_t buffer, int startOffset, int endOffset, boolean useMarkup, unsigned long section, int sectionLength, int* textLength) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	HANDLE sectionHandle=UlongToHandle(section);
+	*textLength=0;
+	if(sectionLength<=0||static_cast<unsigned int>(sectionLength)>MAXDWORD/sizeof(wchar_t)) {
+		LOG_ERROR(L"Bad section length "<<sectionLength);
+		CloseHandle(sectionHandle);
+		return false;
+	}
+	wchar_t* view=(wchar_t*)MapViewOfFile(sectionHandle,FILE_MAP_WRITE,0,0,sectionLength*sizeof(wchar_t));
+	// The view keeps the section open for as long as it is mapped.
+	CloseHandle(sectionHandle);
+	if(view==NULL) {
+		LOG_ERROR(L"MapViewOfFile failed, error "<<GetLastError());
+		return false;
+	}
+	backend->acquireForQuery();
+	backend->startQueryDeadline();
+	bool res=backend->copyTextInRange(startOffset,endOffset,useMarkup!=false,view,sectionLength,textLength);
+	bool timedOut=backend->stopQueryDeadline();
+	backend->lock.release();
+	UnmapViewOfFile(view);
+	if(timedOut) {
+		return VBUFREMOTE_TIMEDOUT;
+	}
+	return res;
+}
+
 int VBufRemote_getLineOffsets(VBufRemote_bufferHandle_t buffer, int offset, int maxLineLength, boolean useScreenLayout, int *startOffset, int *endOffset) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
+	backend->acquireForQuery();
+	backend->startQueryDeadline();
 	int res=backend->getLineOffsets(offset,maxLineLength,useScreenLayout!=false,startOffset,endOffset);
+	bool timedOut=backend->stopQueryDeadline();
+	backend->lock.release();
+	if(timedOut) {
+		return VBUFREMOTE_TIMEDOUT;
+	}
+	return res;
+}
+
+int VBufRemote_getMetrics(VBufRemote_bufferHandle_t buffer, wchar_t** metrics) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	VBufStorage_textContainer_t* textContainer=backend->getMetrics();
+	if(textContainer==NULL) {
+		return false;
+	}
+	*metrics=SysAllocString(textContainer->getString().c_str());
+	textContainer->destroy();
+	return true;
+}
+
+int VBufRemote_getMemoryUsage(VBufRemote_bufferHandle_t buffer, wchar_t** usage) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	VBufStorage_memoryUsage_t memoryUsage;
+	// Measuring does not need the content, so a frozen buffer is measured as it is rather than thawed.
+	backend->lock.acquire();
+	backend->getMemoryUsage(&memoryUsage);
 	backend->lock.release();
+	wostringstream s;
+	s<<L"nodes:"<<memoryUsage.nodes<<L";";
+	s<<L"text:"<<memoryUsage.text<<L";";
+	s<<L"attributes:"<<memoryUsage.attributes<<L";";
+	s<<L"identifierIndex:"<<memoryUsage.identifierIndex<<L";";
+	s<<L"otherIndexes:"<<memoryUsage.otherIndexes<<L";";
+	s<<L"total:"<<memoryUsage.getTotal()<<L";";
+	*usage=SysAllocString(s.str().c_str());
+	return true;
+}
+
+/**
+ * Works out the arguments of a batch operation, replacing references to earlier results with those results.
+ * @return false if an argument refers to a value that is not available.
+ */
+bool VBufRemote_resolveBatchArgs(const VBufRemote_batchOp_t& op, int opIndex, const VBufRemote_batchResult_t* results, hyper* args) {
+	for(int i=0;i<4;++i) {
+		if(!(op.argRefs&(1<<i))) {
+			args[i]=op.args[i];
+			continue;
+		}
+		int refOp=(int)(op.args[i]>>8);
+		int refValue=(int)(op.args[i]&0xff);
+		if(refOp<0||refOp>=opIndex||refValue>=5||results[refOp].status==0) return false;
+		args[i]=results[refOp].values[refValue];
+	}
+	return true;
+}
+
+/**
+ * Runs a single batch operation. The caller must hold the backend's lock.
+ */
+int VBufRemote_runBatchOp(VBufBackend_t* backend, int op, const hyper* args, hyper* values, wstring& text) {
+	int res=false;
+	int v[4]={0,0,0,0};
+	VBufStorage_fieldNode_t* node=NULL;
+	switch(op) {
+		case VBUFREMOTE_BATCHOP_GETFIELDNODEOFFSETS:
+		res=backend->getFieldNodeOffsets((VBufStorage_fieldNode_t*)args[0],&v[0],&v[1]);
+		values[0]=v[0];
+		values[1]=v[1];
+		break;
+		case VBUFREMOTE_BATCHOP_ISFIELDNODEATOFFSET:
+		res=backend->isFieldNodeAtOffset((VBufStorage_fieldNode_t*)args[0],(int)args[1]);
+		break;
+		case VBUFREMOTE_BATCHOP_LOCATETEXTFIELDNODEATOFFSET:
+		node=backend->locateTextFieldNodeAtOffset((int)args[0],&v[0],&v[1]);
+		values[0]=v[0];
+		values[1]=v[1];
+		values[2]=(VBufRemote_nodeHandle_t)node;
+		res=node!=NULL;
+		break;
+		case VBUFREMOTE_BATCHOP_LOCATECONTROLFIELDNODEATOFFSET:
+		node=backend->locateControlFieldNodeAtOffset((int)args[0],&v[0],&v[1],&v[2],&v[3]);
+		for(int i=0;i<4;++i) values[i]=v[i];
+		values[4]=(VBufRemote_nodeHandle_t)node;
+		res=node!=NULL;
+		break;
+		case VBUFREMOTE_BATCHOP_GETCONTROLFIELDNODEWITHIDENTIFIER:
+		node=backend->getControlFieldNodeWithIdentifier((int)args[0],(int)args[1]);
+		values[0]=(VBufRemote_nodeHandle_t)node;
+		res=node!=NULL;
+		break;
+		case VBUFREMOTE_BATCHOP_GETIDENTIFIERFROMCONTROLFIELDNODE:
+		res=backend->getIdentifierFromControlFieldNode((VBufStorage_controlFieldNode_t*)args[0],&v[0],&v[1]);
+		values[0]=v[0];
+		values[1]=v[1];
+		break;
+		case VBUFREMOTE_BATCHOP_GETSELECTIONOFFSETS:
+		res=backend->getSelectionOffsets(&v[0],&v[1]);
+		values[0]=v[0];
+		values[1]=v[1];
+		break;
+		case VBUFREMOTE_BATCHOP_GETTEXTLENGTH:
+		values[0]=backend->getTextLength();
+		res=true;
+		break;
+		case VBUFREMOTE_BATCHOP_GETTEXTINRANGE: {
+			VBufStorage_textContainer_t* textContainer=backend->getTextInRange((int)args[0],(int)args[1],args[2]!=0);
+			if(textContainer==NULL) break;
+			const wstring& rangeText=textContainer->getString();
+			values[0]=text.length();
+			values[1]=rangeText.length();
+			text.append(rangeText);
+			textContainer->destroy();
+			res=true;
+			break;
+		}
+		case VBUFREMOTE_BATCHOP_GETLINEOFFSETS:
+		res=backend->getLineOffsets((int)args[0],(int)args[1],args[2]!=0,&v[0],&v[1]);
+		values[0]=v[0];
+		values[1]=v[1];
+		break;
+	}
 	return res;
 }
 
+int VBufRemote_batch(VBufRemote_bufferHandle_t buffer, int opCount, const VBufRemote_batchOp_t* ops, VBufRemote_batchResult_t* results, wchar_t** text, int* version) {
+	if(opCount<0||opCount>VBUFREMOTE_BATCH_MAXOPS) {
+		return false;
+	}
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	wstring batchText;
+	backend->acquireForQuery();
+	backend->startQueryDeadline();
+	*version=(int)backend->getVersion();
+	for(int i=0;i<opCount;++i) {
+		VBufRemote_batchResult_t& result=results[i];
+		result.status=0;
+		for(int j=0;j<5;++j) result.values[j]=0;
+		hyper args[4];
+		if(!VBufRemote_resolveBatchArgs(ops[i],i,results,args)) continue;
+		result.status=VBufRemote_runBatchOp(backend,ops[i].op,args,result.values,batchText);
+	}
+	bool timedOut=backend->stopQueryDeadline();
+	backend->lock.release();
+	*text=SysAllocString(batchText.c_str());
+	if(timedOut) {
+		return VBUFREMOTE_TIMEDOUT;
+	}
+	return true;
+}
+
+int VBufRemote_setQueryTimeout(VBufRemote_bufferHandle_t buffer, int milliseconds) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	backend->lock.acquire();
+	backend->setQueryTimeout(milliseconds);
+	backend->lock.release();
+	return true;
+}
+
+int VBufRemote_setIdleFreezeTimeout(VBufRemote_bufferHandle_t buffer, int milliseconds) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	backend->setIdleFreezeTimeout(milliseconds);
+	return true;
+}
+
+int VBufRemote_setSubtreeSharing(VBufRemote_bufferHandle_t buffer, boolean enable) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	backend->lock.acquire();
+	backend->setSubtreeSharing(enable!=0);
+	backend->lock.release();
+	return true;
+}
+
+int VBufRemote_cancelQueries(VBufRemote_bufferHandle_t buffer) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	// The lock is not taken, as it is held by the queries being cancelled.
+	backend->cancelQueries();
+	return true;
+}
+
 //Special cleanup method for VBufRemote when client is lost
 void __RPC_USER VBufRemote_bufferHandle_t_rundown(VBufRemote_bufferHandle_t buffer) {
 	VBufRemote_destroyBuffer(&buffer);
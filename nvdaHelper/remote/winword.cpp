@@ -12,6 +12,8 @@ This license can be found at:
 http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
+#define LOG_CATEGORY LOGCATEGORY_WINWORD
+
 #define WIN32_LEAN_AND_MEAN 
 
 #include <sstream>
@@ -28,6 +30,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <remote/WinWord/Constants.h>
 #include <remote/WinWord/Fields.h>
 #include "winword.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -971,6 +974,7 @@ typedef struct {
 	BSTR text;
 } winword_getTextInRange_args;
 void winword_getTextInRange_helper(HWND hwnd, winword_getTextInRange_args* args) {
+	TRACE_SCOPE("winword_getTextInRange_helper");
 	//Fetch all needed objects
 	//Get the window object
 	IDispatchPtr pDispatchWindow=NULL;
@@ -20,6 +20,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <remote/nvdaHelperRemote.h>
 #include <vbufBase/backend.h>
 #include <common/log.h>
+#include <common/memoryUsage.h>
 #include "adobeAcrobat.h"
 
 const int TEXTFLAG_UNDERLINE = 0x1;
@@ -240,6 +241,11 @@ class AdobeAcrobatVBufStorage_controlFieldNode_t: public VBufStorage_controlFiel
 	protected:
 	wstring language;
 	friend class AdobeAcrobatVBufBackend_t;
+
+	virtual void getMemoryUsage(VBufStorage_memoryUsage_t* usage) const {
+		VBufStorage_controlFieldNode_t::getMemoryUsage(usage);
+		usage->nodes += sizeof(AdobeAcrobatVBufStorage_controlFieldNode_t) - sizeof(VBufStorage_controlFieldNode_t) + memoryUsage_string(language);
+	}
 };
 
 /*
@@ -443,7 +449,7 @@ AdobeAcrobatVBufStorage_controlFieldNode_t* AdobeAcrobatVBufBackend_t::fillVBuf(
 			parentNode->addAttribute(L"acrobat::stdname", stdName);
 			if (wcscmp(stdName, L"Span") == 0 || wcscmp(stdName, L"Link") == 0 || wcscmp(stdName, L"Quote") == 0) {
 				// This is an inline element.
-				parentNode->isBlock=false;
+				parentNode->setBlock(false);
 			}
 			if (wcscmp(stdName, L"Formula") == 0) {
 				// We don't want the content of formulas,
@@ -667,7 +673,7 @@ AdobeAcrobatVBufStorage_controlFieldNode_t* AdobeAcrobatVBufBackend_t::fillVBuf(
 		// No children, so this is a leaf node.
 		if (!this->isXFA && !stdName) {
 			// Non-XFA leaf nodes with no stdName are inline.
-			parentNode->isBlock=false;
+			parentNode->setBlock(false);
 		}
 
 		// Get the name.
@@ -724,7 +730,7 @@ AdobeAcrobatVBufStorage_controlFieldNode_t* AdobeAcrobatVBufBackend_t::fillVBuf(
 		// Always render a space for empty table cells.
 		previousNode=buffer->addTextFieldNode(parentNode,previousNode,L" ");
 		addAttrsToTextNode(previousNode);
-		parentNode->isBlock=false;
+		parentNode->setBlock(false);
 	} else if (role == ROLE_SYSTEM_TABLE) {
 		nhAssert(tableInfo);
 		for (list<pair<AdobeAcrobatVBufStorage_controlFieldNode_t*, wstring>>::iterator it = tableInfo->nodesWithExplicitHeaders.begin(); it != tableInfo->nodesWithExplicitHeaders.end(); ++it)
@@ -12,6 +12,8 @@ This license can be found at:
 http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
+#define LOG_CATEGORY LOGCATEGORY_GECKO
+
 #include <windows.h>
 #include <set>
 #include <string>
@@ -380,13 +382,14 @@ VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
 		else if(varRole.vt==VT_BSTR)
 			roleString=varRole.bstrVal;
 	}
-	//Add role as an attrib
-	if(roleString)
+	//Add role as an attrib, held as a number unless it is a string
+	if(roleString) {
 		s<<roleString;
-	else
-		s<<role;
-	parentNode->addAttribute(L"IAccessible::role",s.str());
-	s.str(L"");
+		parentNode->addAttribute(L"IAccessible::role",s.str());
+		s.str(L"");
+	} else {
+		parentNode->addTypedAttribute(L"IAccessible::role",VBufStorage_attributeType_enum,role);
+	}
 	VariantClear(&varRole);
 
 	//get states -- IAccessible accState
@@ -399,30 +402,16 @@ VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
 	}
 	int states=varState.lVal;
 	VariantClear(&varState);
-	//Add each state that is on, as an attrib
-	for(int i=0;i<32;++i) {
-		int state=1<<i;
-		if(state&states) {
-			s<<L"IAccessible::state_"<<state;
-			parentNode->addAttribute(s.str(),L"1");
-			s.str(L"");
-		}
-	}
+	//Add the states as a bitset, presented as an attrib for each state that is on
+	parentNode->addTypedAttribute(L"IAccessible::state_",VBufStorage_attributeType_bitset,states);
 	//get IA2States -- IAccessible2 states
 	AccessibleStates IA2States;
 	if(pacc->get_states(&IA2States)!=S_OK) {
 		LOG_DEBUG(L"pacc->get_states failed");
 		IA2States=0;
 	}
-	//Add each state that is on, as an attrib
-	for(int i=0;i<32;++i) {
-		int state=1<<i;
-		if(state&IA2States) {
-			s<<L"IAccessible2::state_"<<state;
-			parentNode->addAttribute(s.str(),L"1");
-			s.str(L"");
-		}
-	}
+	//Add the states as a bitset, presented as an attrib for each state that is on
+	parentNode->addTypedAttribute(L"IAccessible2::state_",VBufStorage_attributeType_bitset,IA2States);
 
 	//get keyboardShortcut -- IAccessible accKeyboardShortcut;
 	BSTR keyboardShortcut;
@@ -464,11 +453,11 @@ VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
 	} else {
 		isBlockElement=FALSE;
 	}
-	parentNode->isBlock=isBlockElement;
+	parentNode->setBlock(isBlockElement);
 
 	// force   isHidden to True if this has an ARIA role of presentation but its focusble -- Gecko does not hide this itself.
 	if((states&STATE_SYSTEM_FOCUSABLE)&&parentNode->matchAttributes(ATTRLIST_ROLES, REGEX_PRESENTATION_ROLE)) {
-		parentNode->isHidden=true;
+		parentNode->setHidden(true);
 	}
 	BSTR name=NULL;
 	if(pacc->get_accName(varChild,&name)!=S_OK)
@@ -521,7 +510,7 @@ VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
 			|| (!isRoot && (role == ROLE_SYSTEM_APPLICATION || role == ROLE_SYSTEM_DIALOG));
 	// Whether this node is interactive.
 	// Certain objects are never interactive, even if other checks are true.
-	bool isNeverInteractive = parentNode->isHidden||(!isEditable && (isRoot || role == ROLE_SYSTEM_DOCUMENT || role == IA2_ROLE_INTERNAL_FRAME));
+	bool isNeverInteractive = parentNode->isHidden()||(!isEditable && (isRoot || role == ROLE_SYSTEM_DOCUMENT || role == IA2_ROLE_INTERNAL_FRAME));
 	bool isInteractive = !isNeverInteractive && (isEditable || inLink || states & STATE_SYSTEM_FOCUSABLE || states & STATE_SYSTEM_UNAVAILABLE || isEmbeddedApp || role == ROLE_SYSTEM_EQUATION);
 	// We aren't finished calculating isInteractive yet; actions are handled below.
 
@@ -726,7 +715,7 @@ VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
 					// (A chunk ends at the end of the text, at the end of an attributes run
 					// or at an embedded object char.)
 					// Add the chunk to the buffer.
-					if(tempNode=buffer->addTextFieldNode(parentNode,previousNode,wstring(IA2Text+chunkStart,i-chunkStart))) {
+					if(tempNode=buffer->addTextFieldNode(parentNode,previousNode,IA2Text+chunkStart,i-chunkStart)) {
 						previousNode=tempNode;
 						// Add text attributes.
 						for(map<wstring,wstring>::const_iterator it=textAttribs.begin();it!=textAttribs.end();++it)
@@ -854,7 +843,7 @@ VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
 			// Always render a space for empty table cells and unknowns.
 			previousNode=buffer->addTextFieldNode(parentNode,previousNode,L" ");
 			if(previousNode&&!locale.empty()) previousNode->addAttribute(L"language",locale);
-			parentNode->isBlock=false;
+			parentNode->setBlock(false);
 		}
 
 		if ((isInteractive || role == ROLE_SYSTEM_SEPARATOR) && parentNode->getLength() == 0) {
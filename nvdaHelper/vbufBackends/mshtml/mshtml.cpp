@@ -12,6 +12,8 @@ This license can be found at:
 http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
+#define LOG_CATEGORY LOGCATEGORY_MSHTML
+
 #include <map>
 #include <algorithm>
 #include <windows.h>
@@ -345,7 +347,7 @@ inline wstring getTextFromHTMLDOMNode(IHTMLDOMNode* pHTMLDOMNode, bool allowPref
 	currentStyleObj->get_##styleName(&tempBSTR);\
 	if(tempBSTR) {\
 		LOG_DEBUG(L"Got "<<L#styleName);\
-		node->addAttribute(L#attrName,tempBSTR);\
+		node->addAttribute(L#attrName,tempBSTR,SysStringLen(tempBSTR));\
 		SysFreeString(tempBSTR);\
 		tempBSTR=NULL;\
 	} else {\
@@ -357,7 +359,7 @@ inline wstring getTextFromHTMLDOMNode(IHTMLDOMNode* pHTMLDOMNode, bool allowPref
 	currentStyleObj->get_##styleName(&tempVar);\
 	if(tempVar.vt==VT_BSTR && tempVar.bstrVal) {\
 		LOG_DEBUG(L"Got "<<L#styleName);\
-		node->addAttribute(L#attrName,tempVar.bstrVal);\
+		node->addAttribute(L#attrName,tempVar.bstrVal,SysStringLen(tempVar.bstrVal));\
 		VariantClear(&tempVar);\
 	} else {\
 		LOG_DEBUG(L"Failed to get "<<L#styleName);\
@@ -759,7 +761,7 @@ VBufStorage_fieldNode_t* MshtmlVBufBackend_t::fillVBuf(VBufStorage_buffer_t* buf
 
 	//Handle text nodes
 	if(!shouldSkipText) { 
-		wstring s=getTextFromHTMLDOMNode(pHTMLDOMNode,allowPreformattedText,(parentNode&&parentNode->isBlock&&!previousNode));
+		wstring s=getTextFromHTMLDOMNode(pHTMLDOMNode,allowPreformattedText,(parentNode&&parentNode->isBlock()&&!previousNode));
 		if(!s.empty()) {
 			LOG_DEBUG(L"Got text from node");
 			VBufStorage_textFieldNode_t* textNode=buffer->addTextFieldNode(parentNode,previousNode,s);
@@ -903,7 +905,7 @@ if(!(formatState&FORMATSTATE_INSERTED)&&nodeName.compare(L"INS")==0) {
 	bool wasInNewSubtree=inNewSubtree;
 	if(!wasInNewSubtree&&!oldNode) {
 		oldNode=this->getControlFieldNodeWithIdentifier(docHandle,ID);
-		if(oldNode&&oldNode->isHidden) oldNode=NULL;
+		if(oldNode&&oldNode->isHidden()) oldNode=NULL;
 		inNewSubtree=!oldNode;
 	}
 	//Add the node to the buffer
@@ -919,7 +921,7 @@ if(!(formatState&FORMATSTATE_INSERTED)&&nodeName.compare(L"INS")==0) {
 
 	//We do not want to render any content for dontRender nodes
 	if(dontRender) {
-		parentNode->isHidden=true;
+		parentNode->setHidden(true);
 		return parentNode;
 	}
 
@@ -1011,7 +1013,7 @@ if(!(formatState&FORMATSTATE_INSERTED)&&nodeName.compare(L"INS")==0) {
 		LIIndexPtr=NULL;
 	}
 
-	parentNode->isHidden=hidden;
+	parentNode->setHidden(hidden);
 
 	if(!hidden) {
 		//Collect and update table information
@@ -1285,12 +1287,10 @@ if(!(formatState&FORMATSTATE_INSERTED)&&nodeName.compare(L"INS")==0) {
 	}
 
 	//Update block setting on node
-	parentNode->isBlock=isBlock;
+	parentNode->setBlock(isBlock);
 
-	//Add all the collected attributes to the node
-	for(tempIter=attribsMap.begin();tempIter!=attribsMap.end();++tempIter) {
-		parentNode->addAttribute(tempIter->first,tempIter->second);
-	}
+	//Add all the collected attributes to the node, handing over the map rather than copying each attribute
+	parentNode->setAttributes(move(attribsMap));
 
 	// Closing quote for <Q> elements
 	if(nodeName.compare(L"Q")==0) {
@@ -12,6 +12,8 @@ This license can be found at:
 http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
+#define LOG_CATEGORY LOGCATEGORY_MSHTML
+
 #include <list>
 #include <windows.h>
 #include <objbase.h>
@@ -19,6 +21,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <mshtml.h>
 #include <mshtmdid.h>
 #include <common/log.h>
+#include <common/memoryUsage.h>
 #include "mshtml.h"
 #include <remote/nvdaController.h>
 #include <common/xml.h>
@@ -428,7 +431,7 @@ void MshtmlVBufStorage_controlFieldNode_t::postProcessLiveRegion(VBufStorage_con
 				oldStart=oldStart->getNext();
 				continue;
 			}
-			if(((VBufStorage_textFieldNode_t*)oldStart)->text.compare(((VBufStorage_textFieldNode_t*)newStart)->text)!=0) {
+			if(((VBufStorage_textFieldNode_t*)oldStart)->getText().compare(((VBufStorage_textFieldNode_t*)newStart)->getText())!=0) {
 				break;
 			}
 			oldStart=oldStart->getNext();
@@ -446,7 +449,7 @@ void MshtmlVBufStorage_controlFieldNode_t::postProcessLiveRegion(VBufStorage_con
 				oldEnd=oldEnd->getPrevious();
 				continue;
 			}
-			if(((VBufStorage_textFieldNode_t*)oldEnd)->text.compare(((VBufStorage_textFieldNode_t*)newEnd)->text)!=0) {
+			if(((VBufStorage_textFieldNode_t*)oldEnd)->getText().compare(((VBufStorage_textFieldNode_t*)newEnd)->getText())!=0) {
 				break;
 			}
 			oldEnd=oldEnd->getPrevious();
@@ -480,3 +483,8 @@ void MshtmlVBufStorage_controlFieldNode_t::generateAttributesForMarkupOpeningTag
 		appendCharToXML(*it, text, true);
 	text += L"\" ";
 }
+
+void MshtmlVBufStorage_controlFieldNode_t::getMemoryUsage(VBufStorage_memoryUsage_t* usage) const {
+	VBufStorage_controlFieldNode_t::getMemoryUsage(usage);
+	usage->nodes += sizeof(MshtmlVBufStorage_controlFieldNode_t) - sizeof(VBufStorage_controlFieldNode_t) + memoryUsage_string(language);
+}
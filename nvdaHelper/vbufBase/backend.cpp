@@ -12,13 +12,18 @@ This license can be found at:
 http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
+#define LOG_CATEGORY LOGCATEGORY_BACKEND
+
 #include <map>
+#include <list>
+#include <sstream>
 #define WIN32_LEAN_AND_MEAN 
 #include <windows.h>
 #include <remote/nvdaHelperRemote.h>
 #include <common/log.h>
 #include <remote/nvdaControllerInternal.h>
 #include <remote/inProcess.h>
+#include <remote/trace.h>
 #include "storage.h"
 #include "backend.h"
 
@@ -26,7 +31,37 @@ using namespace std;
 
 VBufBackendSet_t VBufBackend_t::runningBackends;
 
-VBufBackend_t::VBufBackend_t(int docHandleArg, int IDArg): renderThreadID(GetWindowThreadProcessId((HWND)UlongToHandle(docHandleArg),NULL)), rootDocHandle(docHandleArg), rootID(IDArg), lock(), renderThreadTimerID(0), invalidSubtreeList() {
+/**
+ * A clock for update schedulers, based on the performance counter.
+ */
+class VBufBackend_performanceCounterClock_t: public VBufUpdateSchedulerClock_t {
+	private:
+	long long frequency;
+
+	public:
+
+	VBufBackend_performanceCounterClock_t(): frequency(0) {
+		LARGE_INTEGER li;
+		if(QueryPerformanceFrequency(&li)) frequency=li.QuadPart;
+	}
+
+	virtual long long getTime() {
+		if(frequency==0) return GetTickCount();
+		LARGE_INTEGER li;
+		QueryPerformanceCounter(&li);
+		return (li.QuadPart*1000)/frequency;
+	}
+
+};
+
+VBufBackend_performanceCounterClock_t performanceCounterClock;
+
+/**
+ * How often, in milliseconds, backends check whether they have been idle long enough to be frozen.
+ */
+const UINT VBufBackend_idleCheckInterval=10000;
+
+VBufBackend_t::VBufBackend_t(int docHandleArg, int IDArg): renderThreadID(GetWindowThreadProcessId((HWND)UlongToHandle(docHandleArg),NULL)), updateScheduler(&performanceCounterClock), prioritizeNearSelection(true), nearSelectionDistance(1000), maxConsecutiveDeferredUpdates(4), rootDocHandle(docHandleArg), rootID(IDArg), lock(), renderThreadTimerID(0), invalidSubtreeList(), consecutiveDeferredUpdates(0), metrics(), idleTimerID(0), idleFreezeTimeout(0), lastAccessTime(VBufMetrics_getMicroseconds()) {
 	LOG_DEBUG(L"Initializing backend with docHandle "<<docHandleArg<<L", ID "<<IDArg);
 }
 
@@ -51,6 +86,65 @@ void VBufBackend_t::forceUpdate() {
 	this->update();
 }
 
+void VBufBackend_t::getUpdateSchedulerStats(VBufUpdateSchedulerStats_t* stats) {
+	this->lock.acquire();
+	updateScheduler.getStats(stats);
+	this->lock.release();
+}
+
+void VBufBackend_t::countRenderedContent(const VBufStorage_buffer_t* buffer) {
+	unsigned int nodeCount=0;
+	unsigned long long textBytes=0, attributeBytes=0;
+	buffer->getContentSize(&nodeCount,&textBytes,&attributeBytes);
+	metrics.nodesRendered+=nodeCount;
+	metrics.textBytesRendered+=textBytes;
+	metrics.attributeBytesRendered+=attributeBytes;
+}
+
+VBufStorage_textContainer_t* VBufBackend_t::getMetrics() {
+	wostringstream s;
+	this->lock.acquire();
+	unsigned int nodeCount=0;
+	unsigned long long textBytes=0, attributeBytes=0;
+	this->getContentSize(&nodeCount,&textBytes,&attributeBytes);
+	VBufTimedLockStats_t lockStats;
+	this->lock.getStats(&lockStats);
+	VBufUpdateSchedulerStats_t schedulerStats;
+	updateScheduler.getStats(&schedulerStats);
+	s<<L"initialRenderTime:"<<metrics.initialRenderTime<<L";";
+	s<<L"updateCount:"<<metrics.updateCount<<L";";
+	s<<L"updateTime:"<<metrics.updateTime<<L";";
+	s<<L"maxUpdateTime:"<<metrics.maxUpdateTime<<L";";
+	s<<L"nodesRendered:"<<metrics.nodesRendered<<L";";
+	s<<L"subtreesReplaced:"<<metrics.subtreesReplaced<<L";";
+	s<<L"textBytesRendered:"<<metrics.textBytesRendered<<L";";
+	s<<L"attributeBytesRendered:"<<metrics.attributeBytesRendered<<L";";
+	s<<L"nodeCount:"<<nodeCount<<L";";
+	s<<L"textBytes:"<<textBytes<<L";";
+	s<<L"attributeBytes:"<<attributeBytes<<L";";
+	s<<L"lockAcquisitions:"<<lockStats.acquisitions<<L";";
+	s<<L"lockWaitTime:"<<lockStats.waitTime<<L";";
+	s<<L"maxLockWaitTime:"<<lockStats.maxWaitTime<<L";";
+	s<<L"lockHoldTime:"<<lockStats.holdTime<<L";";
+	s<<L"maxLockHoldTime:"<<lockStats.maxHoldTime<<L";";
+	s<<L"updateRequests:"<<schedulerStats.requests<<L";";
+	s<<L"updateRequestsCoalesced:"<<schedulerStats.eventsCoalesced<<L";";
+	s<<L"updateDelayP50:"<<schedulerStats.delayP50<<L";";
+	s<<L"updateDelayP90:"<<schedulerStats.delayP90<<L";";
+	s<<L"updateDelayP99:"<<schedulerStats.delayP99<<L";";
+	s<<L"maxUpdateDelay:"<<schedulerStats.delayMax<<L";";
+	VBufStorage_freezeStats_t freezeStats;
+	this->getFreezeStats(&freezeStats);
+	s<<L"frozen:"<<this->isFrozen()<<L";";
+	s<<L"freezeCount:"<<freezeStats.freezeCount<<L";";
+	s<<L"thawCount:"<<freezeStats.thawCount<<L";";
+	s<<L"thawTime:"<<freezeStats.thawTime<<L";";
+	s<<L"maxThawTime:"<<freezeStats.maxThawTime<<L";";
+	s<<L"unfrozenBytes:"<<freezeStats.unfrozenBytes<<L";";
+	s<<L"frozenBytes:"<<freezeStats.frozenBytes<<L";";
+	this->lock.release();
+	return new VBufStorage_textContainer_t(s.str());
+}
 
 LRESULT CALLBACK VBufBackend_t::destroy_callWndProcHook(int code, WPARAM wParam,LPARAM lParam) {
 	CWPSTRUCT* pcwp=(CWPSTRUCT*)lParam;
@@ -84,19 +178,29 @@ void CALLBACK VBufBackend_t::renderThread_winEventProcHook(HWINEVENTHOOK hookID,
 }
 
 void VBufBackend_t::requestUpdate() {
+	this->lock.acquire();
+	int delay=updateScheduler.requestUpdate();
+	this->lock.release();
+	if(delay<0&&renderThreadTimerID!=0) {
+		LOG_DEBUG(L"Update already pending, coalescing request");
+		return;
+	}
 	if(renderThreadTimerID==0) {
-		renderThreadTimerID=SetTimer(0,0,100,renderThread_timerProc);
+		renderThreadTimerID=SetTimer(0,0,max(delay,0),renderThread_timerProc);
 		nhAssert(renderThreadTimerID);
-		LOG_DEBUG(L"Set timer with ID "<<renderThreadTimerID);
+		LOG_DEBUG(L"Set timer with ID "<<renderThreadTimerID<<L" for "<<delay<<L" ms");
 	}
 }
 
 void VBufBackend_t::cancelPendingUpdate() {
 	if(renderThreadTimerID>0) {
 		KillTimer(0,renderThreadTimerID);
-		renderThreadTimerID=0;
 		LOG_DEBUG(L"Killed timer with ID "<<renderThreadTimerID);
+		renderThreadTimerID=0;
 	}
+	this->lock.acquire();
+	updateScheduler.cancel();
+	this->lock.release();
 }
 
 
@@ -116,9 +220,52 @@ void CALLBACK VBufBackend_t::renderThread_timerProc(HWND hwnd, UINT msg, UINT_PT
 		// This probably means the timer message was queued before we killed the timer, so just ignore it.
 		return;
 	}
+	backend->lock.acquire();
+	int delay=backend->updateScheduler.timerFired();
+	backend->lock.release();
+	if(delay>0) {
+		// More changes arrived since the timer was armed, so the update has been postponed.
+		backend->renderThreadTimerID=SetTimer(0,0,delay,renderThread_timerProc);
+		nhAssert(backend->renderThreadTimerID);
+		LOG_DEBUG(L"Update postponed, set timer with ID "<<backend->renderThreadTimerID<<L" for "<<delay<<L" ms");
+		return;
+	}
+	// Clear the timer ID before updating, so that any invalidations during the update arm a new timer.
+	backend->renderThreadTimerID=0;
+	if(delay<0) {
+		LOG_DEBUG(L"No update pending");
+		return;
+	}
 	LOG_DEBUG(L"Calling update on backend at "<<backend);
 	backend->update();
-	backend->renderThreadTimerID=0;
+}
+
+void CALLBACK VBufBackend_t::renderThread_idleTimerProc(HWND hwnd, UINT msg, UINT_PTR timerID, DWORD time) {
+	int threadID=GetCurrentThreadId();
+	for(VBufBackendSet_t::iterator i=runningBackends.begin();i!=runningBackends.end();++i) {
+		if((*i)->renderThreadID==threadID&&(*i)->idleTimerID==timerID) {
+			(*i)->freezeIfIdle();
+			return;
+		}
+	}
+}
+
+void VBufBackend_t::freezeIfIdle() {
+	this->lock.acquire();
+	if(idleFreezeTimeout>0&&!isFrozen()&&hasContent()&&renderThreadTimerID==0&&invalidSubtreeList.empty()) {
+		long long idleTime=VBufMetrics_getMicroseconds()-lastAccessTime;
+		if(idleTime>=static_cast<long long>(idleFreezeTimeout)*1000) {
+			LOG_DEBUG(L"Backend at "<<this<<L" idle for "<<idleTime<<L" microseconds, freezing");
+			this->freeze();
+		}
+	}
+	this->lock.release();
+}
+
+void VBufBackend_t::setIdleFreezeTimeout(int milliseconds) {
+	this->lock.acquire();
+	idleFreezeTimeout=max(milliseconds,0);
+	this->lock.release();
 }
 
 void VBufBackend_t::renderThread_initialize() {
@@ -127,10 +274,16 @@ void VBufBackend_t::renderThread_initialize() {
 	LOG_DEBUG(L"Calling update on backend at "<<this);
 	this->update();
 	runningBackends.insert(this);
+	idleTimerID=SetTimer(0,0,VBufBackend_idleCheckInterval,renderThread_idleTimerProc);
+	nhAssert(idleTimerID);
 }
 
 void VBufBackend_t::renderThread_terminate() {
 	cancelPendingUpdate();
+	if(idleTimerID!=0) {
+		KillTimer(0,idleTimerID);
+		idleTimerID=0;
+	}
 	unregisterWinEventHook(renderThread_winEventProcHook);
 	LOG_DEBUG(L"Unregistered winEvent hook for window destructions");
 	LOG_DEBUG(L"Calling clearBuffer on backend at "<<this);
@@ -181,12 +334,68 @@ bool VBufBackend_t::invalidateSubtree(VBufStorage_controlFieldNode_t* node) {
 	return true;
 }
 
+void VBufBackend_t::deferSubtreesFarFromSelection(VBufStorage_controlFieldNodeList_t& subtrees, list<VBufStorage_controlFieldNodeIdentifier_t>& deferredIdentifiers) {
+	if(!prioritizeNearSelection||subtrees.size()<2) {
+		consecutiveDeferredUpdates=0;
+		return;
+	}
+	if(consecutiveDeferredUpdates>=maxConsecutiveDeferredUpdates) {
+		LOG_DEBUG(L"Already deferred "<<consecutiveDeferredUpdates<<L" updates, rendering all subtrees");
+		consecutiveDeferredUpdates=0;
+		return;
+	}
+	VBufStorage_controlFieldNodeList_t nearSubtrees;
+	VBufStorage_controlFieldNodeList_t farSubtrees;
+	for(VBufStorage_controlFieldNodeList_t::iterator i=subtrees.begin();i!=subtrees.end();++i) {
+		int startOffset=0, endOffset=0;
+		if(!getFieldNodeOffsets(*i,&startOffset,&endOffset)) {
+			nearSubtrees.push_back(*i);
+			continue;
+		}
+		int distance=0;
+		if(selectionStart<startOffset) {
+			distance=startOffset-selectionStart;
+		} else if(selectionStart>=endOffset) {
+			distance=selectionStart-endOffset+1;
+		}
+		if(distance<=nearSelectionDistance) {
+			nearSubtrees.push_back(*i);
+		} else {
+			farSubtrees.push_back(*i);
+		}
+	}
+	if(nearSubtrees.empty()||farSubtrees.empty()) {
+		consecutiveDeferredUpdates=0;
+		return;
+	}
+	LOG_DEBUG(L"Rendering "<<nearSubtrees.size()<<L" subtrees near the selection, deferring "<<farSubtrees.size());
+	for(VBufStorage_controlFieldNodeList_t::iterator i=farSubtrees.begin();i!=farSubtrees.end();++i) {
+		int docHandle=0, ID=0;
+		(*i)->getIdentifier(&docHandle,&ID);
+		deferredIdentifiers.push_back(VBufStorage_controlFieldNodeIdentifier_t(docHandle,ID));
+	}
+	subtrees.swap(nearSubtrees);
+	++consecutiveDeferredUpdates;
+}
+
 void VBufBackend_t::update() {
+	TRACE_SCOPE("VBufBackend_t::update");
 	if(this->hasContent()) {
+		long long startTime=VBufMetrics_getMicroseconds();
 		VBufStorage_controlFieldNodeList_t tempSubtreeList;
+		list<VBufStorage_controlFieldNodeIdentifier_t> deferredIdentifiers;
+		//Nodes removed by the last update, which rendering reuses for the controls it renders again.
+		//Any not reused are deleted once this update is done.
+		VBufStorage_nodePool_t nodePool;
 		this->lock.acquire();
+		lastAccessTime=VBufMetrics_getMicroseconds();
+		// Rendering may read the nodes being replaced, so they must have their text and attributes back.
+		if(this->isFrozen()) this->thaw();
+		updateScheduler.updateStarted();
 		LOG_DEBUG(L"Updating "<<invalidSubtreeList.size()<<L" subtrees");
 		invalidSubtreeList.swap(tempSubtreeList);
+		deferSubtreesFarFromSelection(tempSubtreeList,deferredIdentifiers);
+		this->takeRetiredNodes(nodePool);
 		this->lock.release();
 		map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> replacementSubtreeMap;
 		//render all invalid subtrees, storing each subtree in its own buffer
@@ -196,25 +405,57 @@ void VBufBackend_t::update() {
 			VBufStorage_buffer_t* tempBuf=new VBufStorage_buffer_t();
 			nhAssert(tempBuf); //tempBuf can't be NULL
 			LOG_DEBUG(L"Created temp buffer at "<<tempBuf);
+			tempBuf->setNodePool(&nodePool);
 			int docHandle=0, ID=0;
 			node->getIdentifier(&docHandle,&ID);
 			LOG_DEBUG(L"subtree node has docHandle "<<docHandle<<L" and ID "<<ID);
 			LOG_DEBUG(L"Rendering content");
-			render(tempBuf,docHandle,ID,node);
+			{
+				TRACE_SCOPE("VBufBackend_t::render");
+				render(tempBuf,docHandle,ID,node);
+			}
+			tempBuf->setNodePool(NULL);
 			LOG_DEBUG(L"Rendered content in temp buffer");
 			replacementSubtreeMap.insert(make_pair(node,tempBuf));
 		}
 		this->lock.acquire();
+		// Metrics are read under the lock from other threads, so the temp buffers are counted only once it is held, before they are emptied in to this buffer.
+		for(map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>::iterator i=replacementSubtreeMap.begin();i!=replacementSubtreeMap.end();++i) {
+			countRenderedContent(i->second);
+		}
 		LOG_DEBUG(L"Replacing nodes with content of temp buffers");
 		if(!this->replaceSubtrees(replacementSubtreeMap)) {
 			LOG_DEBUGWARNING(L"Error replacing one or more subtrees");
 		}
+		updateScheduler.updateFinished();
+		long long updateTime=VBufMetrics_getMicroseconds()-startTime;
+		++metrics.updateCount;
+		metrics.updateTime+=updateTime;
+		metrics.maxUpdateTime=max(metrics.maxUpdateTime,updateTime);
+		metrics.subtreesReplaced+=replacementSubtreeMap.size();
 		this->lock.release();
+		// Subtrees far from the selection were not rendered in this update.
+		// Their nodes may have been replaced along with the near subtrees, so find them again by identifier and invalidate them for the next update.
+		if(!deferredIdentifiers.empty()) {
+			this->lock.acquire();
+			for(list<VBufStorage_controlFieldNodeIdentifier_t>::iterator i=deferredIdentifiers.begin();i!=deferredIdentifiers.end();++i) {
+				VBufStorage_controlFieldNode_t* node=this->getControlFieldNodeWithIdentifier(i->docHandle,i->ID);
+				if(node) this->invalidateSubtree(node);
+			}
+			this->lock.release();
+		}
 		nvdaControllerInternal_vbufChangeNotify(this->rootDocHandle,this->rootID);
 	} else {
 		LOG_DEBUG(L"Initial render");
 		this->lock.acquire();
-		render(this,rootDocHandle,rootID);
+		long long startTime=VBufMetrics_getMicroseconds();
+		{
+			TRACE_SCOPE("VBufBackend_t::render");
+			render(this,rootDocHandle,rootID);
+		}
+		this->shareNewContent(this->rootNode);
+		metrics.initialRenderTime=VBufMetrics_getMicroseconds()-startTime;
+		countRenderedContent(this);
 		this->lock.release();
 	}
 	LOG_DEBUG(L"Update complete");
@@ -16,10 +16,12 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #define VIRTUALBUFFER_BACKEND_H
 
 #include <set>
+#include <list>
 #define WIN32_LEAN_AND_MEAN 
 #include <windows.h>
 #include "storage.h"
-#include <common/lock.h>
+#include "updateScheduler.h"
+#include "metrics.h"
 
 class VBufBackend_t;
 
@@ -57,6 +59,56 @@ static LRESULT CALLBACK destroy_callWndProcHook(int code, WPARAM wParam, LPARAM
  */
 	VBufStorage_controlFieldNodeList_t invalidSubtreeList;
 
+/**
+ * The number of consecutive updates that have deferred subtrees far from the selection.
+ */
+	int consecutiveDeferredUpdates;
+
+/**
+ * If prioritizing subtrees near the selection, removes from the given list any subtrees too far from the selection, as long as at least one near subtree remains.
+ * @param subtrees the list of invalid subtrees about to be re-rendered.
+ * @param deferredIdentifiers memory where the identifiers of the removed subtrees are placed, so they can be invalidated again after the near subtrees are applied.
+ */
+	void deferSubtreesFarFromSelection(VBufStorage_controlFieldNodeList_t& subtrees, std::list<VBufStorage_controlFieldNodeIdentifier_t>& deferredIdentifiers);
+
+/**
+ * Counts the rendering work done by this backend.
+ */
+	VBufBackendMetrics_t metrics;
+
+/**
+ * The ID of the timer that regularly checks whether this backend has been idle long enough to be frozen.
+ */
+	UINT_PTR idleTimerID;
+
+/**
+ * A timer callback that freezes the backend if it has been idle long enough.
+ */
+	static void CALLBACK renderThread_idleTimerProc(HWND hwnd, UINT msg, UINT_PTR timerID, DWORD time);
+
+/**
+ * How long the backend may go without being queried or updated before it is frozen, in milliseconds, or 0 to never freeze it.
+ */
+	int idleFreezeTimeout;
+
+/**
+ * The time, as given by VBufMetrics_getMicroseconds, the backend was last queried or updated.
+ */
+	long long lastAccessTime;
+
+/**
+ * Freezes the buffer if it has not been queried or updated for idleFreezeTimeout and no update is pending, see VBufStorage_buffer_t::freeze.
+ * Only called in the render thread, so that the buffer is never frozen while rendering reads the nodes being replaced.
+ */
+	void freezeIfIdle();
+
+/**
+ * Adds the content of a freshly rendered buffer to the rendering metrics.
+ * Must be called with lock held.
+ * @param buffer the buffer that was rendered in to.
+ */
+	void countRenderedContent(const VBufStorage_buffer_t* buffer);
+
 	protected:
 
 /**
@@ -69,8 +121,33 @@ static LRESULT CALLBACK destroy_callWndProcHook(int code, WPARAM wParam, LPARAM
  */
 	const int renderThreadID;
 
+/**
+ * Decides how long to wait before updating invalid nodes.
+ * Backends can change its policy in their constructor.
+ * Stats are read from other threads, so after construction it is only used with lock held.
+ */
+	VBufUpdateScheduler_t updateScheduler;
+
+/**
+ * If true, when some invalid subtrees contain or are near the selection, only those are rendered and applied in an update,
+ * and the rest are deferred to a following update.
+ * This lowers the latency of changes near the user on pages with churn elsewhere, E.g. tickers or ads.
+ */
+	bool prioritizeNearSelection;
+
+/**
+ * How many characters a subtree may be from the selection and still be considered near it.
+ */
+	int nearSelectionDistance;
+
+/**
+ * The most updates in a row that may defer far subtrees before an update must render all invalid subtrees, so that distant changes are never starved.
+ */
+	int maxConsecutiveDeferredUpdates;
+
 /**
  * Requests that the backend should update any invalid nodes  when it can in the next little while.
+ * The delay is chosen by the backend's update scheduler.
  */
 	void requestUpdate();
 
@@ -146,6 +223,35 @@ static LRESULT CALLBACK destroy_callWndProcHook(int code, WPARAM wParam, LPARAM
  */
 	virtual void forceUpdate();
 
+/**
+ * Fetches the counters of this backend's update scheduler.
+ * @param stats memory where the counters should be placed.
+ */
+	void getUpdateSchedulerStats(VBufUpdateSchedulerStats_t* stats);
+
+/**
+ * Sets how long the backend may go without being queried or updated before it is frozen to save memory.
+ * It is thawed again by the next query or update.
+ * @param milliseconds the time, or 0 to never freeze the backend, which is the default.
+ */
+	virtual void setIdleFreezeTimeout(int milliseconds);
+
+/**
+ * Acquires the lock for a query from a client, thawing the buffer first if it was frozen while idle.
+ * Callers outside the backend must use this rather than acquiring the lock directly before reading the buffer.
+ */
+	void acquireForQuery() {
+		lock.acquire();
+		lastAccessTime=VBufMetrics_getMicroseconds();
+		if(isFrozen()) thaw();
+	}
+
+/**
+ * Fetches metrics about this backend's rendering, its current content and its lock, for diagnosing slow buffers.
+ * @return a text container holding name:value pairs separated by semi colons, which must be destroyed by the caller.
+ */
+	virtual VBufStorage_textContainer_t* getMetrics();
+
 /**
  * Clears the content of the backend and terminates any code used for rendering.
  */
@@ -157,9 +263,10 @@ static LRESULT CALLBACK destroy_callWndProcHook(int code, WPARAM wParam, LPARAM
 	virtual void destroy();
 
  /**
- * Useful for cerializing access to the buffer
+ * Useful for cerializing access to the buffer.
+ * Times waits and holds so they can be reported in the backend's metrics.
  */
-	LockableObject lock;
+	VBufTimedLock_t lock;
 
 };
 
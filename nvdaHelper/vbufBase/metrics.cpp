@@ -0,0 +1,30 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2017 NV Access Limited
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include "metrics.h"
+
+VBufTimedLockStats_t::VBufTimedLockStats_t(): acquisitions(0), waitTime(0), maxWaitTime(0), holdTime(0), maxHoldTime(0) {
+}
+
+VBufTimedLock_t::VBufTimedLock_t(): LockableObject(), depth(0), acquiredTime(0), stats() {
+}
+
+void VBufTimedLock_t::getStats(VBufTimedLockStats_t* statsArg) const {
+	*statsArg=stats;
+}
+
+VBufBackendMetrics_t::VBufBackendMetrics_t(): initialRenderTime(0), updateCount(0), updateTime(0), maxUpdateTime(0), nodesRendered(0), subtreesReplaced(0), textBytesRendered(0), attributeBytesRendered(0) {
+}
@@ -0,0 +1,168 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2017 NV Access Limited
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_METRICS_H
+#define VIRTUALBUFFER_METRICS_H
+
+#include <string>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <common/lock.h>
+
+// The functions used by callers of a backend's lock are defined inline in this file,
+// as nvdaHelperRemote locks backends without linking vbufBase.
+
+/**
+ * Fetches the current time from the performance counter.
+ * @return the time in microseconds, from an arbitrary but fixed starting point.
+ */
+inline long long VBufMetrics_getMicroseconds() {
+	static long long frequency=0;
+	if(frequency==0) {
+		LARGE_INTEGER li;
+		if(!QueryPerformanceFrequency(&li)||li.QuadPart==0) {
+			return static_cast<long long>(GetTickCount())*1000;
+		}
+		frequency=li.QuadPart;
+	}
+	LARGE_INTEGER li;
+	QueryPerformanceCounter(&li);
+	// Split the conversion so that multiplying by a million can not overflow.
+	return (li.QuadPart/frequency)*1000000+((li.QuadPart%frequency)*1000000)/frequency;
+}
+
+/**
+ * Counters describing how a timed lock has been used. Times are in microseconds.
+ */
+class VBufTimedLockStats_t {
+	public:
+
+/**
+ * The number of times the lock was acquired by a thread not already holding it.
+ */
+	unsigned long long acquisitions;
+
+/**
+ * The total and longest time spent waiting for the lock to become free.
+ */
+	long long waitTime;
+	long long maxWaitTime;
+
+/**
+ * The total and longest time the lock was held, from the outermost acquire to the matching release.
+ */
+	long long holdTime;
+	long long maxHoldTime;
+
+	VBufTimedLockStats_t();
+
+};
+
+/**
+ * A lock that records how long threads wait for it and how long they hold it.
+ * The lock is reentrant for the same thread; only the outermost acquire and release of a thread are timed.
+ */
+class VBufTimedLock_t: public LockableObject {
+	private:
+
+/**
+ * How many times the thread holding the lock has acquired it without releasing.
+ * Only ever touched while the lock is held.
+ */
+	int depth;
+
+/**
+ * The time the outermost acquire by the holding thread completed.
+ */
+	long long acquiredTime;
+
+	VBufTimedLockStats_t stats;
+
+	public:
+
+	VBufTimedLock_t();
+
+/**
+ * Acquires access (possibly waiting until its free), timing the wait.
+ */
+	void acquire() {
+		long long startTime=VBufMetrics_getMicroseconds();
+		LockableObject::acquire();
+		if(depth++>0) return;
+		acquiredTime=VBufMetrics_getMicroseconds();
+		long long waitTime=acquiredTime-startTime;
+		++stats.acquisitions;
+		stats.waitTime+=waitTime;
+		if(waitTime>stats.maxWaitTime) stats.maxWaitTime=waitTime;
+	}
+
+/**
+ * Releases exclusive access of the object, timing how long it was held.
+ */
+	void release() {
+		if(--depth==0) {
+			long long holdTime=VBufMetrics_getMicroseconds()-acquiredTime;
+			stats.holdTime+=holdTime;
+			if(holdTime>stats.maxHoldTime) stats.maxHoldTime=holdTime;
+		}
+		LockableObject::release();
+	}
+
+/**
+ * Fetches the lock's counters. The lock should be held by the caller, so the hold in progress is not included.
+ * @param stats memory where the counters should be placed.
+ */
+	void getStats(VBufTimedLockStats_t* stats) const;
+
+};
+
+/**
+ * Counters describing the rendering work done by a backend. Times are in microseconds.
+ */
+class VBufBackendMetrics_t {
+	public:
+
+/**
+ * How long the initial render of the whole document took.
+ */
+	long long initialRenderTime;
+
+/**
+ * The number of updates that re-rendered invalid subtrees, and the total and longest time they took, including rendering and replacing.
+ */
+	unsigned int updateCount;
+	long long updateTime;
+	long long maxUpdateTime;
+
+/**
+ * The number of nodes rendered, by the initial render and all updates.
+ */
+	unsigned long long nodesRendered;
+
+/**
+ * The number of subtrees replaced by updates.
+ */
+	unsigned long long subtreesReplaced;
+
+/**
+ * The bytes of text and of attribute names and values rendered, by the initial render and all updates.
+ */
+	unsigned long long textBytesRendered;
+	unsigned long long attributeBytesRendered;
+
+	VBufBackendMetrics_t();
+
+};
+
+#endif
@@ -12,6 +12,8 @@ This license can be found at:
 http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
+#define LOG_CATEGORY LOGCATEGORY_STORAGE
+
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -23,14 +25,43 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <vector>
 #include <sstream>
 #include <algorithm>
+#include <climits>
+#include <cwchar>
+#include <cwctype>
 #include <common/xml.h>
 #include <common/log.h>
+#include <common/memoryUsage.h>
+#include <remote/trace.h>
+#include "metrics.h"
 #include "utils.h"
 #include "storage.h"
 
+//Text searches compare a block of characters at a time with SSE2 where the processor has it.
+//Every 64 bit processor does, but 32 bit builds support processors without it, so check for it when first searching.
+#if defined(_M_X64)||defined(__SSE2__)
+#include <emmintrin.h>
+#define VBUFSTORAGE_SSE2
+inline bool canUseSSE2() { return true; }
+#elif defined(_M_IX86)
+#include <emmintrin.h>
+#include <intrin.h>
+#define VBUFSTORAGE_SSE2
+bool canUseSSE2() {
+	static int hasSSE2=-1;
+	if(hasSSE2<0) {
+		int cpuInfo[4];
+		__cpuid(cpuInfo,1);
+		hasSSE2=(cpuInfo[3]&(1<<26))?1:0;
+	}
+	return hasSSE2!=0;
+}
+#endif
+
 using namespace std;
 
-VBufStorage_textContainer_t::VBufStorage_textContainer_t(wstring str): wstring(str) {}
+const VBufStorage_attributeMap_t VBufStorage_noAttributes;
+
+VBufStorage_textContainer_t::VBufStorage_textContainer_t(wstring str): wstring(move(str)) {}
 
 VBufStorage_textContainer_t::~VBufStorage_textContainer_t() {}
 
@@ -63,14 +94,110 @@ bool VBufStorage_controlFieldNodeIdentifier_t::operator==(const VBufStorage_cont
 	return (this->docHandle==other.docHandle)&&(this->ID==other.ID);
 }
 
+//frozen content implementation
+
+/**
+ * Appends a character to frozen text as UTF-8.
+ * Each character is encoded on its own, so surrogates are kept as they are rather than being combined, and the text is restored exactly.
+ */
+void appendFrozenChar(wchar_t c, std::string& frozenText) {
+	unsigned int code=static_cast<unsigned int>(c);
+	if(code<0x80) {
+		frozenText+=static_cast<char>(code);
+	} else if(code<0x800) {
+		frozenText+=static_cast<char>(0xc0|(code>>6));
+		frozenText+=static_cast<char>(0x80|(code&0x3f));
+	} else if(code<0x10000) {
+		frozenText+=static_cast<char>(0xe0|(code>>12));
+		frozenText+=static_cast<char>(0x80|((code>>6)&0x3f));
+		frozenText+=static_cast<char>(0x80|(code&0x3f));
+	} else {
+		// Only where wchar_t is wider than 16 bits.
+		frozenText+=static_cast<char>(0xf0|((code>>18)&0x07));
+		frozenText+=static_cast<char>(0x80|((code>>12)&0x3f));
+		frozenText+=static_cast<char>(0x80|((code>>6)&0x3f));
+		frozenText+=static_cast<char>(0x80|(code&0x3f));
+	}
+}
+
+/**
+ * Reads a character appended to frozen text by appendFrozenChar.
+ * @param pos the position of the character in frozenText, which is moved past it.
+ */
+wchar_t readFrozenChar(const std::string& frozenText, size_t* pos) {
+	unsigned int code=static_cast<unsigned char>(frozenText[(*pos)++]);
+	if(code<0x80) return static_cast<wchar_t>(code);
+	int continuationCount;
+	if(code<0xe0) {
+		code&=0x1f;
+		continuationCount=1;
+	} else if(code<0xf0) {
+		code&=0x0f;
+		continuationCount=2;
+	} else {
+		code&=0x07;
+		continuationCount=3;
+	}
+	for(;continuationCount>0;--continuationCount) {
+		code=(code<<6)|(static_cast<unsigned char>(frozenText[(*pos)++])&0x3f);
+	}
+	return static_cast<wchar_t>(code);
+}
+
+/**
+ * Appends a number to the frozen attributes, in as few bytes as it needs.
+ */
+void appendFrozenNumber(unsigned int number, std::string& frozenAttributes) {
+	for(;number>=0x80;number>>=7) {
+		frozenAttributes+=static_cast<char>(0x80|(number&0x7f));
+	}
+	frozenAttributes+=static_cast<char>(number);
+}
+
+/**
+ * Reads a number appended to the frozen attributes by appendFrozenNumber.
+ * @param pos the position of the number in frozenAttributes, which is moved past it.
+ */
+unsigned int readFrozenNumber(const std::string& frozenAttributes, size_t* pos) {
+	unsigned int number=0;
+	for(int shift=0;;shift+=7) {
+		unsigned int byte=static_cast<unsigned char>(frozenAttributes[(*pos)++]);
+		number|=(byte&0x7f)<<shift;
+		if(byte<0x80) return number;
+	}
+}
+
+/**
+ * Fetches the index of a string in the strings of frozen content, adding it if it is not there yet.
+ * @param indexes the index of each string already added.
+ */
+unsigned int internFrozenString(const std::wstring& str, map<wstring,unsigned int>& indexes, vector<wstring>& strings) {
+	map<wstring,unsigned int>::iterator i=indexes.find(str);
+	if(i!=indexes.end()) return i->second;
+	unsigned int index=static_cast<unsigned int>(strings.size());
+	strings.push_back(str);
+	indexes.insert(make_pair(str,index));
+	return index;
+}
+
+VBufStorage_freezeStats_t::VBufStorage_freezeStats_t(): freezeCount(0), thawCount(0), thawTime(0), maxThawTime(0), unfrozenBytes(0), frozenBytes(0) {
+}
+
+VBufStorage_memoryUsage_t::VBufStorage_memoryUsage_t(): nodes(0), text(0), attributes(0), identifierIndex(0), otherIndexes(0) {
+}
+
+unsigned long long VBufStorage_memoryUsage_t::getTotal() const {
+	return nodes+text+attributes+identifierIndex+otherIndexes;
+}
+
 //field  node implementation
 
-VBufStorage_fieldNode_t* VBufStorage_fieldNode_t::nextNodeInTree(int direction, VBufStorage_fieldNode_t* limitNode, int *relativeStartOffset) {
+VBufStorage_fieldNode_t* VBufStorage_fieldNode_t::nextNodeInTree(int direction, VBufStorage_fieldNode_t* limitNode, int *relativeStartOffset, unsigned int skipUnless) {
 	int relativeOffset=0;
 	VBufStorage_fieldNode_t* tempNode=this;
 	if(direction==TREEDIRECTION_FORWARD) {
 		LOG_DEBUG(L"moving forward");
-		if(tempNode->firstChild!=NULL) {
+		if(tempNode->firstChild!=NULL&&!(skipUnless&&tempNode->canSkipDescendants(skipUnless))) {
 			LOG_DEBUG(L"Moving to first child");
 			tempNode=tempNode->firstChild;
 		} else {
@@ -93,7 +220,7 @@ VBufStorage_fieldNode_t* VBufStorage_fieldNode_t::nextNodeInTree(int direction,
 			if(tempNode->previous==limitNode) return NULL;
 			LOG_DEBUG(L"Using previous node");
 			tempNode=tempNode->previous;
-			while(tempNode->lastChild!=NULL&&tempNode->lastChild!=limitNode) {
+			while(tempNode->lastChild!=NULL&&tempNode->lastChild!=limitNode&&!(skipUnless&&tempNode->canSkipDescendants(skipUnless))) {
 				LOG_DEBUG(L"Using lastChild");
 				tempNode=tempNode->lastChild;
 			}
@@ -107,7 +234,7 @@ VBufStorage_fieldNode_t* VBufStorage_fieldNode_t::nextNodeInTree(int direction,
 		}
 	} else if(direction==TREEDIRECTION_SYMMETRICAL_BACK) {
 		LOG_DEBUG(L"Moving symmetrical backwards");
-		if(tempNode->lastChild!=NULL) {
+		if(tempNode->lastChild!=NULL&&!(skipUnless&&tempNode->canSkipDescendants(skipUnless))) {
 			LOG_DEBUG(L"Moving to last child");
 			tempNode=tempNode->lastChild;
 			relativeOffset=this->length-tempNode->length;
@@ -134,6 +261,51 @@ VBufStorage_fieldNode_t* VBufStorage_fieldNode_t::nextNodeInTree(int direction,
 	return tempNode;
 }
 
+unsigned int VBufStorage_fieldNode_t::getSubtreeFlags() {
+	if(this->subtreeFlags&VBufStorage_subtreeFlag_known) return this->subtreeFlags;
+	unsigned int flags=VBufStorage_subtreeFlag_known;
+	if(this->length>0) {
+		flags|=VBufStorage_subtreeFlag_hasLineContent;
+		if(!this->hidden) flags|=VBufStorage_subtreeFlag_hasVisible;
+	}
+	if(this->block) flags|=VBufStorage_subtreeFlag_hasLineContent;
+	for(VBufStorage_fieldNode_t* child=this->firstChild;child!=NULL;child=child->next) {
+		flags|=child->getSubtreeFlags();
+	}
+	this->subtreeFlags=flags;
+	return flags;
+}
+
+void VBufStorage_fieldNode_t::forgetSubtreeFlags() {
+	//An ancestor of a node whose summary is not known has no known summary either, so the walk can stop at the first such node.
+	for(VBufStorage_fieldNode_t* node=this;node!=NULL&&node->subtreeFlags!=0;node=node->parent) {
+		node->subtreeFlags=0;
+	}
+}
+
+bool VBufStorage_fieldNode_t::canSkipDescendants(unsigned int flag) {
+	//Nothing can be found in a subtree with no length, and everything can be in one whose root would be found itself.
+	if(flag==VBufStorage_subtreeFlag_hasVisible) {
+		if(this->length==0) return true;
+		if(!this->hidden) return false;
+	} else if(flag==VBufStorage_subtreeFlag_hasLineContent) {
+		if(this->length>0||this->block) return false;
+	}
+	return !(getSubtreeFlags()&flag);
+}
+
+void VBufStorage_fieldNode_t::setBlock(bool blockArg) {
+	if(blockArg==this->block) return;
+	this->block=blockArg;
+	forgetSubtreeFlags();
+}
+
+void VBufStorage_fieldNode_t::setHidden(bool hiddenArg) {
+	if(hiddenArg==this->hidden) return;
+	this->hidden=hiddenArg;
+	forgetSubtreeFlags();
+}
+
 inline void outputEscapedAttribute(wostringstream& out, const wstring& text) {
 	for (wstring::const_iterator it = text.begin(); it != text.end(); ++it) {
 		switch (*it) {
@@ -152,14 +324,63 @@ bool VBufStorage_fieldNode_t::matchAttributes(const std::vector<std::wstring>& a
 	for (vector<wstring>::const_iterator attribName = attribs.begin(); attribName != attribs.end(); ++attribName) {
 		outputEscapedAttribute(test, *attribName);
 		test << L":";
+		const VBufStorage_attributeMap_t& attributes=getAttributes();
 		VBufStorage_attributeMap_t::const_iterator foundAttrib = attributes.find(*attribName);
+		int typedValue;
 		if (foundAttrib != attributes.end())
 			outputEscapedAttribute(test, foundAttrib->second);
+		else if (findTypedAttribute(*attribName, &typedValue))
+			test << typedValue;
 		test << L";";
 	}
 	return regex_match(test.str(), regexp);
 }
 
+/**
+ * @return the name of a bit of a bitset typed attribute, see VBufStorage_fieldNode_t::addTypedAttribute.
+ */
+inline wstring getTypedAttributeBitName(const wchar_t* name, int bit) {
+	return name+to_wstring(static_cast<int>(1u<<bit));
+}
+
+/**
+ * Appends the names and values a typed attribute is presented with to a list, see VBufStorage_fieldNode_t::addTypedAttribute.
+ */
+void expandTypedAttribute(const VBufStorage_typedAttribute_t& attribute, vector<pair<wstring,wstring> >& expanded) {
+	if(attribute.type!=VBufStorage_attributeType_bitset) {
+		expanded.push_back(make_pair(wstring(attribute.name),to_wstring(attribute.value)));
+		return;
+	}
+	for(int i=0;i<32;++i) {
+		if(attribute.value&(1u<<i)) expanded.push_back(make_pair(getTypedAttributeBitName(attribute.name,i),wstring(L"1")));
+	}
+}
+
+bool VBufStorage_fieldNode_t::findTypedAttribute(const std::wstring& name, int* value) const {
+	if(!this->typedAttributes) return false;
+	for(VBufStorage_typedAttributeList_t::const_iterator i=this->typedAttributes->begin();i!=this->typedAttributes->end();++i) {
+		if(i->type!=VBufStorage_attributeType_bitset) {
+			if(name==i->name) {
+				*value=i->value;
+				return true;
+			}
+			continue;
+		}
+		size_t prefixLength=wcslen(i->name);
+		if(name.size()<=prefixLength||name.compare(0,prefixLength,i->name)!=0) continue;
+		wchar_t* end;
+		long bitValue=wcstol(name.c_str()+prefixLength,&end,10);
+		if(*end!=L'\0') continue;
+		for(int bit=0;bit<32;++bit) {
+			if(static_cast<long>(static_cast<int>(1u<<bit))!=bitValue) continue;
+			if(!(i->value&(1u<<bit))||getTypedAttributeBitName(i->name,bit)!=name) return false;
+			*value=1;
+			return true;
+		}
+	}
+	return false;
+}
+
 int VBufStorage_fieldNode_t::calculateOffsetInTree() const {
 	int startOffset=0;
 	for(VBufStorage_fieldNode_t* previous=this->previous;previous!=NULL;previous=previous->previous) {
@@ -196,8 +417,8 @@ void VBufStorage_fieldNode_t::generateAttributesForMarkupOpeningTag(std::wstring
 	wostringstream s;
 	s<<L"_startOfNode=\""<<(startOffset==0?1:0)<<L"\" ";
 	s<<L"_endOfNode=\""<<(endOffset>=this->length?1:0)<<L"\" ";
-	s<<L"isBlock=\""<<this->isBlock<<L"\" ";
-	s<<L"isHidden=\""<<this->isHidden<<L"\" ";
+	s<<L"isBlock=\""<<this->block<<L"\" ";
+	s<<L"isHidden=\""<<this->hidden<<L"\" ";
 	int childCount=0;
 	int childControlCount=0;
 	for(VBufStorage_fieldNode_t* child=this->firstChild;child!=NULL;child=child->next) {
@@ -215,14 +436,26 @@ void VBufStorage_fieldNode_t::generateAttributesForMarkupOpeningTag(std::wstring
 	}
 	s<<L"_childcount=\""<<childCount<<L"\" _childcontrolcount=\""<<childControlCount<<L"\" _indexInParent=\""<<indexInParent<<L"\" _parentChildCount=\""<<parentChildCount<<L"\" ";
 	text+=s.str();
-	for(VBufStorage_attributeMap_t::iterator i=this->attributes.begin();i!=this->attributes.end();++i) {
+	const VBufStorage_attributeMap_t& attributes=getAttributes();
+	for(VBufStorage_attributeMap_t::const_iterator i=attributes.begin();i!=attributes.end();++i) {
 		text+=sanitizeXMLAttribName(i->first);
 		text+=L"=\"";
-		for(std::wstring::iterator j=i->second.begin();j!=i->second.end();++j) {
+		for(std::wstring::const_iterator j=i->second.begin();j!=i->second.end();++j) {
 			appendCharToXML(*j,text,true);
 		}
 		text+=L"\" ";
 	}
+	if(!this->typedAttributes) return;
+	vector<pair<wstring,wstring> > expanded;
+	for(VBufStorage_typedAttributeList_t::const_iterator i=this->typedAttributes->begin();i!=this->typedAttributes->end();++i) {
+		expandTypedAttribute(*i,expanded);
+	}
+	for(vector<pair<wstring,wstring> >::const_iterator i=expanded.begin();i!=expanded.end();++i) {
+		text+=sanitizeXMLAttribName(i->first);
+		text+=L"=\"";
+		text+=i->second;
+		text+=L"\" ";
+	}
 }
 
 void VBufStorage_fieldNode_t::generateMarkupOpeningTag(std::wstring& text, int startOffset, int endOffset) {
@@ -239,11 +472,15 @@ void VBufStorage_fieldNode_t::generateMarkupClosingTag(std::wstring& text) {
 	text+=L">";
 }
 
-void VBufStorage_fieldNode_t::getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup, bool(*filter)(VBufStorage_fieldNode_t*)) {
+void VBufStorage_fieldNode_t::getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup, bool(*filter)(VBufStorage_fieldNode_t*), VBufStorage_deadline_t* deadline) {
 	if(this->length==0) {
 		LOG_DEBUG(L"node has 0 length, not collecting text");
 		return;
 	}
+	if(deadline&&deadline->hasExpired()) {
+		LOG_DEBUG(L"deadline expired, not collecting text");
+		return;
+	}
 	LOG_DEBUG(L"getting text between offsets "<<startOffset<<L" and "<<endOffset);
 	nhAssert(startOffset>=0); //startOffset can't be negative
 	nhAssert(startOffset<endOffset); //startOffset must be before endOffset
@@ -262,7 +499,7 @@ void VBufStorage_fieldNode_t::getTextInRange(int startOffset, int endOffset, std
 		LOG_DEBUG(L"child with offsets of "<<childStart<<L" and "<<childEnd); 
 		if(childEnd>startOffset&&endOffset>childStart&&(!filter||filter(child))) {
 			LOG_DEBUG(L"child offsets overlap requested offsets");
-			child->getTextInRange(max(startOffset,childStart)-childStart,min(endOffset-childStart,childLength),text,useMarkup,filter);
+			child->getTextInRange(max(startOffset,childStart)-childStart,min(endOffset-childStart,childLength),text,useMarkup,filter,deadline);
 		}
 		childStart+=childLength;
 		LOG_DEBUG(L"childStart is now "<<childStart);
@@ -278,23 +515,164 @@ void VBufStorage_fieldNode_t::disassociateFromBuffer(VBufStorage_buffer_t* buffe
 	LOG_DEBUG(L"Disassociating fieldNode from buffer");
 }
 
-VBufStorage_fieldNode_t::VBufStorage_fieldNode_t(int lengthArg, bool isBlockArg): parent(NULL), previous(NULL), next(NULL), firstChild(NULL), lastChild(NULL), length(lengthArg), isBlock(isBlockArg), isHidden(false), updateAncestor(NULL), attributes() {
+bool VBufStorage_fieldNode_t::recycle(VBufStorage_nodePool_t* pool) {
+	return false;
+}
+
+const std::wstring* VBufStorage_fieldNode_t::getContentText() const {
+	return NULL;
+}
+
+size_t VBufStorage_fieldNode_t::hashContent() const {
+	std::hash<wstring> hashString;
+	size_t hash=length*4+(block?2:0)+(hidden?1:0);
+	hash=hash*31+reinterpret_cast<size_t>(attributes);
+	if(typedAttributes) {
+		for(VBufStorage_typedAttributeList_t::const_iterator i=typedAttributes->begin();i!=typedAttributes->end();++i) {
+			hash=hash*31+hashString(i->name);
+			hash=hash*31+static_cast<size_t>(i->value);
+		}
+	}
+	const std::wstring* contentText=getContentText();
+	if(contentText) hash=hash*31+hashString(*contentText)+1;
+	return hash;
+}
+
+bool VBufStorage_fieldNode_t::hasSameContent(const VBufStorage_fieldNode_t* other) const {
+	if(length!=other->length||block!=other->block||hidden!=other->hidden||attributes!=other->attributes) return false;
+	size_t typedCount=typedAttributes?typedAttributes->size():0;
+	if(typedCount!=(other->typedAttributes?other->typedAttributes->size():0)) return false;
+	for(size_t i=0;i<typedCount;++i) {
+		const VBufStorage_typedAttribute_t& a=(*typedAttributes)[i];
+		const VBufStorage_typedAttribute_t& b=(*other->typedAttributes)[i];
+		if(a.type!=b.type||a.value!=b.value||wcscmp(a.name,b.name)!=0) return false;
+	}
+	const std::wstring* contentText=getContentText();
+	const std::wstring* otherContentText=other->getContentText();
+	if(!contentText||!otherContentText) return contentText==otherContentText;
+	return *contentText==*otherContentText;
+}
+
+void VBufStorage_fieldNode_t::shareContent(VBufStorage_fieldNode_t* other) {
+}
+
+size_t VBufStorage_fieldNode_t::freezeText(std::string& frozenText) {
+	return 0;
+}
+
+void VBufStorage_fieldNode_t::thawText(const std::string& frozenText, size_t* pos) {
+}
+
+/**
+ * @return the memory used by an attribute set and its names and values.
+ */
+size_t getAttributeSetMemoryUsage(const VBufStorage_attributeSet_t& set) {
+	size_t usage=sizeof(VBufStorage_attributeSet_t)+memoryUsage_tree<VBufStorage_attributeMap_t::value_type>(set.attributes.size());
+	for(VBufStorage_attributeMap_t::const_iterator i=set.attributes.begin();i!=set.attributes.end();++i) {
+		usage+=memoryUsage_string(i->first)+memoryUsage_string(i->second);
+	}
+	return usage;
+}
+
+void VBufStorage_fieldNode_t::getMemoryUsage(VBufStorage_memoryUsage_t* usage) const {
+	if(this->typedAttributes) usage->attributes+=sizeof(VBufStorage_typedAttributeList_t)+memoryUsage_vector(*this->typedAttributes);
+	//Shared sets are counted once by the buffer.
+	if(this->attributes&&!this->attributes->pool) usage->attributes+=getAttributeSetMemoryUsage(*this->attributes);
+}
+
+VBufStorage_fieldNode_t::VBufStorage_fieldNode_t(int lengthArg, bool isBlockArg): parent(NULL), previous(NULL), next(NULL), firstChild(NULL), lastChild(NULL), length(lengthArg), block(isBlockArg), hidden(false), subtreeFlags(0), recyclable(false), attributes(NULL), typedAttributes(NULL), updateAncestor(NULL) {
 	LOG_DEBUG(L"field node initialization at "<<this<<L"length is "<<length);
 }
 
 VBufStorage_fieldNode_t::~VBufStorage_fieldNode_t() {
 	LOG_DEBUG(L"fieldNode being destroied");
+	releaseAttributes();
+	delete this->typedAttributes;
+}
+
+void VBufStorage_fieldNode_t::releaseAttributes() {
+	VBufStorage_attributeSet_t* set=this->attributes;
+	if(!set) return;
+	this->attributes=NULL;
+	if(--(set->refCount)>0) return;
+	set->leavePool();
+	delete set;
+}
+
+VBufStorage_attributeSet_t* VBufStorage_fieldNode_t::getWritableAttributes() {
+	if(!this->attributes) {
+		this->attributes=new VBufStorage_attributeSet_t();
+	} else if(this->attributes->refCount>1) {
+		LOG_DEBUG(L"Copying shared attribute set");
+		VBufStorage_attributeSet_t* set=new VBufStorage_attributeSet_t();
+		set->attributes=this->attributes->attributes;
+		releaseAttributes();
+		this->attributes=set;
+	} else {
+		this->attributes->leavePool();
+	}
+	return this->attributes;
 }
 
-bool VBufStorage_fieldNode_t::addAttribute(const std::wstring& name, const std::wstring& value) {
+bool VBufStorage_fieldNode_t::addAttribute(std::wstring name, std::wstring value) {
 	LOG_DEBUG(L"Adding attribute "<<name<<L" with value "<<value);
-	this->attributes[name]=value;
+	VBufStorage_attributeMap_t& attributes=getWritableAttributes()->attributes;
+	VBufStorage_attributeMap_t::iterator i=attributes.lower_bound(name);
+	if(i!=attributes.end()&&i->first==name) {
+		i->second=move(value);
+	} else {
+		attributes.insert(i,make_pair(move(name),move(value)));
+	}
 	return true;
 }
 
+bool VBufStorage_fieldNode_t::addAttribute(std::wstring name, const wchar_t* value, size_t valueLength) {
+	return addAttribute(move(name),wstring(value,valueLength));
+}
+
+void VBufStorage_fieldNode_t::setAttributes(VBufStorage_attributeMap_t attributesArg) {
+	LOG_DEBUG(L"Setting "<<attributesArg.size()<<L" attributes");
+	if(attributesArg.empty()) return;
+	if(!this->attributes) {
+		this->attributes=new VBufStorage_attributeSet_t();
+		this->attributes->attributes.swap(attributesArg);
+		return;
+	}
+	VBufStorage_attributeMap_t& attributes=getWritableAttributes()->attributes;
+	for(VBufStorage_attributeMap_t::iterator i=attributesArg.begin();i!=attributesArg.end();++i) {
+		attributes[i->first]=move(i->second);
+	}
+}
+
+void VBufStorage_fieldNode_t::addTypedAttribute(const wchar_t* name, VBufStorage_attributeType_t type, int value) {
+	LOG_DEBUG(L"Adding typed attribute "<<name<<L" with value "<<value);
+	if(!this->typedAttributes) this->typedAttributes=new VBufStorage_typedAttributeList_t();
+	for(VBufStorage_typedAttributeList_t::iterator i=this->typedAttributes->begin();i!=this->typedAttributes->end();++i) {
+		if(wcscmp(i->name,name)==0) {
+			i->type=type;
+			i->value=value;
+			return;
+		}
+	}
+	VBufStorage_typedAttribute_t attribute={name,type,value};
+	this->typedAttributes->push_back(attribute);
+}
+
 std::wstring VBufStorage_fieldNode_t::getAttributesString() const {
 	std::wstring attributesString;
-	for(std::map<std::wstring,std::wstring>::const_iterator i=attributes.begin();i!=attributes.end();++i) {
+	const VBufStorage_attributeMap_t& attributes=getAttributes();
+	for(VBufStorage_attributeMap_t::const_iterator i=attributes.begin();i!=attributes.end();++i) {
+		attributesString+=i->first;
+		attributesString+=L':';
+		attributesString+=i->second;
+		attributesString+=L';';
+	}
+	if(!this->typedAttributes) return attributesString;
+	vector<pair<wstring,wstring> > expanded;
+	for(VBufStorage_typedAttributeList_t::const_iterator i=this->typedAttributes->begin();i!=this->typedAttributes->end();++i) {
+		expandTypedAttribute(*i,expanded);
+	}
+	for(vector<pair<wstring,wstring> >::const_iterator i=expanded.begin();i!=expanded.end();++i) {
 		attributesString+=i->first;
 		attributesString+=L':';
 		attributesString+=i->second;
@@ -329,6 +707,20 @@ void VBufStorage_controlFieldNode_t::disassociateFromBuffer(VBufStorage_buffer_t
 	this->VBufStorage_fieldNode_t::disassociateFromBuffer(buffer);
 }
 
+bool VBufStorage_controlFieldNode_t::recycle(VBufStorage_nodePool_t* pool) {
+	nhAssert(pool); //Pool can't be NULL
+	if(!this->recyclable) {
+		LOG_DEBUG(L"Node was not created by the buffer, not keeping it");
+		return false;
+	}
+	return pool->add(this);
+}
+
+void VBufStorage_controlFieldNode_t::getMemoryUsage(VBufStorage_memoryUsage_t* usage) const {
+	usage->nodes+=sizeof(VBufStorage_controlFieldNode_t);
+	this->VBufStorage_fieldNode_t::getMemoryUsage(usage);
+}
+
 VBufStorage_controlFieldNode_t::VBufStorage_controlFieldNode_t(int docHandle, int ID, bool isBlockArg): VBufStorage_fieldNode_t(0,isBlockArg), identifier(docHandle,ID) {  
 	LOG_DEBUG(L"controlFieldNode initialization at "<<this<<L", with docHandle of "<<identifier.docHandle<<L" and ID of "<<identifier.ID); 
 }
@@ -358,7 +750,7 @@ void VBufStorage_textFieldNode_t::generateMarkupTagName(std::wstring& text) {
 	text+=L"text";
 }
 
-void VBufStorage_textFieldNode_t::getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup, bool(*filter)(VBufStorage_fieldNode_t*)) {
+void VBufStorage_textFieldNode_t::getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup, bool(*filter)(VBufStorage_fieldNode_t*), VBufStorage_deadline_t* deadline) {
 	LOG_DEBUG(L"getting text between offsets "<<startOffset<<L" and "<<endOffset);
 	if(useMarkup) {
 		this->generateMarkupOpeningTag(text,startOffset,endOffset);
@@ -366,14 +758,15 @@ void VBufStorage_textFieldNode_t::getTextInRange(int startOffset, int endOffset,
 	nhAssert(startOffset>=0); //StartOffset must be not negative
 	nhAssert(startOffset<endOffset); //StartOffset must be less than endOffset
 	nhAssert(endOffset<=this->length); //endOffset can't be greater than node length
+	const std::wstring& nodeText=getText();
 	if(useMarkup) {
 		wchar_t c;
 		for(int offset=startOffset;offset<endOffset;++offset) {
-			c=this->text[offset];
+			c=nodeText[offset];
 			appendCharToXML(c,text);
 		}
 	} else {
-		text.append(this->text,startOffset,endOffset-startOffset);
+		text.append(nodeText,startOffset,endOffset-startOffset);
 	}
 	if(useMarkup) {
 		this->generateMarkupClosingTag(text);
@@ -381,16 +774,487 @@ void VBufStorage_textFieldNode_t::getTextInRange(int startOffset, int endOffset,
 	LOG_DEBUG(L"generated, text string is now of length "<<text.length());
 }
 
-VBufStorage_textFieldNode_t::VBufStorage_textFieldNode_t(const std::wstring& textArg): VBufStorage_fieldNode_t(static_cast<int>(textArg.length()),false), text(textArg) {
+size_t VBufStorage_textFieldNode_t::freezeText(std::string& frozenText) {
+	const std::wstring& text=getText();
+	for(std::wstring::const_iterator i=text.begin();i!=text.end();++i) {
+		appendFrozenChar(*i,frozenText);
+	}
+	size_t textBytes=text.length()*sizeof(wchar_t);
+	// Swap rather than clear, so that the memory is released.
+	std::wstring().swap(this->text);
+	releaseSharedText();
+	return textBytes;
+}
+
+void VBufStorage_textFieldNode_t::thawText(const std::string& frozenText, size_t* pos) {
+	nhAssert(this->text.empty());
+	nhAssert(!this->sharedText);
+	this->text.reserve(this->length);
+	for(int i=0;i<this->length;++i) {
+		this->text+=readFrozenChar(frozenText,pos);
+	}
+}
+
+void VBufStorage_textFieldNode_t::getMemoryUsage(VBufStorage_memoryUsage_t* usage) const {
+	usage->nodes+=sizeof(VBufStorage_textFieldNode_t);
+	usage->text+=memoryUsage_string(this->text);
+	//Shared text is divided between the nodes holding it, so that it is counted about once.
+	if(this->sharedText) usage->text+=(sizeof(VBufStorage_sharedText_t)+memoryUsage_string(this->sharedText->text))/this->sharedText->refCount;
+	this->VBufStorage_fieldNode_t::getMemoryUsage(usage);
+}
+
+const std::wstring* VBufStorage_textFieldNode_t::getContentText() const {
+	return &getText();
+}
+
+void VBufStorage_textFieldNode_t::shareContent(VBufStorage_fieldNode_t* other) {
+	nhAssert(other); //Other can't be NULL, and must be a text field as it has the same content
+	VBufStorage_textFieldNode_t* otherText=static_cast<VBufStorage_textFieldNode_t*>(other);
+	if(!otherText->sharedText) {
+		otherText->sharedText=new VBufStorage_sharedText_t(move(otherText->text));
+		otherText->sharedText->refCount=1;
+		std::wstring().swap(otherText->text);
+	}
+	if(this->sharedText==otherText->sharedText) return;
+	releaseSharedText();
+	std::wstring().swap(this->text);
+	this->sharedText=otherText->sharedText;
+	++(this->sharedText->refCount);
+}
+
+void VBufStorage_textFieldNode_t::releaseSharedText() {
+	VBufStorage_sharedText_t* shared=this->sharedText;
+	if(!shared) return;
+	this->sharedText=NULL;
+	if(--(shared->refCount)==0) delete shared;
+}
+
+VBufStorage_textFieldNode_t::VBufStorage_textFieldNode_t(std::wstring textArg): VBufStorage_fieldNode_t(static_cast<int>(textArg.length()),false), text(move(textArg)), sharedText(NULL) {
 	LOG_DEBUG(L"textFieldNode initialization, with text of length "<<length);
 }
 
+VBufStorage_textFieldNode_t::~VBufStorage_textFieldNode_t() {
+	releaseSharedText();
+}
+
+VBufStorage_sharedText_t::VBufStorage_sharedText_t(std::wstring textArg): text(move(textArg)), refCount(0) {
+}
+
 std::wstring VBufStorage_textFieldNode_t::getDebugInfo() const {
 	std::wostringstream s;
 	s<<L"text "<<this->VBufStorage_fieldNode_t::getDebugInfo();
 	return s.str();
 }
 
+//node pool implementation
+
+VBufStorage_nodePool_t::VBufStorage_nodePool_t(): nodes() {
+}
+
+VBufStorage_nodePool_t::~VBufStorage_nodePool_t() {
+	clear();
+}
+
+bool VBufStorage_nodePool_t::add(VBufStorage_controlFieldNode_t* node) {
+	nhAssert(node); //Node can't be NULL
+	if(nodes.size()>=maxSize) {
+		LOG_DEBUG(L"Pool full, not keeping node");
+		return false;
+	}
+	if(!nodes.insert(make_pair(node->identifier,node)).second) {
+		LOG_DEBUG(L"Pool already has a node with identifier docHandle "<<node->identifier.docHandle<<L", ID "<<node->identifier.ID);
+		return false;
+	}
+	node->parent=NULL;
+	node->previous=node->next=NULL;
+	node->firstChild=node->lastChild=NULL;
+	node->length=0;
+	node->hidden=false;
+	node->subtreeFlags=0;
+	node->updateAncestor=NULL;
+	//An attribute set only this node holds is emptied and kept for the node's new attributes, one held by other nodes is left to them.
+	VBufStorage_attributeSet_t* set=node->attributes;
+	if(set&&set->refCount==1) {
+		set->leavePool();
+		set->attributes.clear();
+	} else {
+		node->releaseAttributes();
+	}
+	if(node->typedAttributes) node->typedAttributes->clear();
+	return true;
+}
+
+VBufStorage_controlFieldNode_t* VBufStorage_nodePool_t::take(int docHandle, int ID, bool isBlock) {
+	map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::iterator i=nodes.find(VBufStorage_controlFieldNodeIdentifier_t(docHandle,ID));
+	if(i==nodes.end()) return NULL;
+	VBufStorage_controlFieldNode_t* node=i->second;
+	nodes.erase(i);
+	node->block=isBlock;
+	LOG_DEBUG(L"Reusing node "<<node->getDebugInfo());
+	return node;
+}
+
+void VBufStorage_nodePool_t::clear() {
+	for(map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::iterator i=nodes.begin();i!=nodes.end();++i) {
+		delete i->second;
+	}
+	nodes.clear();
+}
+
+void VBufStorage_nodePool_t::swap(VBufStorage_nodePool_t& other) {
+	nodes.swap(other.nodes);
+}
+
+size_t VBufStorage_nodePool_t::size() const {
+	return nodes.size();
+}
+
+void VBufStorage_nodePool_t::getMemoryUsage(VBufStorage_memoryUsage_t* usage) const {
+	usage->otherIndexes+=memoryUsage_tree<map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::value_type>(nodes.size());
+	for(map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::const_iterator i=nodes.begin();i!=nodes.end();++i) {
+		i->second->getMemoryUsage(usage);
+	}
+}
+
+//cursor implementation
+
+VBufStorage_cursor_t::VBufStorage_cursor_t(VBufStorage_buffer_t* bufferArg): buffer(bufferArg), version(0), path(), offset(0) {
+}
+
+bool VBufStorage_cursor_t::moveToOffset(int newOffset) {
+	VBufStorage_fieldNode_t* rootNode=buffer->rootNode;
+	if(rootNode==NULL||newOffset<0||newOffset>=rootNode->length) {
+		LOG_DEBUG(L"Offset "<<newOffset<<L" not in buffer, returning false");
+		return false;
+	}
+	if(version!=buffer->version||path.empty()||path.front().first!=rootNode) {
+		LOG_DEBUG(L"Locating offset "<<newOffset<<L" from the root");
+		path.clear();
+		path.push_back(make_pair(rootNode,0));
+		version=buffer->version;
+	}
+	// Climb to the nearest ancestor containing the new offset, remembering the child climbed from so the search across its siblings can start there.
+	VBufStorage_fieldNode_t* hint=NULL;
+	int hintStart=0;
+	while(path.size()>1&&(newOffset<path.back().second||newOffset>=path.back().second+path.back().first->length)) {
+		hint=path.back().first;
+		hintStart=path.back().second;
+		path.pop_back();
+	}
+	// Descend to the text field node containing the new offset.
+	for(VBufStorage_fieldNode_t* node=path.back().first;node->firstChild!=NULL;node=path.back().first) {
+		VBufStorage_fieldNode_t* child=node->firstChild;
+		int childStart=path.back().second;
+		if(hint!=NULL) {
+			child=hint;
+			childStart=hintStart;
+			hint=NULL;
+		}
+		while(newOffset<childStart) {
+			child=child->previous;
+			nhAssert(child);
+			childStart-=child->length;
+		}
+		while(newOffset>=childStart+child->length) {
+			childStart+=child->length;
+			child=child->next;
+			nhAssert(child);
+		}
+		path.push_back(make_pair(child,childStart));
+	}
+	offset=newOffset;
+	return true;
+}
+
+bool VBufStorage_cursor_t::moveByCharacter(int count) {
+	if(!isPlaced()) return false;
+	return moveToOffset(offset+count);
+}
+
+bool VBufStorage_cursor_t::moveToNextNode() {
+	if(!isPlaced()) return false;
+	return moveToOffset(getNodeEndOffset());
+}
+
+bool VBufStorage_cursor_t::moveToPreviousNode() {
+	if(!isPlaced()||!moveToOffset(getNodeStartOffset()-1)) return false;
+	return moveToOffset(getNodeStartOffset());
+}
+
+bool VBufStorage_cursor_t::getLineOffsets(int maxLineLength, bool useScreenLayout, int* startOffset, int* endOffset) {
+	if(!isPlaced()) return false;
+	return buffer->getLineOffsetsFromNode(getNode(),getNodeStartOffset(),getNodeEndOffset(),offset,maxLineLength,useScreenLayout,startOffset,endOffset);
+}
+
+bool VBufStorage_cursor_t::moveToNextLine(int maxLineLength, bool useScreenLayout) {
+	int lineStart, lineEnd;
+	if(!getLineOffsets(maxLineLength,useScreenLayout,&lineStart,&lineEnd)) return false;
+	return moveToOffset(lineEnd);
+}
+
+bool VBufStorage_cursor_t::moveToPreviousLine(int maxLineLength, bool useScreenLayout) {
+	int lineStart, lineEnd;
+	if(!getLineOffsets(maxLineLength,useScreenLayout,&lineStart,&lineEnd)||!moveToOffset(lineStart-1)) return false;
+	getLineOffsets(maxLineLength,useScreenLayout,&lineStart,&lineEnd);
+	return moveToOffset(lineStart);
+}
+
+bool VBufStorage_cursor_t::isPlaced() {
+	if(path.empty()) return false;
+	if(version!=buffer->version) {
+		// Find the offset again in the changed buffer, if it is still there.
+		path.clear();
+		return moveToOffset(offset);
+	}
+	return true;
+}
+
+VBufStorage_textFieldNode_t* VBufStorage_cursor_t::getNode() {
+	if(!isPlaced()) return NULL;
+	return static_cast<VBufStorage_textFieldNode_t*>(path.back().first);
+}
+
+int VBufStorage_cursor_t::getNodeStartOffset() {
+	if(!isPlaced()) return 0;
+	return path.back().second;
+}
+
+int VBufStorage_cursor_t::getNodeEndOffset() {
+	if(!isPlaced()) return 0;
+	return path.back().second+path.back().first->length;
+}
+
+//attribute set implementation
+
+VBufStorage_attributeSet_t::VBufStorage_attributeSet_t(): attributes(), refCount(1), pool(NULL), hash(0) {
+}
+
+void VBufStorage_attributeSet_t::leavePool() {
+	if(!pool) return;
+	pair<VBufStorage_attributeSetPool_t::iterator,VBufStorage_attributeSetPool_t::iterator> range=pool->equal_range(hash);
+	for(VBufStorage_attributeSetPool_t::iterator i=range.first;i!=range.second;++i) {
+		if(i->second==this) {
+			pool->erase(i);
+			break;
+		}
+	}
+	pool=NULL;
+}
+
+/**
+ * @return a hash of the names and values of a set of attributes.
+ */
+size_t hashAttributes(const VBufStorage_attributeMap_t& attributes) {
+	std::hash<wstring> hashString;
+	size_t hash=attributes.size();
+	for(VBufStorage_attributeMap_t::const_iterator i=attributes.begin();i!=attributes.end();++i) {
+		hash=hash*31+hashString(i->first);
+		hash=hash*31+hashString(i->second);
+	}
+	return hash;
+}
+
+//attribute query implementation
+
+/**
+ * The regular expressions NVDA searches with for any value of an attribute, and for any value that is not empty, see VBufStorage_attributeQuery_t.
+ */
+const wchar_t VBufStorage_anyValueRegexp[]=L"(?:\\\\;|[^;])*;";
+const wchar_t VBufStorage_notEmptyValueRegexp[]=L"(?:\\\\;|[^;])+;";
+
+/**
+ * Reads a name or value, escaped as for outputEscapedAttribute, from a regular expression that matches it literally.
+ * @param regexp the regular expression.
+ * @param pos the position in regexp to start reading from, which is moved past the name or value and its terminator.
+ * @param terminator the colon ending a name or the semicolon ending a value.
+ * @param value memory where the name or value without its escapes is placed.
+ * @return false if the regular expression does not match a name or value ending in the terminator there.
+ */
+bool readRegexpAttribute(const wstring& regexp, size_t* pos, wchar_t terminator, wstring& value) {
+	bool escaped=false;
+	while(*pos<regexp.size()) {
+		wchar_t c=regexp[(*pos)++];
+		if(c==L'\\') {
+			if(*pos>=regexp.size()||iswalnum(regexp[*pos])) return false;
+			c=regexp[(*pos)++];
+		} else if(c!=L'\0'&&wcschr(L"^$.*+?()[]{}|",c)) {
+			return false;
+		}
+		if(escaped) {
+			value+=c;
+			escaped=false;
+		} else if(c==L'\\') {
+			escaped=true;
+		} else if(c==L':'||c==L';') {
+			return c==terminator;
+		} else {
+			value+=c;
+		}
+	}
+	return false;
+}
+
+/**
+ * Adds a value an attribute may have to a condition.
+ */
+void addConditionValue(VBufStorage_attributeCondition_t& condition, const wstring& value) {
+	if(value.empty()) {
+		condition.matchesMissing=true;
+	} else {
+		wchar_t* end;
+		long number=wcstol(value.c_str(),&end,10);
+		if(*end==L'\0'&&number>=INT_MIN&&number<=INT_MAX&&to_wstring(number)==value) condition.numericValues.push_back(static_cast<int>(number));
+	}
+	condition.values.push_back(value);
+}
+
+VBufStorage_attributeQuery_t::VBufStorage_attributeQuery_t(): attribsList(), regexObj(), options(), isCompiled(false) {
+}
+
+VBufStorage_attributeQuery_t::VBufStorage_attributeQuery_t(const wstring& attribs, const wstring& regexp): attribsList(), regexObj(regexp), options(), isCompiled(false) {
+	wistringstream attribsStream(attribs);
+	copy(istream_iterator<wstring,wchar_t,std::char_traits<wchar_t>>(attribsStream),istream_iterator<wstring,wchar_t,std::char_traits<wchar_t>>(),back_inserter<vector<wstring> >(attribsList));
+	isCompiled=compile(regexp);
+	if(!isCompiled) {
+		LOG_DEBUG(L"Could not compile regexp "<<regexp<<L", it will be matched as it is");
+		options.clear();
+	}
+}
+
+bool VBufStorage_attributeQuery_t::compile(const wstring& regexp) {
+	const wstring anyValue=VBufStorage_anyValueRegexp;
+	const wstring notEmptyValue=VBufStorage_notEmptyValueRegexp;
+	size_t pos=0;
+	for(;;) {
+		//Each option tests every requested attribute in turn.
+		vector<VBufStorage_attributeCondition_t> conditions;
+		for(vector<wstring>::const_iterator i=attribsList.begin();i!=attribsList.end();++i) {
+			wstring name;
+			if(!readRegexpAttribute(regexp,&pos,L':',name)||name!=*i) return false;
+			if(regexp.compare(pos,anyValue.size(),anyValue)==0) {
+				pos+=anyValue.size();
+				continue;
+			}
+			VBufStorage_attributeCondition_t condition;
+			condition.name=name;
+			condition.notEmpty=false;
+			condition.matchesMissing=false;
+			if(regexp.compare(pos,notEmptyValue.size(),notEmptyValue)==0) {
+				pos+=notEmptyValue.size();
+				condition.notEmpty=true;
+			} else if(regexp.compare(pos,3,L"(?:")==0) {
+				//The attribute must have one of a group of exact values.
+				pos+=3;
+				for(;;) {
+					wstring value;
+					if(!readRegexpAttribute(regexp,&pos,L';',value)) return false;
+					addConditionValue(condition,value);
+					if(pos>=regexp.size()) return false;
+					if(regexp[pos++]==L')') break;
+					if(regexp[pos-1]!=L'|') return false;
+				}
+			} else {
+				//The attribute must have a single exact value.
+				wstring value;
+				if(!readRegexpAttribute(regexp,&pos,L';',value)) return false;
+				addConditionValue(condition,value);
+			}
+			conditions.push_back(condition);
+		}
+		options.push_back(conditions);
+		if(pos==regexp.size()) return true;
+		if(regexp[pos++]!=L'|') return false;
+	}
+}
+
+bool VBufStorage_attributeQuery_t::meetsCondition(const VBufStorage_fieldNode_t* node, const VBufStorage_attributeCondition_t& condition) {
+	const VBufStorage_attributeMap_t& attributes=node->getAttributes();
+	VBufStorage_attributeMap_t::const_iterator foundAttrib=attributes.find(condition.name);
+	if(foundAttrib!=attributes.end()) {
+		if(condition.notEmpty) return !foundAttrib->second.empty();
+		return find(condition.values.begin(),condition.values.end(),foundAttrib->second)!=condition.values.end();
+	}
+	int typedValue;
+	if(node->findTypedAttribute(condition.name,&typedValue)) {
+		if(condition.notEmpty) return true;
+		return find(condition.numericValues.begin(),condition.numericValues.end(),typedValue)!=condition.numericValues.end();
+	}
+	return !condition.notEmpty&&condition.matchesMissing;
+}
+
+bool VBufStorage_attributeQuery_t::matches(VBufStorage_fieldNode_t* node) const {
+	if(!isCompiled) return node->matchAttributes(attribsList,regexObj);
+	for(vector<vector<VBufStorage_attributeCondition_t> >::const_iterator i=options.begin();i!=options.end();++i) {
+		vector<VBufStorage_attributeCondition_t>::const_iterator j=i->begin();
+		for(;j!=i->end()&&meetsCondition(node,*j);++j);
+		if(j==i->end()) return true;
+	}
+	return false;
+}
+
+size_t VBufStorage_attributeQuery_t::getMemoryUsage() const {
+	size_t usage=memoryUsage_vector(attribsList)+memoryUsage_vector(options);
+	for(vector<wstring>::const_iterator i=attribsList.begin();i!=attribsList.end();++i) {
+		usage+=memoryUsage_string(*i);
+	}
+	for(vector<vector<VBufStorage_attributeCondition_t> >::const_iterator i=options.begin();i!=options.end();++i) {
+		usage+=memoryUsage_vector(*i);
+		for(vector<VBufStorage_attributeCondition_t>::const_iterator j=i->begin();j!=i->end();++j) {
+			usage+=memoryUsage_string(j->name)+memoryUsage_vector(j->values)+memoryUsage_vector(j->numericValues);
+			for(vector<wstring>::const_iterator k=j->values.begin();k!=j->values.end();++k) {
+				usage+=memoryUsage_string(*k);
+			}
+		}
+	}
+	return usage;
+}
+
+//outline category implementation
+
+VBufStorage_outlineCategory_t::VBufStorage_outlineCategory_t(const wstring& attribsArg, const wstring& regexpArg): attribs(attribsArg), regexp(regexpArg), query(attribsArg,regexpArg) {
+}
+
+//deadline implementation
+
+/**
+ * The number of times a deadline is checked between reads of the clock.
+ */
+const unsigned int VBufStorage_deadlineClockInterval=64;
+
+VBufStorage_deadline_t::VBufStorage_deadline_t(): endTime(0), cancelCount(NULL), startCancelCount(0), checksUntilClock(0), expired(false) {
+}
+
+void VBufStorage_deadline_t::start(long long timeLimit, const std::atomic<unsigned int>* cancelCountArg) {
+	endTime=(timeLimit>0)?VBufMetrics_getMicroseconds()+timeLimit:0;
+	cancelCount=cancelCountArg;
+	startCancelCount=cancelCount?cancelCount->load(memory_order_relaxed):0;
+	checksUntilClock=VBufStorage_deadlineClockInterval;
+	expired=false;
+}
+
+bool VBufStorage_deadline_t::stop() {
+	bool wasExpired=expired;
+	endTime=0;
+	cancelCount=NULL;
+	expired=false;
+	return wasExpired;
+}
+
+bool VBufStorage_deadline_t::hasExpired() {
+	if(expired) return true;
+	if(cancelCount&&cancelCount->load(memory_order_relaxed)!=startCancelCount) {
+		LOG_DEBUGWARNING(L"Query cancelled");
+		expired=true;
+	} else if(endTime>0&&--checksUntilClock==0) {
+		checksUntilClock=VBufStorage_deadlineClockInterval;
+		if(VBufMetrics_getMicroseconds()>=endTime) {
+			LOG_DEBUGWARNING(L"Query timed out");
+			expired=true;
+		}
+	}
+	return expired;
+}
+
 //buffer implementation
 
 void VBufStorage_buffer_t::forgetControlFieldNode(VBufStorage_controlFieldNode_t* node) {
@@ -426,6 +1290,8 @@ bool VBufStorage_buffer_t::insertNode(VBufStorage_controlFieldNode_t* parent, VB
 		LOG_DEBUGWARNING(L"No parent specified but the root node already exists at "<<this->rootNode<<L". returning false");
 		return false;
 	}
+	//The frozen content follows the buffer's set of nodes, so it must be unpacked before the set changes.
+	if(frozenContent) thaw();
 	VBufStorage_fieldNode_t* next=NULL;
 	//make sure we have a good parent, previous and next
 	if(previous!=NULL) parent=previous->parent;
@@ -458,6 +1324,7 @@ bool VBufStorage_buffer_t::insertNode(VBufStorage_controlFieldNode_t* parent, VB
 	node->parent=parent;
 	node->previous=previous;
 	node->next=next;
+	if(parent) parent->forgetSubtreeFlags();
 	if(node->length>0) {
 		LOG_DEBUG(L"Widening ancestors by "<<node->length);
 		for(VBufStorage_fieldNode_t* ancestor=node->parent;ancestor!=NULL;ancestor=ancestor->parent) {
@@ -470,43 +1337,57 @@ bool VBufStorage_buffer_t::insertNode(VBufStorage_controlFieldNode_t* parent, VB
 	LOG_DEBUG(L"Inserted subtree");
 	nhAssert(this->nodes.count(node)==0);
 	this->nodes.insert(node);
+	++version;
 	return true;
 }
 
-void VBufStorage_buffer_t::deleteNode(VBufStorage_fieldNode_t* node) {
+void VBufStorage_buffer_t::deleteNode(VBufStorage_fieldNode_t* node, bool recycle) {
 	nhAssert(node);
+	if(canUpdateTableGrids()) removeTableCell(node);
+	if(canUpdateOutlineNodes()) outlineNodes.erase(node);
 	node->disassociateFromBuffer(this);
 	nhAssert(this->nodes.count(node)==1);
 	this->nodes.erase(node);
+	if(recycle&&node->recycle(&retiredNodes)) {
+		LOG_DEBUG(L"kept node at "<<node<<L" to be reused");
+		return;
+	}
 	LOG_DEBUG(L"deleting node at "<<node);
 	delete node;
 }
 
-void VBufStorage_buffer_t::deleteSubtree(VBufStorage_fieldNode_t* node) {
+void VBufStorage_buffer_t::deleteSubtree(VBufStorage_fieldNode_t* node, bool recycle) {
 	nhAssert(node); //node can't be null
 	LOG_DEBUG(L"deleting subtree starting at "<<node->getDebugInfo());
 	//Save off next before deleting the subtree 
 	for(VBufStorage_fieldNode_t* child=node->firstChild;child!=NULL;) {
 		VBufStorage_fieldNode_t* next=child->next;
-		deleteSubtree(child);
+		deleteSubtree(child,recycle);
 		child=next;
 	}
-	deleteNode(node);
+	deleteNode(node,recycle);
 	LOG_DEBUG(L"Deleted subtree");
 }
 
-VBufStorage_buffer_t::VBufStorage_buffer_t(): rootNode(NULL), nodes(), controlFieldNodesByIdentifier(), selectionStart(0), selectionLength(0) {
+VBufStorage_buffer_t::VBufStorage_buffer_t(): rootNode(NULL), nodes(), controlFieldNodesByIdentifier(), selectionStart(0), selectionLength(0), version(0), lineStreams(), locateCursor(this), tableGrids(), tableGridsVersion(0), outlineCategories(), outlineNodes(), outlineNodesVersion(0), outlineEntries(), outlineEntriesVersion(0), outlineEntriesCategoryCount(0), queryDeadline(), queryTimeout(0), queryCancelCount(0), frozenContent(NULL), freezeStats(), attributeSets(), retiredNodes(), nodePool(NULL), subtreeSharing(false) {
 	LOG_DEBUG(L"buffer initializing");
 }
 
 VBufStorage_buffer_t::~VBufStorage_buffer_t() {
 	LOG_DEBUG(L"buffer being destroied");
 	this->clearBuffer();
+	for(list<VBufStorage_lineStream_t*>::iterator i=lineStreams.begin();i!=lineStreams.end();++i) {
+		delete *i;
+	}
 }
 
 VBufStorage_controlFieldNode_t*  VBufStorage_buffer_t::addControlFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int docHandle, int ID, bool isBlock) {
 	LOG_DEBUG(L"Adding control field node to buffer with parent at "<<parent<<L", previous at "<<previous<<L", docHandle "<<docHandle<<L", ID "<<ID);
-	VBufStorage_controlFieldNode_t* controlFieldNode=new VBufStorage_controlFieldNode_t(docHandle,ID,isBlock);
+	VBufStorage_controlFieldNode_t* controlFieldNode=nodePool?nodePool->take(docHandle,ID,isBlock):NULL;
+	if(!controlFieldNode) {
+		controlFieldNode=new VBufStorage_controlFieldNode_t(docHandle,ID,isBlock);
+		controlFieldNode->recyclable=true;
+	}
 	nhAssert(controlFieldNode); //controlFieldNode must have been allocated
 	LOG_DEBUG(L"Created controlFieldNode: "<<controlFieldNode->getDebugInfo());
 	if(addControlFieldNode(parent,previous,controlFieldNode)!=controlFieldNode) {
@@ -537,7 +1418,7 @@ VBufStorage_controlFieldNode_t*  VBufStorage_buffer_t::addControlFieldNode(VBufS
 	return controlFieldNode;
 }
 
-VBufStorage_textFieldNode_t*  VBufStorage_buffer_t::addTextFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, const std::wstring& text) {
+VBufStorage_textFieldNode_t*  VBufStorage_buffer_t::addTextFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, std::wstring text) {
 	LOG_DEBUG(L"Add textFieldNode using parent at "<<parent<<L", previous at "<<previous);
 	// #2963: Strip any private area unicode or 0-with spaces from the start and end of the string
 	size_t textLength=text.length();
@@ -557,7 +1438,11 @@ VBufStorage_textFieldNode_t*  VBufStorage_buffer_t::addTextFieldNode(VBufStorage
 		needsStrip=true;
 	}
 	size_t subLength=max(textLength-i,subStart)-subStart;
-	VBufStorage_textFieldNode_t* textFieldNode=new VBufStorage_textFieldNode_t(needsStrip?text.substr(subStart,subLength):text);
+	if(needsStrip) {
+		text.erase(subStart+subLength);
+		text.erase(0,subStart);
+	}
+	VBufStorage_textFieldNode_t* textFieldNode=new VBufStorage_textFieldNode_t(move(text));
 	nhAssert(textFieldNode); //controlFieldNode must have been allocated
 	LOG_DEBUG(L"Created textFieldNode: "<<textFieldNode->getDebugInfo());
 	if(addTextFieldNode(parent,previous,textFieldNode)!=textFieldNode) {
@@ -568,6 +1453,10 @@ VBufStorage_textFieldNode_t*  VBufStorage_buffer_t::addTextFieldNode(VBufStorage
 	return textFieldNode;
 }
 
+VBufStorage_textFieldNode_t*  VBufStorage_buffer_t::addTextFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, const wchar_t* text, size_t textLength) {
+	return addTextFieldNode(parent,previous,wstring(text,textLength));
+}
+
 VBufStorage_textFieldNode_t*  VBufStorage_buffer_t::addTextFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, VBufStorage_textFieldNode_t* textFieldNode) {
 	if(!textFieldNode) {
 		LOG_DEBUGWARNING(L"Node is NULL. Returnning NULL");
@@ -588,6 +1477,7 @@ VBufStorage_textFieldNode_t*  VBufStorage_buffer_t::addTextFieldNode(VBufStorage
 }
 
 bool VBufStorage_buffer_t::replaceSubtrees(map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>& m) {
+	TRACE_SCOPE("VBufStorage_buffer_t::replaceSubtrees");
 	VBufStorage_controlFieldNode_t* parent=NULL;
 	VBufStorage_fieldNode_t* previous=NULL;
 	//Using the current selection start, record a list of ancestor fields by their identifier, 
@@ -617,7 +1507,10 @@ bool VBufStorage_buffer_t::replaceSubtrees(map<VBufStorage_fieldNode_t*,VBufStor
 		}
 		parent=node->parent;
 		previous=node->previous;
-		if(!this->removeFieldNode(node)) {
+		bool updateTableGrids=canUpdateTableGrids();
+		bool updateOutlineNodes=canUpdateOutlineNodes();
+		//The removed nodes are kept so that the next re-render of the same controls can reuse them.
+		if(!this->removeFieldNode(node,true,true)) {
 			LOG_DEBUGWARNING(L"Error removing node. Skipping");
 			failedBuffers=true;
 			buffer->clearBuffer();
@@ -633,6 +1526,16 @@ bool VBufStorage_buffer_t::replaceSubtrees(map<VBufStorage_fieldNode_t*,VBufStor
 			m.erase(i++);
 			continue;
 		}
+		//The new subtree was fully rendered before being inserted, so its attributes can be shared and its table cells added straight away.
+		shareNewContent(buffer->rootNode);
+		if(updateTableGrids) {
+			addTableCells(buffer->rootNode);
+			tableGridsVersion=version;
+		}
+		if(updateOutlineNodes) {
+			addOutlineNodes(buffer->rootNode,~0u);
+			outlineNodesVersion=version;
+		}
 		buffer->nodes.erase(buffer->rootNode);
 		this->nodes.insert(buffer->nodes.begin(),buffer->nodes.end());
 		buffer->nodes.clear();
@@ -689,7 +1592,7 @@ bool VBufStorage_buffer_t::replaceSubtrees(map<VBufStorage_fieldNode_t*,VBufStor
 	return !failedBuffers;
 }
 
-bool VBufStorage_buffer_t::removeFieldNode(VBufStorage_fieldNode_t* node,bool removeDescendants) {
+bool VBufStorage_buffer_t::removeFieldNode(VBufStorage_fieldNode_t* node,bool removeDescendants,bool recycle) {
 	if(!isNodeInBuffer(node)) {
 		LOG_DEBUGWARNING(L"Node at "<<node<<L" is not in buffer at "<<this<<L". Returnning false");
 		return false;
@@ -698,6 +1601,9 @@ bool VBufStorage_buffer_t::removeFieldNode(VBufStorage_fieldNode_t* node,bool re
 		LOG_DEBUGWARNING(L"Cannot remove the rootNode without removing its descedants. Returnning false");
 		return false;
 	}
+	if(frozenContent) thaw();
+	bool updateTableGrids=canUpdateTableGrids();
+	bool updateOutlineNodes=canUpdateOutlineNodes();
 	if((removeDescendants||!node->firstChild)&&node->length>0) {
 		LOG_DEBUG(L"collapsing length of ancestors by "<<node->length);
 		for(VBufStorage_fieldNode_t* ancestor=node->parent;ancestor!=NULL;ancestor=ancestor->parent) {
@@ -708,6 +1614,7 @@ bool VBufStorage_buffer_t::removeFieldNode(VBufStorage_fieldNode_t* node,bool re
 		}
 	}
 	LOG_DEBUG(L"Disconnecting node from its siblings and or parent");
+	if(node->parent) node->parent->forgetSubtreeFlags();
 	if(node->next!=NULL) {
 		node->next->previous=(!removeDescendants&&node->lastChild)?node->lastChild:node->previous;
 	} else if(node->parent) {
@@ -722,20 +1629,26 @@ bool VBufStorage_buffer_t::removeFieldNode(VBufStorage_fieldNode_t* node,bool re
 		for(VBufStorage_fieldNode_t* child=node->firstChild;child!=NULL;child=child->next) child->parent=node->parent;
 		if(node->firstChild) node->firstChild->previous=node->previous;
 		if(node->lastChild) node->lastChild->next=node->next;
-		deleteNode(node);
+		deleteNode(node,recycle);
 	} else {
 		LOG_DEBUG(L"Deleting subtree");
-		deleteSubtree(node);
+		deleteSubtree(node,recycle);
 	}
 	if(node==this->rootNode) {
 		LOG_DEBUG(L"Removing root node from buffer ");
 		this->rootNode=NULL;
 	}
+	++version;
+	//Cells and outline nodes were removed from tableGrids and outlineNodes as their nodes were deleted.
+	if(updateTableGrids) tableGridsVersion=version;
+	if(updateOutlineNodes) outlineNodesVersion=version;
 	LOG_DEBUG(L"Removed fieldNode and descendants, returning true");
 	return true;
 }
 
 void VBufStorage_buffer_t::clearBuffer() {
+	delete frozenContent;
+	frozenContent=NULL;
 	for(set<VBufStorage_fieldNode_t*>::iterator i=nodes.begin();i!=nodes.end();++i) {
 		nhAssert(*i);
 		delete *i;
@@ -744,6 +1657,13 @@ void VBufStorage_buffer_t::clearBuffer() {
 	controlFieldNodesByIdentifier.clear();
 	selectionStart=selectionLength=0;
 	this->rootNode=NULL;
+	++version;
+	tableGrids.clear();
+	tableGridsVersion=version;
+	outlineNodes.clear();
+	outlineNodesVersion=version;
+	nhAssert(attributeSets.empty());
+	retiredNodes.clear();
 }
 
 bool VBufStorage_buffer_t::getFieldNodeOffsets(VBufStorage_fieldNode_t* node, int *startOffset, int *endOffset) {
@@ -788,15 +1708,13 @@ VBufStorage_textFieldNode_t* VBufStorage_buffer_t::locateTextFieldNodeAtOffset(i
 		LOG_DEBUGWARNING(L"Offset "<<offset<<L" out of range. Returnning NULL");
 		return NULL;
 	}
-	int relativeOffset=0;
-	VBufStorage_textFieldNode_t* node=this->rootNode->locateTextFieldNodeAtOffset(offset,&relativeOffset);
-	if(node==NULL) {
+	if(!this->locateCursor.moveToOffset(offset)) {
 		LOG_DEBUGWARNING(L"Could not locate node, returning NULL");
 		return NULL;
 	}
-	int startOffset=offset-relativeOffset;
-	if(nodeStartOffset) *nodeStartOffset=startOffset;
-	if(nodeEndOffset) *nodeEndOffset=startOffset+node->length;
+	VBufStorage_textFieldNode_t* node=this->locateCursor.getNode();
+	if(nodeStartOffset) *nodeStartOffset=this->locateCursor.getNodeStartOffset();
+	if(nodeEndOffset) *nodeEndOffset=this->locateCursor.getNodeEndOffset();
 	LOG_DEBUG(L"Located node, returning node at "<<node);
 	return node;
 }
@@ -873,6 +1791,34 @@ int VBufStorage_buffer_t::getTextLength() const {
 	return length;
 }
 
+void VBufStorage_buffer_t::getContentSize(unsigned int* nodeCount, unsigned long long* textBytes, unsigned long long* attributeBytes) const {
+	*nodeCount=static_cast<unsigned int>(nodes.size());
+	//The length of the root node is the length of all the text in the buffer
+	*textBytes=static_cast<unsigned long long>(getTextLength())*sizeof(wchar_t);
+	*attributeBytes=0;
+	//Typed attributes are held as they are whether or not the buffer is frozen.
+	for(std::set<VBufStorage_fieldNode_t*>::const_iterator i=nodes.begin();i!=nodes.end();++i) {
+		if((*i)->typedAttributes) *attributeBytes+=(*i)->typedAttributes->size()*sizeof(VBufStorage_typedAttribute_t);
+	}
+	if(frozenContent) {
+		//Measure the packed attributes as they will be once thawed.
+		const string& attributes=frozenContent->attributes;
+		for(size_t pos=0;pos<attributes.size();) {
+			unsigned int stringCount=readFrozenNumber(attributes,&pos)*2;
+			for(unsigned int i=0;i<stringCount;++i) {
+				*attributeBytes+=frozenContent->strings[readFrozenNumber(attributes,&pos)].length()*sizeof(wchar_t);
+			}
+		}
+		return;
+	}
+	for(std::set<VBufStorage_fieldNode_t*>::const_iterator i=nodes.begin();i!=nodes.end();++i) {
+		const VBufStorage_attributeMap_t& attributes=(*i)->getAttributes();
+		for(VBufStorage_attributeMap_t::const_iterator j=attributes.begin();j!=attributes.end();++j) {
+			*attributeBytes+=(j->first.length()+j->second.length())*sizeof(wchar_t);
+		}
+	}
+}
+
 VBufStorage_textContainer_t*  VBufStorage_buffer_t::getTextInRange(int startOffset, int endOffset, bool useMarkup) {
 	if(this->rootNode==NULL) {
 		LOG_DEBUGWARNING(L"buffer is empty, returning NULL");
@@ -883,9 +1829,300 @@ VBufStorage_textContainer_t*  VBufStorage_buffer_t::getTextInRange(int startOffs
 		return NULL;
 	}
 	wstring text;
-	this->rootNode->getTextInRange(startOffset,endOffset,text,useMarkup);
+	this->rootNode->getTextInRange(startOffset,endOffset,text,useMarkup,NULL,&queryDeadline);
+	if(queryDeadline.hasExpired()) {
+		LOG_DEBUGWARNING(L"Gave up getting text between offsets "<<startOffset<<L" and "<<endOffset<<L", returning NULL");
+		return NULL;
+	}
 	LOG_DEBUG(L"Got text between offsets "<<startOffset<<L" and "<<endOffset<<L", returning true");
-	return new VBufStorage_textContainer_t(text);
+	return new VBufStorage_textContainer_t(move(text));
+}
+
+void VBufStorage_buffer_t::copyNodeText(VBufStorage_fieldNode_t* node, int startOffset, int endOffset, wchar_t* dest) {
+	if(node->firstChild==NULL) {
+		// Only text field nodes have length with out having children.
+		const wstring& text=static_cast<VBufStorage_textFieldNode_t*>(node)->getText();
+		text.copy(dest,endOffset-startOffset,startOffset);
+		return;
+	}
+	int childStart=0;
+	for(VBufStorage_fieldNode_t* child=node->firstChild;child!=NULL&&childStart<endOffset;child=child->next) {
+		int childEnd=childStart+child->length;
+		if(child->length>0&&childEnd>startOffset) {
+			int copyStart=max(startOffset,childStart);
+			this->copyNodeText(child,copyStart-childStart,min(endOffset,childEnd)-childStart,dest+(copyStart-startOffset));
+		}
+		childStart=childEnd;
+	}
+}
+
+bool VBufStorage_buffer_t::copyTextInRange(int startOffset, int endOffset, bool useMarkup, wchar_t* dest, int destLength, int* textLength) {
+	*textLength=0;
+	if(this->rootNode==NULL) {
+		LOG_DEBUGWARNING(L"buffer is empty, returning false");
+		return false;
+	}
+	if(startOffset<0||startOffset>=endOffset||endOffset>this->rootNode->length) {
+		LOG_DEBUGWARNING(L"Bad offsets of "<<startOffset<<L" and "<<endOffset<<L", returning false");
+		return false;
+	}
+	if(!useMarkup) {
+		*textLength=endOffset-startOffset;
+		if(*textLength>destLength) {
+			LOG_DEBUG(L"Text of length "<<*textLength<<L" does not fit in "<<destLength<<L" characters, returning false");
+			return false;
+		}
+		this->copyNodeText(this->rootNode,startOffset,endOffset,dest);
+		return true;
+	}
+	wstring text;
+	this->rootNode->getTextInRange(startOffset,endOffset,text,true,NULL,&queryDeadline);
+	if(queryDeadline.hasExpired()) {
+		LOG_DEBUGWARNING(L"Gave up generating markup between offsets "<<startOffset<<L" and "<<endOffset<<L", returning false");
+		return false;
+	}
+	*textLength=static_cast<int>(text.length());
+	if(*textLength>destLength) {
+		LOG_DEBUG(L"Text of length "<<*textLength<<L" does not fit in "<<destLength<<L" characters, returning false");
+		return false;
+	}
+	text.copy(dest,text.length());
+	return true;
+}
+
+bool VBufStorage_buffer_t::getTableCellCoordinates(VBufStorage_fieldNode_t* node, wstring& tableID, int* row, int* column, int* rowSpan, int* columnSpan) {
+	if(!node->attributes) return false;
+	const VBufStorage_attributeMap_t& attributes=node->attributes->attributes;
+	VBufStorage_attributeMap_t::const_iterator tableIDAttrib=attributes.find(L"table-id");
+	if(tableIDAttrib==attributes.end()) return false;
+	VBufStorage_attributeMap_t::const_iterator rowAttrib=attributes.find(L"table-rownumber");
+	VBufStorage_attributeMap_t::const_iterator columnAttrib=attributes.find(L"table-columnnumber");
+	if(rowAttrib==attributes.end()||columnAttrib==attributes.end()) return false;
+	tableID=tableIDAttrib->second;
+	*row=wcstol(rowAttrib->second.c_str(),NULL,10);
+	*column=wcstol(columnAttrib->second.c_str(),NULL,10);
+	VBufStorage_attributeMap_t::const_iterator spanAttrib=attributes.find(L"table-rowsspanned");
+	*rowSpan=(spanAttrib!=attributes.end())?wcstol(spanAttrib->second.c_str(),NULL,10):1;
+	spanAttrib=attributes.find(L"table-columnsspanned");
+	*columnSpan=(spanAttrib!=attributes.end())?wcstol(spanAttrib->second.c_str(),NULL,10):1;
+	*rowSpan=max(*rowSpan,1);
+	*columnSpan=max(*columnSpan,1);
+	return true;
+}
+
+bool VBufStorage_buffer_t::canUpdateTableGrids() const {
+	return tableGridsVersion==version;
+}
+
+void VBufStorage_buffer_t::addTableCells(VBufStorage_fieldNode_t* node) {
+	wstring tableID;
+	int row, column;
+	VBufStorage_tableGridCell_t cell;
+	for(VBufStorage_fieldNode_t* tempNode=node;tempNode!=NULL;) {
+		if(getTableCellCoordinates(tempNode,tableID,&row,&column,&cell.rowSpan,&cell.columnSpan)) {
+			VBufStorage_tableGrid_t& grid=tableGrids[tableID];
+			cell.node=tempNode;
+			grid.cells.insert(make_pair(make_pair(row,column),cell));
+			grid.maxRowSpan=max(grid.maxRowSpan,cell.rowSpan);
+			grid.maxColumnSpan=max(grid.maxColumnSpan,cell.columnSpan);
+		}
+		if(tempNode->firstChild) {
+			tempNode=tempNode->firstChild;
+			continue;
+		}
+		while(tempNode!=node&&!tempNode->next) tempNode=tempNode->parent;
+		tempNode=(tempNode!=node)?tempNode->next:NULL;
+	}
+}
+
+void VBufStorage_buffer_t::removeTableCell(VBufStorage_fieldNode_t* node) {
+	wstring tableID;
+	int row, column, rowSpan, columnSpan;
+	if(!getTableCellCoordinates(node,tableID,&row,&column,&rowSpan,&columnSpan)) return;
+	map<wstring,VBufStorage_tableGrid_t>::iterator i=tableGrids.find(tableID);
+	if(i==tableGrids.end()) return;
+	multimap<pair<int,int>,VBufStorage_tableGridCell_t>& cells=i->second.cells;
+	pair<multimap<pair<int,int>,VBufStorage_tableGridCell_t>::iterator,multimap<pair<int,int>,VBufStorage_tableGridCell_t>::iterator> range=cells.equal_range(make_pair(row,column));
+	for(multimap<pair<int,int>,VBufStorage_tableGridCell_t>::iterator j=range.first;j!=range.second;++j) {
+		if(j->second.node==node) {
+			cells.erase(j);
+			break;
+		}
+	}
+	if(cells.empty()) tableGrids.erase(i);
+}
+
+VBufStorage_fieldNode_t* VBufStorage_buffer_t::getTableCell(const wstring& tableID, int row, int column, int* startOffset, int* endOffset) {
+	if(tableGridsVersion!=version) {
+		TRACE_SCOPE("VBufStorage_buffer_t::buildTableGrids");
+		LOG_DEBUG(L"Buffer has changed, building table grids");
+		tableGrids.clear();
+		if(this->rootNode) addTableCells(this->rootNode);
+		tableGridsVersion=version;
+	}
+	map<wstring,VBufStorage_tableGrid_t>::const_iterator i=tableGrids.find(tableID);
+	if(i==tableGrids.end()) {
+		LOG_DEBUG(L"No table with ID "<<tableID<<L", returning NULL");
+		return NULL;
+	}
+	const VBufStorage_tableGrid_t& grid=i->second;
+	//Only cells starting at most maxRowSpan-1 rows and maxColumnSpan-1 columns before the given row and column can cover it.
+	//Spans can be as large as their attributes say, so work in long long to avoid overflowing.
+	long long firstColumn=static_cast<long long>(column)-grid.maxColumnSpan+1;
+	pair<int,int> from(static_cast<int>(max(static_cast<long long>(row)-grid.maxRowSpan+1,static_cast<long long>(INT_MIN))),static_cast<int>(max(firstColumn,static_cast<long long>(INT_MIN))));
+	VBufStorage_fieldNode_t* node=NULL;
+	int nodeStart=-1;
+	for(multimap<pair<int,int>,VBufStorage_tableGridCell_t>::const_iterator j=grid.cells.lower_bound(from);j!=grid.cells.end()&&j->first.first<=row;) {
+		int cellRow=j->first.first;
+		int cellColumn=j->first.second;
+		if(cellColumn<firstColumn) {
+			j=grid.cells.lower_bound(make_pair(cellRow,from.second));
+			continue;
+		}
+		if(cellColumn>column) {
+			//Skip to the next row.
+			if(cellRow==INT_MAX) break;
+			j=grid.cells.lower_bound(make_pair(cellRow+1,from.second));
+			continue;
+		}
+		const VBufStorage_tableGridCell_t& cell=j->second;
+		++j;
+		if(static_cast<long long>(row)-cellRow>=cell.rowSpan||static_cast<long long>(column)-cellColumn>=cell.columnSpan) continue;
+		if(cell.node->length==0||cell.node->hidden) continue;
+		//Where cells overlap, the first in the buffer is found, and an enclosing cell comes before the cells with in it.
+		if(!node) {
+			node=cell.node;
+			continue;
+		}
+		if(nodeStart<0) nodeStart=node->calculateOffsetInTree();
+		int cellStart=cell.node->calculateOffsetInTree();
+		if(cellStart<nodeStart||(cellStart==nodeStart&&cell.node->length>node->length)) {
+			node=cell.node;
+			nodeStart=cellStart;
+		}
+	}
+	if(!node) {
+		LOG_DEBUG(L"No cell with text covers row "<<row<<L", column "<<column<<L" in table "<<tableID<<L", returning NULL");
+		return NULL;
+	}
+	*startOffset=(nodeStart>=0)?nodeStart:node->calculateOffsetInTree();
+	*endOffset=(*startOffset)+node->length;
+	return node;
+}
+
+/**
+ * Orders outline entries as their nodes appear in the buffer.
+ * Nodes starting at the same offset are in the buffer from the outermost to the innermost.
+ */
+bool isOutlineEntryBefore(const VBufStorage_outlineEntry_t& a, const VBufStorage_outlineEntry_t& b) {
+	if(a.startOffset!=b.startOffset) return a.startOffset<b.startOffset;
+	return a.depth<b.depth;
+}
+
+bool VBufStorage_buffer_t::canUpdateOutlineNodes() const {
+	return outlineNodesVersion==version;
+}
+
+void VBufStorage_buffer_t::addOutlineNodes(VBufStorage_fieldNode_t* node, unsigned int categories) {
+	categories&=(outlineCategories.size()<VBufStorage_maxOutlineCategories)?((1u<<outlineCategories.size())-1):~0u;
+	if(categories==0) return;
+	for(VBufStorage_fieldNode_t* tempNode=node;tempNode!=NULL;) {
+		unsigned int nodeCategories=0;
+		for(size_t i=0;i<outlineCategories.size();++i) {
+			if((categories&(1u<<i))&&outlineCategories[i].query.matches(tempNode)) nodeCategories|=(1u<<i);
+		}
+		if(nodeCategories) outlineNodes[tempNode]|=nodeCategories;
+		if(tempNode->firstChild) {
+			tempNode=tempNode->firstChild;
+			continue;
+		}
+		while(tempNode!=node&&!tempNode->next) tempNode=tempNode->parent;
+		tempNode=(tempNode!=node)?tempNode->next:NULL;
+	}
+}
+
+int VBufStorage_buffer_t::addOutlineCategory(const wstring& attribs, const wstring& regexp) {
+	for(size_t i=0;i<outlineCategories.size();++i) {
+		if(outlineCategories[i].attribs==attribs&&outlineCategories[i].regexp==regexp) return static_cast<int>(i);
+	}
+	if(outlineCategories.size()>=VBufStorage_maxOutlineCategories) {
+		LOG_DEBUGWARNING(L"Already "<<outlineCategories.size()<<L" outline categories, returning -1");
+		return -1;
+	}
+	try {
+		outlineCategories.push_back(VBufStorage_outlineCategory_t(attribs,regexp));
+	} catch (...) {
+		LOG_ERROR(L"Error in regular expression");
+		return -1;
+	}
+	int category=static_cast<int>(outlineCategories.size()-1);
+	//If outlineNodes is up to date, only the new category needs to be found, otherwise all categories will be found when it is next built.
+	if(canUpdateOutlineNodes()&&this->rootNode) {
+		TRACE_SCOPE("VBufStorage_buffer_t::addOutlineNodes");
+		addOutlineNodes(this->rootNode,1u<<category);
+	}
+	LOG_DEBUG(L"Added outline category "<<category<<L" with attributes "<<attribs<<L" and regexp "<<regexp);
+	return category;
+}
+
+void VBufStorage_buffer_t::getOutline(unsigned int categories, int firstEntry, int maxEntries, int* entryCount, VBufStorage_fieldNode_t** nodes, unsigned int* nodeCategories, int* startOffsets, int* endOffsets, int* totalEntryCount) {
+	if(outlineNodesVersion!=version) {
+		TRACE_SCOPE("VBufStorage_buffer_t::addOutlineNodes");
+		LOG_DEBUG(L"Buffer has changed, finding outline nodes");
+		outlineNodes.clear();
+		if(this->rootNode) addOutlineNodes(this->rootNode,~0u);
+		outlineNodesVersion=version;
+	}
+	if(outlineEntriesVersion!=version||outlineEntriesCategoryCount!=outlineCategories.size()) {
+		TRACE_SCOPE("VBufStorage_buffer_t::getOutline sorting");
+		outlineEntries.clear();
+		//The start offset of each node is found from the start offsets of its ancestors,
+		//each list of children being walked at most once to find the start offsets of all the children.
+		map<VBufStorage_fieldNode_t*,int> knownStartOffsets;
+		for(map<VBufStorage_fieldNode_t*,unsigned int>::const_iterator i=outlineNodes.begin();i!=outlineNodes.end();++i) {
+			VBufStorage_fieldNode_t* node=i->first;
+			if(node->length==0||node->hidden) continue;
+			vector<VBufStorage_fieldNode_t*> ancestors;
+			VBufStorage_fieldNode_t* known=node;
+			map<VBufStorage_fieldNode_t*,int>::const_iterator knownOffset;
+			for(;known!=NULL&&(knownOffset=knownStartOffsets.find(known))==knownStartOffsets.end();known=known->parent) ancestors.push_back(known);
+			int startOffset=(known!=NULL)?knownOffset->second:0;
+			//Walk back down from the nearest ancestor with a known start offset, or from above the root.
+			for(vector<VBufStorage_fieldNode_t*>::reverse_iterator j=ancestors.rbegin();j!=ancestors.rend();++j) {
+				VBufStorage_fieldNode_t* parent=(*j)->parent;
+				if(parent==NULL) {
+					knownStartOffsets[*j]=0;
+					continue;
+				}
+				int childStart=startOffset;
+				for(VBufStorage_fieldNode_t* child=parent->firstChild;child!=NULL;child=child->next) {
+					knownStartOffsets[child]=childStart;
+					if(child==*j) startOffset=childStart;
+					childStart+=child->length;
+				}
+			}
+			VBufStorage_outlineEntry_t entry={node,i->second,startOffset,startOffset+node->length,static_cast<int>(ancestors.size())};
+			for(VBufStorage_fieldNode_t* ancestor=known;ancestor!=NULL;ancestor=ancestor->parent) ++entry.depth;
+			outlineEntries.push_back(entry);
+		}
+		sort(outlineEntries.begin(),outlineEntries.end(),isOutlineEntryBefore);
+		outlineEntriesVersion=version;
+		outlineEntriesCategoryCount=outlineCategories.size();
+	}
+	*entryCount=0;
+	*totalEntryCount=0;
+	for(vector<VBufStorage_outlineEntry_t>::const_iterator i=outlineEntries.begin();i!=outlineEntries.end();++i) {
+		if(!(i->categories&categories)) continue;
+		if(*totalEntryCount>=firstEntry&&*entryCount<maxEntries) {
+			nodes[*entryCount]=i->node;
+			nodeCategories[*entryCount]=i->categories;
+			startOffsets[*entryCount]=i->startOffset;
+			endOffsets[*entryCount]=i->endOffset;
+			++(*entryCount);
+		}
+		++(*totalEntryCount);
+	}
+	LOG_DEBUG(L"Fetched "<<*entryCount<<L" of "<<*totalEntryCount<<L" outline nodes");
 }
 
 VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset, VBufStorage_findDirection_t direction, const std::wstring& attribs, const std::wstring &regexp, int *startOffset, int *endOffset) {
@@ -914,14 +2151,9 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 		LOG_DEBUGWARNING(L"Could not find node at offset "<<offset<<L", returning NULL");
 		return NULL;
 	}
-	// Split attribs at spaces.
-	vector<wstring> attribsList;
-	copy(istream_iterator<wstring, wchar_t, std::char_traits<wchar_t>>(wistringstream(attribs)),
-		istream_iterator<wstring, wchar_t, std::char_traits<wchar_t>>(),
-		back_inserter<vector<wstring> >(attribsList));
-	wregex regexObj;
+	VBufStorage_attributeQuery_t query;
 	try {
-		regexObj=wregex(regexp);
+		query=VBufStorage_attributeQuery_t(attribs,regexp);
 	} catch (...) {
 		LOG_ERROR(L"Error in regular expression");
 		return NULL;
@@ -930,12 +2162,17 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 	LOG_DEBUG(L"initial start is "<<bufferStart<<L" and initial end is "<<bufferEnd);
 	if(direction==VBufStorage_findDirection_forward) {
 		LOG_DEBUG(L"searching forward");
-		for(node=node->nextNodeInTree(TREEDIRECTION_FORWARD,NULL,&tempRelativeStart);node!=NULL;node=node->nextNodeInTree(TREEDIRECTION_FORWARD,NULL,&tempRelativeStart)) {
+		//Subtrees with nothing a search can find, such as large hidden regions, are stepped over rather than walked.
+		for(node=node->nextNodeInTree(TREEDIRECTION_FORWARD,NULL,&tempRelativeStart,VBufStorage_subtreeFlag_hasVisible);node!=NULL;node=node->nextNodeInTree(TREEDIRECTION_FORWARD,NULL,&tempRelativeStart,VBufStorage_subtreeFlag_hasVisible)) {
+			if(queryDeadline.hasExpired()) {
+				node=NULL;
+				break;
+			}
 			bufferStart+=tempRelativeStart;
 			bufferEnd=bufferStart+node->length;
 			LOG_DEBUG(L"start is now "<<bufferStart<<L" and end is now "<<bufferEnd);
 			LOG_DEBUG(L"Checking node "<<node->getDebugInfo());
-			if(node->length>0&&!(node->isHidden)&&node->matchAttributes(attribsList,regexObj)) {
+			if(node->length>0&&!(node->hidden)&&query.matches(node)) {
 				LOG_DEBUG(L"found a match");
 				break;
 			}
@@ -943,11 +2180,15 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 	} else if(direction==VBufStorage_findDirection_back) {
 		LOG_DEBUG(L"searching back");
 		bool skippedFirstMatch=false;
-		for(node=node->nextNodeInTree(TREEDIRECTION_BACK,NULL,&tempRelativeStart);node!=NULL;node=node->nextNodeInTree(TREEDIRECTION_BACK,NULL,&tempRelativeStart)) {
+		for(node=node->nextNodeInTree(TREEDIRECTION_BACK,NULL,&tempRelativeStart,VBufStorage_subtreeFlag_hasVisible);node!=NULL;node=node->nextNodeInTree(TREEDIRECTION_BACK,NULL,&tempRelativeStart,VBufStorage_subtreeFlag_hasVisible)) {
+			if(queryDeadline.hasExpired()) {
+				node=NULL;
+				break;
+			}
 			bufferStart+=tempRelativeStart;
 			bufferEnd=bufferStart+node->length;
 			LOG_DEBUG(L"start is now "<<bufferStart<<L" and end is now "<<bufferEnd);
-			if(node->length>0&&!(node->isHidden)&&node->matchAttributes(attribsList,regexObj)) {
+			if(node->length>0&&!(node->hidden)&&query.matches(node)) {
 				//Skip first containing parent match or parent match where offset hasn't changed 
 				if((bufferStart==offset)||(!skippedFirstMatch&&bufferStart<offset&&bufferEnd>offset)) {
 					LOG_DEBUG(L"skipping initial parent");
@@ -967,7 +2208,7 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 			if(node) {
 				bufferEnd=bufferStart+node->length;
 			}
-		} while(node!=NULL&&(node->isHidden||!node->matchAttributes(attribsList,regexObj)));
+		} while(node!=NULL&&(node->hidden||!query.matches(node)));
 		LOG_DEBUG(L"end is now "<<bufferEnd);
 	}
 	if(node==NULL) {
@@ -980,19 +2221,207 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 	return node;
 }
 
+/**
+ * Finds the first occurrence of some characters in a run of text, with out the run needing to be null terminated.
+ * Places where the first and last characters both match are found a block of characters at a time with SSE2, and only those are compared in full.
+ * @param from the position in the text to start at.
+ * @return the position of the occurrence, or wstring::npos if there is none.
+ */
+size_t findCharacters(const wchar_t* text, size_t textLength, const wchar_t* chars, size_t charsLength, size_t from) {
+	if(charsLength==0||textLength<charsLength||from>textLength-charsLength) return wstring::npos;
+	size_t pos=from;
+	size_t lastStart=textLength-charsLength;
+#ifdef VBUFSTORAGE_SSE2
+	if(canUseSSE2()) {
+		const size_t blockLength=sizeof(__m128i)/sizeof(wchar_t);
+#if WCHAR_MAX<=0xFFFF
+		const __m128i first=_mm_set1_epi16(static_cast<short>(chars[0]));
+		const __m128i last=_mm_set1_epi16(static_cast<short>(chars[charsLength-1]));
+#define VBUFSTORAGE_CMPEQ _mm_cmpeq_epi16
+#else
+		const __m128i first=_mm_set1_epi32(static_cast<int>(chars[0]));
+		const __m128i last=_mm_set1_epi32(static_cast<int>(chars[charsLength-1]));
+#define VBUFSTORAGE_CMPEQ _mm_cmpeq_epi32
+#endif
+		for(;pos+blockLength<=lastStart+1;pos+=blockLength) {
+			__m128i firstBlock=_mm_loadu_si128(reinterpret_cast<const __m128i*>(text+pos));
+			__m128i lastBlock=_mm_loadu_si128(reinterpret_cast<const __m128i*>(text+pos+charsLength-1));
+			int mask=_mm_movemask_epi8(_mm_and_si128(VBUFSTORAGE_CMPEQ(firstBlock,first),VBUFSTORAGE_CMPEQ(lastBlock,last)));
+			if(mask==0) continue;
+			//Each character sets one bit of the mask for each of its bytes.
+			for(size_t i=0;i<blockLength;++i) {
+				if((mask&(1<<(i*sizeof(wchar_t))))&&(charsLength<=2||wmemcmp(text+pos+i+1,chars+1,charsLength-2)==0)) return pos+i;
+			}
+		}
+#undef VBUFSTORAGE_CMPEQ
+	}
+#endif
+	for(;pos<=lastStart;++pos) {
+		const wchar_t* found=wmemchr(text+pos,chars[0],lastStart-pos+1);
+		if(!found) break;
+		pos=found-text;
+		if(wmemcmp(text+pos+1,chars+1,charsLength-1)==0) return pos;
+	}
+	return wstring::npos;
+}
+
+/**
+ * Finds the last occurrence of some characters in a run of text, see findCharacters.
+ * @return the position of the occurrence, or wstring::npos if there is none.
+ */
+size_t findLastCharacters(const wchar_t* text, size_t textLength, const wchar_t* chars, size_t charsLength) {
+	size_t last=wstring::npos;
+	for(size_t pos=findCharacters(text,textLength,chars,charsLength,0);pos!=wstring::npos;pos=findCharacters(text,textLength,chars,charsLength,pos+1)) {
+		last=pos;
+	}
+	return last;
+}
+
+/**
+ * Converts text to lower case a character at a time, so that it can be compared with out regard to case while keeping its length.
+ * @param from the position in the text to start at, so text already converted is not converted again.
+ */
+void foldCase(wstring& text, size_t from=0) {
+	for(wstring::iterator i=text.begin()+from;i!=text.end();++i) {
+		*i=towlower(*i);
+	}
+}
+
+/**
+ * The number of characters of text gathered from consecutive text field nodes before they are searched, see VBufStorage_buffer_t::findText.
+ */
+const size_t VBufStorage_findTextChunkLength=4096;
+
+bool VBufStorage_buffer_t::findText(int offset, const std::wstring& text, bool reverse, bool caseSensitive, int* startOffset, int* endOffset) {
+	TRACE_SCOPE("VBufStorage_buffer_t::findText");
+	if(this->rootNode==NULL||text.empty()) {
+		LOG_DEBUGWARNING(L"Buffer is empty or no text given, returning false");
+		return false;
+	}
+	if(offset<0||offset>this->rootNode->length) {
+		LOG_DEBUGWARNING(L"Invalid offset: "<<offset);
+		return false;
+	}
+	LOG_DEBUG(L"Finding text of length "<<text.length()<<L" from offset "<<offset<<(reverse?L" back":L" forward"));
+	wstring needle(text);
+	if(!caseSensitive) foldCase(needle);
+	const size_t needleLength=needle.length();
+	//Most text field nodes hold only a few characters, so rather than searching each on its own, the text of consecutive nodes is gathered in to a chunk of limited length and searched at once.
+	//Each chunk keeps the needleLength-1 characters next to the previous one, so matches spanning chunks are found, with out the text of the whole buffer ever being held.
+	int nodeStart, nodeEnd, tempRelativeStart;
+	wstring chunk;
+	chunk.reserve(VBufStorage_findTextChunkLength+needleLength);
+	int foundStart=-1;
+	if(!reverse) {
+		//Find the first match starting at or after offset.
+		if(offset==this->rootNode->length) return false;
+		VBufStorage_fieldNode_t* node=this->locateTextFieldNodeAtOffset(offset,&nodeStart,&nodeEnd);
+		if(node==NULL) return false;
+		int chunkStart=offset;
+		size_t nodeRelativeStart=offset-nodeStart;
+		size_t foldedLength=0;
+		while(node!=NULL) {
+			if(queryDeadline.hasExpired()) {
+				LOG_DEBUGWARNING(L"Gave up finding text, returning false");
+				return false;
+			}
+			//Only text field nodes have length with out having children.
+			if(node->firstChild==NULL&&node->length>0) {
+				chunk.append(static_cast<VBufStorage_textFieldNode_t*>(node)->getText(),nodeRelativeStart,wstring::npos);
+				nodeRelativeStart=0;
+			}
+			node=node->nextNodeInTree(TREEDIRECTION_FORWARD,NULL,&tempRelativeStart);
+			if(node!=NULL&&chunk.length()<VBufStorage_findTextChunkLength) continue;
+			if(!caseSensitive) foldCase(chunk,foldedLength);
+			size_t pos=findCharacters(chunk.c_str(),chunk.length(),needle.c_str(),needleLength,0);
+			if(pos!=wstring::npos) {
+				foundStart=chunkStart+static_cast<int>(pos);
+				break;
+			}
+			size_t keepLength=min(chunk.length(),needleLength-1);
+			chunkStart+=static_cast<int>(chunk.length()-keepLength);
+			chunk.erase(0,chunk.length()-keepLength);
+			foldedLength=keepLength;
+		}
+	} else {
+		//Find the last match ending at or before offset.
+		if(offset==0) return false;
+		VBufStorage_fieldNode_t* node=this->locateTextFieldNodeAtOffset(offset-1,&nodeStart,&nodeEnd);
+		if(node==NULL) return false;
+		//Nodes are visited last to first, so the text of each is noted until there is enough for a chunk, and then copied in to it in order.
+		vector<pair<const wchar_t*,size_t> > pieces;
+		size_t piecesLength=0;
+		int chunkEnd=offset;
+		//Only the start of the node containing offset is searched, and the whole of each node before it.
+		size_t relativeEnd=offset-nodeStart;
+		while(node!=NULL) {
+			if(queryDeadline.hasExpired()) {
+				LOG_DEBUGWARNING(L"Gave up finding text, returning false");
+				return false;
+			}
+			if(node->firstChild==NULL&&node->length>0) {
+				const wstring& nodeText=static_cast<VBufStorage_textFieldNode_t*>(node)->getText();
+				size_t length=min(relativeEnd,nodeText.length());
+				pieces.push_back(make_pair(nodeText.c_str(),length));
+				piecesLength+=length;
+				relativeEnd=wstring::npos;
+			}
+			node=node->nextNodeInTree(TREEDIRECTION_BACK,NULL,&tempRelativeStart);
+			if(node!=NULL&&piecesLength<VBufStorage_findTextChunkLength) continue;
+			//chunk already holds the start of the chunk after this one.
+			chunk.insert(0,piecesLength,L'\0');
+			size_t chunkPos=0;
+			for(vector<pair<const wchar_t*,size_t> >::reverse_iterator i=pieces.rbegin();i!=pieces.rend();++i) {
+				chunk.replace(chunkPos,i->second,i->first,i->second);
+				chunkPos+=i->second;
+			}
+			if(!caseSensitive) {
+				wstring::iterator foldEnd=chunk.begin()+piecesLength;
+				for(wstring::iterator i=chunk.begin();i!=foldEnd;++i) *i=towlower(*i);
+			}
+			pieces.clear();
+			piecesLength=0;
+			size_t pos=findLastCharacters(chunk.c_str(),chunk.length(),needle.c_str(),needleLength);
+			if(pos!=wstring::npos) {
+				foundStart=chunkEnd-static_cast<int>(chunk.length()-pos);
+				break;
+			}
+			size_t keepLength=min(chunk.length(),needleLength-1);
+			chunkEnd-=static_cast<int>(chunk.length()-keepLength);
+			chunk.erase(keepLength);
+		}
+	}
+	if(foundStart<0) {
+		LOG_DEBUG(L"Text not found, returning false");
+		return false;
+	}
+	*startOffset=foundStart;
+	*endOffset=foundStart+static_cast<int>(needleLength);
+	LOG_DEBUG(L"Found text at offsets "<<*startOffset<<L" and "<<*endOffset<<L", returning true");
+	return true;
+}
+
 bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool useScreenLayout, int *startOffset, int *endOffset) {
 	if(this->rootNode==NULL||offset>=this->rootNode->length) {
 		LOG_DEBUGWARNING(L"Offset of "<<offset<<L" too big for buffer, returning false");
 		return false;
 	}
-	LOG_DEBUG(L"Calculating line offsets, using offset "<<offset<<L", with max line length of "<<maxLineLength<<L", useing screen layout "<<useScreenLayout);
 	int initBufferStart, initBufferEnd;
 	VBufStorage_fieldNode_t* initNode=locateTextFieldNodeAtOffset(offset,&initBufferStart,&initBufferEnd);
+	if(initNode==NULL) {
+		LOG_DEBUGWARNING(L"Could not locate node at offset "<<offset<<L", returning false");
+		return false;
+	}
+	return this->getLineOffsetsFromNode(initNode,initBufferStart,initBufferEnd,offset,maxLineLength,useScreenLayout,startOffset,endOffset);
+}
+
+bool VBufStorage_buffer_t::getLineOffsetsFromNode(VBufStorage_fieldNode_t* initNode, int initBufferStart, int initBufferEnd, int offset, int maxLineLength, bool useScreenLayout, int *startOffset, int *endOffset) {
+	LOG_DEBUG(L"Calculating line offsets, using offset "<<offset<<L", with max line length of "<<maxLineLength<<L", useing screen layout "<<useScreenLayout);
 	LOG_DEBUG(L"Starting at node "<<initNode->getDebugInfo());
 	std::set<int> possibleBreaks;
 	//Find the node at which to limit the search for line endings.
 	VBufStorage_fieldNode_t* limitBlockNode=NULL;
-	for(limitBlockNode=initNode->parent;limitBlockNode!=NULL&&!limitBlockNode->isBlock;limitBlockNode=limitBlockNode->parent);
+	for(limitBlockNode=initNode->parent;limitBlockNode!=NULL&&!limitBlockNode->block;limitBlockNode=limitBlockNode->parent);
 	//Some needed variables for searching back and forward
 	VBufStorage_fieldNode_t* node=NULL;
 	int relative, bufferStart, bufferEnd, tempRelativeStart;
@@ -1004,6 +2433,10 @@ bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool us
 	bufferEnd = initBufferEnd;
 	int lineEnd;
 	do {
+		if(queryDeadline.hasExpired()) {
+			LOG_DEBUGWARNING(L"Gave up searching forward for the end of the line, returning false");
+			return false;
+		}
 	possibleBreaks.insert(bufferStart);
 	possibleBreaks.insert(bufferEnd);
 		if(node->length>0&&node->firstChild==NULL) {
@@ -1034,9 +2467,9 @@ bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool us
 			}
 		}
 		//Move on to the next node.
-		node = node->nextNodeInTree(TREEDIRECTION_FORWARD,limitBlockNode,&tempRelativeStart);
+		node = node->nextNodeInTree(TREEDIRECTION_FORWARD,limitBlockNode,&tempRelativeStart,VBufStorage_subtreeFlag_hasLineContent);
 		//If not using screen layout, make sure not to pass in to another control field node
-		if(node&&((!useScreenLayout&&node->firstChild)||node->isBlock)) {
+		if(node&&((!useScreenLayout&&node->firstChild)||node->block)) {
 			node=NULL;
 		}
 		if(node) {
@@ -1053,6 +2486,10 @@ bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool us
 	int lineStart;
 	foundHardBreak=false;
 	do {
+		if(queryDeadline.hasExpired()) {
+			LOG_DEBUGWARNING(L"Gave up searching back for the start of the line, returning false");
+			return false;
+		}
 		possibleBreaks.insert(bufferStart);
 		possibleBreaks.insert(bufferEnd);
 		if(node->length>0&&node->firstChild==NULL) {
@@ -1083,9 +2520,9 @@ bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool us
 			}
 		}
 		//Move on to the previous node.
-		node = node->nextNodeInTree(TREEDIRECTION_SYMMETRICAL_BACK,useScreenLayout?limitBlockNode:node->parent,&tempRelativeStart);
+		node = node->nextNodeInTree(TREEDIRECTION_SYMMETRICAL_BACK,useScreenLayout?limitBlockNode:node->parent,&tempRelativeStart,VBufStorage_subtreeFlag_hasLineContent);
 		//If not using screen layout, make sure not to pass in to another control field node
-		if(node&&node->isBlock) {
+		if(node&&node->block) {
 			node=NULL;
 		}
 		if(node) {
@@ -1123,6 +2560,82 @@ bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool us
 	return true;
 }
 
+VBufStorage_lineStream_t::VBufStorage_lineStream_t(unsigned int versionArg, const VBufStorage_cursor_t& cursorArg, int maxLineLengthArg, bool useScreenLayoutArg): version(versionArg), cursor(cursorArg), maxLineLength(maxLineLengthArg), useScreenLayout(useScreenLayoutArg), atEnd(false) {
+}
+
+/**
+ * The most line streams a buffer keeps open.
+ */
+const size_t VBufStorage_maxLineStreams=16;
+
+VBufStorage_lineStream_t* VBufStorage_buffer_t::openLineStream(int offset, int maxLineLength, bool useScreenLayout) {
+	VBufStorage_cursor_t cursor(this);
+	if(!cursor.moveToOffset(offset)) {
+		LOG_DEBUGWARNING(L"Could not locate node at offset "<<offset<<L", returning NULL");
+		return NULL;
+	}
+	int lineStart, lineEnd;
+	if(!cursor.getLineOffsets(maxLineLength,useScreenLayout,&lineStart,&lineEnd)) {
+		LOG_DEBUGWARNING(L"Could not get line offsets at offset "<<offset<<L", returning NULL");
+		return NULL;
+	}
+	cursor.moveToOffset(lineStart);
+	if(lineStreams.size()>=VBufStorage_maxLineStreams) {
+		LOG_DEBUGWARNING(L"Too many line streams open, closing the oldest");
+		delete lineStreams.front();
+		lineStreams.pop_front();
+	}
+	VBufStorage_lineStream_t* stream=new VBufStorage_lineStream_t(version,cursor,maxLineLength,useScreenLayout);
+	lineStreams.push_back(stream);
+	LOG_DEBUG(L"Opened line stream at "<<stream<<L" from offset "<<lineStart);
+	return stream;
+}
+
+VBufStorage_textContainer_t* VBufStorage_buffer_t::readLineStream(VBufStorage_lineStream_t* stream, int maxLines, bool useMarkup, int* lineCount, int* startOffsets, int* endOffsets, int* textLengths) {
+	*lineCount=0;
+	if(find(lineStreams.begin(),lineStreams.end(),stream)==lineStreams.end()) {
+		LOG_DEBUGWARNING(L"Line stream at "<<stream<<L" is not open on this buffer, returning NULL");
+		return NULL;
+	}
+	if(stream->version!=version) {
+		LOG_DEBUG(L"Buffer has changed since line stream at "<<stream<<L" was opened, returning NULL");
+		return NULL;
+	}
+	wstring text;
+	while(*lineCount<maxLines&&!stream->atEnd) {
+		int lineStart, lineEnd;
+		if(!stream->cursor.getLineOffsets(stream->maxLineLength,stream->useScreenLayout,&lineStart,&lineEnd)) {
+			LOG_DEBUGWARNING(L"Could not get line offsets at offset "<<stream->cursor.getOffset());
+			break;
+		}
+		size_t oldTextLength=text.length();
+		this->rootNode->getTextInRange(lineStart,lineEnd,text,useMarkup,NULL,&queryDeadline);
+		if(queryDeadline.hasExpired()) {
+			// Leave out the incomplete line, so that the stream reads it again next time.
+			text.resize(oldTextLength);
+			break;
+		}
+		startOffsets[*lineCount]=lineStart;
+		endOffsets[*lineCount]=lineEnd;
+		textLengths[*lineCount]=static_cast<int>(text.length()-oldTextLength);
+		++(*lineCount);
+		if(!stream->cursor.moveToOffset(lineEnd)) stream->atEnd=true;
+	}
+	if(*lineCount==0&&queryDeadline.hasExpired()) {
+		LOG_DEBUGWARNING(L"Gave up reading line stream at "<<stream<<L", returning NULL");
+		return NULL;
+	}
+	LOG_DEBUG(L"Read "<<*lineCount<<L" lines from line stream at "<<stream);
+	return new VBufStorage_textContainer_t(move(text));
+}
+
+void VBufStorage_buffer_t::closeLineStream(VBufStorage_lineStream_t* stream) {
+	list<VBufStorage_lineStream_t*>::iterator i=find(lineStreams.begin(),lineStreams.end(),stream);
+	if(i==lineStreams.end()) return;
+	delete *i;
+	lineStreams.erase(i);
+}
+
 bool VBufStorage_buffer_t::hasContent() {
 	return (this->rootNode)?true:false;
 }
@@ -1141,6 +2654,266 @@ bool VBufStorage_buffer_t::isDescendantNode(VBufStorage_fieldNode_t* parent, VBu
 	return false;
 }
 
+unsigned int VBufStorage_buffer_t::getVersion() const {
+	return version;
+}
+
+void VBufStorage_buffer_t::setQueryTimeout(int milliseconds) {
+	queryTimeout=max(milliseconds,0);
+}
+
+void VBufStorage_buffer_t::startQueryDeadline() {
+	queryDeadline.start(static_cast<long long>(queryTimeout)*1000,&queryCancelCount);
+}
+
+bool VBufStorage_buffer_t::stopQueryDeadline() {
+	return queryDeadline.stop();
+}
+
+void VBufStorage_buffer_t::cancelQueries() {
+	queryCancelCount.fetch_add(1,memory_order_relaxed);
+}
+
+bool VBufStorage_buffer_t::freeze() {
+	if(frozenContent) {
+		LOG_DEBUGWARNING(L"Buffer already frozen, returning false");
+		return false;
+	}
+	if(!this->rootNode) {
+		LOG_DEBUGWARNING(L"Buffer is empty, returning false");
+		return false;
+	}
+	TRACE_SCOPE("VBufStorage_buffer_t::freeze");
+	//A frozen buffer is not being re-rendered, so there is no point keeping nodes for reuse.
+	retiredNodes.clear();
+	frozenContent=new VBufStorage_frozenContent_t();
+	map<wstring,unsigned int> stringIndexes;
+	unsigned long long unfrozenBytes=0;
+	for(set<VBufStorage_fieldNode_t*>::iterator i=nodes.begin();i!=nodes.end();++i) {
+		VBufStorage_fieldNode_t* node=*i;
+		unfrozenBytes+=node->freezeText(frozenContent->text);
+		const VBufStorage_attributeMap_t& attributes=node->getAttributes();
+		appendFrozenNumber(static_cast<unsigned int>(attributes.size()),frozenContent->attributes);
+		for(VBufStorage_attributeMap_t::const_iterator j=attributes.begin();j!=attributes.end();++j) {
+			unfrozenBytes+=(j->first.length()+j->second.length())*sizeof(wchar_t);
+			appendFrozenNumber(internFrozenString(j->first,stringIndexes,frozenContent->strings),frozenContent->attributes);
+			appendFrozenNumber(internFrozenString(j->second,stringIndexes,frozenContent->strings),frozenContent->attributes);
+		}
+		node->releaseAttributes();
+	}
+	nhAssert(attributeSets.empty());
+	frozenContent->text.shrink_to_fit();
+	frozenContent->strings.shrink_to_fit();
+	frozenContent->attributes.shrink_to_fit();
+	unsigned long long frozenBytes=frozenContent->text.size()+frozenContent->attributes.size();
+	for(vector<wstring>::const_iterator i=frozenContent->strings.begin();i!=frozenContent->strings.end();++i) {
+		frozenBytes+=i->length()*sizeof(wchar_t);
+	}
+	++freezeStats.freezeCount;
+	freezeStats.unfrozenBytes=unfrozenBytes;
+	freezeStats.frozenBytes=frozenBytes;
+	LOG_DEBUG(L"Froze "<<nodes.size()<<L" nodes, "<<unfrozenBytes<<L" bytes packed in to "<<frozenBytes);
+	return true;
+}
+
+bool VBufStorage_buffer_t::thaw() {
+	if(!frozenContent) {
+		return false;
+	}
+	TRACE_SCOPE("VBufStorage_buffer_t::thaw");
+	long long startTime=VBufMetrics_getMicroseconds();
+	const vector<wstring>& strings=frozenContent->strings;
+	const string& attributes=frozenContent->attributes;
+	size_t textPos=0;
+	size_t attributePos=0;
+	for(set<VBufStorage_fieldNode_t*>::iterator i=nodes.begin();i!=nodes.end();++i) {
+		VBufStorage_fieldNode_t* node=*i;
+		node->thawText(frozenContent->text,&textPos);
+		nhAssert(!node->attributes);
+		unsigned int attributeCount=readFrozenNumber(attributes,&attributePos);
+		if(attributeCount>0) node->attributes=new VBufStorage_attributeSet_t();
+		for(unsigned int j=0;j<attributeCount;++j) {
+			const wstring& name=strings[readFrozenNumber(attributes,&attributePos)];
+			const wstring& value=strings[readFrozenNumber(attributes,&attributePos)];
+			//The attributes were packed in order, so each belongs at the end of the map.
+			node->attributes->attributes.insert(node->attributes->attributes.end(),make_pair(name,value));
+		}
+	}
+	nhAssert(textPos==frozenContent->text.size());
+	nhAssert(attributePos==attributes.size());
+	delete frozenContent;
+	frozenContent=NULL;
+	shareNewContent(this->rootNode);
+	long long thawTime=VBufMetrics_getMicroseconds()-startTime;
+	++freezeStats.thawCount;
+	freezeStats.thawTime+=thawTime;
+	freezeStats.maxThawTime=max(freezeStats.maxThawTime,thawTime);
+	LOG_DEBUG(L"Thawed "<<nodes.size()<<L" nodes in "<<thawTime<<L" microseconds");
+	return true;
+}
+
+void VBufStorage_buffer_t::shareAttributes(VBufStorage_fieldNode_t* node) {
+	TRACE_SCOPE("VBufStorage_buffer_t::shareAttributes");
+	for(VBufStorage_fieldNode_t* tempNode=node;tempNode!=NULL;) {
+		VBufStorage_attributeSet_t* set=tempNode->attributes;
+		if(set&&!set->pool&&set->attributes.empty()) {
+			//A reused node may have been left an empty set.
+			tempNode->releaseAttributes();
+		} else if(set&&!set->pool) {
+			nhAssert(set->refCount==1); //Only shared sets are held by more than one node
+			set->hash=hashAttributes(set->attributes);
+			pair<VBufStorage_attributeSetPool_t::iterator,VBufStorage_attributeSetPool_t::iterator> range=attributeSets.equal_range(set->hash);
+			VBufStorage_attributeSetPool_t::iterator i=range.first;
+			for(;i!=range.second&&i->second->attributes!=set->attributes;++i);
+			if(i!=range.second) {
+				tempNode->releaseAttributes();
+				tempNode->attributes=i->second;
+				++(i->second->refCount);
+			} else {
+				set->pool=&attributeSets;
+				attributeSets.insert(make_pair(set->hash,set));
+			}
+		}
+		if(tempNode->firstChild) {
+			tempNode=tempNode->firstChild;
+			continue;
+		}
+		while(tempNode!=node&&!tempNode->next) tempNode=tempNode->parent;
+		tempNode=(tempNode!=node)?tempNode->next:NULL;
+	}
+}
+
+/**
+ * A node of a subtree being searched by VBufStorage_buffer_t::shareSubtrees, which lists the nodes in depth-first order.
+ */
+typedef struct {
+	VBufStorage_fieldNode_t* node;
+	// The number of nodes in the subtree at this node, including itself, so the subtree is this entry and the size-1 entries after it.
+	size_t size;
+	// The hash of the content of all the nodes in the subtree and of how they are arranged.
+	size_t hash;
+} VBufStorage_subtreeEntry_t;
+
+void VBufStorage_buffer_t::shareSubtrees(VBufStorage_fieldNode_t* node) {
+	if(!node) return;
+	TRACE_SCOPE("VBufStorage_buffer_t::shareSubtrees");
+	//Nodes with the same attributes must hold the same set for their content to be compared by it.
+	shareAttributes(node);
+	vector<VBufStorage_subtreeEntry_t> entries;
+	for(VBufStorage_fieldNode_t* tempNode=node;tempNode!=NULL;) {
+		VBufStorage_subtreeEntry_t entry={tempNode,1,0};
+		entries.push_back(entry);
+		if(tempNode->firstChild) {
+			tempNode=tempNode->firstChild;
+			continue;
+		}
+		while(tempNode!=node&&!tempNode->next) tempNode=tempNode->parent;
+		tempNode=(tempNode!=node)?tempNode->next:NULL;
+	}
+	//Working back from the end, the children of each node have their size and hash by the time the node is reached.
+	for(size_t i=entries.size();i-->0;) {
+		VBufStorage_subtreeEntry_t& entry=entries[i];
+		entry.hash=entry.node->hashContent();
+		if(!entry.node->firstChild) continue;
+		for(size_t child=i+1;;child+=entries[child].size) {
+			entry.size+=entries[child].size;
+			entry.hash=entry.hash*31+entries[child].hash;
+			if(!entries[child].node->next) break;
+		}
+	}
+	//Working forward, each subtree the same as an earlier one shares its content and is not searched further.
+	multimap<size_t,size_t> earlierSubtrees;
+	size_t sharedNodeCount=0;
+	for(size_t i=0;i<entries.size();) {
+		pair<multimap<size_t,size_t>::const_iterator,multimap<size_t,size_t>::const_iterator> range=earlierSubtrees.equal_range(entries[i].hash);
+		size_t size=entries[i].size;
+		multimap<size_t,size_t>::const_iterator earlier=range.first;
+		for(;earlier!=range.second;++earlier) {
+			//Listed in depth-first order, the same subtrees have the same content and size at each position.
+			size_t j=0;
+			if(entries[earlier->second].size==size) {
+				for(;j<size&&entries[earlier->second+j].size==entries[i+j].size&&entries[earlier->second+j].node->hasSameContent(entries[i+j].node);++j);
+			}
+			if(j==size) break;
+		}
+		if(earlier==range.second) {
+			earlierSubtrees.insert(make_pair(entries[i].hash,i));
+			++i;
+			continue;
+		}
+		for(size_t j=0;j<size;++j) {
+			entries[i+j].node->shareContent(entries[earlier->second+j].node);
+		}
+		sharedNodeCount+=size;
+		i+=size;
+	}
+	LOG_DEBUG(L"Shared the content of "<<sharedNodeCount<<L" of "<<entries.size()<<L" nodes");
+}
+
+void VBufStorage_buffer_t::setSubtreeSharing(bool enable) {
+	subtreeSharing=enable;
+	if(enable&&this->rootNode&&!frozenContent) shareSubtrees(this->rootNode);
+}
+
+void VBufStorage_buffer_t::shareNewContent(VBufStorage_fieldNode_t* node) {
+	if(subtreeSharing) {
+		shareSubtrees(node);
+	} else {
+		shareAttributes(node);
+	}
+}
+
+bool VBufStorage_buffer_t::isFrozen() const {
+	return frozenContent!=NULL;
+}
+
+void VBufStorage_buffer_t::getFreezeStats(VBufStorage_freezeStats_t* stats) const {
+	*stats=freezeStats;
+}
+
+void VBufStorage_buffer_t::getMemoryUsage(VBufStorage_memoryUsage_t* usage) const {
+	*usage=VBufStorage_memoryUsage_t();
+	usage->nodes=memoryUsage_tree<VBufStorage_fieldNode_t*>(nodes.size());
+	for(set<VBufStorage_fieldNode_t*>::const_iterator i=nodes.begin();i!=nodes.end();++i) {
+		(*i)->getMemoryUsage(usage);
+	}
+	usage->identifierIndex=memoryUsage_tree<map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::value_type>(controlFieldNodesByIdentifier.size());
+	if(frozenContent) {
+		usage->text+=sizeof(VBufStorage_frozenContent_t)+memoryUsage_string(frozenContent->text);
+		usage->attributes+=memoryUsage_vector(frozenContent->strings)+memoryUsage_string(frozenContent->attributes);
+		for(vector<wstring>::const_iterator i=frozenContent->strings.begin();i!=frozenContent->strings.end();++i) {
+			usage->attributes+=memoryUsage_string(*i);
+		}
+	}
+	for(VBufStorage_attributeSetPool_t::const_iterator i=attributeSets.begin();i!=attributeSets.end();++i) {
+		usage->attributes+=getAttributeSetMemoryUsage(*(i->second));
+	}
+	usage->otherIndexes=memoryUsage_tree<VBufStorage_attributeSetPool_t::value_type>(attributeSets.size());
+	usage->otherIndexes+=memoryUsage_tree<map<wstring,VBufStorage_tableGrid_t>::value_type>(tableGrids.size());
+	for(map<wstring,VBufStorage_tableGrid_t>::const_iterator i=tableGrids.begin();i!=tableGrids.end();++i) {
+		usage->otherIndexes+=memoryUsage_string(i->first)+memoryUsage_tree<multimap<pair<int,int>,VBufStorage_tableGridCell_t>::value_type>(i->second.cells.size());
+	}
+	//The compiled regular expressions of outline categories are not included, as their size is not known.
+	usage->otherIndexes+=memoryUsage_vector(outlineCategories);
+	for(vector<VBufStorage_outlineCategory_t>::const_iterator i=outlineCategories.begin();i!=outlineCategories.end();++i) {
+		usage->otherIndexes+=memoryUsage_string(i->attribs)+memoryUsage_string(i->regexp)+i->query.getMemoryUsage();
+	}
+	usage->otherIndexes+=memoryUsage_tree<map<VBufStorage_fieldNode_t*,unsigned int>::value_type>(outlineNodes.size());
+	usage->otherIndexes+=memoryUsage_vector(outlineEntries);
+	usage->otherIndexes+=(lineStreams.size()+1)*memoryUsage_listEntry<VBufStorage_lineStream_t*>()+lineStreams.size()*sizeof(VBufStorage_lineStream_t);
+	retiredNodes.getMemoryUsage(usage);
+}
+
+void VBufStorage_buffer_t::takeRetiredNodes(VBufStorage_nodePool_t& pool) {
+	nhAssert(pool.size()==0); //Pool must be empty
+	LOG_DEBUG(L"Taking "<<retiredNodes.size()<<L" retired nodes");
+	retiredNodes.swap(pool);
+}
+
+void VBufStorage_buffer_t::setNodePool(VBufStorage_nodePool_t* pool) {
+	nodePool=pool;
+}
+
 bool VBufStorage_buffer_t::isNodeInBuffer(VBufStorage_fieldNode_t* node) {
 	return this->nodes.count(node)?true:false;
 }
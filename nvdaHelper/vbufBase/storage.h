@@ -15,6 +15,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #ifndef VIRTUALBUFFER_STORAGE_H
 #define VIRTUALBUFFER_STORAGE_H
 
+#include <atomic>
 #include <string>
 #include <map>
 #include <set>
@@ -40,6 +41,15 @@ typedef enum {
 	TREEDIRECTION_SYMMETRICAL_BACK
 } TreeDirection;
 
+/**
+ * Flags summarising a node and its descendants, so that walks of the tree can step over subtrees holding nothing they look for.
+ */
+typedef enum {
+	VBufStorage_subtreeFlag_known=1,
+	VBufStorage_subtreeFlag_hasVisible=2,
+	VBufStorage_subtreeFlag_hasLineContent=4
+} VBufStorage_subtreeFlag_t;
+
 class VBufStorage_textContainer_t: protected std::wstring {
 	protected:
 	~VBufStorage_textContainer_t();
@@ -56,6 +66,9 @@ class VBufStorage_fieldNode_t;
 class VBufStorage_controlFieldNode_t;
 class VBufStorage_textFieldNode_t;
 class VBufStorage_controlFieldNodeIdentifier_t;
+class VBufStorage_deadline_t;
+class VBufStorage_memoryUsage_t;
+class VBufStorage_nodePool_t;
 
 /**
  * a list of control field nodes.
@@ -97,6 +110,110 @@ class VBufStorage_controlFieldNodeIdentifier_t {
  */
 typedef std::map<std::wstring,std::wstring> VBufStorage_attributeMap_t;
 
+/**
+ * The attributes of a node that has none.
+ */
+extern const VBufStorage_attributeMap_t VBufStorage_noAttributes;
+
+class VBufStorage_attributeSet_t;
+
+/**
+ * The shared attribute sets of a buffer by the hash of their attributes, see VBufStorage_buffer_t::shareAttributes.
+ */
+typedef std::multimap<size_t,VBufStorage_attributeSet_t*> VBufStorage_attributeSetPool_t;
+
+/**
+ * The attributes of one or more nodes.
+ * Nodes with the same attributes share one set once their buffer has shared them, see VBufStorage_buffer_t::shareAttributes.
+ * A node changing a shared set gets its own copy of it first.
+ */
+class VBufStorage_attributeSet_t {
+	public:
+
+	VBufStorage_attributeMap_t attributes;
+
+/**
+ * The number of nodes holding this set.
+ */
+	unsigned int refCount;
+
+/**
+ * The pool of the buffer sharing this set, or NULL if it is not shared, in which case it is held by only one node and may be changed.
+ */
+	VBufStorage_attributeSetPool_t* pool;
+
+/**
+ * The hash of the attributes, which is only valid while the set is in a pool.
+ */
+	size_t hash;
+
+/**
+ * constructor, making an empty set held by one node that is not shared.
+ */
+	VBufStorage_attributeSet_t();
+
+/**
+ * Removes this set from its pool, so that it is no longer shared and may be changed by the one node holding it.
+ */
+	void leavePool();
+
+};
+
+/**
+ * The kinds of number a typed attribute can hold, see VBufStorage_fieldNode_t::addTypedAttribute.
+ */
+typedef enum {
+	VBufStorage_attributeType_int32,
+	VBufStorage_attributeType_enum,
+	VBufStorage_attributeType_bitset
+} VBufStorage_attributeType_t;
+
+/**
+ * An attribute held as a number rather than as a string, see VBufStorage_fieldNode_t::addTypedAttribute.
+ */
+typedef struct {
+	const wchar_t* name;
+	VBufStorage_attributeType_t type;
+	int value;
+} VBufStorage_typedAttribute_t;
+
+/**
+ * A type for the typed attributes of a node.
+ */
+typedef std::vector<VBufStorage_typedAttribute_t> VBufStorage_typedAttributeList_t;
+
+/**
+ * A cell in a table's grid, with the number of rows and columns it spans.
+ */
+typedef struct {
+	VBufStorage_fieldNode_t* node;
+	int rowSpan;
+	int columnSpan;
+} VBufStorage_tableGridCell_t;
+
+/**
+ * The cells of a table, each kept once at the row and column it starts at.
+ * A cell spanning several rows or columns is found at the others by looking back over at most maxRowSpan rows and maxColumnSpan columns,
+ * so large spans cost no more memory than small ones.
+ */
+class VBufStorage_tableGrid_t {
+	public:
+
+/**
+ * The cells by the row and column they start at. More than one cell can start at the same place.
+ */
+	std::multimap<std::pair<int,int>,VBufStorage_tableGridCell_t> cells;
+
+/**
+ * The most rows and columns spanned by any cell added since the grid was built.
+ */
+	int maxRowSpan;
+	int maxColumnSpan;
+
+	VBufStorage_tableGrid_t(): cells(), maxRowSpan(1), maxColumnSpan(1) {}
+
+};
+
 /**
  * a node that represents a field in a buffer.
  * Nodes have relationships with other nodes (giving the ability to form a tree structure), they have a length in characters (how many characters they span in the buffer), and they can hold name value attribute paires. Their constructor is protected and their only friend is a buffer, thus they can only be created by a buffer. 
@@ -139,18 +256,93 @@ class VBufStorage_fieldNode_t {
 	int length;
 
 /**
- * a map to hold attributes for this field.
+ * true if this field should cause a line break at its start and end when a buffer is calculating lines.
  */
-	VBufStorage_attributeMap_t attributes;
+	bool block;
+
+	/**
+	* True if this node his hidden - searches will not locate this node.
+	*/
+	bool hidden;
+
+/**
+ * A summary of this node and its descendants, see VBufStorage_subtreeFlag_t and getSubtreeFlags.
+ * It is 0 until asked for, and is forgotten whenever the subtree changes.
+ * While a node's summary is known, so are those of all its descendants.
+ */
+	unsigned char subtreeFlags;
+
+/**
+ * true if this is a control field node the buffer created itself, rather than an instance of a backend's own subclass given to addControlFieldNode,
+ * so that it can be given to a pool and handed out again in place of a new node, see recycle.
+ * Subclasses hold resources of their own, such as COM objects and event sinks, that a pool must not keep alive.
+ */
+	bool recyclable;
+
+/**
+ * Summarises this node and its descendants, working out the summary of any of them whose subtree has changed since it was last asked for.
+ * @return VBufStorage_subtreeFlag_known, with VBufStorage_subtreeFlag_hasVisible if any of them has length and is not hidden,
+ * and VBufStorage_subtreeFlag_hasLineContent if any of them has length or is a block.
+ */
+	unsigned int getSubtreeFlags();
+
+/**
+ * Forgets the summary of this node and of its ancestors, as their subtrees have changed.
+ */
+	void forgetSubtreeFlags();
+
+/**
+ * Checks if a walk of the tree looking for certain nodes can step over this node's descendants, see nextNodeInTree.
+ * @param flag VBufStorage_subtreeFlag_hasVisible to look for nodes that a search can find, or VBufStorage_subtreeFlag_hasLineContent to look for text and blocks.
+ * @return true if none of this node's descendants are such nodes.
+ */
+	bool canSkipDescendants(unsigned int flag);
+
+/**
+ * The attributes of this field, or NULL if it has none, in which case no set is allocated.
+ * The set may be shared with other nodes that have the same attributes.
+ * The links, length and flags above are all that walking the tree reads, so they are declared together at the start of the node,
+ * and the attributes are held apart from it.
+ */
+	VBufStorage_attributeSet_t* attributes;
+
+/**
+ * @return the attributes of this field, which are empty if it has none.
+ */
+	inline const VBufStorage_attributeMap_t& getAttributes() const { return attributes?attributes->attributes:VBufStorage_noAttributes; }
+
+/**
+ * Lets go of this field's attribute set, deleting the set if no other node holds it, and leaves this field with no attributes.
+ */
+	void releaseAttributes();
+
+/**
+ * @return the attribute set of this field ready to be changed, creating it if this field has none, or copying it if it is shared.
+ */
+	VBufStorage_attributeSet_t* getWritableAttributes();
+
+/**
+ * The typed attributes of this field, or NULL if it has none, see addTypedAttribute.
+ */
+	VBufStorage_typedAttributeList_t* typedAttributes;
+
+/**
+ * Finds the value of a typed attribute of this field by the name it is presented with, see addTypedAttribute.
+ * @param name the name of the attribute, which for a bitset is the name of one of its bits.
+ * @param value memory where the value is placed, which for a bit of a bitset is 1.
+ * @return true if the attribute was found, false if this field has no such typed attribute or the bit is not set.
+ */
+	bool findTypedAttribute(const std::wstring& name, int* value) const;
 
 /**
  * moves to the next node, in depth-first order.
 * @param direction the direction to walk
  * @param limitNode the node which can not be passed
  * @param relativeStartOffset memory to place the start offset of the next node relative to the start offset of the original node
+ * @param skipUnless if not 0, a flag for canSkipDescendants: the descendants of any node that holds no such nodes are stepped over rather than walked.
  * @return the next node.
  */
-	VBufStorage_fieldNode_t* nextNodeInTree(int direction, VBufStorage_fieldNode_t* limitNode, int *relativeStartOffset);
+	VBufStorage_fieldNode_t* nextNodeInTree(int direction, VBufStorage_fieldNode_t* limitNode, int *relativeStartOffset, unsigned int skipUnless=0);
 
 /**
  * Calculates the offset for this node relative to the surrounding tree. 
@@ -200,6 +392,59 @@ class VBufStorage_fieldNode_t {
  */
 	virtual void disassociateFromBuffer(VBufStorage_buffer_t* buffer);
 
+/**
+ * Gives this node, once it has been disassociated from its buffer, to the given pool to be reused rather than deleted.
+ * Only control field nodes the buffer created itself can be reused, as the pool finds them by their identifier and hands them out in place of new ones.
+ * @param pool the pool to give this node to.
+ * @return true if the pool took this node, false if it should be deleted.
+ */
+	virtual bool recycle(VBufStorage_nodePool_t* pool);
+
+/**
+ * @return the text this field holds itself, or NULL if it is not a text field.
+ */
+	virtual const std::wstring* getContentText() const;
+
+/**
+ * Hashes what this field holds, other than its links and identifier, for finding repeated subtrees, see VBufStorage_buffer_t::shareSubtrees.
+ * Attribute sets are hashed by their address, so they must have been shared by the buffer first.
+ */
+	size_t hashContent() const;
+
+/**
+ * Checks if this field holds the same as another, other than its links and identifier, see hashContent.
+ * @param other the other field.
+ * @return true if both are the same kind of field, with the same length, flags, attributes and text.
+ */
+	bool hasSameContent(const VBufStorage_fieldNode_t* other) const;
+
+/**
+ * Lets this field hold the storage of another that has the same content rather than its own, see VBufStorage_buffer_t::shareSubtrees.
+ * Fields share their attribute sets through their buffer already, so this only shares storage a subclass holds itself.
+ * @param other a field for which hasSameContent is true.
+ */
+	virtual void shareContent(VBufStorage_fieldNode_t* other);
+
+/**
+ * Moves any text held by this node to the end of the given frozen text, see VBufStorage_buffer_t::freeze.
+ * @param frozenText the text of the nodes frozen so far, as UTF-8.
+ * @return the bytes of text this node held before freezing.
+ */
+	virtual size_t freezeText(std::string& frozenText);
+
+/**
+ * Restores any text held by this node from frozen text, see VBufStorage_buffer_t::thaw.
+ * @param frozenText the text of all the frozen nodes, as UTF-8.
+ * @param pos the position in frozenText of this node's text, which is moved past it.
+ */
+	virtual void thawText(const std::string& frozenText, size_t* pos);
+
+/**
+ * Adds the memory used by this node to the given totals, see VBufStorage_buffer_t::getMemoryUsage.
+ * Subclasses add the size of their object and anything else they hold, and call this to add the attributes.
+ */
+	virtual void getMemoryUsage(VBufStorage_memoryUsage_t* usage) const;
+
 /**
  * constructor.
  * @param length the length in characters this node should be, usually left as  its default.
@@ -213,14 +458,12 @@ class VBufStorage_fieldNode_t {
 	virtual ~VBufStorage_fieldNode_t();
 
 	friend class VBufStorage_buffer_t;
+	friend class VBufStorage_cursor_t;
+	friend class VBufStorage_attributeQuery_t;
+	friend class VBufStorage_nodePool_t;
 
 	public:
 
-/**
- * true if this field should cause a line break at its start and end when a buffer is calculating lines.
- */
-	bool isBlock;
-
 	/**
  * work out if the attributes in the given string exist on this node.
  * @param attribsString the string containing the attributes, each attribute can have multiple values to match on.
@@ -228,11 +471,6 @@ class VBufStorage_fieldNode_t {
  */
 	bool matchAttributes(const std::vector<std::wstring>& attribs, const std::wregex& regexp);
 
-	/**
-	* True if this node his hidden - searches will not locate this node.
-	*/
-	bool isHidden;
-
 /**
  * points to an optional ancestor node which should be re-rendered instead of this node, if this node changes.
  */
@@ -269,11 +507,41 @@ class VBufStorage_fieldNode_t {
 
 /**
  * Adds an attribute to this field.
+ * The name and value are taken by value, so a temporary or moved string, such as the result of a wostringstream's str, is moved in to the field rather than copied.
  * @param name the name of the attribute
  * @param value the value of the attribute.
  * @return true if the attribute was added, false if there was an error.
  */
-	bool addAttribute(const std::wstring& name, const std::wstring& value);
+	bool addAttribute(std::wstring name, std::wstring value);
+
+/**
+ * Adds an attribute to this field, copying its value straight from the given characters, such as a BSTR and its SysStringLen.
+ * @param name the name of the attribute
+ * @param value the characters of the value, which need not be null terminated.
+ * @param valueLength the number of characters in value.
+ * @return true if the attribute was added, false if there was an error.
+ */
+	bool addAttribute(std::wstring name, const wchar_t* value, size_t valueLength);
+
+/**
+ * Adds many attributes to this field at once, replacing any it already has with the same names.
+ * If the field has no attributes yet, the given map becomes its attributes without any of them being copied,
+ * so a backend collecting attributes in a map should move it in here rather than adding each one.
+ * @param attributes the attributes to add.
+ */
+	void setAttributes(VBufStorage_attributeMap_t attributes);
+
+/**
+ * Adds an attribute held as a number to this field, replacing any typed attribute of the same name.
+ * It is presented exactly as the string attributes backends add for the same information, so markup and searches do not change,
+ * but it takes less memory and searches compare it as a number.
+ * An int32 or enum is presented as name with the number as its value.
+ * A bitset is presented as an attribute for each bit that is set, named name followed by the bit as a signed number, with the value 1.
+ * @param name the name of the attribute, or the start of the name of each bit of a bitset, which must last as long as the field, such as a string literal.
+ * @param type the kind of number.
+ * @param value the number.
+ */
+	void addTypedAttribute(const wchar_t* name, VBufStorage_attributeType_t type, int value);
 
 /**
  * @return a string of all the attributes in this field, format of name:value pares separated by a semi colon.
@@ -287,9 +555,10 @@ class VBufStorage_fieldNode_t {
  * @param text a string in whish to append the text.
  * @param useMarkup if true then markup indicating opening and closing of fields will be included.
  * @param filter: a function that takes the current recursive node and returns true if text should be fetched and false if it should be skipped.
+ * @param deadline if not NULL, no more text is fetched once it has expired, leaving text incomplete.
  * @return true if successfull, false otherwize.
  */ 
-	virtual void getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup=false,bool(*filter)(VBufStorage_fieldNode_t*)=NULL);
+	virtual void getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup=false,bool(*filter)(VBufStorage_fieldNode_t*)=NULL,VBufStorage_deadline_t* deadline=NULL);
 
 /**
  * @return a string providing information about this node's type, and its state.
@@ -301,6 +570,27 @@ class VBufStorage_fieldNode_t {
  */
 	inline int getLength() { return this->length; }
 
+/**
+ * @return true if this field should cause a line break at its start and end when a buffer is calculating lines.
+ */
+	inline bool isBlock() const { return this->block; }
+
+/**
+ * Sets whether this field should cause a line break at its start and end when a buffer is calculating lines.
+ */
+	void setBlock(bool block);
+
+/**
+ * @return true if this node is hidden - searches will not locate this node.
+ */
+	inline bool isHidden() const { return this->hidden; }
+
+/**
+ * Sets whether this node is hidden, so that searches will not locate it.
+ * Its descendants are still located unless they are hidden themselves.
+ */
+	void setHidden(bool hidden);
+
 };
 
 /**
@@ -321,6 +611,10 @@ class VBufStorage_controlFieldNode_t : public VBufStorage_fieldNode_t {
 
 	virtual void disassociateFromBuffer(VBufStorage_buffer_t* buffer);
 
+	virtual bool recycle(VBufStorage_nodePool_t* pool);
+
+	virtual void getMemoryUsage(VBufStorage_memoryUsage_t* usage) const;
+
 /**
  * constructor.
  * @param docHandle the docHandle of the control
@@ -330,6 +624,7 @@ class VBufStorage_controlFieldNode_t : public VBufStorage_fieldNode_t {
 	VBufStorage_controlFieldNode_t(int docHandle, int ID, bool isBlock);
 
 	friend class VBufStorage_buffer_t;
+	friend class VBufStorage_nodePool_t;
 
 	public:
 
@@ -344,6 +639,27 @@ class VBufStorage_controlFieldNode_t : public VBufStorage_fieldNode_t {
 
 };
 
+/**
+ * Text held by more than one text field node, see VBufStorage_buffer_t::shareSubtrees.
+ */
+class VBufStorage_sharedText_t {
+	public:
+
+	const std::wstring text;
+
+/**
+ * The number of nodes holding this text.
+ */
+	unsigned int refCount;
+
+/**
+ * constructor, making text held by no node yet.
+ * @param text the text, which is moved in.
+ */
+	VBufStorage_sharedText_t(std::wstring text);
+
+};
+
 /**
  * a node that represents a field of text in a buffer.
  * It holds the actual text it represents, and also sets its length accordingly. 
@@ -351,125 +667,806 @@ class VBufStorage_controlFieldNode_t : public VBufStorage_fieldNode_t {
 class VBufStorage_textFieldNode_t : public VBufStorage_fieldNode_t {
 	protected:
 
+/**
+ * The text this field contains, unless it shares the text of other fields with the same text, in which case this is empty.
+ * It is never changed once the node is created, other than being emptied while its buffer is frozen or when it is shared.
+ */
+	std::wstring text;
+
+/**
+ * The text this field shares with other fields, or NULL if it holds its own.
+ */
+	VBufStorage_sharedText_t* sharedText;
+
+/**
+ * Lets go of the text this field shares, deleting it if no other field holds it.
+ */
+	void releaseSharedText();
+
+	virtual const std::wstring* getContentText() const;
+
+	virtual void shareContent(VBufStorage_fieldNode_t* other);
+
 	virtual VBufStorage_textFieldNode_t*locateTextFieldNodeAtOffset(int offset, int *relativeOffset);
 
 	virtual void generateMarkupTagName(std::wstring& text);
 
-	virtual void getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup=false,bool(*filter)(VBufStorage_fieldNode_t*)=NULL);
+	virtual void getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup=false,bool(*filter)(VBufStorage_fieldNode_t*)=NULL,VBufStorage_deadline_t* deadline=NULL);
+
+	virtual size_t freezeText(std::string& frozenText);
+
+	virtual void thawText(const std::string& frozenText, size_t* pos);
+
+	virtual void getMemoryUsage(VBufStorage_memoryUsage_t* usage) const;
 
 /**
  * constructor.
- * @param text the text this field should contain.
+ * @param text the text this field should contain, which is moved in to the field.
  */
-	VBufStorage_textFieldNode_t(const std::wstring& text);
+	VBufStorage_textFieldNode_t(std::wstring text);
+
+	virtual ~VBufStorage_textFieldNode_t();
 
 	friend class VBufStorage_buffer_t;
 
 	public:
 
-	/**
- * The text this field contains.
+/**
+ * @return the text this field contains, which is empty while its buffer is frozen.
  */
-	const std::wstring text;
+	inline const std::wstring& getText() const { return sharedText?sharedText->text:text; }
 
 	virtual std::wstring getDebugInfo() const;
 
 };
 
 /**
- * a buffer that can store text with overlaying fields.
- * it stores the text and fields in an internal tree of nodes.
- */ 
-class VBufStorage_buffer_t {
-	protected:
+ * Control field nodes removed from a buffer, kept by their identifier so that re-rendering the same controls can reuse them rather than allocating new ones.
+ * A kept node is emptied when it is added: it has no links, length or attributes, but keeps its attribute set and typed attribute list if no other node holds them,
+ * so that the attributes added when it is reused go in to the memory they were in before.
+ * Nodes still in the pool when it is cleared or destroyed are deleted.
+ */
+class VBufStorage_nodePool_t {
+	private:
+
+	std::map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*> nodes;
+
+	VBufStorage_nodePool_t(const VBufStorage_nodePool_t&);
+
+	VBufStorage_nodePool_t& operator=(const VBufStorage_nodePool_t&);
+
+	public:
 
 /**
- * points to the first node in the tree of nodes.
+ * The most nodes a pool keeps, so that removing a large subtree does not keep all of its nodes.
  */
-	VBufStorage_fieldNode_t* rootNode;
+	static const size_t maxSize=10000;
+
+	VBufStorage_nodePool_t();
+
+	~VBufStorage_nodePool_t();
 
 /**
- * Holds pointers to all nodes in the buffer
+ * Empties the given node, which must no longer be in a buffer, and keeps it to be reused.
+ * @param node the node.
+ * @return true if the node was kept, false if the pool is full or already has a node with the same identifier, in which case the node is not changed.
  */
-	std::set<VBufStorage_fieldNode_t*> nodes;
+	bool add(VBufStorage_controlFieldNode_t* node);
 
 /**
- * holds pointers to all control field nodes in this buffer, searchable by  the control's unique identifier.
+ * Takes a kept node with the given identifier out of the pool.
+ * @param docHandle the docHandle of the control.
+ * @param ID the ID of the control.
+ * @param isBlock the value the node's isBlock should return.
+ * @return the node, or NULL if the pool has no node with this identifier.
  */
-	std::map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*> controlFieldNodesByIdentifier;
+	VBufStorage_controlFieldNode_t* take(int docHandle, int ID, bool isBlock);
 
 /**
- * the offset at where the current selection starts.
- */ 
-	int selectionStart;
+ * Deletes all the kept nodes.
+ */
+	void clear();
 
 /**
- * The length of the selection.
+ * Exchanges the kept nodes of this pool with those of another.
  */
-	int selectionLength;
+	void swap(VBufStorage_nodePool_t& other);
 
 /**
- * removes the controlFieldNode from the buffer's controlFieldNodesByIdentifier set.
+ * @return the number of kept nodes.
  */
-	void forgetControlFieldNode(VBufStorage_controlFieldNode_t* node);
+	size_t size() const;
 
 /**
- * Inserts the given fieldNode in to the buffer's tree of nodes. Makes all needed connections with other nodes in the buffer's node tree.
- * @param parent a control field already in the buffer that should be the inserted node's parent, note if also specifying previous then parent can be NULL.
- * @param previous the field already in the buffer that the inserted node will come directly after, note previous's parent will always be used over the parent argument.
- * @param node the node being inserted.
- */ 
-	bool insertNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, VBufStorage_fieldNode_t* node);
+ * Adds the memory used by the kept nodes, and by the pool to find them, to the given totals.
+ */
+	void getMemoryUsage(VBufStorage_memoryUsage_t* usage) const;
+
+};
 
 /**
- * disassociates the given node and its descendants from this buffer and deletes the node and its descendants.
- * @param node the node you wish to delete.
+ * A position in a buffer, at an offset with in a text field node.
+ * The cursor keeps the path of nodes from the root to its text field node, along with their offsets,
+ * so moving to a nearby offset only climbs to the nearest common ancestor and walks across from there, rather than descending from the root.
+ * Moving through the buffer in order, such as by character, node or line, therefore costs amortised constant time per move.
+ * If the buffer's content changes the cursor finds its offset again from the root on its next move.
  */
-	void deleteSubtree(VBufStorage_fieldNode_t* node);
+class VBufStorage_cursor_t {
+	protected:
 
 /**
- * disassociates the given node from this buffer and deletes the node.
- * @param node the node you wish to delete.
+ * The buffer this cursor moves through.
  */
-	void deleteNode(VBufStorage_fieldNode_t* node);
+	VBufStorage_buffer_t* buffer;
 
-	friend class VBufStorage_fieldNode_t;
-	friend class VBufStorage_controlFieldNode_t;
-	friend class VBufStorage_textFieldNode_t;
+/**
+ * The version of the buffer's content the path was found in.
+ */
+	unsigned int version;
+
+/**
+ * The nodes from the root node down to the text field node containing offset, each with its start offset in the buffer.
+ * Empty if the cursor has not been placed yet.
+ */
+	std::vector<std::pair<VBufStorage_fieldNode_t*,int> > path;
+
+/**
+ * The offset in the buffer the cursor is at.
+ */
+	int offset;
 
 	public:
 
-/*
- * constructor.
+/**
+ * Creates a cursor that is not yet placed at any offset.
+ * @param buffer the buffer this cursor moves through.
  */
-	VBufStorage_buffer_t();
+	VBufStorage_cursor_t(VBufStorage_buffer_t* buffer);
 
 /**
- * Destructor
+ * Moves to the given offset.
+ * @param offset the offset to move to.
+ * @return true if the cursor moved, false if the offset is not in the buffer, in which case the cursor is unchanged.
  */
-	~VBufStorage_buffer_t();
+	bool moveToOffset(int offset);
 
 /**
- * Adds a control field in to the buffer.
- * @param parent the control field which should be the new field's parent, note that if also specifying previous parent can be NULL.
- * @param previous the field which the new field  should come directly after, note that previous's parent  will be used over the parent argument, and previous can also not be the buffer's root node (first field added).
- * @param docHandle the docHandle you wish the new control field node to have
- * @param ID the ID you wish the new control field node to have.  
- * @param isBlock if true then the buffer will force a line break at the start and end of the new control.
- * @return the newly added control field.
+ * Moves by a number of characters, forward if count is positive and back if it is negative.
+ * @return true if the cursor moved, false if the new offset would not be in the buffer.
  */
-	VBufStorage_controlFieldNode_t* addControlFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int docHandle, int ID, bool isBlock);
- 
-	VBufStorage_controlFieldNode_t* addControlFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, VBufStorage_controlFieldNode_t* node); 
+	bool moveByCharacter(int count);
+
+/**
+ * Moves to the start of the next text field node.
+ * @return true if the cursor moved, false if it is in the last text field node.
+ */
+	bool moveToNextNode();
+
+/**
+ * Moves to the start of the previous text field node.
+ * @return true if the cursor moved, false if it is in the first text field node.
+ */
+	bool moveToPreviousNode();
+
+/**
+ * Moves to the start of the next line, see VBufStorage_buffer_t::getLineOffsets.
+ * @return true if the cursor moved, false if it is on the last line.
+ */
+	bool moveToNextLine(int maxLineLength, bool useScreenLayout);
+
+/**
+ * Moves to the start of the previous line, see VBufStorage_buffer_t::getLineOffsets.
+ * @return true if the cursor moved, false if it is on the first line.
+ */
+	bool moveToPreviousLine(int maxLineLength, bool useScreenLayout);
+
+/**
+ * Fetches the offsets of the line the cursor is on, see VBufStorage_buffer_t::getLineOffsets.
+ * @return true if successfull, false if the cursor is not placed.
+ */
+	bool getLineOffsets(int maxLineLength, bool useScreenLayout, int* startOffset, int* endOffset);
+
+/**
+ * @return true if the cursor is at an offset in the buffer, it is not if it has not yet been placed or its offset has been removed from the buffer.
+ */
+	bool isPlaced();
+
+/**
+ * @return the offset the cursor is at.
+ */
+	inline int getOffset() const { return offset; }
+
+/**
+ * @return the text field node containing the cursor's offset, or NULL if the cursor is not placed.
+ */
+	VBufStorage_textFieldNode_t* getNode();
+
+/**
+ * @return the start offset in the buffer of the cursor's text field node.
+ */
+	int getNodeStartOffset();
+
+/**
+ * @return the end offset in the buffer of the cursor's text field node.
+ */
+	int getNodeEndOffset();
+
+};
+
+/**
+ * An attribute a node must have for an option of a VBufStorage_attributeQuery_t to match it.
+ */
+class VBufStorage_attributeCondition_t {
+	public:
+
+/**
+ * The name of the attribute.
+ */
+	std::wstring name;
+
+/**
+ * True if the attribute must have a value that is not empty, false if its value must be one of values.
+ */
+	bool notEmpty;
+
+/**
+ * The values the attribute may have.
+ */
+	std::vector<std::wstring> values;
+
+/**
+ * The values that are numbers, compared with the value of a typed attribute.
+ */
+	std::vector<int> numericValues;
+
+/**
+ * True if values includes an empty value, which a node without the attribute also matches.
+ */
+	bool matchesMissing;
+
+};
+
+/**
+ * The attributes and regular expression of a search, as for VBufStorage_buffer_t::findNodeByAttributes, prepared for testing many nodes.
+ * A regular expression made only of the exact, empty, not empty and any values NVDA searches for is compiled in to conditions on each attribute,
+ * which are tested without building a string of the node's attributes and compare typed attributes as numbers.
+ * Any other regular expression, such as for word matches, is matched against the string as before.
+ */
+class VBufStorage_attributeQuery_t {
+	public:
+
+	std::vector<std::wstring> attribsList;
+	std::wregex regexObj;
+
+/**
+ * The conditions of each option of the regular expression, a node matching if it meets all the conditions of any option.
+ */
+	std::vector<std::vector<VBufStorage_attributeCondition_t> > options;
+
+/**
+ * True if the regular expression was compiled in to options, false if it must be matched as it is.
+ */
+	bool isCompiled;
+
+/**
+ * A query matching any node.
+ */
+	VBufStorage_attributeQuery_t();
+
+/**
+ * constructor.
+ * Throws an exception if the regular expression is not valid.
+ * @param attribs the names of the attributes to match, separated by spaces.
+ * @param regexp regular expression the requested attributes must match.
+ */
+	VBufStorage_attributeQuery_t(const std::wstring& attribs, const std::wstring& regexp);
+
+/**
+ * @return true if the given node matches.
+ */
+	bool matches(VBufStorage_fieldNode_t* node) const;
+
+/**
+ * @return the bytes allocated for the attribute names and conditions, not including the regular expression, whose size is not known.
+ */
+	size_t getMemoryUsage() const;
+
+	private:
+
+/**
+ * Compiles the regular expression in to options.
+ * @return true if it could be, false if it is not of a form that can be.
+ */
+	bool compile(const std::wstring& regexp);
+
+/**
+ * @return true if the given node meets the given condition.
+ */
+	static bool meetsCondition(const VBufStorage_fieldNode_t* node, const VBufStorage_attributeCondition_t& condition);
+
+};
+
+/**
+ * A kind of node kept in a buffer's outline, such as headings or landmarks, see VBufStorage_buffer_t::addOutlineCategory.
+ */
+class VBufStorage_outlineCategory_t {
+	public:
+
+/**
+ * The attributes and regular expression nodes of this category match, as for VBufStorage_buffer_t::findNodeByAttributes.
+ */
+	std::wstring attribs;
+	std::wstring regexp;
+
+	VBufStorage_attributeQuery_t query;
+
+/**
+ * constructor.
+ * Throws an exception if the regular expression is not valid.
+ */
+	VBufStorage_outlineCategory_t(const std::wstring& attribs, const std::wstring& regexp);
+
+};
+
+/**
+ * A node in a buffer's outline, see VBufStorage_buffer_t::getOutline.
+ */
+typedef struct {
+	VBufStorage_fieldNode_t* node;
+	unsigned int categories;
+	int startOffset;
+	int endOffset;
+	int depth;
+} VBufStorage_outlineEntry_t;
+
+/**
+ * The most categories a buffer's outline can have, one for each bit of a category mask.
+ */
+const int VBufStorage_maxOutlineCategories=32;
+
+/**
+ * Lets a long running query of a buffer give up part way through, once a time limit has passed or once queries are cancelled from another thread.
+ * A deadline that has not been started never expires.
+ */
+class VBufStorage_deadline_t {
+	private:
+
+/**
+ * The time, as given by VBufMetrics_getMicroseconds, after which the deadline expires, or 0 if there is no time limit.
+ */
+	long long endTime;
+
+/**
+ * Increased by another thread to cancel queries, or NULL if queries can not be cancelled.
+ */
+	const std::atomic<unsigned int>* cancelCount;
+
+/**
+ * The value of cancelCount when the deadline was started.
+ */
+	unsigned int startCancelCount;
+
+/**
+ * How many more checks to make before reading the clock again, as reading it for every node would slow down searches.
+ */
+	unsigned int checksUntilClock;
+
+	bool expired;
+
+	public:
+
+	VBufStorage_deadline_t();
+
+/**
+ * Starts the deadline.
+ * @param timeLimit the microseconds from now after which the deadline expires, or 0 for no time limit.
+ * @param cancelCount a count that another thread increases to cancel queries, or NULL.
+ */
+	void start(long long timeLimit, const std::atomic<unsigned int>* cancelCount);
+
+/**
+ * Stops the deadline, so that it no longer expires.
+ * @return true if the deadline expired while it was started.
+ */
+	bool stop();
+
+/**
+ * Checks the deadline. Called regularly by long running queries.
+ * Once the deadline has expired, this keeps returning true until the deadline is stopped.
+ * @return true if the deadline has expired, in which case the query should give up.
+ */
+	bool hasExpired();
+
+};
+
+/**
+ * The text and attributes of a buffer's nodes, packed in to a compact form while the buffer is frozen, see VBufStorage_buffer_t::freeze.
+ * Nodes are listed in the order of the buffer's set of nodes, which can not change while the buffer is frozen.
+ */
+class VBufStorage_frozenContent_t {
+	public:
+
+/**
+ * The text of all the text field nodes, one after the other, as UTF-8.
+ */
+	std::string text;
+
+/**
+ * Every distinct attribute name and value in the buffer, each held only once.
+ */
+	std::vector<std::wstring> strings;
+
+/**
+ * For each node, its number of attributes, followed by the indexes in strings of the name and value of each attribute.
+ * Each number is held in as few bytes as it needs, 7 bits per byte, with the top bit set on all but the last byte.
+ */
+	std::string attributes;
+
+};
+
+/**
+ * Counters describing how a buffer has been frozen and thawed. Times are in microseconds.
+ */
+class VBufStorage_freezeStats_t {
+	public:
+
+/**
+ * The number of times the buffer was frozen and thawed.
+ */
+	unsigned int freezeCount;
+	unsigned int thawCount;
+
+/**
+ * The total and longest time taken to thaw the buffer.
+ */
+	long long thawTime;
+	long long maxThawTime;
+
+/**
+ * The bytes of text and attribute names and values held by the nodes the last time the buffer was frozen, and the bytes of the frozen content that replaced them.
+ * The memory used to allocate each string and attribute is not included, so the memory saved is more than the difference.
+ */
+	unsigned long long unfrozenBytes;
+	unsigned long long frozenBytes;
+
+	VBufStorage_freezeStats_t();
+
+};
+
+/**
+ * The memory used by a buffer, in bytes, by what it is used for, see VBufStorage_buffer_t::getMemoryUsage.
+ * Sizes of the strings and containers held follow the layout of the Visual C++ standard library, and do not include the heap's own overhead for each allocation.
+ */
+class VBufStorage_memoryUsage_t {
+	public:
+
+/**
+ * The field node objects, and the set of all nodes.
+ */
+	unsigned long long nodes;
+
+/**
+ * The text of text field nodes, including the packed text while the buffer is frozen.
+ */
+	unsigned long long text;
+
+/**
+ * The attribute maps of nodes and their names and values, including the packed attributes while the buffer is frozen.
+ */
+	unsigned long long attributes;
+
+/**
+ * The map of control field nodes by identifier.
+ */
+	unsigned long long identifierIndex;
+
+/**
+ * The table grids, the outline and the open line streams.
+ */
+	unsigned long long otherIndexes;
+
+	VBufStorage_memoryUsage_t();
+
+/**
+ * @return the total of all the categories.
+ */
+	unsigned long long getTotal() const;
+
+};
+
+/**
+ * A position in a buffer from which lines are read one after another, see VBufStorage_buffer_t::openLineStream.
+ * The stream keeps a cursor at the start of the next line, so that reading the next lines does not need to locate it again from the root.
+ * Streams are owned by their buffer, and can only be read while the buffer's content is the same as when they were opened.
+ */
+class VBufStorage_lineStream_t {
+	protected:
+
+/**
+ * The version of the buffer's content this stream was opened on.
+ */
+	unsigned int version;
+
+/**
+ * At the offset from which the next line will be read.
+ */
+	VBufStorage_cursor_t cursor;
+
+	int maxLineLength;
+
+	bool useScreenLayout;
+
+/**
+ * true once the last line of the buffer has been read.
+ */
+	bool atEnd;
+
+	VBufStorage_lineStream_t(unsigned int version, const VBufStorage_cursor_t& cursor, int maxLineLength, bool useScreenLayout);
+
+	friend class VBufStorage_buffer_t;
+
+};
+
+/**
+ * a buffer that can store text with overlaying fields.
+ * it stores the text and fields in an internal tree of nodes.
+ */ 
+class VBufStorage_buffer_t {
+	protected:
+
+/**
+ * points to the first node in the tree of nodes.
+ */
+	VBufStorage_fieldNode_t* rootNode;
+
+/**
+ * Holds pointers to all nodes in the buffer
+ */
+	std::set<VBufStorage_fieldNode_t*> nodes;
+
+/**
+ * holds pointers to all control field nodes in this buffer, searchable by  the control's unique identifier.
+ */
+	std::map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*> controlFieldNodesByIdentifier;
+
+/**
+ * the offset at where the current selection starts.
+ */ 
+	int selectionStart;
+
+/**
+ * The length of the selection.
+ */
+	int selectionLength;
+
+/**
+ * Changed every time nodes are added to or removed from the buffer.
+ */
+	unsigned int version;
+
+/**
+ * The line streams opened on this buffer and not yet closed, most recently opened last.
+ */
+	std::list<VBufStorage_lineStream_t*> lineStreams;
+
+/**
+ * Used to locate text field nodes by offset, so that each lookup starts from where the last one finished.
+ */
+	VBufStorage_cursor_t locateCursor;
+
+/**
+ * The cells of every table in the buffer, by the table's table-id attribute.
+ * Built from the whole tree when first needed after the buffer changes in a way that could not be followed,
+ * and otherwise kept up to date as nodes are removed and subtrees are replaced.
+ */
+	std::map<std::wstring,VBufStorage_tableGrid_t> tableGrids;
+
+/**
+ * The version of the buffer's content tableGrids is up to date with.
+ */
+	unsigned int tableGridsVersion;
+
+/**
+ * The categories of the outline, in the order they were added.
+ */
+	std::vector<VBufStorage_outlineCategory_t> outlineCategories;
+
+/**
+ * The nodes in the buffer matching any outline category, each with a mask of the categories it matches.
+ * Kept up to date in the same way as tableGrids.
+ */
+	std::map<VBufStorage_fieldNode_t*,unsigned int> outlineNodes;
+
+/**
+ * The version of the buffer's content outlineNodes is up to date with.
+ */
+	unsigned int outlineNodesVersion;
+
+/**
+ * The nodes of outlineNodes with text that are not hidden, with their offsets, in the order they appear in the buffer.
+ * Kept until the buffer's content or the outline categories change, so that the outline can be fetched in several parts.
+ */
+	std::vector<VBufStorage_outlineEntry_t> outlineEntries;
+
+/**
+ * The version of the buffer's content and the number of outline categories outlineEntries was made for.
+ */
+	unsigned int outlineEntriesVersion;
+	size_t outlineEntriesCategoryCount;
+
+/**
+ * Checked by findNodeByAttributes, line offset calculation and markup generation, so that they can give up once it expires, see startQueryDeadline.
+ */
+	VBufStorage_deadline_t queryDeadline;
+
+/**
+ * The longest a query may run once its deadline is started, in milliseconds, or 0 for no limit.
+ */
+	int queryTimeout;
+
+/**
+ * Increased by cancelQueries, so that queries already running when it is called give up.
+ */
+	std::atomic<unsigned int> queryCancelCount;
+
+/**
+ * The packed text and attributes of the nodes while the buffer is frozen, or NULL if it is not frozen.
+ */
+	VBufStorage_frozenContent_t* frozenContent;
+
+	VBufStorage_freezeStats_t freezeStats;
+
+/**
+ * The attribute sets shared by the nodes of this buffer, see shareAttributes.
+ */
+	VBufStorage_attributeSetPool_t attributeSets;
+
+/**
+ * Control field nodes removed by replaceSubtrees, kept to be reused by the next re-render of the same controls, see takeRetiredNodes.
+ */
+	VBufStorage_nodePool_t retiredNodes;
+
+/**
+ * The pool addControlFieldNode takes nodes from before allocating new ones, or NULL, see setNodePool.
+ */
+	VBufStorage_nodePool_t* nodePool;
+
+/**
+ * True if repeated subtrees are shared whenever content is added to or thawed in this buffer, see setSubtreeSharing.
+ */
+	bool subtreeSharing;
+
+/**
+ * Shares the attributes, and if subtreeSharing is on the repeated subtrees, of a subtree just added to or thawed in this buffer.
+ * @param node the node at the top of the subtree.
+ */
+	void shareNewContent(VBufStorage_fieldNode_t* node);
+
+/**
+ * removes the controlFieldNode from the buffer's controlFieldNodesByIdentifier set.
+ */
+	void forgetControlFieldNode(VBufStorage_controlFieldNode_t* node);
+
+/**
+ * Inserts the given fieldNode in to the buffer's tree of nodes. Makes all needed connections with other nodes in the buffer's node tree.
+ * @param parent a control field already in the buffer that should be the inserted node's parent, note if also specifying previous then parent can be NULL.
+ * @param previous the field already in the buffer that the inserted node will come directly after, note previous's parent will always be used over the parent argument.
+ * @param node the node being inserted.
+ */ 
+	bool insertNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, VBufStorage_fieldNode_t* node);
+
+/**
+ * disassociates the given node and its descendants from this buffer and deletes the node and its descendants.
+ * @param node the node you wish to delete.
+ * @param recycle true if control field nodes should be kept in retiredNodes to be reused rather than deleted.
+ */
+	void deleteSubtree(VBufStorage_fieldNode_t* node, bool recycle=false);
+
+/**
+ * disassociates the given node from this buffer and deletes the node.
+ * @param node the node you wish to delete.
+ * @param recycle true if a control field node should be kept in retiredNodes to be reused rather than deleted.
+ */
+	void deleteNode(VBufStorage_fieldNode_t* node, bool recycle=false);
+
+/**
+ * Copies the text of the given node and its descendants between the given offsets, with out markup, straight from the text field nodes in to dest.
+ * @param node the node to copy text from.
+ * @param startOffset the offset, relative to the node, to start from.
+ * @param endOffset the offset, relative to the node, to end at.
+ * @param dest memory to receive endOffset-startOffset characters.
+ */
+	void copyNodeText(VBufStorage_fieldNode_t* node, int startOffset, int endOffset, wchar_t* dest);
+
+/**
+ * Expands the given offset to the start and end offsets of the containing line, as getLineOffsets does, starting from the text field node already located at the offset.
+ * @param initNode the text field node containing offset.
+ * @param initBufferStart the start offset of initNode in the buffer.
+ * @param initBufferEnd the end offset of initNode in the buffer.
+ */
+	bool getLineOffsetsFromNode(VBufStorage_fieldNode_t* initNode, int initBufferStart, int initBufferEnd, int offset, int maxLineLength, bool useScreenLayout, int *startOffset, int *endOffset);
+
+/**
+ * @return true if tableGrids is up to date with the buffer's content and can be updated as it changes.
+ */
+	bool canUpdateTableGrids() const;
+
+/**
+ * Fetches the table a node is a cell of, and the rows and columns it covers.
+ * @return false if the node is not a table cell.
+ */
+	static bool getTableCellCoordinates(VBufStorage_fieldNode_t* node, std::wstring& tableID, int* row, int* column, int* rowSpan, int* columnSpan);
+
+/**
+ * Adds the table cells in the given node and its descendants to tableGrids.
+ */
+	void addTableCells(VBufStorage_fieldNode_t* node);
+
+/**
+ * Removes the given node from tableGrids if it is a table cell.
+ */
+	void removeTableCell(VBufStorage_fieldNode_t* node);
+
+/**
+ * @return true if outlineNodes is up to date with the buffer's content and can be updated as it changes.
+ */
+	bool canUpdateOutlineNodes() const;
+
+/**
+ * Adds the nodes in the given node and its descendants that match any of the given categories to outlineNodes.
+ * @param categories a mask of the categories to match, bit n being set for category n.
+ */
+	void addOutlineNodes(VBufStorage_fieldNode_t* node, unsigned int categories);
+
+	friend class VBufStorage_fieldNode_t;
+	friend class VBufStorage_controlFieldNode_t;
+	friend class VBufStorage_textFieldNode_t;
+	friend class VBufStorage_cursor_t;
+
+	public:
+
+/*
+ * constructor.
+ */
+	VBufStorage_buffer_t();
+
+/**
+ * Destructor
+ */
+	~VBufStorage_buffer_t();
+
+/**
+ * Adds a control field in to the buffer.
+ * @param parent the control field which should be the new field's parent, note that if also specifying previous parent can be NULL.
+ * @param previous the field which the new field  should come directly after, note that previous's parent  will be used over the parent argument, and previous can also not be the buffer's root node (first field added).
+ * @param docHandle the docHandle you wish the new control field node to have
+ * @param ID the ID you wish the new control field node to have.  
+ * @param isBlock if true then the buffer will force a line break at the start and end of the new control.
+ * @return the newly added control field.
+ */
+	VBufStorage_controlFieldNode_t* addControlFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int docHandle, int ID, bool isBlock);
+ 
+	VBufStorage_controlFieldNode_t* addControlFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, VBufStorage_controlFieldNode_t* node); 
 
 /**
  * Adds a text field in to the buffer.
+ * The text is taken by value, so a temporary or moved string is moved in to the field rather than copied.
  * @param parent the control field which should be the new field's parent, note that if also specifying previous, parent can be NULL.
  * @param previous the field which the new field  should come directly after, note that previous's parent  will be used over the parent argument, and previous can also not be the buffer's root node (first field added).
  * @param text the text that this field will contain.
  * @return the newly added text field.
  */
-	VBufStorage_textFieldNode_t* addTextFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, const std::wstring& text);
+	VBufStorage_textFieldNode_t* addTextFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, std::wstring text);
+
+/**
+ * Adds a text field in to the buffer, copying its text straight from the given characters, such as a BSTR and its SysStringLen.
+ * @param parent the control field which should be the new field's parent, as for the other addTextFieldNode.
+ * @param previous the field which the new field should come directly after, as for the other addTextFieldNode.
+ * @param text the characters of the text, which need not be null terminated.
+ * @param textLength the number of characters in text.
+ * @return the newly added text field.
+ */
+	VBufStorage_textFieldNode_t* addTextFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, const wchar_t* text, size_t textLength);
 
 	VBufStorage_textFieldNode_t* addTextFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, VBufStorage_textFieldNode_t* node);
 
@@ -490,9 +1487,10 @@ class VBufStorage_buffer_t {
  * disassociates from this buffer, and deletes, the given field and its descendants.
  * @param node the node you wish to remove.
 	* @param removeDescedants true if descendants should be removed, false otherwise.
+ * @param recycle true if control field nodes removed should be kept to be reused by a later re-render rather than deleted, see takeRetiredNodes.
  * @return true if the node was removed, false otherwise.
  */
-	bool removeFieldNode(VBufStorage_fieldNode_t* node, bool removeDescendants=true);
+	bool removeFieldNode(VBufStorage_fieldNode_t* node, bool removeDescendants=true, bool recycle=false);
 
 /*
  * Removes all nodes from the buffer.
@@ -565,6 +1563,57 @@ class VBufStorage_buffer_t {
  */
 	virtual VBufStorage_fieldNode_t* findNodeByAttributes(int offset, VBufStorage_findDirection_t  direction, const std::wstring &attribs, const std::wstring &regexp, int *startOffset, int *endOffset);
 
+/**
+ * Finds some text in the buffer, searching the text of a few thousand characters of text field nodes at a time rather than fetching the text of the whole buffer.
+ * The text found may span several text field nodes.
+ * @param offset searching forward, the offset at or after which the text must start, searching back, the offset at or before which it must end.
+ * @param text the text to find.
+ * @param reverse true to find the last occurrence before offset, false to find the first after it.
+ * @param caseSensitive false to compare characters with out regard to case.
+ * @param startOffset memory where the start offset of the found text will be placed
+ * @param endOffset memory where the end offset of the found text will be placed
+ * @return true if the text was found, false if it was not or the search gave up.
+ */
+	virtual bool findText(int offset, const std::wstring& text, bool reverse, bool caseSensitive, int* startOffset, int* endOffset);
+
+/**
+ * Finds the cell of a table covering the given row and column, using the table-id, table-rownumber, table-columnnumber, table-rowsspanned and table-columnsspanned attributes of the buffer's nodes.
+ * Unlike searching with findNodeByAttributes, this does not depend on the size of the table.
+ * If more than one cell covers the row and column, the first in the buffer that has text and is not hidden is found.
+ * @param tableID the table-id attribute of the table.
+ * @param row the row number.
+ * @param column the column number.
+ * @param startOffset memory where the start offset of the found cell will be placed
+ * @param endOffset memory where the end offset of the found cell will be placed
+ * @return the found cell, or NULL if no cell covers the row and column or the cell has no text or is hidden.
+ */
+	virtual VBufStorage_fieldNode_t* getTableCell(const std::wstring& tableID, int row, int column, int* startOffset, int* endOffset);
+
+/**
+ * Adds a category of nodes to be kept in the buffer's outline, such as headings, landmarks, links or form fields.
+ * The nodes of each category are found once and then kept up to date as the buffer changes, so that fetching the outline does not need to search the buffer.
+ * @param attribs the attributes to match, as for findNodeByAttributes.
+ * @param regexp regular expression the requested attributes must match, as for findNodeByAttributes.
+ * @return the number of the category, which is the number of an existing category with the same attributes and regular expression,
+ * or -1 if there are already VBufStorage_maxOutlineCategories categories or the regular expression is not valid.
+ */
+	virtual int addOutlineCategory(const std::wstring& attribs, const std::wstring& regexp);
+
+/**
+ * Fetches some of the nodes in the buffer's outline, in the order they appear in the buffer.
+ * Only nodes with text that are not hidden are included, as for findNodeByAttributes.
+ * @param categories a mask of the categories of nodes to fetch, bit n being set for category n.
+ * @param firstEntry the number of matching nodes to skip, so that a large outline can be fetched in several parts.
+ * @param maxEntries the most nodes to fetch.
+ * @param entryCount memory to place the number of nodes fetched.
+ * @param nodes memory for maxEntries nodes.
+ * @param nodeCategories memory for maxEntries masks of the categories each node matches.
+ * @param startOffsets memory for maxEntries start offsets of the nodes.
+ * @param endOffsets memory for maxEntries end offsets of the nodes.
+ * @param totalEntryCount memory to place the number of nodes matching the categories in the whole outline.
+ */
+	virtual void getOutline(unsigned int categories, int firstEntry, int maxEntries, int* entryCount, VBufStorage_fieldNode_t** nodes, unsigned int* nodeCategories, int* startOffsets, int* endOffsets, int* totalEntryCount);
+
 /**
  * Retreaves the current selection offsets for the buffer
  * @param startOffset memory where the start offset of the selection will be placed
@@ -587,6 +1636,14 @@ class VBufStorage_buffer_t {
  */
 	virtual int getTextLength() const;
 
+/**
+ * Measures the content held in the buffer.
+ * @param nodeCount memory where the number of field nodes will be placed.
+ * @param textBytes memory where the number of bytes of text will be placed.
+ * @param attributeBytes memory where the number of bytes of attribute names and values will be placed, with typed attributes counted at the size they are held in.
+ */
+	virtual void getContentSize(unsigned int* nodeCount, unsigned long long* textBytes, unsigned long long* attributeBytes) const;
+
 /**
  * Retreaves the text in the buffer between given offsets, optionally containing markup.
  * @param startOffset the offset to start from
@@ -597,6 +1654,19 @@ class VBufStorage_buffer_t {
  */
 	virtual VBufStorage_textContainer_t*  getTextInRange(int startOffset, int endOffset, bool useMarkup=false);
 
+/**
+ * Copies the text in the buffer between given offsets, optionally containing markup, in to memory provided by the caller, such as a shared memory section.
+ * Text with out markup is copied straight from the buffer's text field nodes, with no intermediate string. Markup is generated and then copied once.
+ * @param startOffset the offset to start from
+ * @param endOffset the offset to end at.
+ * @param useMarkup if true then markup is included in the text denoting field starts and ends.
+ * @param dest memory to receive the text, which is not null terminated.
+ * @param destLength the number of characters dest can hold.
+ * @param textLength memory to place the length of the text, which is set even if the text does not fit in dest.
+ * @return true if the text was copied, false if the offsets were bad or the text does not fit.
+ */
+	virtual bool copyTextInRange(int startOffset, int endOffset, bool useMarkup, wchar_t* dest, int destLength, int* textLength);
+
 /**
  * Expands the given offset to the start and end offsets of the containing line.
  * @param offset the offset to expand.
@@ -608,6 +1678,140 @@ class VBufStorage_buffer_t {
  */ 
 	virtual bool getLineOffsets(int offset, int maxLineLength, bool useScreenLayout, int *startOffset, int *endOffset);
 
+/**
+ * Opens a stream from which the lines starting with the one containing the given offset can be read one after another.
+ * Only a few streams can be open at once, opening more closes the oldest.
+ * @param offset an offset in the first line to read.
+ * @param maxLineLength the maximum length of a line, as for getLineOffsets.
+ * @param useScreenLayout as for getLineOffsets.
+ * @return the stream, or NULL if the offset is not in the buffer.
+ */
+	virtual VBufStorage_lineStream_t* openLineStream(int offset, int maxLineLength, bool useScreenLayout);
+
+/**
+ * Reads the next lines from a stream, moving the stream past them.
+ * @param stream a stream opened on this buffer.
+ * @param maxLines the most lines to read.
+ * @param useMarkup if true then markup is included in the text denoting field starts and ends.
+ * @param lineCount memory to place the number of lines read, which is 0 at the end of the buffer.
+ * @param startOffsets memory for maxLines start offsets of the lines.
+ * @param endOffsets memory for maxLines end offsets of the lines.
+ * @param textLengths memory for maxLines lengths of the text of each line within the returned text.
+ * @return the text of all the lines read, one after the other, or NULL if the stream is not open or the buffer's content has changed since it was opened.
+ */
+	virtual VBufStorage_textContainer_t* readLineStream(VBufStorage_lineStream_t* stream, int maxLines, bool useMarkup, int* lineCount, int* startOffsets, int* endOffsets, int* textLengths);
+
+/**
+ * Closes a stream opened on this buffer. Does nothing if the stream has already been closed.
+ * @param stream the stream to close.
+ */
+	virtual void closeLineStream(VBufStorage_lineStream_t* stream);
+
+/**
+ * Fetches a number that changes every time the content of the buffer changes,
+ * so that information fetched from the buffer at different times can be checked to be from the same content.
+ * @return the version.
+ */
+	virtual unsigned int getVersion() const;
+
+/**
+ * Sets how long queries may run once their deadline is started, see startQueryDeadline.
+ * @param milliseconds the time limit, or 0 for no limit.
+ */
+	virtual void setQueryTimeout(int milliseconds);
+
+/**
+ * Starts the deadline checked by findNodeByAttributes, getLineOffsets, getTextInRange, copyTextInRange and readLineStream.
+ * Until stopQueryDeadline is called, these give up and fail once the query timeout has passed or cancelQueries is called.
+ * With out a started deadline they never give up.
+ * The caller must hold the buffer's lock until it stops the deadline.
+ */
+	virtual void startQueryDeadline();
+
+/**
+ * Stops the deadline started by startQueryDeadline.
+ * @return true if a query gave up since the deadline was started, in which case it failed because of the deadline rather than its arguments.
+ */
+	virtual bool stopQueryDeadline();
+
+/**
+ * Makes the queries running on this buffer give up as soon as they next check their deadline.
+ * Unlike other methods, this may be called with out holding the buffer's lock, as the query to cancel is holding it.
+ */
+	virtual void cancelQueries();
+
+/**
+ * Lets the given node and its descendants share one attribute set with every other node of this buffer that has the same attributes, to save memory.
+ * Called once a subtree is fully rendered, as it is cheaper to share sets once than to look them up as each attribute is added.
+ * Attributes added to a node afterwards go in to its own copy of the set.
+ * @param node the node at the top of the subtree.
+ */
+	void shareAttributes(VBufStorage_fieldNode_t* node);
+
+/**
+ * Moves the control field nodes replaceSubtrees has removed from this buffer in to the given pool, so that the buffers the replacements are rendered in to can reuse them.
+ * The nodes are kept until the next time this is called, or until the buffer is frozen or cleared.
+ * @param pool memory where the nodes are placed, which should be empty.
+ */
+	void takeRetiredNodes(VBufStorage_nodePool_t& pool);
+
+/**
+ * Sets a pool of nodes for addControlFieldNode to reuse: a control field with the identifier of a node in the pool is added as that node rather than a new one.
+ * @param pool the pool, which must last until it is set to NULL or the buffer is destroyed, or NULL to always allocate new nodes.
+ */
+	void setNodePool(VBufStorage_nodePool_t* pool);
+
+/**
+ * Finds subtrees of the given node that are the same as an earlier one, other than the identifiers of their control fields,
+ * such as the rows of a table or the messages of a chat, and lets their nodes share the text and attributes of the earlier one rather than holding their own.
+ * Each subtree keeps its own nodes, so each node still has its own identifier, links and position in the buffer; only what the nodes hold is stored once.
+ * Attributes are shared first, see shareAttributes.
+ * Subtrees are compared by a hash of their nodes' content and structure, and then node by node, so only subtrees with in the given node are found.
+ * @param node the node at the top of the subtree to search.
+ */
+	void shareSubtrees(VBufStorage_fieldNode_t* node);
+
+/**
+ * Turns sharing repeated subtrees on or off for content later added to or thawed in this buffer, see shareSubtrees.
+ * Turning it on also shares the repeated subtrees of the buffer's current content. It is off by default.
+ * @param enable true to share repeated subtrees, false to no longer share them.
+ */
+	virtual void setSubtreeSharing(bool enable);
+
+/**
+ * Freezes the buffer, packing the text and attributes of all its nodes in to a compact form and releasing the strings and maps that held them, to save memory while the buffer is not used.
+ * The nodes themselves stay in the buffer, so nodes and offsets found before freezing are still valid.
+ * While the buffer is frozen its nodes have no text or attributes, so it must be thawed before it is queried or its nodes are read.
+ * Typed attributes are already compact, so they are left on the nodes.
+ * Inserting or removing nodes thaws the buffer first, and clearing the buffer discards the frozen content.
+ * @return true if the buffer was frozen, false if it was already frozen or is empty.
+ */
+	virtual bool freeze();
+
+/**
+ * Restores the text and attributes of the nodes of a frozen buffer.
+ * @return true if the buffer was thawed, false if it was not frozen.
+ */
+	virtual bool thaw();
+
+/**
+ * @return true if the buffer is frozen, see freeze.
+ */
+	virtual bool isFrozen() const;
+
+/**
+ * Fetches the counters of how this buffer has been frozen and thawed.
+ * @param stats memory where the counters should be placed.
+ */
+	virtual void getFreezeStats(VBufStorage_freezeStats_t* stats) const;
+
+/**
+ * Measures the memory used by this buffer and its nodes, by category.
+ * Unlike getContentSize this includes the memory of the node objects, the indexes kept by the buffer, and the unused capacity of strings and containers.
+ * @param usage memory where the totals should be placed.
+ */
+	virtual void getMemoryUsage(VBufStorage_memoryUsage_t* usage) const;
+
 /**
  * Does this buffer have content?
  * true if there is content, false otherwise.
@@ -0,0 +1,96 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2017 NV Access Limited
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <algorithm>
+#include "updateScheduler.h"
+
+using namespace std;
+
+VBufUpdateSchedulerPolicy_t::VBufUpdateSchedulerPolicy_t(int initialDelayArg, int maxDelayArg, int growthFactorArg, int maxStalenessArg, int churnPeriodArg): initialDelay(initialDelayArg), maxDelay(maxDelayArg), growthFactor(growthFactorArg), maxStaleness(maxStalenessArg), churnPeriod(churnPeriodArg) {
+}
+
+VBufUpdateScheduler_t::VBufUpdateScheduler_t(VBufUpdateSchedulerClock_t* clockArg, const VBufUpdateSchedulerPolicy_t& policyArg): clock(clockArg), policy(policyArg), pending(false), hasUpdated(false), firstRequestTime(0), dueTime(0), lastUpdateFinishedTime(0), window(policyArg.initialDelay), updatesRun(0), requests(0), eventsCoalesced(0), delays() {
+}
+
+void VBufUpdateScheduler_t::setPolicy(const VBufUpdateSchedulerPolicy_t& policyArg) {
+	policy=policyArg;
+	window=min(window,policy.maxDelay);
+}
+
+const VBufUpdateSchedulerPolicy_t& VBufUpdateScheduler_t::getPolicy() const {
+	return policy;
+}
+
+int VBufUpdateScheduler_t::growWindow(int value) const {
+	return max(policy.initialDelay,min(value*max(policy.growthFactor,1),policy.maxDelay));
+}
+
+int VBufUpdateScheduler_t::requestUpdate() {
+	long long now=clock->getTime();
+	++requests;
+	if(pending) {
+		++eventsCoalesced;
+		window=growWindow(window);
+		// Push the update out by the grown window, but never past the staleness bound of the first request.
+		dueTime=max(dueTime,min(now+window,firstRequestTime+policy.maxStaleness));
+		return -1;
+	}
+	pending=true;
+	firstRequestTime=now;
+	if(hasUpdated&&now-lastUpdateFinishedTime<=policy.churnPeriod) {
+		window=growWindow(window);
+	} else {
+		window=policy.initialDelay;
+	}
+	dueTime=now+min(window,policy.maxStaleness);
+	return static_cast<int>(dueTime-now);
+}
+
+int VBufUpdateScheduler_t::timerFired() {
+	if(!pending) return -1;
+	long long now=clock->getTime();
+	if(now>=dueTime) return 0;
+	return static_cast<int>(dueTime-now);
+}
+
+void VBufUpdateScheduler_t::updateStarted() {
+	++updatesRun;
+	if(!pending) return;
+	pending=false;
+	long long delay=clock->getTime()-firstRequestTime;
+	delays.add(delay>0?static_cast<unsigned long long>(delay):0);
+}
+
+void VBufUpdateScheduler_t::updateFinished() {
+	hasUpdated=true;
+	lastUpdateFinishedTime=clock->getTime();
+}
+
+void VBufUpdateScheduler_t::cancel() {
+	pending=false;
+}
+
+bool VBufUpdateScheduler_t::isPending() const {
+	return pending;
+}
+
+void VBufUpdateScheduler_t::getStats(VBufUpdateSchedulerStats_t* stats) const {
+	stats->updatesRun=updatesRun;
+	stats->requests=requests;
+	stats->eventsCoalesced=eventsCoalesced;
+	stats->delayP50=static_cast<int>(delays.getPercentile(50));
+	stats->delayP90=static_cast<int>(delays.getPercentile(90));
+	stats->delayP99=static_cast<int>(delays.getPercentile(99));
+	stats->delayMax=static_cast<int>(delays.getMax());
+}
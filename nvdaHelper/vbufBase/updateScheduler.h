@@ -0,0 +1,215 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2017 NV Access Limited
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_UPDATESCHEDULER_H
+#define VIRTUALBUFFER_UPDATESCHEDULER_H
+
+#include <common/latencyHistogram.h>
+
+/**
+ * A source of time for an update scheduler.
+ * Backends use a clock based on the performance counter, tests can provide a fake clock.
+ */
+class VBufUpdateSchedulerClock_t {
+	public:
+
+/**
+ * @return the current time in milliseconds, from an arbitrary but fixed starting point.
+ */
+	virtual long long getTime()=0;
+
+	virtual ~VBufUpdateSchedulerClock_t() {}
+
+};
+
+/**
+ * Values controlling how long a scheduler waits before running an update, all in milliseconds.
+ */
+class VBufUpdateSchedulerPolicy_t {
+	public:
+
+/**
+ * How long to wait before updating for an isolated change.
+ */
+	int initialDelay;
+
+/**
+ * The largest the coalescing window can grow to while changes keep arriving.
+ */
+	int maxDelay;
+
+/**
+ * The factor the coalescing window is multiplied by each time another change arrives while an update is pending.
+ */
+	int growthFactor;
+
+/**
+ * The longest an update may be postponed after the first change it covers, no matter how many changes keep arriving.
+ */
+	int maxStaleness;
+
+/**
+ * If a change arrives within this long after the last update finished, the page is considered to be churning and the grown window is kept rather than starting again from initialDelay.
+ */
+	int churnPeriod;
+
+	VBufUpdateSchedulerPolicy_t(int initialDelay=20, int maxDelay=250, int growthFactor=2, int maxStaleness=500, int churnPeriod=250);
+
+};
+
+/**
+ * Counters describing the work done by an update scheduler.
+ */
+class VBufUpdateSchedulerStats_t {
+	public:
+
+/**
+ * The number of updates that have been started.
+ */
+	unsigned int updatesRun;
+
+/**
+ * The number of update requests received in total.
+ */
+	unsigned int requests;
+
+/**
+ * The number of update requests that were folded in to an already pending update.
+ */
+	unsigned int eventsCoalesced;
+
+/**
+ * Percentiles and maximum of the delay between the first request covered by an update and the update starting, in milliseconds.
+ * Percentiles are the upper bound of a power of 2 bucket.
+ */
+	int delayP50;
+	int delayP90;
+	int delayP99;
+	int delayMax;
+
+};
+
+/**
+ * Decides when a backend should re-render its invalid subtrees.
+ * An isolated change is updated after a short delay.
+ * While changes keep arriving, the window in which they are coalesced grows exponentially up to a maximum,
+ * but an update is never postponed for longer than the maximum staleness after the first change it covers.
+ * The scheduler does not own a timer; its owner arms a timer for the delays it returns.
+ * It is not thread safe; whoever owns it must serialize calls to it, as a backend does by holding its lock around each call.
+ */
+class VBufUpdateScheduler_t {
+	private:
+
+	VBufUpdateSchedulerClock_t* clock;
+
+	VBufUpdateSchedulerPolicy_t policy;
+
+/**
+ * true if a request has been made that has not yet been covered by an update.
+ */
+	bool pending;
+
+/**
+ * true once at least one update has finished.
+ */
+	bool hasUpdated;
+
+/**
+ * the time of the first request covered by the pending update.
+ */
+	long long firstRequestTime;
+
+/**
+ * the time at which the pending update should run.
+ */
+	long long dueTime;
+
+/**
+ * the time the last update finished.
+ */
+	long long lastUpdateFinishedTime;
+
+/**
+ * The current coalescing window.
+ */
+	int window;
+
+	unsigned int updatesRun;
+	unsigned int requests;
+	unsigned int eventsCoalesced;
+
+/**
+ * The delays of updates in milliseconds.
+ */
+	LatencyHistogram delays;
+
+	int growWindow(int value) const;
+
+	public:
+
+/**
+ * constructor
+ * @param clock the clock used to time requests, which must outlive the scheduler.
+ * @param policy the initial scheduling policy.
+ */
+	VBufUpdateScheduler_t(VBufUpdateSchedulerClock_t* clock, const VBufUpdateSchedulerPolicy_t& policy=VBufUpdateSchedulerPolicy_t());
+
+/**
+ * Changes the scheduling policy. A pending update keeps its current due time.
+ */
+	void setPolicy(const VBufUpdateSchedulerPolicy_t& policy);
+
+	const VBufUpdateSchedulerPolicy_t& getPolicy() const;
+
+/**
+ * Records that something has become invalid and needs updating.
+ * @return the number of milliseconds a timer should be armed for, or -1 if an update is already pending and this request was coalesced in to it.
+ */
+	int requestUpdate();
+
+/**
+ * To be called when a timer armed for a delay returned by this scheduler fires.
+ * @return 0 if the update should be run now, the number of milliseconds to re-arm the timer for if more changes postponed the update, or -1 if no update is pending.
+ */
+	int timerFired();
+
+/**
+ * Records that an update is starting, covering all requests made so far.
+ */
+	void updateStarted();
+
+/**
+ * Records that an update has finished.
+ */
+	void updateFinished();
+
+/**
+ * Forgets any pending update, E.g. when its timer has been killed.
+ */
+	void cancel();
+
+/**
+ * @return true if there is a request not yet covered by an update.
+ */
+	bool isPending() const;
+
+/**
+ * Fetches the scheduler's counters.
+ * @param stats memory where the counters should be placed.
+ */
+	void getStats(VBufUpdateSchedulerStats_t* stats) const;
+
+};
+
+#endif
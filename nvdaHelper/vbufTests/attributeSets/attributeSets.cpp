@@ -0,0 +1,139 @@
+/**
+ * tests/attributeSets/attributeSets.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Checks that nodes with the same attributes share one set of them without changing what any node has,
+ * that changing the attributes of a node sharing a set leaves the other nodes alone, and that shared sets are freed with the last node holding them.
+ */
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int sectionCount=20;
+const int paragraphsPerSection=20;
+
+/**
+ * Adds a section of paragraphs, each made of runs of text with the formatting attributes a backend gives every run, so most runs have the same attributes.
+ * @param nodes memory where every node added is placed.
+ * @return the section.
+ */
+VBufStorage_controlFieldNode_t* addSection(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int sectionNumber, vector<VBufStorage_fieldNode_t*>& nodes) {
+	VBufStorage_controlFieldNode_t* section=buffer.addControlFieldNode(parent,previous,1,sectionNumber*1000,true);
+	section->addAttribute(L"role",L"section");
+	nodes.push_back(section);
+	VBufStorage_fieldNode_t* previousParagraph=NULL;
+	for(int i=0;i<paragraphsPerSection;++i) {
+		VBufStorage_controlFieldNode_t* paragraph=buffer.addControlFieldNode(section,previousParagraph,1,sectionNumber*1000+i+1,true);
+		paragraph->addAttribute(L"role",L"paragraph");
+		nodes.push_back(paragraph);
+		VBufStorage_fieldNode_t* previousRun=NULL;
+		for(int j=0;j<3;++j) {
+			VBufStorage_textFieldNode_t* run=buffer.addTextFieldNode(paragraph,previousRun,L"Some text ");
+			run->addAttribute(L"font-family",L"Segoe UI, Tahoma, Geneva, Verdana, sans-serif");
+			run->addAttribute(L"font-size",L"10pt");
+			run->addAttribute(L"color",(j==1)?L"rgb(0,0,238)":L"rgb(0,0,0)");
+			run->addAttribute(L"background-color",L"transparent");
+			nodes.push_back(run);
+			previousRun=run;
+		}
+		previousParagraph=paragraph;
+	}
+	return section;
+}
+
+/**
+ * The attributes of each node, and the text of the whole buffer with markup.
+ */
+wstring describeBuffer(VBufStorage_buffer_t& buffer, const vector<VBufStorage_fieldNode_t*>& nodes) {
+	wstring description;
+	for(vector<VBufStorage_fieldNode_t*>::const_iterator i=nodes.begin();i!=nodes.end();++i) {
+		description+=(*i)->getAttributesString();
+		description+=L"\n";
+	}
+	VBufStorage_textContainer_t* text=buffer.getTextInRange(0,buffer.getTextLength(),true);
+	if(text) {
+		description+=text->getString();
+		text->destroy();
+	}
+	return description;
+}
+
+int main(int argc, char *argv[]) {
+	VBufStorage_buffer_t buffer;
+	VBufStorage_memoryUsage_t emptyUsage;
+	buffer.getMemoryUsage(&emptyUsage);
+	vector<VBufStorage_fieldNode_t*> nodes;
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,0,0,true);
+	nodes.push_back(root);
+	vector<VBufStorage_controlFieldNode_t*> sections;
+	VBufStorage_fieldNode_t* previous=NULL;
+	for(int i=1;i<=sectionCount;++i) {
+		previous=addSection(buffer,root,previous,i,nodes);
+		sections.push_back(static_cast<VBufStorage_controlFieldNode_t*>(previous));
+	}
+	wstring description=describeBuffer(buffer,nodes);
+	VBufStorage_memoryUsage_t unsharedUsage, usage;
+	buffer.getMemoryUsage(&unsharedUsage);
+	// Sharing changes no node's attributes, but they take much less memory.
+	buffer.shareAttributes(root);
+	test(describeBuffer(buffer,nodes)==description, L"sharing does not change the attributes");
+	buffer.getMemoryUsage(&usage);
+	test(usage.attributes<unsharedUsage.attributes/10, L"shared attributes use less memory, " << usage.attributes << L" of " << unsharedUsage.attributes);
+	test(usage.nodes==unsharedUsage.nodes, L"sharing does not change the memory used by nodes");
+	// Sharing again changes nothing.
+	VBufStorage_memoryUsage_t sharedUsage=usage;
+	buffer.shareAttributes(root);
+	buffer.getMemoryUsage(&usage);
+	test(usage.attributes==sharedUsage.attributes&&usage.otherIndexes==sharedUsage.otherIndexes, L"sharing again does not change the memory used");
+	// Changing a node sharing a set gives it its own copy, and leaves the others alone.
+	VBufStorage_fieldNode_t* run=nodes[3];
+	test(run->addAttribute(L"color",L"red"), L"attribute changed");
+	test(run->getAttributesString().find(L"color:red;")!=wstring::npos, L"changed node has the new value");
+	test(nodes[7]->getAttributesString()==nodes[11]->getAttributesString()&&nodes[7]->getAttributesString().find(L"color:rgb(0,0,0);")!=wstring::npos, L"nodes that shared the set keep the old value");
+	buffer.getMemoryUsage(&usage);
+	test(usage.attributes>sharedUsage.attributes, L"the copy uses memory");
+	// Changing it back and sharing again shares it with the others once more.
+	run->addAttribute(L"color",L"rgb(0,0,0)");
+	buffer.shareAttributes(run);
+	test(describeBuffer(buffer,nodes)==description, L"changed node shared again");
+	buffer.getMemoryUsage(&usage);
+	test(usage.attributes==sharedUsage.attributes, L"no more memory is used once shared again, " << usage.attributes << L" of " << sharedUsage.attributes);
+	// A replaced subtree shares the sets already in the buffer.
+	// The nodes of the first section are deleted, so only those of later sections are checked after this.
+	VBufStorage_fieldNode_t* laterRun=nodes[4+4*paragraphsPerSection];
+	map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> replacements;
+	VBufStorage_buffer_t* tempBuffer=new VBufStorage_buffer_t();
+	vector<VBufStorage_fieldNode_t*> replacementNodes;
+	addSection(*tempBuffer,NULL,NULL,sectionCount+1,replacementNodes);
+	replacements[sections[0]]=tempBuffer;
+	test(buffer.replaceSubtrees(replacements), L"section replaced");
+	buffer.getMemoryUsage(&usage);
+	test(usage.attributes==sharedUsage.attributes, L"replaced section shares the existing sets, " << usage.attributes << L" of " << sharedUsage.attributes);
+	test(replacementNodes[1]->getAttributesString()==L"role:paragraph;", L"replaced section has its attributes");
+	// Freezing and thawing keeps the attributes shared.
+	buffer.freeze();
+	buffer.thaw();
+	test(replacementNodes[2]->getAttributesString()==laterRun->getAttributesString(), L"attributes are the same after thawing");
+	buffer.getMemoryUsage(&usage);
+	test(usage.attributes<unsharedUsage.attributes/10, L"attributes are shared after thawing, " << usage.attributes << L" of " << unsharedUsage.attributes);
+	// Removing every node holding a set frees it.
+	buffer.clearBuffer();
+	buffer.getMemoryUsage(&usage);
+	test(usage.attributes==0&&usage.otherIndexes==emptyUsage.otherIndexes, L"cleared buffer has no attribute sets");
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
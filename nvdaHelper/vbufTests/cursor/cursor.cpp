@@ -0,0 +1,149 @@
+/**
+ * tests/cursor/cursor.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Checks that moving a cursor by character, node and line finds the same nodes and lines as walking the buffer's tree.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int paragraphCount=200;
+
+/**
+ * Fills a buffer with nested paragraphs, some of them blocks and some ending in line feeds,
+ * each containing text, a link and an empty control.
+ * @return the last paragraph.
+ */
+VBufStorage_fieldNode_t* fillBuffer(VBufStorage_buffer_t& buffer) {
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,1,0,true);
+	VBufStorage_controlFieldNode_t* section=NULL;
+	VBufStorage_fieldNode_t* previous=NULL;
+	for(int i=1;i<=paragraphCount;++i) {
+		if(i%10==1) {
+			section=buffer.addControlFieldNode(root,section,2,i,true);
+			previous=NULL;
+		}
+		VBufStorage_controlFieldNode_t* paragraph=buffer.addControlFieldNode(section,previous,1,i*3,i%3==0);
+		wostringstream s;
+		s<<L"Paragraph "<<i<<L" has some text"<<((i%5)?L" ":L"\n");
+		VBufStorage_fieldNode_t* text=buffer.addTextFieldNode(paragraph,NULL,s.str());
+		VBufStorage_controlFieldNode_t* link=buffer.addControlFieldNode(paragraph,text,1,i*3+1,false);
+		buffer.addControlFieldNode(paragraph,link,1,i*3+2,false);
+		buffer.addTextFieldNode(link,NULL,L"link");
+		buffer.addTextFieldNode(paragraph,link,L" and more words.");
+		previous=paragraph;
+	}
+	return previous;
+}
+
+/**
+ * Collects the text field nodes in the subtree of the given node, in order, with their start offsets.
+ */
+void collectTextNodes(VBufStorage_fieldNode_t* node, int startOffset, vector<pair<VBufStorage_fieldNode_t*,int> >& textNodes) {
+	if(node->getFirstChild()==NULL) {
+		if(node->getLength()>0) textNodes.push_back(make_pair(node,startOffset));
+		return;
+	}
+	for(VBufStorage_fieldNode_t* child=node->getFirstChild();child!=NULL;child=child->getNext()) {
+		collectTextNodes(child,startOffset,textNodes);
+		startOffset+=child->getLength();
+	}
+}
+
+void checkCharacters(VBufStorage_buffer_t& buffer, const vector<pair<VBufStorage_fieldNode_t*,int> >& textNodes) {
+	VBufStorage_cursor_t cursor(&buffer);
+	test(!cursor.isPlaced(), L"new cursor is not placed");
+	test(!cursor.moveByCharacter(1), L"cursor that is not placed can not move");
+	test(cursor.moveToOffset(0), L"cursor moved to start");
+	size_t index=0;
+	for(int offset=0;offset<buffer.getTextLength();++offset) {
+		if(offset>=textNodes[index].second+textNodes[index].first->getLength()) ++index;
+		test(cursor.getOffset()==offset, L"cursor at " << cursor.getOffset() << L", expected " << offset);
+		test(cursor.getNode()==textNodes[index].first&&cursor.getNodeStartOffset()==textNodes[index].second, L"node at " << offset);
+		test(cursor.getNodeEndOffset()==textNodes[index].second+textNodes[index].first->getLength(), L"node end at " << offset);
+		if(offset+1<buffer.getTextLength()) test(cursor.moveByCharacter(1), L"moved forward from " << offset);
+	}
+	test(!cursor.moveByCharacter(1), L"can not move past the end");
+	test(cursor.getOffset()==buffer.getTextLength()-1, L"cursor unchanged after failing to move");
+	for(int offset=buffer.getTextLength()-1;offset>0;offset-=7) {
+		test(cursor.moveToOffset(offset)&&cursor.moveByCharacter(-7)==(offset>=7), L"moved back from " << offset);
+	}
+	test(!cursor.moveToOffset(-1), L"can not move before the start");
+}
+
+void checkNodes(VBufStorage_buffer_t& buffer, const vector<pair<VBufStorage_fieldNode_t*,int> >& textNodes) {
+	VBufStorage_cursor_t cursor(&buffer);
+	cursor.moveToOffset(0);
+	for(size_t i=0;i<textNodes.size();++i) {
+		test(cursor.getNode()==textNodes[i].first&&cursor.getOffset()==textNodes[i].second, L"forward to node " << i);
+		test(cursor.moveToNextNode()==(i+1<textNodes.size()), L"move from node " << i);
+	}
+	cursor.moveToOffset(buffer.getTextLength()-1);
+	for(size_t i=textNodes.size();i-->0;) {
+		test(cursor.getNode()==textNodes[i].first, L"back to node " << i);
+		test(cursor.moveToPreviousNode()==(i>0), L"move back from node " << i);
+	}
+}
+
+void checkLines(VBufStorage_buffer_t& buffer, int maxLineLength, bool useScreenLayout) {
+	vector<int> lineStarts;
+	for(int offset=0;offset<buffer.getTextLength();) {
+		int startOffset, endOffset;
+		buffer.getLineOffsets(offset,maxLineLength,useScreenLayout,&startOffset,&endOffset);
+		lineStarts.push_back(startOffset);
+		offset=endOffset;
+	}
+	VBufStorage_cursor_t cursor(&buffer);
+	cursor.moveToOffset(0);
+	for(size_t i=0;i<lineStarts.size();++i) {
+		test(cursor.getOffset()==lineStarts[i], L"forward to line " << i << L" at " << cursor.getOffset() << L", expected " << lineStarts[i]);
+		test(cursor.moveToNextLine(maxLineLength,useScreenLayout)==(i+1<lineStarts.size()), L"move from line " << i);
+	}
+	cursor.moveToOffset(buffer.getTextLength()-1);
+	for(size_t i=lineStarts.size();i-->0;) {
+		test(cursor.moveToPreviousLine(maxLineLength,useScreenLayout)==(i>0), L"move back from line " << i);
+		if(i>0) test(cursor.getOffset()==lineStarts[i-1], L"back to line " << (i-1) << L" at " << cursor.getOffset() << L", expected " << lineStarts[i-1]);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	VBufStorage_buffer_t buffer;
+	VBufStorage_fieldNode_t* last=fillBuffer(buffer);
+	vector<pair<VBufStorage_fieldNode_t*,int> > textNodes;
+	VBufStorage_fieldNode_t* root=last;
+	while(root->getParent()) root=root->getParent();
+	collectTextNodes(root,0,textNodes);
+	checkCharacters(buffer,textNodes);
+	checkNodes(buffer,textNodes);
+	for(int useScreenLayout=0;useScreenLayout<2;++useScreenLayout) {
+		for(int maxLineLength=0;maxLineLength<=30;maxLineLength+=30) {
+			checkLines(buffer,maxLineLength,useScreenLayout!=0);
+		}
+	}
+	// A cursor finds its offset again after the buffer changes, and is no longer placed if the offset was removed.
+	VBufStorage_cursor_t cursor(&buffer);
+	int endOffset=buffer.getTextLength()-1;
+	cursor.moveToOffset(endOffset);
+	VBufStorage_fieldNode_t* added=buffer.addTextFieldNode(last->getParent(),last,L"More text");
+	test(cursor.isPlaced()&&cursor.getOffset()==endOffset, L"cursor placed after text was added");
+	test(cursor.getNodeEndOffset()==endOffset+1, L"cursor node found again after text was added");
+	test(cursor.moveToOffset(buffer.getTextLength()-1)&&cursor.getNode()==added, L"cursor moved in to added text");
+	buffer.removeFieldNode(added);
+	test(!cursor.isPlaced()&&!cursor.getNode(), L"cursor not placed after its text was removed");
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
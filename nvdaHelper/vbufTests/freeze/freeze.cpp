@@ -0,0 +1,131 @@
+/**
+ * tests/freeze/freeze.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Checks that freezing and thawing a buffer gives back exactly the same text and attributes, and that changing a frozen buffer thaws it first.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int paragraphCount=200;
+
+/**
+ * Fills a buffer with paragraphs of text in several scripts, each with a link, sharing most attribute values.
+ * @param nodes memory where every node added is placed.
+ */
+void fillBuffer(VBufStorage_buffer_t& buffer, vector<VBufStorage_fieldNode_t*>& nodes) {
+	const wchar_t* texts[]={L"Plain text, ", L"caf\xe9 na\xefve \xa9 ", L"\x4e2d\x6587 ", L"\xd83d\xde00 surrogates \xd800 alone ", L""};
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,0,0,true);
+	nodes.push_back(root);
+	VBufStorage_fieldNode_t* previous=NULL;
+	for(int i=1;i<=paragraphCount;++i) {
+		VBufStorage_controlFieldNode_t* paragraph=buffer.addControlFieldNode(root,previous,1,i*2,true);
+		paragraph->addAttribute(L"role",L"paragraph");
+		wostringstream s;
+		s<<i;
+		paragraph->addAttribute(L"id",s.str());
+		nodes.push_back(paragraph);
+		VBufStorage_fieldNode_t* text=buffer.addTextFieldNode(paragraph,NULL,texts[i%5]);
+		nodes.push_back(text);
+		VBufStorage_controlFieldNode_t* link=buffer.addControlFieldNode(paragraph,text,1,i*2+1,false);
+		link->addAttribute(L"role",L"link");
+		link->addAttribute(L"name",texts[(i+1)%5]);
+		nodes.push_back(link);
+		nodes.push_back(buffer.addTextFieldNode(link,NULL,L"a link"));
+		previous=paragraph;
+	}
+}
+
+/**
+ * The text and attributes of each node, and the text of the whole buffer with markup.
+ */
+wstring describeBuffer(VBufStorage_buffer_t& buffer, const vector<VBufStorage_fieldNode_t*>& nodes) {
+	wstring description;
+	for(vector<VBufStorage_fieldNode_t*>::const_iterator i=nodes.begin();i!=nodes.end();++i) {
+		description+=(*i)->getAttributesString();
+		if(!(*i)->getFirstChild()&&(*i)->getLength()>0) {
+			description+=static_cast<VBufStorage_textFieldNode_t*>(*i)->getText();
+		}
+		description+=L"\n";
+	}
+	VBufStorage_textContainer_t* text=buffer.getTextInRange(0,buffer.getTextLength(),true);
+	if(text) {
+		description+=text->getString();
+		text->destroy();
+	}
+	return description;
+}
+
+int main(int argc, char *argv[]) {
+	VBufStorage_buffer_t buffer;
+	test(!buffer.freeze(), L"empty buffer not frozen");
+	vector<VBufStorage_fieldNode_t*> nodes;
+	fillBuffer(buffer,nodes);
+	wstring description=describeBuffer(buffer,nodes);
+	unsigned int nodeCount, frozenNodeCount;
+	unsigned long long textBytes, attributeBytes, frozenTextBytes, frozenAttributeBytes;
+	buffer.getContentSize(&nodeCount,&textBytes,&attributeBytes);
+	unsigned int version=buffer.getVersion();
+	int length=buffer.getTextLength();
+	test(buffer.freeze(), L"buffer frozen");
+	test(buffer.isFrozen(), L"buffer is frozen");
+	test(!buffer.freeze(), L"frozen buffer not frozen again");
+	// Freezing keeps the nodes, and only their text and attributes are packed.
+	test(buffer.getVersion()==version, L"freezing does not change the version");
+	test(buffer.getTextLength()==length, L"freezing does not change the length");
+	test(nodes[1]->getAttributesString().empty(), L"frozen node has no attributes");
+	test(static_cast<VBufStorage_textFieldNode_t*>(nodes[2])->getText().empty(), L"frozen node has no text");
+	buffer.getContentSize(&frozenNodeCount,&frozenTextBytes,&frozenAttributeBytes);
+	test(frozenNodeCount==nodeCount&&frozenTextBytes==textBytes&&frozenAttributeBytes==attributeBytes, L"content size measured the same while frozen");
+	VBufStorage_freezeStats_t stats;
+	buffer.getFreezeStats(&stats);
+	test(stats.freezeCount==1&&stats.thawCount==0, L"freeze counted");
+	test(stats.unfrozenBytes==textBytes+attributeBytes, L"unfrozen bytes are the text and attributes of the nodes");
+	test(stats.frozenBytes<stats.unfrozenBytes/2, L"frozen content is less than half the size, " << stats.frozenBytes << L" of " << stats.unfrozenBytes);
+	test(buffer.thaw(), L"buffer thawed");
+	test(!buffer.isFrozen(), L"buffer is not frozen");
+	test(!buffer.thaw(), L"thawed buffer not thawed again");
+	test(describeBuffer(buffer,nodes)==description, L"thawed buffer has the same text and attributes");
+	buffer.getFreezeStats(&stats);
+	test(stats.thawCount==1&&stats.maxThawTime>=0&&stats.thawTime==stats.maxThawTime, L"thaw counted");
+	int startOffset, endOffset;
+	VBufStorage_fieldNode_t* link=buffer.findNodeByAttributes(-1,VBufStorage_findDirection_forward,L"role",L"role:link;",&startOffset,&endOffset);
+	test(link==nodes[3], L"search finds the first link after thawing");
+	// Adding a node to a frozen buffer thaws it first.
+	buffer.freeze();
+	VBufStorage_fieldNode_t* text=buffer.addTextFieldNode(static_cast<VBufStorage_controlFieldNode_t*>(nodes[1]),NULL,L"Start ");
+	test(!buffer.isFrozen(), L"adding a node thaws the buffer");
+	test(buffer.removeFieldNode(text), L"added node removed");
+	test(describeBuffer(buffer,nodes)==description, L"buffer has the same text and attributes after adding to it while frozen");
+	// As does removing one, which leaves the same content as removing it from a buffer that was never frozen.
+	buffer.freeze();
+	test(buffer.removeFieldNode(nodes[nodes.size()-4]), L"paragraph removed from frozen buffer");
+	test(!buffer.isFrozen(), L"removing a node thaws the buffer");
+	nodes.resize(nodes.size()-4);
+	VBufStorage_buffer_t unfrozenBuffer;
+	vector<VBufStorage_fieldNode_t*> unfrozenNodes;
+	fillBuffer(unfrozenBuffer,unfrozenNodes);
+	unfrozenBuffer.removeFieldNode(unfrozenNodes[unfrozenNodes.size()-4]);
+	unfrozenNodes.resize(unfrozenNodes.size()-4);
+	test(describeBuffer(buffer,nodes)==describeBuffer(unfrozenBuffer,unfrozenNodes), L"buffer has the same text and attributes after removing from it while frozen");
+	// Clearing a frozen buffer discards the frozen content.
+	buffer.freeze();
+	buffer.clearBuffer();
+	test(!buffer.isFrozen(), L"clearing the buffer discards the frozen content");
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
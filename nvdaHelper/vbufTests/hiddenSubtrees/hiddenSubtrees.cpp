@@ -0,0 +1,215 @@
+/**
+ * tests/hiddenSubtrees/hiddenSubtrees.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Checks that searches stepping over hidden and empty subtrees still find every node that is not hidden, including those in hidden subtrees,
+ * that hiding and showing nodes after a search is taken in to account by the next, and that lines do not pass empty blocks inside inline nodes.
+ * Also reports how long searches take on a page with large hidden regions and on the same page without them.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int sectionCount=100;
+const int paragraphsPerSection=10;
+const int menuItemsPerSection=100;
+const int iterations=5;
+
+long long getMicroseconds() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Adds a control with the given role, and text if any.
+ */
+VBufStorage_controlFieldNode_t* addControl(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int& ID, const wchar_t* role, const wstring& text, bool isBlock) {
+	VBufStorage_controlFieldNode_t* control=buffer.addControlFieldNode(parent,previous,1,ID++,isBlock);
+	control->addAttribute(L"role",role);
+	if(!text.empty()) buffer.addTextFieldNode(control,NULL,text);
+	return control;
+}
+
+/**
+ * Adds a menu whose items are all hidden, as a page does for menus shown when hovered.
+ * @param withText true to give the items text as a backend that renders hidden text does, false to leave them empty as one that skips it does.
+ * @return the menu.
+ */
+VBufStorage_controlFieldNode_t* addHiddenMenu(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int& ID, bool withText) {
+	VBufStorage_controlFieldNode_t* menu=addControl(buffer,parent,previous,ID,L"list",L"",true);
+	menu->setHidden(true);
+	VBufStorage_fieldNode_t* previousItem=NULL;
+	for(int i=0;i<menuItemsPerSection;++i) {
+		VBufStorage_controlFieldNode_t* item=addControl(buffer,menu,previousItem,ID,L"listitem",L"",true);
+		item->setHidden(true);
+		VBufStorage_controlFieldNode_t* link=addControl(buffer,item,NULL,ID,L"link",withText?L"A menu item":L"",false);
+		link->setHidden(true);
+		VBufStorage_controlFieldNode_t* heading=addControl(buffer,item,link,ID,L"heading",withText?L"A menu heading":L"",false);
+		heading->setHidden(true);
+		previousItem=item;
+	}
+	return menu;
+}
+
+/**
+ * Fills a buffer with sections, each with a heading and paragraphs, and if asked, hidden menus with and without text.
+ * One section's paragraphs are in a hidden node whose children are not hidden, as for a node with a presentational role.
+ * @return the root node.
+ */
+VBufStorage_controlFieldNode_t* fillBuffer(VBufStorage_buffer_t& buffer, bool withHiddenRegions) {
+	int ID=1;
+	VBufStorage_controlFieldNode_t* root=addControl(buffer,NULL,NULL,ID,L"document",L"",true);
+	VBufStorage_fieldNode_t* previousSection=NULL;
+	for(int i=0;i<sectionCount;++i) {
+		VBufStorage_controlFieldNode_t* section=addControl(buffer,root,previousSection,ID,L"section",L"",true);
+		wostringstream s;
+		s<<L"Section "<<i;
+		VBufStorage_fieldNode_t* previous=addControl(buffer,section,NULL,ID,L"heading",s.str(),true);
+		if(withHiddenRegions) previous=addHiddenMenu(buffer,section,previous,ID,false);
+		VBufStorage_controlFieldNode_t* container=section;
+		if(i==sectionCount/2) {
+			container=addControl(buffer,section,previous,ID,L"presentation",L"",true);
+			container->setHidden(true);
+			previous=NULL;
+		}
+		for(int j=0;j<paragraphsPerSection;++j) {
+			previous=addControl(buffer,container,previous,ID,L"paragraph",L"Some text in a paragraph, ",true);
+			addControl(buffer,static_cast<VBufStorage_controlFieldNode_t*>(previous),previous->getFirstChild(),ID,L"link",L"a link",false);
+		}
+		if(withHiddenRegions) addHiddenMenu(buffer,section,section->getLastChild(),ID,true);
+		previousSection=section;
+	}
+	return root;
+}
+
+/**
+ * Finds the start offsets of the nodes with the given role that a search should find, walking every node.
+ */
+void findNodesWithRole(VBufStorage_fieldNode_t* node, int startOffset, const wstring& role, vector<int>& startOffsets) {
+	if(node->getLength()>0&&!node->isHidden()&&node->getAttributesString().find(L"role:"+role+L";")!=wstring::npos) {
+		startOffsets.push_back(startOffset);
+	}
+	for(VBufStorage_fieldNode_t* child=node->getFirstChild();child!=NULL;child=child->getNext()) {
+		findNodesWithRole(child,startOffset,role,startOffsets);
+		startOffset+=child->getLength();
+	}
+}
+
+/**
+ * Finds the start offsets of every node with the given role by searching the buffer forward from its start.
+ */
+vector<int> searchForward(VBufStorage_buffer_t& buffer, const wstring& role) {
+	vector<int> startOffsets;
+	wstring regexp=L"role:"+role+L";";
+	int startOffset=-1, endOffset;
+	while(buffer.findNodeByAttributes(startOffset,VBufStorage_findDirection_forward,L"role",regexp,&startOffset,&endOffset)) {
+		startOffsets.push_back(startOffset);
+	}
+	return startOffsets;
+}
+
+/**
+ * Finds the start offsets of every node with the given role by searching the buffer back from its end, giving them in the order they are in the buffer.
+ */
+vector<int> searchBack(VBufStorage_buffer_t& buffer, const wstring& role) {
+	vector<int> startOffsets;
+	wstring regexp=L"role:"+role+L";";
+	int startOffset=buffer.getTextLength()-1, endOffset;
+	while(buffer.findNodeByAttributes(startOffset,VBufStorage_findDirection_back,L"role",regexp,&startOffset,&endOffset)) {
+		startOffsets.insert(startOffsets.begin(),startOffset);
+	}
+	return startOffsets;
+}
+
+/**
+ * Searches for a node that is not there, which visits every node a search cannot step over.
+ * @return the time taken in microseconds, averaged over the iterations.
+ */
+long long timeSearch(VBufStorage_buffer_t& buffer) {
+	long long time=0;
+	for(int i=0;i<iterations;++i) {
+		int startOffset, endOffset;
+		long long start=getMicroseconds();
+		VBufStorage_fieldNode_t* node=buffer.findNodeByAttributes(-1,VBufStorage_findDirection_forward,L"role",L"role:table;",&startOffset,&endOffset);
+		time+=getMicroseconds()-start;
+		test(!node, L"search for a table finds nothing");
+	}
+	return time/iterations;
+}
+
+int main(int argc, char *argv[]) {
+	VBufStorage_buffer_t buffer;
+	VBufStorage_controlFieldNode_t* root=fillBuffer(buffer,true);
+	// Searches find the same nodes as a walk of every node, in both directions.
+	const wchar_t* roles[]={L"heading",L"link",L"paragraph"};
+	for(int i=0;i<3;++i) {
+		vector<int> expected;
+		findNodesWithRole(root,0,roles[i],expected);
+		test(searchForward(buffer,roles[i])==expected, roles[i] << L": searching forward finds every node that is not hidden");
+		test(searchBack(buffer,roles[i])==expected, roles[i] << L": searching back finds every node that is not hidden");
+	}
+	vector<int> paragraphs;
+	findNodesWithRole(root,0,L"paragraph",paragraphs);
+	test(paragraphs.size()==sectionCount*paragraphsPerSection, L"paragraphs in a hidden node whose children are not hidden are found, " << paragraphs.size());
+	// Showing a node in a hidden region already searched lets it be found, and hiding it again does not.
+	VBufStorage_fieldNode_t* section=root->getFirstChild()->getNext();
+	VBufStorage_fieldNode_t* hiddenHeading=section->getLastChild()->getFirstChild()->getFirstChild()->getNext();
+	int headingCount=static_cast<int>(searchForward(buffer,L"heading").size());
+	hiddenHeading->setHidden(false);
+	test(searchForward(buffer,L"heading").size()==headingCount+1, L"a shown heading is found");
+	test(searchBack(buffer,L"heading").size()==headingCount+1, L"a shown heading is found searching back");
+	hiddenHeading->setHidden(true);
+	test(searchForward(buffer,L"heading").size()==headingCount, L"a heading hidden again is not found");
+	// Text added in a hidden region with no text until now is found if it is not hidden.
+	VBufStorage_controlFieldNode_t* emptyItem=static_cast<VBufStorage_controlFieldNode_t*>(section->getFirstChild()->getNext()->getFirstChild());
+	VBufStorage_controlFieldNode_t* shownLink=buffer.addControlFieldNode(emptyItem,NULL,1,1000000,false);
+	shownLink->addAttribute(L"role",L"link");
+	buffer.addTextFieldNode(shownLink,NULL,L"shown");
+	vector<int> links;
+	findNodesWithRole(root,0,L"link",links);
+	test(searchForward(buffer,L"link")==links, L"a link added in an empty hidden region is found");
+	test(buffer.removeFieldNode(shownLink), L"link removed");
+	// Lines pass empty inline nodes, but not empty blocks inside them.
+	{
+		VBufStorage_buffer_t lineBuffer;
+		int ID=1;
+		VBufStorage_controlFieldNode_t* paragraph=addControl(lineBuffer,NULL,NULL,ID,L"paragraph",L"",true);
+		VBufStorage_fieldNode_t* previous=lineBuffer.addTextFieldNode(paragraph,NULL,L"before ");
+		VBufStorage_controlFieldNode_t* span=addControl(lineBuffer,paragraph,previous,ID,L"span",L"",false);
+		span->setHidden(true);
+		addControl(lineBuffer,span,NULL,ID,L"span",L"",false);
+		previous=lineBuffer.addTextFieldNode(paragraph,span,L"middle ");
+		span=addControl(lineBuffer,paragraph,previous,ID,L"span",L"",false);
+		addControl(lineBuffer,span,NULL,ID,L"separator",L"",true);
+		lineBuffer.addTextFieldNode(paragraph,span,L"after");
+		int lineStart, lineEnd;
+		test(lineBuffer.getLineOffsets(0,0,true,&lineStart,&lineEnd)&&lineStart==0&&lineEnd==14, L"line passes an empty inline node, " << lineStart << L" to " << lineEnd);
+		test(lineBuffer.getLineOffsets(14,0,true,&lineStart,&lineEnd)&&lineStart==14&&lineEnd==19, L"line after an empty block starts at it, " << lineStart << L" to " << lineEnd);
+		test(lineBuffer.getLineOffsets(8,0,true,&lineStart,&lineEnd)&&lineStart==0&&lineEnd==14, L"line before an empty block ends at it, " << lineStart << L" to " << lineEnd);
+	}
+	// A page with large hidden regions is searched in about the time the same page without them is.
+	unsigned int nodeCount, hiddenNodeCount;
+	unsigned long long textBytes, attributeBytes;
+	buffer.getContentSize(&hiddenNodeCount,&textBytes,&attributeBytes);
+	long long hiddenTime=timeSearch(buffer);
+	VBufStorage_buffer_t visibleBuffer;
+	fillBuffer(visibleBuffer,false);
+	visibleBuffer.getContentSize(&nodeCount,&textBytes,&attributeBytes);
+	long long visibleTime=timeSearch(visibleBuffer);
+	wcout<<L"search "<<hiddenTime<<L" us with hidden regions ("<<hiddenNodeCount<<L" nodes), "<<visibleTime<<L" us without ("<<nodeCount<<L" nodes)"<<endl;
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
@@ -0,0 +1,158 @@
+/**
+ * tests/ingestion/ingestion.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Renders the same synthetic page twice, once handing text and attributes to the buffer as copies and once moving them in or giving their characters directly,
+ * and reports how many allocations and how long each takes, checking that both give the same buffer.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+// Every allocation made by this program is counted.
+unsigned long long allocationCount=0;
+
+void* operator new(size_t size) {
+	++allocationCount;
+	void* p=malloc(size?size:1);
+	if(!p) throw bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t size) noexcept {
+	free(p);
+}
+
+const int paragraphCount=20000;
+const int iterations=5;
+
+// Stands in for a BSTR a backend gets from a COM call, with its length.
+const wchar_t fontFamily[]=L"Segoe UI, Tahoma, Geneva, Verdana, sans-serif";
+const size_t fontFamilyLength=(sizeof(fontFamily)/sizeof(wchar_t))-1;
+const wchar_t paragraphText[]=L"Some text in a paragraph, long enough not to be held in the string object itself.";
+const size_t paragraphTextLength=(sizeof(paragraphText)/sizeof(wchar_t))-1;
+
+long long getMicroseconds() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Collects the attributes of a paragraph in a map, as the MSHTML backend does for the HTML attributes of a node.
+ */
+void collectAttributes(int index, VBufStorage_attributeMap_t& attribs) {
+	attribs[L"HTMLAttrib::class"]=L"article-body-paragraph";
+	attribs[L"HTMLAttrib::id"]=L"paragraph-with-a-long-identifier";
+	attribs[L"HTMLAttrib::lang"]=L"en-US-x-a-long-language-tag";
+	attribs[L"IHTMLDOMNode::nodeName"]=L"PARAGRAPH-ELEMENT";
+}
+
+/**
+ * Renders a paragraph, copying its text and attributes in to the buffer, as backends did when these could only be given as references.
+ */
+void renderCopying(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t*& previous, int index) {
+	VBufStorage_controlFieldNode_t* paragraph=buffer.addControlFieldNode(parent,previous,1,index,true);
+	VBufStorage_attributeMap_t attribs;
+	collectAttributes(index,attribs);
+	for(VBufStorage_attributeMap_t::const_iterator i=attribs.begin();i!=attribs.end();++i) {
+		paragraph->addAttribute(i->first,i->second);
+	}
+	wstring text(paragraphText,paragraphTextLength);
+	VBufStorage_textFieldNode_t* textNode=buffer.addTextFieldNode(paragraph,NULL,text);
+	wstring family(fontFamily,fontFamilyLength);
+	textNode->addAttribute(L"font-family",family);
+	wostringstream s;
+	s<<L"formatting state of paragraph number "<<index;
+	wstring formatState=s.str();
+	textNode->addAttribute(L"formatState",formatState);
+	previous=paragraph;
+}
+
+/**
+ * Renders a paragraph, moving its text and attributes in to the buffer, or giving their characters directly.
+ */
+void renderMoving(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t*& previous, int index) {
+	VBufStorage_controlFieldNode_t* paragraph=buffer.addControlFieldNode(parent,previous,1,index,true);
+	VBufStorage_attributeMap_t attribs;
+	collectAttributes(index,attribs);
+	paragraph->setAttributes(move(attribs));
+	VBufStorage_textFieldNode_t* textNode=buffer.addTextFieldNode(paragraph,NULL,paragraphText,paragraphTextLength);
+	textNode->addAttribute(L"font-family",fontFamily,fontFamilyLength);
+	wostringstream s;
+	s<<L"formatting state of paragraph number "<<index;
+	textNode->addAttribute(L"formatState",s.str());
+	previous=paragraph;
+}
+
+/**
+ * Renders the page in to an empty buffer, one paragraph at a time using the given function.
+ * @param allocations memory where the number of allocations made is added.
+ * @param time memory where the time taken in microseconds is added.
+ */
+void renderPage(VBufStorage_buffer_t& buffer, void (*renderParagraph)(VBufStorage_buffer_t&, VBufStorage_controlFieldNode_t*, VBufStorage_fieldNode_t*&, int), unsigned long long& allocations, long long& time) {
+	unsigned long long startCount=allocationCount;
+	long long start=getMicroseconds();
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,0,0,true);
+	root->addAttribute(L"role",L"document");
+	VBufStorage_fieldNode_t* previous=NULL;
+	for(int i=1;i<=paragraphCount;++i) {
+		renderParagraph(buffer,root,previous,i);
+	}
+	time+=getMicroseconds()-start;
+	allocations+=allocationCount-startCount;
+}
+
+/**
+ * The text of the whole buffer with markup.
+ */
+wstring describeBuffer(VBufStorage_buffer_t& buffer) {
+	wstring description;
+	VBufStorage_textContainer_t* text=buffer.getTextInRange(0,buffer.getTextLength(),true);
+	if(text) {
+		description=text->getString();
+		text->destroy();
+	}
+	return description;
+}
+
+int main(int argc, char *argv[]) {
+	unsigned long long copyingAllocations=0, movingAllocations=0;
+	long long copyingTime=0, movingTime=0;
+	wstring copyingDescription, movingDescription;
+	for(int i=0;i<iterations;++i) {
+		VBufStorage_buffer_t copyingBuffer;
+		renderPage(copyingBuffer,renderCopying,copyingAllocations,copyingTime);
+		if(i==0) copyingDescription=describeBuffer(copyingBuffer);
+		copyingBuffer.clearBuffer();
+		VBufStorage_buffer_t movingBuffer;
+		renderPage(movingBuffer,renderMoving,movingAllocations,movingTime);
+		if(i==0) movingDescription=describeBuffer(movingBuffer);
+		movingBuffer.clearBuffer();
+	}
+	test(!copyingDescription.empty()&&movingDescription==copyingDescription, L"both ways of rendering give the same buffer");
+	test(movingAllocations<copyingAllocations, L"moving allocates less than copying");
+	wcout<<paragraphCount<<L" paragraphs"<<endl;
+	wcout<<L"copying: "<<(copyingAllocations/iterations)<<L" allocations, "<<(copyingTime/iterations)<<L" us"<<endl;
+	wcout<<L"moving: "<<(movingAllocations/iterations)<<L" allocations, "<<(movingTime/iterations)<<L" us"<<endl;
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
@@ -0,0 +1,102 @@
+/**
+ * tests/lineStream/lineStream.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Checks that reading lines from a line stream gives the same lines as getLineOffsets and getTextInRange.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int paragraphCount=300;
+const int linesPerRead=7;
+
+/**
+ * Fills a buffer with paragraphs, some of them blocks and some ending in line feeds,
+ * each containing text, a link and an empty control.
+ * @return the last paragraph.
+ */
+VBufStorage_fieldNode_t* fillBuffer(VBufStorage_buffer_t& buffer) {
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,1,0,true);
+	VBufStorage_fieldNode_t* previous=NULL;
+	for(int i=1;i<=paragraphCount;++i) {
+		VBufStorage_controlFieldNode_t* paragraph=buffer.addControlFieldNode(root,previous,1,i*3,i%3==0);
+		wostringstream s;
+		s<<L"Paragraph "<<i<<L" has some text & a"<<((i%5)?L" ":L"\n");
+		VBufStorage_fieldNode_t* text=buffer.addTextFieldNode(paragraph,NULL,s.str());
+		VBufStorage_controlFieldNode_t* link=buffer.addControlFieldNode(paragraph,text,1,i*3+1,false);
+		buffer.addControlFieldNode(paragraph,link,1,i*3+2,false);
+		buffer.addTextFieldNode(link,NULL,L"link with words");
+		buffer.addTextFieldNode(paragraph,link,L" in the middle of it with more words.");
+		previous=paragraph;
+	}
+	return previous;
+}
+
+/**
+ * Reads every line from the given offset to the end of the buffer, checking each against getLineOffsets and getTextInRange.
+ */
+void checkStream(VBufStorage_buffer_t& buffer, int offset, int maxLineLength, bool useScreenLayout, bool useMarkup) {
+	VBufStorage_lineStream_t* stream=buffer.openLineStream(offset,maxLineLength,useScreenLayout);
+	test(stream, L"stream opened at " << offset);
+	if(!stream) return;
+	int expectedStart, expectedEnd;
+	buffer.getLineOffsets(offset,maxLineLength,useScreenLayout,&expectedStart,&expectedEnd);
+	int lineOffset=expectedStart;
+	for(;;) {
+		int startOffsets[linesPerRead];
+		int endOffsets[linesPerRead];
+		int textLengths[linesPerRead];
+		int lineCount=0;
+		VBufStorage_textContainer_t* textContainer=buffer.readLineStream(stream,linesPerRead,useMarkup,&lineCount,startOffsets,endOffsets,textLengths);
+		test(textContainer, L"stream read at " << lineOffset);
+		if(!textContainer) break;
+		size_t textOffset=0;
+		for(int i=0;i<lineCount;++i) {
+			buffer.getLineOffsets(lineOffset,maxLineLength,useScreenLayout,&expectedStart,&expectedEnd);
+			test(startOffsets[i]==expectedStart&&endOffsets[i]==expectedEnd, L"line at " << lineOffset << L" is " << startOffsets[i] << L" to " << endOffsets[i] << L", expected " << expectedStart << L" to " << expectedEnd);
+			VBufStorage_textContainer_t* expectedText=buffer.getTextInRange(expectedStart,expectedEnd,useMarkup);
+			test(textContainer->getString().substr(textOffset,textLengths[i])==expectedText->getString(), L"text of line at " << lineOffset);
+			expectedText->destroy();
+			textOffset+=textLengths[i];
+			lineOffset=endOffsets[i];
+		}
+		textContainer->destroy();
+		if(lineCount==0) break;
+	}
+	test(lineOffset==buffer.getTextLength(), L"stream read to the end of the buffer, stopped at " << lineOffset);
+	buffer.closeLineStream(stream);
+}
+
+int main(int argc, char *argv[]) {
+	VBufStorage_buffer_t buffer;
+	VBufStorage_fieldNode_t* last=fillBuffer(buffer);
+	for(int useScreenLayout=0;useScreenLayout<2;++useScreenLayout) {
+		for(int maxLineLength=0;maxLineLength<=30;maxLineLength+=30) {
+			for(int offset=0;offset<200;offset+=37) {
+				checkStream(buffer,offset,maxLineLength,useScreenLayout!=0,useScreenLayout!=0);
+			}
+		}
+	}
+	VBufStorage_lineStream_t* stream=buffer.openLineStream(0,0,false);
+	int startOffsets[1], endOffsets[1], textLengths[1], lineCount;
+	buffer.addTextFieldNode(last->getParent(),last,L"More text");
+	test(!buffer.readLineStream(stream,1,false,&lineCount,startOffsets,endOffsets,textLengths), L"stream can not be read after the buffer changes");
+	buffer.closeLineStream(stream);
+	test(!buffer.readLineStream(stream,1,false,&lineCount,startOffsets,endOffsets,textLengths), L"closed stream can not be read");
+	test(!buffer.openLineStream(buffer.getTextLength(),0,false), L"stream can not be opened past the end of the buffer");
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
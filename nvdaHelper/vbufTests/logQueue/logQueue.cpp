@@ -0,0 +1,185 @@
+/**
+ * tests/logQueue/logQueue.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Measures logging through the log queue against shipping each message with its own call,
+ * using a stand-in sink that costs about as much per call as an RPC to NVDA.
+ * Also checks that no message is lost when the queue is stopped while threads are logging.
+ */
+
+#include <cwchar>
+#include <iostream>
+#include <sstream>
+#include <windows.h>
+#include <common/lock.h>
+#include <common/log.h>
+#include <common/logQueue.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int threadCount=4;
+const int messagesPerThread=20000;
+
+// Roughly the cost of an RPC round trip to NVDA, and of marshalling each message, in microseconds.
+const long long sinkCallCost=20;
+const long long sinkRecordCost=1;
+
+// Work done by logging threads between messages, in microseconds.
+const long long producerWorkCost=5;
+
+long long getMicroseconds() {
+	static LARGE_INTEGER frequency={0};
+	if(frequency.QuadPart==0) QueryPerformanceFrequency(&frequency);
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (counter.QuadPart*1000000)/frequency.QuadPart;
+}
+
+void spin(long long microseconds) {
+	long long end=getMicroseconds()+microseconds;
+	while(getMicroseconds()<end);
+}
+
+/**
+ * The stand-in sink handles one call at a time, as NVDA does.
+ */
+LockableObject sinkLock;
+long long sinkCalls=0;
+long long sinkRecords=0;
+long long outOfOrderRecords=0;
+long lastSequence[threadCount];
+
+/**
+ * Checks that messages from each logging thread arrive in order.
+ * Messages are of the form "<thread index> <sequence>", anything else, such as the queue's own dropped messages warning, is ignored.
+ */
+void sinkRecord(const wchar_t* msg) {
+	wchar_t* end=NULL;
+	long threadIndex=wcstol(msg,&end,10);
+	if(end==msg||threadIndex<0||threadIndex>=threadCount) return;
+	long sequence=wcstol(end,NULL,10);
+	if(sequence<=lastSequence[threadIndex]) ++outOfOrderRecords;
+	lastSequence[threadIndex]=sequence;
+	++sinkRecords;
+}
+
+void logMessage(int level, const wchar_t* msg) {
+	sinkLock.acquire();
+	spin(sinkCallCost+sinkRecordCost);
+	++sinkCalls;
+	sinkRecord(msg);
+	sinkLock.release();
+}
+
+void logMessages(const LogRecord_t* records, unsigned int count) {
+	sinkLock.acquire();
+	spin(sinkCallCost+sinkRecordCost*count);
+	++sinkCalls;
+	for(unsigned int i=0;i<count;++i) {
+		sinkRecord(records[i].message);
+	}
+	sinkLock.release();
+}
+
+/**
+ * Total time logging threads spent in logQueue_enqueue, in microseconds.
+ */
+volatile long long producerMicroseconds[threadCount];
+
+DWORD WINAPI producerThreadFunc(LPVOID data) {
+	int threadIndex=static_cast<int>(reinterpret_cast<size_t>(data));
+	wostringstream s;
+	long long total=0;
+	for(int i=1;i<=messagesPerThread;++i) {
+		spin(producerWorkCost);
+		s.str(L"");
+		s<<threadIndex<<L" "<<i;
+		long long start=getMicroseconds();
+		logQueue_enqueue(LOGLEVEL_DEBUGWARNING,s.str().c_str());
+		total+=getMicroseconds()-start;
+	}
+	producerMicroseconds[threadIndex]=total;
+	return 0;
+}
+
+struct runResult_t {
+	long long elapsed;
+	long long producerTime;
+	long long calls;
+	long long records;
+	long long dropped;
+};
+
+/**
+ * Logs from several threads at once and waits for them all to finish, then stops the queue so that everything still queued is passed on.
+ * @param stopAfter if not 0, stops the queue this many milliseconds after the threads start, while they are still logging.
+ */
+runResult_t run(DWORD stopAfter=0) {
+	sinkCalls=sinkRecords=outOfOrderRecords=0;
+	for(int i=0;i<threadCount;++i) lastSequence[i]=0;
+	unsigned long long droppedBefore=logQueue_getDroppedCount();
+	long long start=getMicroseconds();
+	HANDLE threads[threadCount];
+	for(int i=0;i<threadCount;++i) {
+		threads[i]=CreateThread(NULL,0,producerThreadFunc,reinterpret_cast<LPVOID>(static_cast<size_t>(i)),0,NULL);
+	}
+	if(stopAfter) {
+		Sleep(stopAfter);
+		logQueue_stop();
+	}
+	for(int i=0;i<threadCount;++i) {
+		WaitForSingleObject(threads[i],INFINITE);
+		CloseHandle(threads[i]);
+	}
+	// Stopping the queue passes on everything still queued.
+	logQueue_stop();
+	runResult_t result;
+	result.elapsed=getMicroseconds()-start;
+	result.producerTime=0;
+	for(int i=0;i<threadCount;++i) result.producerTime+=producerMicroseconds[i];
+	result.calls=sinkCalls;
+	result.records=sinkRecords;
+	result.dropped=static_cast<long long>(logQueue_getDroppedCount()-droppedBefore);
+	return result;
+}
+
+void printResult(const wchar_t* name, const runResult_t& result) {
+	long long total=threadCount*messagesPerThread;
+	wcout<<name<<L": "<<result.records<<L" of "<<total<<L" messages delivered in "<<(result.elapsed/1000)<<L" ms"
+		<<L", "<<((result.records*1000000)/(result.elapsed>0?result.elapsed:1))<<L" messages/s"
+		<<L", "<<result.calls<<L" sink calls"
+		<<L", "<<result.dropped<<L" dropped"
+		<<L", "<<((result.producerTime*1000)/total)<<L" ns per message in the logging thread"<<endl;
+}
+
+int main(int argc, char *argv[]) {
+	long long total=threadCount*messagesPerThread;
+	// Without the background thread, every message is passed straight to logMessage, as before the queue existed.
+	runResult_t direct=run();
+	printResult(L"direct",direct);
+	test(direct.records==total, L"direct delivers every message, got " << direct.records);
+	test(direct.calls==total, L"direct makes a call per message, got " << direct.calls);
+	test(outOfOrderRecords==0, L"direct keeps each thread's order, " << outOfOrderRecords << L" out of order");
+	test(logQueue_start(), L"queue starts");
+	runResult_t queued=run();
+	printResult(L"queued",queued);
+	test(queued.records+queued.dropped==total, L"queued delivers or counts every message, got " << queued.records << L"+" << queued.dropped);
+	test(outOfOrderRecords==0, L"queued keeps each thread's order, " << outOfOrderRecords << L" out of order");
+	test(queued.calls<queued.records, L"queued batches messages, " << queued.calls << L" calls for " << queued.records << L" messages");
+	test(queued.producerTime<direct.producerTime, L"queued logging threads spend less time logging");
+	// Messages published by threads that saw the queue running just before it stopped are still passed on.
+	test(logQueue_start(), L"queue starts again");
+	runResult_t stopped=run(50);
+	printResult(L"stopped while logging",stopped);
+	test(stopped.records+stopped.dropped==total, L"stopping while logging delivers or counts every message, got " << stopped.records << L"+" << stopped.dropped);
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
@@ -0,0 +1,80 @@
+/**
+ * tests/memoryUsage/memoryUsage.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Checks that the memory a buffer reports using follows the nodes, text, attributes and indexes it holds, and goes back down when they are removed.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int paragraphCount=100;
+
+int main(int argc, char *argv[]) {
+	VBufStorage_buffer_t buffer;
+	VBufStorage_memoryUsage_t emptyUsage, usage, previousUsage;
+	buffer.getMemoryUsage(&emptyUsage);
+	test(emptyUsage.text==0&&emptyUsage.attributes==0, L"empty buffer has no text or attributes");
+	test(emptyUsage.getTotal()==emptyUsage.nodes+emptyUsage.identifierIndex+emptyUsage.otherIndexes, L"total is the sum of the categories");
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,0,0,true);
+	buffer.getMemoryUsage(&usage);
+	test(usage.nodes>emptyUsage.nodes, L"adding a node uses memory for it");
+	test(usage.identifierIndex>emptyUsage.identifierIndex, L"adding a control field node uses memory in the identifier index");
+	test(usage.text==0, L"control field node has no text");
+	VBufStorage_fieldNode_t* previous=NULL;
+	for(int i=1;i<=paragraphCount;++i) {
+		VBufStorage_controlFieldNode_t* paragraph=buffer.addControlFieldNode(root,previous,1,i,true);
+		wostringstream s;
+		s<<L"The description of paragraph "<<i;
+		paragraph->addAttribute(L"description",s.str());
+		buffer.addTextFieldNode(paragraph,NULL,L"Some text long enough not to be held in the string object itself.");
+		previous=paragraph;
+	}
+	previousUsage=usage;
+	buffer.getMemoryUsage(&usage);
+	test(usage.nodes>=previousUsage.nodes+2*paragraphCount*sizeof(VBufStorage_textFieldNode_t), L"every node is counted");
+	test(usage.text>=paragraphCount*64*sizeof(wchar_t), L"the text of every text field node is counted");
+	test(usage.attributes>=paragraphCount*30*sizeof(wchar_t), L"the attributes of every node are counted");
+	test(usage.identifierIndex>previousUsage.identifierIndex, L"the identifiers of the paragraphs are counted");
+	unsigned int nodeCount;
+	unsigned long long textBytes, attributeBytes;
+	buffer.getContentSize(&nodeCount,&textBytes,&attributeBytes);
+	test(usage.text>=textBytes&&usage.attributes>=attributeBytes, L"memory used is at least the size of the content");
+	// Building a table grid uses memory in the other indexes.
+	previousUsage=usage;
+	VBufStorage_controlFieldNode_t* cell=buffer.addControlFieldNode(root,previous,1,paragraphCount+1,false);
+	cell->addAttribute(L"table-id",L"1");
+	cell->addAttribute(L"table-rownumber",L"1");
+	cell->addAttribute(L"table-columnnumber",L"1");
+	buffer.addTextFieldNode(cell,NULL,L"cell");
+	int startOffset, endOffset;
+	test(buffer.getTableCell(L"1",1,1,&startOffset,&endOffset)==cell, L"cell found in the table grid");
+	buffer.getMemoryUsage(&usage);
+	test(usage.otherIndexes>previousUsage.otherIndexes, L"table grid uses memory in the other indexes");
+	// Freezing packs the text and attributes in to less memory.
+	previousUsage=usage;
+	buffer.freeze();
+	buffer.getMemoryUsage(&usage);
+	test(usage.nodes==previousUsage.nodes, L"freezing does not change the memory used by nodes");
+	test(usage.text+usage.attributes<previousUsage.text+previousUsage.attributes, L"frozen text and attributes use less memory, " << usage.text+usage.attributes << L" of " << previousUsage.text+previousUsage.attributes);
+	test(usage.text>0&&usage.attributes>0, L"frozen text and attributes are counted");
+	buffer.thaw();
+	// Clearing the buffer gives back all the memory.
+	buffer.clearBuffer();
+	buffer.getMemoryUsage(&usage);
+	test(usage.nodes==emptyUsage.nodes&&usage.text==0&&usage.attributes==0&&usage.identifierIndex==emptyUsage.identifierIndex, L"cleared buffer uses as much memory as an empty one");
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
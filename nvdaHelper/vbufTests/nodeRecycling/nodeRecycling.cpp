@@ -0,0 +1,191 @@
+/**
+ * tests/nodeRecycling/nodeRecycling.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Checks that re-rendering a subtree the way a backend's update does reuses the control field nodes the previous update removed,
+ * giving the same buffer as new nodes would with fewer allocations, and that kept nodes are freed when they are not reused.
+ * Also checks that nodes of a backend's own subclass are deleted rather than kept, as only nodes the buffer created are handed out again.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+// Every allocation made by this program is counted.
+unsigned long long allocationCount=0;
+
+void* operator new(size_t size) {
+	++allocationCount;
+	void* p=malloc(size?size:1);
+	if(!p) throw bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t size) noexcept {
+	free(p);
+}
+
+const int itemCount=50;
+
+int backendNodesDestroyed=0;
+
+/**
+ * A control field node of a backend's own, as the mshtml and Acrobat backends add, which counts how many have been destroyed.
+ */
+class BackendNode_t: public VBufStorage_controlFieldNode_t {
+	public:
+
+	BackendNode_t(int docHandle, int ID): VBufStorage_controlFieldNode_t(docHandle,ID,true) {}
+
+	~BackendNode_t() {
+		++backendNodesDestroyed;
+	}
+
+};
+
+/**
+ * Renders a list of items, as a backend renders a live region whose items change, with the given text in each item.
+ * @param nodes if not NULL, memory where the list and its items are placed.
+ * @return the list.
+ */
+VBufStorage_controlFieldNode_t* renderList(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, const wstring& itemText, vector<VBufStorage_controlFieldNode_t*>* nodes) {
+	VBufStorage_controlFieldNode_t* list=buffer.addControlFieldNode(parent,previous,1,1,true);
+	list->addAttribute(L"role",L"list");
+	if(nodes) nodes->push_back(list);
+	VBufStorage_fieldNode_t* previousItem=NULL;
+	for(int i=0;i<itemCount;++i) {
+		VBufStorage_controlFieldNode_t* item=buffer.addControlFieldNode(list,previousItem,1,i+2,true);
+		item->addAttribute(L"role",L"listitem");
+		wostringstream s;
+		s<<L"item number "<<i<<L" of a list long enough not to be held in the string object";
+		item->addAttribute(L"description",s.str());
+		item->addTypedAttribute(L"level",VBufStorage_attributeType_int32,i);
+		buffer.addTextFieldNode(item,NULL,itemText);
+		if(nodes) nodes->push_back(item);
+		previousItem=item;
+	}
+	return list;
+}
+
+/**
+ * The text of the whole buffer with markup.
+ */
+wstring describeBuffer(VBufStorage_buffer_t& buffer) {
+	wstring description;
+	VBufStorage_textContainer_t* text=buffer.getTextInRange(0,buffer.getTextLength(),true);
+	if(text) {
+		description=text->getString();
+		text->destroy();
+	}
+	return description;
+}
+
+/**
+ * Re-renders the list with new text as a backend's update does: the list is rendered in to a temporary buffer using the nodes the previous update removed, then replaces the old list.
+ * @param allocations memory where the number of allocations made by rendering is placed.
+ * @return the new list.
+ */
+VBufStorage_controlFieldNode_t* updateList(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* oldList, const wstring& itemText, bool reuseNodes, vector<VBufStorage_controlFieldNode_t*>* nodes, unsigned long long* allocations) {
+	VBufStorage_nodePool_t nodePool;
+	if(reuseNodes) buffer.takeRetiredNodes(nodePool);
+	VBufStorage_buffer_t* tempBuf=new VBufStorage_buffer_t();
+	tempBuf->setNodePool(&nodePool);
+	unsigned long long startCount=allocationCount;
+	VBufStorage_controlFieldNode_t* list=renderList(*tempBuf,NULL,NULL,itemText,nodes);
+	*allocations=allocationCount-startCount;
+	tempBuf->setNodePool(NULL);
+	map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> replacements;
+	replacements[oldList]=tempBuf;
+	test(buffer.replaceSubtrees(replacements), L"list replaced");
+	return list;
+}
+
+int main(int argc, char *argv[]) {
+	VBufStorage_buffer_t buffer;
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,0,0,true);
+	VBufStorage_fieldNode_t* heading=buffer.addTextFieldNode(root,NULL,L"A heading before the list");
+	vector<VBufStorage_controlFieldNode_t*> firstNodes;
+	VBufStorage_controlFieldNode_t* list=renderList(buffer,root,heading,L"first text",&firstNodes);
+	buffer.shareAttributes(root);
+	// The first update has no removed nodes to reuse.
+	unsigned long long newAllocations, reusedAllocations;
+	list=updateList(buffer,list,L"second text",true,NULL,&newAllocations);
+	VBufStorage_memoryUsage_t usage, previousUsage;
+	buffer.getMemoryUsage(&usage);
+	test(usage.nodes>=(itemCount+1)*sizeof(VBufStorage_controlFieldNode_t)*2, L"removed nodes are kept, " << usage.nodes);
+	// The second reuses the nodes the first removed, giving the same buffer as new nodes would.
+	vector<VBufStorage_controlFieldNode_t*> reusedNodes;
+	list=updateList(buffer,list,L"third text",true,&reusedNodes,&reusedAllocations);
+	test(reusedNodes==firstNodes, L"the list and its items are the nodes removed by the previous update");
+	// Each item saves allocating its node, its attribute set and its typed attribute list.
+	test(reusedAllocations+3*itemCount<=newAllocations, L"reusing nodes allocates less, " << reusedAllocations << L" of " << newAllocations);
+	wstring reusedDescription=describeBuffer(buffer);
+	VBufStorage_buffer_t otherBuffer;
+	VBufStorage_controlFieldNode_t* otherRoot=otherBuffer.addControlFieldNode(NULL,NULL,0,0,true);
+	VBufStorage_fieldNode_t* otherHeading=otherBuffer.addTextFieldNode(otherRoot,NULL,L"A heading before the list");
+	renderList(otherBuffer,otherRoot,otherHeading,L"third text",NULL);
+	test(reusedDescription==describeBuffer(otherBuffer), L"reused nodes give the same buffer as new ones");
+	test(reusedNodes[2]->getAttributesString()==L"description:item number 1 of a list long enough not to be held in the string object;role:listitem;level:1;", L"reused node has only its new attributes, " << reusedNodes[2]->getAttributesString());
+	test(buffer.getControlFieldNodeWithIdentifier(1,3)==reusedNodes[2], L"reused node found by its identifier");
+	// Reused nodes share attributes with the rest of the buffer.
+	buffer.getMemoryUsage(&previousUsage);
+	buffer.shareAttributes(root);
+	buffer.getMemoryUsage(&usage);
+	test(usage.attributes==previousUsage.attributes, L"reused nodes' attributes were shared when they replaced the old list");
+	// An update not reusing nodes leaves those kept to the next update that does, after which any not reused are freed.
+	list=updateList(buffer,list,L"fourth text",false,NULL,&newAllocations);
+	VBufStorage_nodePool_t nodePool;
+	buffer.takeRetiredNodes(nodePool);
+	test(nodePool.size()==itemCount+1, L"removed nodes kept until taken, " << nodePool.size());
+	nodePool.clear();
+	buffer.takeRetiredNodes(nodePool);
+	test(nodePool.size()==0, L"taken nodes are not kept again");
+	// Nodes of a backend's own subclass removed by an update are deleted, not kept.
+	VBufStorage_controlFieldNode_t* backendList=buffer.addControlFieldNode(root,list,new BackendNode_t(2,1));
+	VBufStorage_fieldNode_t* previousItem=NULL;
+	for(int i=0;i<3;++i) {
+		previousItem=buffer.addControlFieldNode(backendList,previousItem,new BackendNode_t(2,i+2));
+		buffer.addTextFieldNode(static_cast<VBufStorage_controlFieldNode_t*>(previousItem),NULL,L"backend item");
+	}
+	VBufStorage_buffer_t* tempBuf=new VBufStorage_buffer_t();
+	VBufStorage_controlFieldNode_t* newBackendList=tempBuf->addControlFieldNode(NULL,NULL,2,1,true);
+	tempBuf->addTextFieldNode(newBackendList,NULL,L"backend list");
+	map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> replacements;
+	replacements[backendList]=tempBuf;
+	test(buffer.replaceSubtrees(replacements), L"backend list replaced");
+	test(backendNodesDestroyed==4, L"removed backend nodes are deleted, " << backendNodesDestroyed << L" of 4");
+	buffer.takeRetiredNodes(nodePool);
+	test(nodePool.size()==0, L"removed backend nodes are not kept, " << nodePool.size());
+	buffer.removeFieldNode(newBackendList);
+	// Freezing and clearing free the kept nodes.
+	updateList(buffer,list,L"fifth text",true,NULL,&reusedAllocations);
+	buffer.getMemoryUsage(&previousUsage);
+	buffer.freeze();
+	buffer.thaw();
+	buffer.getMemoryUsage(&usage);
+	test(usage.nodes<previousUsage.nodes, L"freezing frees the kept nodes");
+	buffer.clearBuffer();
+	buffer.takeRetiredNodes(nodePool);
+	test(nodePool.size()==0, L"cleared buffer keeps no nodes");
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
@@ -0,0 +1,140 @@
+/**
+ * tests/outline/outline.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Checks that the outline holds the same nodes as searching with findNodeByAttributes, as the buffer changes.
+ */
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int sectionCount=30;
+
+/**
+ * Adds a section with a heading, a paragraph containing a link, and every third section a landmark around a heading.
+ * The nodes of the section are identified by the section number as their docHandle.
+ * @return the section.
+ */
+VBufStorage_controlFieldNode_t* addSection(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int sectionNumber) {
+	VBufStorage_controlFieldNode_t* section=buffer.addControlFieldNode(parent,previous,sectionNumber,0,true);
+	VBufStorage_controlFieldNode_t* heading=buffer.addControlFieldNode(section,NULL,sectionNumber,1,true);
+	heading->addAttribute(L"role",L"heading");
+	wostringstream s;
+	s<<(sectionNumber%6+1);
+	heading->addAttribute(L"level",s.str());
+	buffer.addTextFieldNode(heading,NULL,L"Heading");
+	VBufStorage_controlFieldNode_t* paragraph=buffer.addControlFieldNode(section,heading,sectionNumber,2,true);
+	buffer.addTextFieldNode(paragraph,NULL,L"Some text with ");
+	VBufStorage_controlFieldNode_t* link=buffer.addControlFieldNode(paragraph,paragraph->getLastChild(),sectionNumber,3,false);
+	link->addAttribute(L"role",L"link");
+	buffer.addTextFieldNode(link,NULL,L"a link");
+	// An empty link is left out of the outline, as searches skip it.
+	VBufStorage_controlFieldNode_t* emptyLink=buffer.addControlFieldNode(paragraph,link,sectionNumber,4,false);
+	emptyLink->addAttribute(L"role",L"link");
+	if(sectionNumber%3==0) {
+		VBufStorage_controlFieldNode_t* landmark=buffer.addControlFieldNode(section,paragraph,sectionNumber,5,true);
+		landmark->addAttribute(L"landmark",L"navigation");
+		// The heading starts at the same offset as the landmark, but comes after it.
+		VBufStorage_controlFieldNode_t* innerHeading=buffer.addControlFieldNode(landmark,NULL,sectionNumber,6,true);
+		innerHeading->addAttribute(L"role",L"heading");
+		innerHeading->addAttribute(L"level",L"2");
+		buffer.addTextFieldNode(innerHeading,NULL,L"Navigation");
+	}
+	return section;
+}
+
+/**
+ * Checks the outline for a category against every match found by searching forward from the start of the buffer.
+ */
+void checkCategory(VBufStorage_buffer_t& buffer, int category, const wstring& attribs, const wstring& regexp, const wchar_t* name) {
+	vector<VBufStorage_fieldNode_t*> expectedNodes;
+	vector<pair<int,int> > expectedOffsets;
+	int offset=-1;
+	for(;;) {
+		int startOffset, endOffset;
+		VBufStorage_fieldNode_t* node=buffer.findNodeByAttributes(offset,VBufStorage_findDirection_forward,attribs,regexp,&startOffset,&endOffset);
+		if(!node) break;
+		expectedNodes.push_back(node);
+		expectedOffsets.push_back(make_pair(startOffset,endOffset));
+		offset=startOffset;
+	}
+	// Fetch the outline a few nodes at a time, as a client does with a large outline.
+	const int maxEntries=4;
+	vector<VBufStorage_fieldNode_t*> nodes;
+	vector<pair<int,int> > offsets;
+	for(;;) {
+		VBufStorage_fieldNode_t* entryNodes[maxEntries];
+		unsigned int entryCategories[maxEntries];
+		int startOffsets[maxEntries], endOffsets[maxEntries];
+		int entryCount, totalEntryCount;
+		buffer.getOutline(1u<<category,static_cast<int>(nodes.size()),maxEntries,&entryCount,entryNodes,entryCategories,startOffsets,endOffsets,&totalEntryCount);
+		test(totalEntryCount==static_cast<int>(expectedNodes.size()), name << L" outline has " << totalEntryCount << L" nodes, expected " << expectedNodes.size());
+		for(int i=0;i<entryCount;++i) {
+			test(entryCategories[i]&(1u<<category), name << L" outline node has its category");
+			nodes.push_back(entryNodes[i]);
+			offsets.push_back(make_pair(startOffsets[i],endOffsets[i]));
+		}
+		if(entryCount<maxEntries) break;
+	}
+	test(nodes==expectedNodes&&offsets==expectedOffsets, name << L" outline has the same nodes as searching");
+}
+
+void checkOutline(VBufStorage_buffer_t& buffer, const int* categories) {
+	checkCategory(buffer,categories[0],L"role",L"role:heading;",L"heading");
+	checkCategory(buffer,categories[1],L"landmark",L"landmark:(?:\\\\;|[^;])+;",L"landmark");
+	checkCategory(buffer,categories[2],L"role",L"role:link;",L"link");
+}
+
+int main(int argc, char *argv[]) {
+	VBufStorage_buffer_t buffer;
+	int categories[3];
+	// Add a category before the buffer has content, and the others once it has.
+	categories[0]=buffer.addOutlineCategory(L"role",L"role:heading;");
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,0,0,true);
+	map<int,VBufStorage_controlFieldNode_t*> sections;
+	VBufStorage_fieldNode_t* previous=NULL;
+	for(int i=1;i<=sectionCount;++i) {
+		previous=sections[i]=addSection(buffer,root,previous,i);
+	}
+	checkCategory(buffer,categories[0],L"role",L"role:heading;",L"heading");
+	categories[1]=buffer.addOutlineCategory(L"landmark",L"landmark:(?:\\\\;|[^;])+;");
+	categories[2]=buffer.addOutlineCategory(L"role",L"role:link;");
+	test(categories[0]==0&&categories[1]==1&&categories[2]==2, L"categories numbered in order");
+	test(buffer.addOutlineCategory(L"role",L"role:link;")==categories[2], L"same category added again has the same number");
+	test(buffer.addOutlineCategory(L"role",L"role:(")==-1, L"category with a bad regular expression not added");
+	checkOutline(buffer,categories);
+	// Replace some sections, as a backend does when they change, and remove another.
+	for(int i=3;i<=sectionCount;i+=7) {
+		map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> replacements;
+		VBufStorage_buffer_t* tempBuffer=new VBufStorage_buffer_t();
+		// The replacement is identified by a new section number, so it has a landmark where the original did not, or the other way around.
+		addSection(*tempBuffer,NULL,NULL,i+sectionCount+1);
+		replacements[sections[i]]=tempBuffer;
+		test(buffer.replaceSubtrees(replacements), L"section " << i << L" replaced");
+		checkOutline(buffer,categories);
+	}
+	buffer.removeFieldNode(sections[2]);
+	checkOutline(buffer,categories);
+	// Hiding a node leaves it out of the outline.
+	int startOffset, endOffset;
+	VBufStorage_fieldNode_t* heading=buffer.findNodeByAttributes(-1,VBufStorage_findDirection_forward,L"role",L"role:heading;",&startOffset,&endOffset);
+	heading->setHidden(true);
+	buffer.addTextFieldNode(root,NULL,L"Start");
+	checkOutline(buffer,categories);
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
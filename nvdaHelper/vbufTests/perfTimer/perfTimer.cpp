@@ -0,0 +1,121 @@
+/**
+ * tests/perfTimer/perfTimer.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Checks that timers stopped on several threads at once are all counted when results are merged,
+ * whether their threads have exited or are still running, and whether results are read while they are timing or after.
+ * PerfTimer has no Windows dependencies, so this test also builds with g++ on Linux.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <common/PerfTimer.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int threadCount=4;
+const int quickHits=20000;
+// Of every 100 hits of the mixed section, this many are slow, so the 99th percentile is slow and the median quick.
+const int mixedHits=100;
+const int slowMixedHits=2;
+const int slowMicroseconds=5000;
+
+PerfTimerId quickId;
+PerfTimerId mixedId;
+
+/**
+ * Times sections as a thread of a backend would, registering their names again as code on another thread might.
+ */
+void timeSections(atomic<bool>* registeredSame) {
+	if(PerfTimer::registerTimer("quick")!=quickId||PerfTimer::registerTimer("mixed")!=mixedId) *registeredSame=false;
+	for(int i=0;i<quickHits;++i) {
+		PerfTimer timer(quickId);
+	}
+	for(int i=0;i<mixedHits;++i) {
+		PerfTimer timer(mixedId);
+		if(i<slowMixedHits) this_thread::sleep_for(chrono::microseconds(slowMicroseconds));
+	}
+}
+
+/**
+ * Adds results read at one time to those read before.
+ */
+void addResults(map<string,PerfResult>& total, const map<string,PerfResult>& results) {
+	for(map<string,PerfResult>::const_iterator i=results.begin();i!=results.end();++i) {
+		PerfResult& result=total[i->first];
+		result.totalTime+=i->second.totalTime;
+		result.numberOfHits+=i->second.numberOfHits;
+		result.latencies.merge(i->second.latencies);
+	}
+}
+
+/**
+ * Checks the merged results of every thread that ran timeSections.
+ */
+void checkResults(map<string,PerfResult>& results, unsigned int threads, const wchar_t* name) {
+	const PerfResult& quick=results["quick"];
+	test(quick.numberOfHits==threads*quickHits&&quick.latencies.getCount()==quick.numberOfHits, name << L": every quick hit counted, " << quick.numberOfHits << L" and " << quick.latencies.getCount());
+	test(quick.latencies.getPercentile(50)<1000, name << L": quick median is quick, " << quick.latencies.getPercentile(50));
+	const PerfResult& mixed=results["mixed"];
+	test(mixed.numberOfHits==threads*mixedHits&&mixed.latencies.getCount()==mixed.numberOfHits, name << L": every mixed hit counted, " << mixed.numberOfHits << L" and " << mixed.latencies.getCount());
+	test(mixed.latencies.getPercentile(50)<1000, name << L": mixed median is quick, " << mixed.latencies.getPercentile(50));
+	test(mixed.latencies.getPercentile(99)>=slowMicroseconds, name << L": mixed 99th percentile is slow, " << mixed.latencies.getPercentile(99));
+	test(mixed.latencies.getMax()>=slowMicroseconds&&mixed.latencies.getMax()>=mixed.latencies.getPercentile(99), name << L": mixed max is the slowest hit, " << mixed.latencies.getMax());
+	test(mixed.totalTime>=threads*slowMixedHits*slowMicroseconds/1000.0, name << L": mixed total time includes the slow hits, " << mixed.totalTime);
+}
+
+int main(int argc, char *argv[]) {
+	quickId=PerfTimer::registerTimer("quick");
+	mixedId=PerfTimer::registerTimer("mixed");
+	test(quickId!=mixedId&&PerfTimer::registerTimer("quick")==quickId, L"each name has its own id");
+	atomic<bool> registeredSame(true);
+	// Threads that have exited by the time results are read.
+	{
+		vector<thread> threads;
+		for(int i=0;i<threadCount;++i) threads.push_back(thread(timeSections,&registeredSame));
+		for(size_t i=0;i<threads.size();++i) threads[i].join();
+	}
+	map<string,PerfResult> results=PerfTimer::GetTimerDataAndReset();
+	checkResults(results,threadCount,L"exited threads");
+	test(PerfTimer::GetTimerDataAndReset().empty(), L"reading results resets them");
+	// Threads still timing while results are read, and the reading thread timing too.
+	{
+		map<string,PerfResult> total;
+		vector<thread> threads;
+		for(int i=0;i<threadCount;++i) threads.push_back(thread(timeSections,&registeredSame));
+		timeSections(&registeredSame);
+		for(int i=0;i<100;++i) addResults(total,PerfTimer::GetTimerDataAndReset());
+		for(size_t i=0;i<threads.size();++i) threads[i].join();
+		addResults(total,PerfTimer::GetTimerDataAndReset());
+		checkResults(total,threadCount+1,L"running threads");
+	}
+	test(registeredSame, L"registering a name on another thread gives the same id");
+	// Sections past the limit are not timed.
+	for(PerfTimerId i=0;i<PerfTimer::maxTimers;++i) {
+		PerfTimer::registerTimer("section "+to_string(i));
+	}
+	test(PerfTimer::registerTimer("one too many")==PerfTimer::maxTimers, L"registering past the limit fails");
+	{
+		PerfTimer timer("one too many");
+	}
+	test(PerfTimer::GetTimerDataAndReset().empty(), L"a section past the limit is not timed");
+	{
+		PerfTimer timer(quickId);
+	}
+	test(PerfTimer::GetPerfResults().find("quick Total time: ")!=string::npos, L"formatted results name the section");
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
@@ -0,0 +1,103 @@
+/**
+ * tests/queryDeadline/queryDeadline.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Checks that searches, line offset calculations and markup generation give up once the query deadline expires or queries are cancelled, and not otherwise.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int paragraphCount=10000;
+
+/**
+ * Fills a buffer with many paragraphs in sections of a single block, each containing a link, so that a line of the buffer spans every paragraph.
+ */
+void fillBuffer(VBufStorage_buffer_t& buffer) {
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,0,0,true);
+	VBufStorage_controlFieldNode_t* section=NULL;
+	VBufStorage_fieldNode_t* previous=NULL;
+	for(int i=1;i<=paragraphCount;++i) {
+		if(i%100==1) {
+			section=buffer.addControlFieldNode(root,section,2,i,false);
+			previous=NULL;
+		}
+		VBufStorage_controlFieldNode_t* paragraph=buffer.addControlFieldNode(section,previous,1,i*2,false);
+		paragraph->addAttribute(L"role",L"paragraph");
+		VBufStorage_fieldNode_t* text=buffer.addTextFieldNode(paragraph,NULL,L"Some text in a paragraph ");
+		VBufStorage_controlFieldNode_t* link=buffer.addControlFieldNode(paragraph,text,1,i*2+1,false);
+		link->addAttribute(L"role",L"link");
+		buffer.addTextFieldNode(link,NULL,L"and a link. ");
+		previous=paragraph;
+	}
+}
+
+/**
+ * Runs every kind of query that checks the deadline.
+ * @param expectSuccess true if all the queries should succeed, false if they should all give up.
+ */
+void checkQueries(VBufStorage_buffer_t& buffer, bool expectSuccess, const wchar_t* name) {
+	int startOffset, endOffset;
+	VBufStorage_fieldNode_t* node=buffer.findNodeByAttributes(-1,VBufStorage_findDirection_forward,L"role",L"role:heading;",&startOffset,&endOffset);
+	test(!node, name << L": search for a node that is not there finds nothing");
+	node=buffer.findNodeByAttributes(0,VBufStorage_findDirection_forward,L"role",L"role:link;",&startOffset,&endOffset);
+	test((node!=NULL)==expectSuccess, name << L": search for a link");
+	test(buffer.getLineOffsets(buffer.getTextLength()/2,0,true,&startOffset,&endOffset)==expectSuccess, name << L": line offsets");
+	VBufStorage_textContainer_t* text=buffer.getTextInRange(0,buffer.getTextLength(),true);
+	test((text!=NULL)==expectSuccess, name << L": text with markup");
+	if(text) text->destroy();
+	VBufStorage_lineStream_t* stream=buffer.openLineStream(0,0,true);
+	int lineCount, startOffsets[4], endOffsets[4], textLengths[4];
+	text=buffer.readLineStream(stream,4,true,&lineCount,startOffsets,endOffsets,textLengths);
+	test((text!=NULL)==expectSuccess, name << L": line stream");
+	if(text) text->destroy();
+	buffer.closeLineStream(stream);
+}
+
+int main(int argc, char *argv[]) {
+	VBufStorage_buffer_t buffer;
+	fillBuffer(buffer);
+	// With out a started deadline queries never give up.
+	buffer.setQueryTimeout(1);
+	checkQueries(buffer,true,L"no deadline");
+	// A deadline with a generous time limit does not expire.
+	buffer.setQueryTimeout(60000);
+	buffer.startQueryDeadline();
+	checkQueries(buffer,true,L"long time limit");
+	test(!buffer.stopQueryDeadline(), L"deadline with a long time limit did not expire");
+	// Cancelling queries makes those already running give up.
+	buffer.startQueryDeadline();
+	buffer.cancelQueries();
+	checkQueries(buffer,false,L"cancelled");
+	test(buffer.stopQueryDeadline(), L"cancelled deadline expired");
+	// Queries started after cancelling are not affected.
+	buffer.startQueryDeadline();
+	checkQueries(buffer,true,L"started after cancelling");
+	test(!buffer.stopQueryDeadline(), L"deadline started after cancelling did not expire");
+	// A search through the whole buffer takes longer than a millisecond.
+	buffer.setQueryTimeout(1);
+	buffer.startQueryDeadline();
+	int startOffset, endOffset;
+	bool timedOut=false;
+	for(int i=0;i<1000&&!timedOut;++i) {
+		buffer.findNodeByAttributes(-1,VBufStorage_findDirection_forward,L"role",L"role:heading;",&startOffset,&endOffset);
+		timedOut=buffer.stopQueryDeadline();
+		buffer.startQueryDeadline();
+	}
+	buffer.stopQueryDeadline();
+	test(timedOut, L"search through the whole buffer timed out");
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
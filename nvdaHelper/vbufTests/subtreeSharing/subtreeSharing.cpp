@@ -0,0 +1,187 @@
+/**
+ * tests/subtreeSharing/subtreeSharing.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Checks that sharing repeated subtrees, such as table rows and chat messages, changes nothing a client can read while taking less memory,
+ * and that shared text outlives the nodes it was first shared from.
+ * Also reports the memory each kind of synthetic page takes before and after sharing.
+ */
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int rowCount=500;
+const int messageCount=500;
+
+/**
+ * Adds a control with the given role and text.
+ */
+VBufStorage_controlFieldNode_t* addControl(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int& ID, const wchar_t* role, const wstring& text) {
+	VBufStorage_controlFieldNode_t* control=buffer.addControlFieldNode(parent,previous,1,ID++,false);
+	control->addAttribute(L"role",role);
+	buffer.addTextFieldNode(control,NULL,text);
+	return control;
+}
+
+/**
+ * Adds a table whose rows each have a name that differs, and a status and two buttons that are the same in every row.
+ * @return the table.
+ */
+VBufStorage_controlFieldNode_t* addTable(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int& ID) {
+	VBufStorage_controlFieldNode_t* table=buffer.addControlFieldNode(parent,previous,1,ID++,true);
+	table->addAttribute(L"role",L"table");
+	VBufStorage_fieldNode_t* previousRow=NULL;
+	for(int i=0;i<rowCount;++i) {
+		VBufStorage_controlFieldNode_t* row=buffer.addControlFieldNode(table,previousRow,1,ID++,true);
+		row->addAttribute(L"role",L"row");
+		wostringstream name;
+		name<<L"Account holder number "<<i;
+		VBufStorage_fieldNode_t* cell=addControl(buffer,row,NULL,ID,L"cell",name.str());
+		cell=addControl(buffer,row,cell,ID,L"cell",L"Active, renewed automatically each month");
+		VBufStorage_controlFieldNode_t* actions=buffer.addControlFieldNode(row,cell,1,ID++,false);
+		actions->addAttribute(L"role",L"cell");
+		VBufStorage_fieldNode_t* button=addControl(buffer,actions,NULL,ID,L"button",L"Edit account details");
+		button->addTypedAttribute(L"states",VBufStorage_attributeType_bitset,0x100000);
+		button=addControl(buffer,actions,button,ID,L"button",L"Remove account");
+		button->addTypedAttribute(L"states",VBufStorage_attributeType_bitset,0x100000);
+		previousRow=row;
+	}
+	return table;
+}
+
+/**
+ * Adds a chat log whose messages each have an author from a few, a time, the text of the message, and reply and react buttons.
+ * @return the log.
+ */
+VBufStorage_controlFieldNode_t* addChat(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int& ID) {
+	const wchar_t* authors[]={L"Someone with a long display name",L"Another person in the conversation",L"A third participant"};
+	VBufStorage_controlFieldNode_t* log=buffer.addControlFieldNode(parent,previous,1,ID++,true);
+	log->addAttribute(L"role",L"log");
+	VBufStorage_fieldNode_t* previousMessage=NULL;
+	for(int i=0;i<messageCount;++i) {
+		VBufStorage_controlFieldNode_t* message=buffer.addControlFieldNode(log,previousMessage,1,ID++,true);
+		message->addAttribute(L"role",L"listitem");
+		VBufStorage_fieldNode_t* field=addControl(buffer,message,NULL,ID,L"graphic",L"avatar");
+		field=addControl(buffer,message,field,ID,L"heading",authors[i%3]);
+		wostringstream time;
+		time<<L"10:"<<(i%60);
+		field=addControl(buffer,message,field,ID,L"staticText",time.str());
+		wostringstream text;
+		text<<L"This is message "<<i<<L" of the conversation, which says something different each time.";
+		field=addControl(buffer,message,field,ID,L"paragraph",text.str());
+		field=addControl(buffer,message,field,ID,L"button",L"Reply");
+		addControl(buffer,message,field,ID,L"button",L"Add reaction");
+		previousMessage=message;
+	}
+	return log;
+}
+
+/**
+ * The text of the whole buffer with markup.
+ */
+wstring describeBuffer(VBufStorage_buffer_t& buffer) {
+	wstring description;
+	VBufStorage_textContainer_t* text=buffer.getTextInRange(0,buffer.getTextLength(),true);
+	if(text) {
+		description=text->getString();
+		text->destroy();
+	}
+	return description;
+}
+
+/**
+ * Shares the repeated subtrees of a page, checking nothing a client can read changes, and reports the memory saved.
+ * @return the memory used for text before sharing subtrees.
+ */
+unsigned long long sharePage(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* root, const wchar_t* name) {
+	wstring description=describeBuffer(buffer);
+	VBufStorage_memoryUsage_t attributesSharedUsage, subtreesSharedUsage;
+	buffer.shareAttributes(root);
+	buffer.getMemoryUsage(&attributesSharedUsage);
+	buffer.shareSubtrees(root);
+	buffer.getMemoryUsage(&subtreesSharedUsage);
+	test(describeBuffer(buffer)==description, name << L": sharing subtrees does not change the buffer");
+	test(subtreesSharedUsage.text<attributesSharedUsage.text, name << L": shared text uses less memory, " << subtreesSharedUsage.text << L" of " << attributesSharedUsage.text);
+	test(subtreesSharedUsage.nodes==attributesSharedUsage.nodes, name << L": sharing subtrees does not change the memory used by nodes");
+	wcout<<name<<L": "<<attributesSharedUsage.getTotal()<<L" bytes with attributes shared, "<<subtreesSharedUsage.getTotal()<<L" with subtrees shared ("<<attributesSharedUsage.text<<L" to "<<subtreesSharedUsage.text<<L" for text)"<<endl;
+	return attributesSharedUsage.text;
+}
+
+int main(int argc, char *argv[]) {
+	// Each kind of page on its own.
+	{
+		VBufStorage_buffer_t buffer;
+		int ID=1;
+		VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,1,ID++,true);
+		addTable(buffer,root,NULL,ID);
+		sharePage(buffer,root,L"table");
+	}
+	VBufStorage_buffer_t buffer;
+	int ID=1;
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,1,ID++,true);
+	VBufStorage_controlFieldNode_t* chat=addChat(buffer,root,NULL,ID);
+	unsigned long long unsharedText=sharePage(buffer,root,L"chat");
+	// Each node keeps its identifier.
+	VBufStorage_controlFieldNode_t* node=buffer.getControlFieldNodeWithIdentifier(1,10);
+	int docHandle=0, nodeID=0;
+	test(node&&node->getIdentifier(&docHandle,&nodeID)&&nodeID==10, L"a node in a shared subtree is found by its identifier");
+	int startOffset, endOffset;
+	VBufStorage_fieldNode_t* reply=buffer.findNodeByAttributes(-1,VBufStorage_findDirection_forward,L"role",L"role:button;",&startOffset,&endOffset);
+	VBufStorage_fieldNode_t* nextReply=buffer.findNodeByAttributes(startOffset,VBufStorage_findDirection_forward,L"role",L"role:button;",&startOffset,&endOffset);
+	nextReply=buffer.findNodeByAttributes(startOffset,VBufStorage_findDirection_forward,L"role",L"role:button;",&startOffset,&endOffset);
+	test(reply&&nextReply&&reply!=nextReply&&static_cast<VBufStorage_textFieldNode_t*>(nextReply->getFirstChild())->getText()==L"Reply", L"each shared button is still found as its own node");
+	// Removing the subtree the others share from leaves them their text.
+	VBufStorage_fieldNode_t* firstMessage=chat->getFirstChild();
+	int firstMessageLength=firstMessage->getLength();
+	VBufStorage_textContainer_t* text=buffer.getTextInRange(firstMessageLength,buffer.getTextLength(),false);
+	wstring laterMessagesText=text->getString();
+	text->destroy();
+	test(buffer.removeFieldNode(firstMessage), L"first message removed");
+	text=buffer.getTextInRange(0,buffer.getTextLength(),false);
+	test(text->getString()==laterMessagesText, L"other messages keep their text when the message they shared from is removed");
+	text->destroy();
+	wstring remaining=describeBuffer(buffer);
+	// Freezing and thawing with sharing on shares the subtrees again.
+	buffer.setSubtreeSharing(true);
+	buffer.freeze();
+	buffer.thaw();
+	test(describeBuffer(buffer)==remaining, L"thawed buffer is unchanged");
+	VBufStorage_memoryUsage_t usage;
+	buffer.getMemoryUsage(&usage);
+	test(usage.text<unsharedText*3/4, L"thawed buffer shares its subtrees again, " << usage.text << L" of " << unsharedText);
+	// A replaced subtree shares its repeated subtrees when sharing is on.
+	VBufStorage_buffer_t* tempBuffer=new VBufStorage_buffer_t();
+	int tempID=ID;
+	VBufStorage_controlFieldNode_t* newChat=addChat(*tempBuffer,NULL,NULL,tempID);
+	text=tempBuffer->getTextInRange(0,tempBuffer->getTextLength(),false);
+	wstring newChatText=text->getString();
+	text->destroy();
+	map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> replacements;
+	replacements[chat]=tempBuffer;
+	test(buffer.replaceSubtrees(replacements), L"chat replaced");
+	text=buffer.getTextInRange(0,buffer.getTextLength(),false);
+	test(text->getString()==newChatText, L"replaced chat is unchanged by sharing");
+	text->destroy();
+	buffer.getMemoryUsage(&usage);
+	test(usage.text<unsharedText*3/4, L"replaced chat shares its subtrees, " << usage.text << L" of " << unsharedText);
+	test(buffer.getControlFieldNodeWithIdentifier(1,ID+1)->getParent()==newChat, L"replaced chat's nodes found by their identifiers");
+	// Clearing frees the shared text.
+	buffer.clearBuffer();
+	buffer.getMemoryUsage(&usage);
+	test(usage.text==0&&usage.attributes==0, L"cleared buffer holds no text or attributes");
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
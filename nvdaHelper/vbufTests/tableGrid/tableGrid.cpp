@@ -0,0 +1,171 @@
+/**
+ * tests/tableGrid/tableGrid.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Checks that getTableCell finds the same cells as searching with findNodeByAttributes, including cells that span rows or columns, as the buffer changes.
+ * Also checks cells spanning many rows, and cells that overlap where the first in the buffer is empty or hidden.
+ */
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int rowCount=20;
+const int columnCount=6;
+
+wstring toString(int i) {
+	wostringstream s;
+	s<<i;
+	return s.str();
+}
+
+/**
+ * Adds a cell to a row.
+ * The cell in column 2 of every fifth row spans two rows, and the cell in column 4 of every row spans two columns.
+ * @return the cell.
+ */
+VBufStorage_controlFieldNode_t* addCell(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* row, VBufStorage_fieldNode_t* previous, int tableNumber, int rowNumber, int columnNumber) {
+	VBufStorage_controlFieldNode_t* cell=buffer.addControlFieldNode(row,previous,tableNumber,rowNumber*100+columnNumber,false);
+	cell->addAttribute(L"table-id",toString(tableNumber));
+	cell->addAttribute(L"table-rownumber",toString(rowNumber));
+	cell->addAttribute(L"table-columnnumber",toString(columnNumber));
+	if(columnNumber==2&&rowNumber%5==1) cell->addAttribute(L"table-rowsspanned",L"2");
+	if(columnNumber==4) cell->addAttribute(L"table-columnsspanned",L"2");
+	wostringstream s;
+	s<<L"cell "<<rowNumber<<L","<<columnNumber<<L" ";
+	buffer.addTextFieldNode(cell,NULL,s.str());
+	return cell;
+}
+
+/**
+ * Adds a table, leaving out the cells covered by spanning cells.
+ * The nodes of the table are identified by the table number as their docHandle.
+ * @return the table.
+ */
+VBufStorage_controlFieldNode_t* addTable(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int tableNumber) {
+	VBufStorage_controlFieldNode_t* table=buffer.addControlFieldNode(parent,previous,tableNumber,0,true);
+	table->addAttribute(L"table-id",toString(tableNumber));
+	VBufStorage_fieldNode_t* previousRow=NULL;
+	for(int r=1;r<=rowCount;++r) {
+		VBufStorage_controlFieldNode_t* row=buffer.addControlFieldNode(table,previousRow,tableNumber,r,true);
+		VBufStorage_fieldNode_t* previousCell=NULL;
+		for(int c=1;c<=columnCount;++c) {
+			if(c==5||(c==2&&r%5==2)) continue;
+			previousCell=addCell(buffer,row,previousCell,tableNumber,r,c);
+		}
+		previousRow=row;
+	}
+	return table;
+}
+
+/**
+ * Checks getTableCell against searching for the cell covering each row and column.
+ */
+void checkTable(VBufStorage_buffer_t& buffer, const wstring& tableID) {
+	for(int r=1;r<=rowCount;++r) {
+		for(int c=1;c<=columnCount;++c) {
+			int coveringRow=(c==2&&r%5==2)?r-1:r;
+			int coveringColumn=(c==5)?4:c;
+			wostringstream regexp;
+			regexp<<L"table-id:"<<tableID<<L";table-rownumber:"<<coveringRow<<L";table-columnnumber:"<<coveringColumn<<L";";
+			int expectedStart=0, expectedEnd=0;
+			VBufStorage_fieldNode_t* expected=buffer.findNodeByAttributes(-1,VBufStorage_findDirection_forward,L"table-id table-rownumber table-columnnumber",regexp.str(),&expectedStart,&expectedEnd);
+			int start=0, end=0;
+			VBufStorage_fieldNode_t* cell=buffer.getTableCell(tableID,r,c,&start,&end);
+			test(cell&&cell==expected&&start==expectedStart&&end==expectedEnd, L"cell at row " << r << L", column " << c << L" of table " << tableID);
+		}
+	}
+	int start, end;
+	test(!buffer.getTableCell(tableID,rowCount+1,1,&start,&end), L"no cell past the last row of table " << tableID);
+	test(!buffer.getTableCell(tableID,1,columnCount+1,&start,&end), L"no cell past the last column of table " << tableID);
+}
+
+/**
+ * Adds a cell directly to a table, with text unless the text is empty.
+ * @return the cell.
+ */
+VBufStorage_controlFieldNode_t* addSpanningCell(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* table, VBufStorage_fieldNode_t* previous, int ID, int rowNumber, int columnNumber, int rowSpan, int columnSpan, const wstring& text) {
+	VBufStorage_controlFieldNode_t* cell=buffer.addControlFieldNode(table,previous,3,ID,false);
+	cell->addAttribute(L"table-id",L"3");
+	cell->addAttribute(L"table-rownumber",toString(rowNumber));
+	cell->addAttribute(L"table-columnnumber",toString(columnNumber));
+	cell->addAttribute(L"table-rowsspanned",toString(rowSpan));
+	cell->addAttribute(L"table-columnsspanned",toString(columnSpan));
+	if(!text.empty()) buffer.addTextFieldNode(cell,NULL,text);
+	return cell;
+}
+
+/**
+ * Checks a table whose cells span many rows and overlap, as badly formed pages have.
+ */
+void checkOverlappingCells(VBufStorage_buffer_t& buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous) {
+	VBufStorage_controlFieldNode_t* table=buffer.addControlFieldNode(parent,previous,3,0,true);
+	table->addAttribute(L"table-id",L"3");
+	VBufStorage_controlFieldNode_t* empty=addSpanningCell(buffer,table,NULL,1,1,1,1,2,L"");
+	VBufStorage_controlFieldNode_t* underEmpty=addSpanningCell(buffer,table,empty,2,1,2,1,1,L"under empty");
+	VBufStorage_controlFieldNode_t* hidden=addSpanningCell(buffer,table,underEmpty,3,2,1,100,1,L"hidden");
+	hidden->setHidden(true);
+	VBufStorage_controlFieldNode_t* tall=addSpanningCell(buffer,table,hidden,4,2,2,100,1,L"tall");
+	VBufStorage_controlFieldNode_t* underHidden=addSpanningCell(buffer,table,tall,5,50,1,1,1,L"under hidden");
+	VBufStorage_controlFieldNode_t* underTall=addSpanningCell(buffer,table,underHidden,6,50,2,1,1,L"under tall");
+	int start, end;
+	test(!buffer.getTableCell(L"3",1,1,&start,&end), L"no cell where the only cell is empty");
+	test(buffer.getTableCell(L"3",1,2,&start,&end)==underEmpty, L"a cell is found under an empty cell covering it");
+	test(buffer.getTableCell(L"3",50,1,&start,&end)==underHidden, L"a cell is found under a hidden cell covering it");
+	test(!buffer.getTableCell(L"3",60,1,&start,&end), L"no cell where the only cell is hidden");
+	VBufStorage_fieldNode_t* cell=buffer.getTableCell(L"3",90,2,&start,&end);
+	int expectedStart=0, expectedEnd=0;
+	buffer.getFieldNodeOffsets(tall,&expectedStart,&expectedEnd);
+	test(cell==tall&&start==expectedStart&&end==expectedEnd, L"a cell spanning 100 rows is found at row 90");
+	test(buffer.getTableCell(L"3",101,2,&start,&end)==tall, L"a cell spanning 100 rows is found at its last row");
+	test(!buffer.getTableCell(L"3",102,2,&start,&end), L"no cell past the last row of a cell spanning 100 rows");
+	test(buffer.getTableCell(L"3",50,2,&start,&end)==tall, L"where cells with text overlap, the first in the buffer is found");
+	// Removing a cell uncovers the cell it overlapped, with out building the grid again.
+	test(buffer.removeFieldNode(tall), L"tall cell removed");
+	test(buffer.getTableCell(L"3",50,2,&start,&end)==underTall, L"the cell under a removed cell is found");
+	test(!buffer.getTableCell(L"3",90,2,&start,&end), L"no cell where the removed cell was");
+	buffer.removeFieldNode(table);
+}
+
+int main(int argc, char *argv[]) {
+	VBufStorage_buffer_t buffer;
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,0,0,true);
+	VBufStorage_controlFieldNode_t* first=addTable(buffer,root,NULL,1);
+	VBufStorage_controlFieldNode_t* second=addTable(buffer,root,first,2);
+	checkTable(buffer,L"1");
+	checkTable(buffer,L"2");
+	int start, end;
+	test(!buffer.getTableCell(L"3",1,1,&start,&end), L"no cells in a table that does not exist");
+	// Replace the first table with a new rendering of it, as a backend does when the table changes.
+	map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> replacements;
+	VBufStorage_buffer_t* tempBuffer=new VBufStorage_buffer_t();
+	addTable(*tempBuffer,NULL,NULL,1);
+	replacements[first]=tempBuffer;
+	test(buffer.replaceSubtrees(replacements), L"first table replaced");
+	checkTable(buffer,L"1");
+	checkTable(buffer,L"2");
+	// Removing a cell leaves nothing at its row and column.
+	VBufStorage_fieldNode_t* cell=buffer.getTableCell(L"2",3,4,&start,&end);
+	test(cell&&buffer.removeFieldNode(cell), L"cell removed");
+	test(!buffer.getTableCell(L"2",3,4,&start,&end)&&!buffer.getTableCell(L"2",3,5,&start,&end), L"no cell where the removed cell was");
+	test(buffer.getTableCell(L"2",3,3,&start,&end), L"cell next to the removed cell still found");
+	buffer.removeFieldNode(second);
+	test(!buffer.getTableCell(L"2",1,1,&start,&end), L"no cells in a removed table");
+	checkTable(buffer,L"1");
+	checkOverlappingCells(buffer,root,NULL);
+	checkTable(buffer,L"1");
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
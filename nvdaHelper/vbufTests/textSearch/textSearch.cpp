@@ -0,0 +1,180 @@
+/**
+ * tests/textSearch/textSearch.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Checks that finding text in a buffer finds the same occurrences, in both directions and with and without regard to case,
+ * as searching the text of the whole buffer does, including those spanning several text field nodes.
+ * Also reports how long finding text takes on a large buffer, against fetching its text and searching that as NVDA did.
+ */
+
+#include <chrono>
+#include <cwctype>
+#include <iostream>
+#include <string>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int checkedParagraphCount=300;
+const int timedParagraphCount=20000;
+const int iterations=5;
+
+long long getMicroseconds() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Fills a buffer with paragraphs of words, each paragraph split in to runs of text at places that fall within words as well as between them.
+ * Some runs are a single character, so that a word can span several of them.
+ */
+void fillBuffer(VBufStorage_buffer_t& buffer, int paragraphCount) {
+	const wchar_t* words[]={L"virtual",L"Buffer",L"search",L"the",L"a",L"NVDA",L"text",L"node",L"BOUNDARY",L"x",L"find"};
+	const int wordCount=sizeof(words)/sizeof(words[0]);
+	unsigned int seed=1;
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,1,0,true);
+	VBufStorage_fieldNode_t* previousParagraph=NULL;
+	for(int i=0;i<paragraphCount;++i) {
+		VBufStorage_controlFieldNode_t* paragraph=buffer.addControlFieldNode(root,previousParagraph,1,i+1,true);
+		wstring text;
+		for(int j=0;j<25;++j) {
+			seed=seed*1103515245+12345;
+			text+=words[(seed>>16)%wordCount];
+			text+=L" ";
+		}
+		VBufStorage_fieldNode_t* previousRun=NULL;
+		for(size_t start=0;start<text.length();) {
+			seed=seed*1103515245+12345;
+			size_t length=((seed>>16)%4==0)?1:1+(seed>>18)%17;
+			length=min(length,text.length()-start);
+			previousRun=buffer.addTextFieldNode(paragraph,previousRun,text.substr(start,length));
+			start+=length;
+		}
+		previousParagraph=paragraph;
+	}
+}
+
+/**
+ * Fetches the text of the whole buffer, optionally in lower case, as NVDA did to search it.
+ */
+wstring getBufferText(VBufStorage_buffer_t& buffer, bool foldCase) {
+	VBufStorage_textContainer_t* container=buffer.getTextInRange(0,buffer.getTextLength(),false);
+	wstring text=container->getString();
+	container->destroy();
+	if(foldCase) {
+		for(wstring::iterator i=text.begin();i!=text.end();++i) *i=towlower(*i);
+	}
+	return text;
+}
+
+/**
+ * Finds every occurrence of some text forward from the start of the buffer and back from its end,
+ * checking each is where a search of the buffer's text finds it.
+ * @return the number of occurrences found.
+ */
+size_t checkOccurrences(VBufStorage_buffer_t& buffer, const wstring& needle, bool caseSensitive) {
+	wstring text=getBufferText(buffer,!caseSensitive);
+	wstring foldedNeedle=needle;
+	if(!caseSensitive) {
+		for(wstring::iterator i=foldedNeedle.begin();i!=foldedNeedle.end();++i) *i=towlower(*i);
+	}
+	int needleLength=static_cast<int>(needle.length());
+	size_t count=0;
+	bool allFound=true;
+	// Each search forward starts one past the start of the last occurrence found.
+	int offset=0;
+	for(;;) {
+		size_t expected=text.find(foldedNeedle,offset);
+		int startOffset, endOffset;
+		bool found=buffer.findText(offset,needle,false,caseSensitive,&startOffset,&endOffset);
+		if(expected==wstring::npos) {
+			allFound=allFound&&!found;
+			break;
+		}
+		if(!found||startOffset!=static_cast<int>(expected)||endOffset!=startOffset+needleLength) {
+			allFound=false;
+			break;
+		}
+		++count;
+		offset=startOffset+1;
+	}
+	test(allFound, needle << L": found forward where the buffer's text has it, case sensitive " << caseSensitive);
+	// Each search back finds an occurrence ending at or before the start of the last one found.
+	allFound=true;
+	size_t backCount=0;
+	offset=static_cast<int>(text.length());
+	for(;;) {
+		size_t expected=(offset>=needleLength)?text.rfind(foldedNeedle,offset-needleLength):wstring::npos;
+		int startOffset, endOffset;
+		bool found=buffer.findText(offset,needle,true,caseSensitive,&startOffset,&endOffset);
+		if(expected==wstring::npos) {
+			allFound=allFound&&!found;
+			break;
+		}
+		if(!found||startOffset!=static_cast<int>(expected)||endOffset!=startOffset+needleLength) {
+			allFound=false;
+			break;
+		}
+		++backCount;
+		offset=startOffset;
+	}
+	test(allFound, needle << L": found back where the buffer's text has it, case sensitive " << caseSensitive);
+	return count+backCount;
+}
+
+int main(int argc, char *argv[]) {
+	{
+		VBufStorage_buffer_t buffer;
+		fillBuffer(buffer,checkedParagraphCount);
+		// Words span several runs, and "e t" spans words, so most occurrences span text field nodes.
+		const wchar_t* needles[]={L"buffer",L"Buffer",L"BOUNDARY",L"boundary",L"e t",L"x x",L"NVDA text node",L"a",L"virtual buffer search the",L"absent"};
+		for(int i=0;i<10;++i) {
+			checkOccurrences(buffer,needles[i],true);
+			checkOccurrences(buffer,needles[i],false);
+		}
+		test(checkOccurrences(buffer,L"bOuNdArY",false)>0, L"text with mixed case is found with out regard to case");
+		test(checkOccurrences(buffer,L"bOuNdArY",true)==0, L"text with mixed case is not found with regard to case");
+		int startOffset, endOffset;
+		int length=buffer.getTextLength();
+		test(!buffer.findText(length,L"a",false,true,&startOffset,&endOffset), L"nothing is found forward from the end");
+		test(!buffer.findText(0,L"a",true,true,&startOffset,&endOffset), L"nothing is found back from the start");
+		test(!buffer.findText(length+1,L"a",false,true,&startOffset,&endOffset), L"nothing is found past the end");
+		test(!buffer.findText(0,L"",false,true,&startOffset,&endOffset), L"empty text is not found");
+		// Text as long as the buffer is found, and longer text is not.
+		wstring text=getBufferText(buffer,false);
+		test(buffer.findText(0,text,false,true,&startOffset,&endOffset)&&startOffset==0&&endOffset==length, L"the whole text is found forward");
+		test(buffer.findText(length,text,true,true,&startOffset,&endOffset)&&startOffset==0&&endOffset==length, L"the whole text is found back");
+		test(!buffer.findText(0,text+L"x",false,true,&startOffset,&endOffset), L"text longer than the buffer is not found");
+	}
+	// Finding text that is not there reads all of it.
+	VBufStorage_buffer_t buffer;
+	fillBuffer(buffer,timedParagraphCount);
+	long long findTime=0, foldedFindTime=0, fetchTime=0, foldedFetchTime=0;
+	for(int i=0;i<iterations;++i) {
+		int startOffset, endOffset;
+		long long start=getMicroseconds();
+		test(!buffer.findText(0,L"absent text",false,true,&startOffset,&endOffset), L"absent text is not found");
+		findTime+=getMicroseconds()-start;
+		start=getMicroseconds();
+		test(!buffer.findText(0,L"absent text",false,false,&startOffset,&endOffset), L"absent text is not found with out regard to case");
+		foldedFindTime+=getMicroseconds()-start;
+		start=getMicroseconds();
+		test(getBufferText(buffer,false).find(L"absent text")==wstring::npos, L"absent text is not in the buffer's text");
+		fetchTime+=getMicroseconds()-start;
+		start=getMicroseconds();
+		test(getBufferText(buffer,true).find(L"absent text")==wstring::npos, L"absent text is not in the buffer's text with out regard to case");
+		foldedFetchTime+=getMicroseconds()-start;
+	}
+	wcout<<buffer.getTextLength()<<L" characters"<<endl;
+	wcout<<L"find "<<(findTime/iterations)<<L" us, fetch text and search it "<<(fetchTime/iterations)<<L" us"<<endl;
+	wcout<<L"with out regard to case: find "<<(foldedFindTime/iterations)<<L" us, fetch text and search it "<<(foldedFetchTime/iterations)<<L" us"<<endl;
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
@@ -0,0 +1,182 @@
+/**
+ * tests/textSection/textSection.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Measures copying a large buffer's text in to a shared memory section against fetching it as a string,
+ * copying it in to a BSTR and marshalling it, as VBufRemote_getTextInRange does.
+ * Windows file mappings are stood in for by POSIX shared memory elsewhere.
+ */
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int paragraphCount=5000;
+const int iterations=10;
+
+long long getMicroseconds() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * A shared memory section holding a given number of characters.
+ */
+class TextSection_t {
+	public:
+	wchar_t* view;
+	size_t length;
+
+	TextSection_t(size_t lengthArg): view(NULL), length(lengthArg) {
+		size_t size=length*sizeof(wchar_t);
+#ifdef _WIN32
+		HANDLE section=CreateFileMapping(INVALID_HANDLE_VALUE,NULL,PAGE_READWRITE,0,static_cast<DWORD>(size),NULL);
+		if(!section) return;
+		view=static_cast<wchar_t*>(MapViewOfFile(section,FILE_MAP_WRITE,0,0,size));
+		CloseHandle(section);
+#else
+		int fd=shm_open("/nvda_test_textSection",O_CREAT|O_RDWR,0600);
+		if(fd<0) return;
+		shm_unlink("/nvda_test_textSection");
+		if(ftruncate(fd,size)==0) {
+			void* address=mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+			if(address!=MAP_FAILED) view=static_cast<wchar_t*>(address);
+		}
+		close(fd);
+#endif
+	}
+
+	~TextSection_t() {
+		if(!view) return;
+#ifdef _WIN32
+		UnmapViewOfFile(view);
+#else
+		munmap(view,length*sizeof(wchar_t));
+#endif
+	}
+
+};
+
+/**
+ * Fills a buffer with paragraphs of text and links, each with a few attributes, roughly like a long web page.
+ */
+void fillBuffer(VBufStorage_buffer_t& buffer) {
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,1,0,true);
+	root->addAttribute(L"role",L"document");
+	VBufStorage_fieldNode_t* previous=NULL;
+	for(int i=1;i<=paragraphCount;++i) {
+		VBufStorage_controlFieldNode_t* paragraph=buffer.addControlFieldNode(root,previous,1,i*2,true);
+		paragraph->addAttribute(L"role",L"paragraph");
+		wostringstream s;
+		s<<L"Paragraph "<<i<<L" has some text & a ";
+		VBufStorage_fieldNode_t* text=buffer.addTextFieldNode(paragraph,NULL,s.str());
+		VBufStorage_controlFieldNode_t* link=buffer.addControlFieldNode(paragraph,text,1,i*2+1,false);
+		link->addAttribute(L"role",L"link");
+		link->addAttribute(L"value",L"http://www.nvda-project.org/");
+		buffer.addTextFieldNode(link,NULL,L"<link>");
+		buffer.addTextFieldNode(paragraph,link,L" in the middle of it.\n");
+		previous=paragraph;
+	}
+}
+
+/**
+ * Fetches text the way VBufRemote_getTextInRange does, with a further copy standing in for RPC marshalling.
+ * @return the time taken in microseconds.
+ */
+long long fetchAsString(VBufStorage_buffer_t& buffer, bool useMarkup, wstring& result) {
+	long long start=getMicroseconds();
+	int length=buffer.getTextLength();
+	VBufStorage_textContainer_t* textContainer=buffer.getTextInRange(0,length,useMarkup);
+	const wstring& text=textContainer->getString();
+	wchar_t* bstr=new wchar_t[text.length()+1];
+	memcpy(bstr,text.c_str(),(text.length()+1)*sizeof(wchar_t));
+	textContainer->destroy();
+	size_t bstrLength=wcslen(bstr);
+	wchar_t* marshalled=new wchar_t[bstrLength+1];
+	memcpy(marshalled,bstr,(bstrLength+1)*sizeof(wchar_t));
+	delete[] bstr;
+	long long elapsed=getMicroseconds()-start;
+	result.assign(marshalled,bstrLength);
+	delete[] marshalled;
+	return elapsed;
+}
+
+/**
+ * Fetches text in to a shared memory section.
+ * @return the time taken in microseconds, or -1 if the text did not fit.
+ */
+long long fetchToSection(VBufStorage_buffer_t& buffer, bool useMarkup, TextSection_t& section, wstring& result) {
+	long long start=getMicroseconds();
+	int textLength=0;
+	bool res=buffer.copyTextInRange(0,buffer.getTextLength(),useMarkup,section.view,static_cast<int>(section.length),&textLength);
+	long long elapsed=getMicroseconds()-start;
+	if(!res) return -1;
+	result.assign(section.view,textLength);
+	return elapsed;
+}
+
+void compare(VBufStorage_buffer_t& buffer, bool useMarkup, TextSection_t& section) {
+	const wchar_t* name=useMarkup?L"markup":L"text";
+	wstring expected, actual;
+	long long stringTime=0;
+	long long sectionTime=0;
+	for(int i=0;i<iterations;++i) {
+		stringTime+=fetchAsString(buffer,useMarkup,expected);
+		long long elapsed=fetchToSection(buffer,useMarkup,section,actual);
+		test(elapsed>=0, name << L" fits in the section");
+		sectionTime+=elapsed;
+	}
+	test(actual==expected, name << L" copied to the section matches the string");
+	wcout<<name<<L" of "<<expected.length()<<L" characters: string and BSTR "<<(stringTime/iterations)<<L" us"
+		<<L", section "<<(sectionTime/iterations)<<L" us"<<endl;
+	if(!useMarkup) {
+		test(sectionTime<stringTime, L"copying text to the section is faster than fetching it as a string");
+	}
+}
+
+int main(int argc, char *argv[]) {
+	VBufStorage_buffer_t buffer;
+	fillBuffer(buffer);
+	int length=buffer.getTextLength();
+	wstring markup;
+	fetchAsString(buffer,true,markup);
+	TextSection_t section(markup.length());
+	test(section.view!=NULL, L"section mapped");
+	if(!section.view) return failCount;
+	compare(buffer,false,section);
+	compare(buffer,true,section);
+	// Ranges that start and end part way through text nodes.
+	for(int start=0;start<200;start+=7) {
+		VBufStorage_textContainer_t* textContainer=buffer.getTextInRange(start,length-start,false);
+		wstring expected=textContainer->getString();
+		textContainer->destroy();
+		int textLength=0;
+		test(buffer.copyTextInRange(start,length-start,false,section.view,static_cast<int>(section.length),&textLength), L"range from " << start << L" copied");
+		test(wstring(section.view,textLength)==expected, L"range from " << start << L" matches the string");
+	}
+	int textLength=0;
+	test(!buffer.copyTextInRange(0,length,true,section.view,length,&textLength), L"markup does not fit in a section only as long as the text");
+	test(textLength>length, L"needed length given when markup does not fit, got " << textLength);
+	test(!buffer.copyTextInRange(0,length+1,false,section.view,static_cast<int>(section.length),&textLength), L"bad offsets are refused");
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
@@ -0,0 +1,164 @@
+/**
+ * tests/traversal/traversal.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Measures the operations that walk a large buffer's tree of nodes: building and clearing it, searching it, calculating node offsets, reading it line by line and fetching its text.
+ * Also reports the size of each kind of node and the memory the buffer uses before and after sharing attributes, so that changes to the layout of nodes can be compared.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int sectionCount=200;
+const int paragraphsPerSection=100;
+const int iterations=5;
+
+long long getMicroseconds() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Fills a buffer with sections of paragraphs, each paragraph with text, a link and a few attributes, roughly like a long web page.
+ * @param paragraphs memory where every paragraph added is placed.
+ * @return the root node.
+ */
+VBufStorage_controlFieldNode_t* fillBuffer(VBufStorage_buffer_t& buffer, vector<VBufStorage_fieldNode_t*>& paragraphs) {
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,1,0,true);
+	root->addAttribute(L"role",L"document");
+	VBufStorage_fieldNode_t* previousSection=NULL;
+	int ID=1;
+	for(int i=0;i<sectionCount;++i) {
+		VBufStorage_controlFieldNode_t* section=buffer.addControlFieldNode(root,previousSection,1,ID++,true);
+		section->addAttribute(L"role",L"section");
+		VBufStorage_fieldNode_t* previous=NULL;
+		for(int j=0;j<paragraphsPerSection;++j) {
+			VBufStorage_controlFieldNode_t* paragraph=buffer.addControlFieldNode(section,previous,1,ID++,true);
+			paragraph->addAttribute(L"role",L"paragraph");
+			paragraph->addAttribute(L"level",L"1");
+			paragraphs.push_back(paragraph);
+			VBufStorage_fieldNode_t* text=buffer.addTextFieldNode(paragraph,NULL,L"Some text in a paragraph, ");
+			VBufStorage_controlFieldNode_t* link=buffer.addControlFieldNode(paragraph,text,1,ID++,false);
+			link->addAttribute(L"role",L"link");
+			link->addAttribute(L"value",L"http://www.nvda-project.org/");
+			link->addAttribute(L"states",L"linked focusable");
+			buffer.addTextFieldNode(link,NULL,L"a link");
+			buffer.addTextFieldNode(paragraph,link,L" and some more text.");
+			previous=paragraph;
+		}
+		previousSection=section;
+	}
+	return root;
+}
+
+int main(int argc, char *argv[]) {
+	wcout<<L"node sizes: field "<<sizeof(VBufStorage_fieldNode_t)<<L", control field "<<sizeof(VBufStorage_controlFieldNode_t)<<L", text field "<<sizeof(VBufStorage_textFieldNode_t)<<L" bytes"<<endl;
+	VBufStorage_buffer_t buffer;
+	vector<VBufStorage_fieldNode_t*> paragraphs;
+	long long buildTime=0;
+	long long shareTime=0;
+	long long clearTime=0;
+	VBufStorage_memoryUsage_t unsharedUsage;
+	for(int i=0;i<iterations;++i) {
+		if(i>0) {
+			long long start=getMicroseconds();
+			buffer.clearBuffer();
+			clearTime+=getMicroseconds()-start;
+			paragraphs.clear();
+		}
+		long long start=getMicroseconds();
+		VBufStorage_controlFieldNode_t* root=fillBuffer(buffer,paragraphs);
+		buildTime+=getMicroseconds()-start;
+		if(i==0) buffer.getMemoryUsage(&unsharedUsage);
+		// Backends share the attributes of what they render once it is complete.
+		start=getMicroseconds();
+		buffer.shareAttributes(root);
+		shareTime+=getMicroseconds()-start;
+	}
+	VBufStorage_memoryUsage_t usage;
+	buffer.getMemoryUsage(&usage);
+	unsigned int nodeCount;
+	unsigned long long textBytes, attributeBytes;
+	buffer.getContentSize(&nodeCount,&textBytes,&attributeBytes);
+	wcout<<nodeCount<<L" nodes using "<<usage.nodes<<L" bytes for nodes, "<<usage.attributes<<L" for attributes, "<<usage.getTotal()<<L" in total"<<endl;
+	wcout<<L"before sharing attributes, "<<unsharedUsage.attributes<<L" bytes for attributes, "<<unsharedUsage.getTotal()<<L" in total"<<endl;
+	wcout<<L"build "<<(buildTime/iterations)<<L" us, share attributes "<<(shareTime/iterations)<<L" us"<<endl;
+	// Searching for something that is not there visits every node and checks its attributes.
+	long long searchTime=0;
+	for(int i=0;i<iterations;++i) {
+		int startOffset, endOffset;
+		long long start=getMicroseconds();
+		VBufStorage_fieldNode_t* node=buffer.findNodeByAttributes(-1,VBufStorage_findDirection_forward,L"role",L"role:heading;",&startOffset,&endOffset);
+		searchTime+=getMicroseconds()-start;
+		test(!node, L"search for a heading finds nothing");
+	}
+	wcout<<L"search "<<(searchTime/iterations)<<L" us"<<endl;
+	// Calculating the offsets of a node walks back along its previous siblings and up through its ancestors.
+	long long offsetsTime=0;
+	for(int i=0;i<iterations;++i) {
+		long long start=getMicroseconds();
+		int lastEndOffset=0;
+		for(vector<VBufStorage_fieldNode_t*>::const_iterator j=paragraphs.begin();j!=paragraphs.end();++j) {
+			int startOffset, endOffset;
+			buffer.getFieldNodeOffsets(*j,&startOffset,&endOffset);
+			test(startOffset==lastEndOffset, L"paragraphs follow each other");
+			lastEndOffset=endOffset;
+		}
+		offsetsTime+=getMicroseconds()-start;
+	}
+	wcout<<L"node offsets "<<(offsetsTime/iterations)<<L" us"<<endl;
+	// Reading every line.
+	long long linesTime=0;
+	int lastEndOffset=0;
+	for(int i=0;i<iterations;++i) {
+		long long start=getMicroseconds();
+		VBufStorage_lineStream_t* stream=buffer.openLineStream(0,0,false);
+		const int maxLines=64;
+		int lineCount, startOffsets[maxLines], endOffsets[maxLines], textLengths[maxLines];
+		lastEndOffset=0;
+		for(;;) {
+			VBufStorage_textContainer_t* text=buffer.readLineStream(stream,maxLines,false,&lineCount,startOffsets,endOffsets,textLengths);
+			if(!text) break;
+			text->destroy();
+			if(lineCount>0) lastEndOffset=endOffsets[lineCount-1];
+			if(lineCount<maxLines) break;
+		}
+		buffer.closeLineStream(stream);
+		linesTime+=getMicroseconds()-start;
+	}
+	test(lastEndOffset==buffer.getTextLength(), L"lines read to the end of the buffer");
+	wcout<<L"lines "<<(linesTime/iterations)<<L" us"<<endl;
+	// Fetching all the text, with and without markup.
+	long long textTime=0;
+	long long markupTime=0;
+	for(int i=0;i<iterations;++i) {
+		long long start=getMicroseconds();
+		VBufStorage_textContainer_t* text=buffer.getTextInRange(0,buffer.getTextLength(),false);
+		textTime+=getMicroseconds()-start;
+		text->destroy();
+		start=getMicroseconds();
+		text=buffer.getTextInRange(0,buffer.getTextLength(),true);
+		markupTime+=getMicroseconds()-start;
+		text->destroy();
+	}
+	wcout<<L"text "<<(textTime/iterations)<<L" us, markup "<<(markupTime/iterations)<<L" us"<<endl;
+	long long start=getMicroseconds();
+	buffer.clearBuffer();
+	clearTime+=getMicroseconds()-start;
+	wcout<<L"clear "<<(clearTime/iterations)<<L" us"<<endl;
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
@@ -0,0 +1,230 @@
+/**
+ * tests/typedAttributes/typedAttributes.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * Checks that nodes with typed attributes have the same attributes, markup, search results and outline as nodes with the equivalent string attributes,
+ * and that searches compiled in to conditions on attributes match the same nodes as the regular expressions they were compiled from.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+const int paragraphCount=120;
+
+/**
+ * Searches as built by NVDA's _prepareForFindByAttributes, and with values written out, and whether each can be compiled.
+ */
+const struct {
+	const wchar_t* attribs;
+	const wchar_t* regexp;
+	bool compiled;
+} searches[]={
+	{L"IAccessible::role",L"IAccessible\\\\:\\\\:role:(?:30;)",true},
+	{L"IAccessible::role IAccessible2::state_-2147483648",L"IAccessible\\\\:\\\\:role:(?:43;|44;)IAccessible2\\\\:\\\\:state_-2147483648:(?:\\\\;|[^;])*;|IAccessible\\\\:\\\\:role:(?:\\\\;|[^;])*;IAccessible2\\\\:\\\\:state_-2147483648:(?:1;)",true},
+	{L"IAccessible::state_1 IAccessible::role",L"IAccessible\\\\:\\\\:state_1:(?:;)IAccessible\\\\:\\\\:role:(?:30;)",true},
+	{L"name",L"name:(?:\\\\;|[^;])+;",true},
+	{L"name",L"name:(?:a\\\\:b\\\\;c\\\\\\\\d \\(x\\)\\|\\[y\\];)",true},
+	{L"name IAccessible::role",L"name:(?:;|two;)IAccessible\\\\:\\\\:role:(?:div;|30;)",true},
+	{L"class",L"class:(?:\\\\;|[^;])*\\b(?:foo)\\b(?:\\\\;|[^;])*;",false},
+	{L"IAccessible::role name",L"IAccessible\\\\:\\\\:role:30;name:two;",true},
+	{L"IAccessible::state_1048576 IAccessible::role IAccessible2::state_1",L"IAccessible\\\\:\\\\:state_1048576:(?:1;)IAccessible\\\\:\\\\:role:(?:42;)IAccessible2\\\\:\\\\:state_1:(?:\\\\;|[^;])*;|IAccessible\\\\:\\\\:state_1048576:(?:\\\\;|[^;])*;IAccessible\\\\:\\\\:role:(?:\\\\;|[^;])*;IAccessible2\\\\:\\\\:state_1:(?:1;)",true},
+};
+const int searchCount=sizeof(searches)/sizeof(searches[0]);
+
+/**
+ * Adds each state that is on as a string attribute, as backends did before typed attributes.
+ */
+void addStateAttributes(VBufStorage_fieldNode_t* node, const wstring& prefix, int states) {
+	for(int i=0;i<32;++i) {
+		int state=1<<i;
+		if(state&states) {
+			wostringstream s;
+			s<<prefix<<state;
+			node->addAttribute(s.str(),L"1");
+		}
+	}
+}
+
+/**
+ * Fills a buffer with paragraphs that have a role and states like those of an IAccessible2 backend, and a name and class that vary.
+ * @param useTypedAttributes true to add the role and states as typed attributes, false to add them as strings.
+ * @param nodes memory where every node added is placed.
+ */
+void fillBuffer(VBufStorage_buffer_t& buffer, bool useTypedAttributes, vector<VBufStorage_fieldNode_t*>& nodes) {
+	const int roles[]={30,42,43,44};
+	const wchar_t* names[]={L"a:b;c\\d (x)|[y]", L"two", L"", NULL, L"name"};
+	VBufStorage_controlFieldNode_t* root=buffer.addControlFieldNode(NULL,NULL,0,0,true);
+	nodes.push_back(root);
+	VBufStorage_fieldNode_t* previous=NULL;
+	for(int i=1;i<=paragraphCount;++i) {
+		VBufStorage_controlFieldNode_t* paragraph=buffer.addControlFieldNode(root,previous,1,i,true);
+		int role=roles[i%4];
+		int states=((i%3==0)?0x1:0)|((i%5==0)?0x100000:0)|((i%11==0)?0x80000000:0);
+		int IA2States=((i%2==0)?0x1:0)|((i%13==0)?0x80000000:0);
+		if(i%7==0) {
+			paragraph->addAttribute(L"IAccessible::role",L"div");
+		} else if(useTypedAttributes) {
+			// The role added first is replaced.
+			paragraph->addTypedAttribute(L"IAccessible::role",VBufStorage_attributeType_enum,0);
+			paragraph->addTypedAttribute(L"IAccessible::role",VBufStorage_attributeType_enum,role);
+		} else {
+			wostringstream s;
+			s<<role;
+			paragraph->addAttribute(L"IAccessible::role",s.str());
+		}
+		if(useTypedAttributes) {
+			paragraph->addTypedAttribute(L"IAccessible::state_",VBufStorage_attributeType_bitset,states);
+			paragraph->addTypedAttribute(L"IAccessible2::state_",VBufStorage_attributeType_bitset,IA2States);
+		} else {
+			addStateAttributes(paragraph,L"IAccessible::state_",states);
+			addStateAttributes(paragraph,L"IAccessible2::state_",IA2States);
+		}
+		if(names[i%5]) paragraph->addAttribute(L"name",names[i%5]);
+		paragraph->addAttribute(L"class",(i%4==0)?L"foo bar":L"foobar");
+		if(useTypedAttributes&&i%10==0) paragraph->addTypedAttribute(L"level",VBufStorage_attributeType_int32,-i);
+		else if(i%10==0) paragraph->addAttribute(L"level",to_wstring(-i));
+		nodes.push_back(paragraph);
+		nodes.push_back(buffer.addTextFieldNode(paragraph,NULL,L"Some text"));
+		previous=paragraph;
+	}
+}
+
+/**
+ * @return the name:value; pairs of an attributes string, sorted.
+ */
+vector<wstring> splitAttributesString(const wstring& attributes) {
+	vector<wstring> pairs;
+	size_t start=0;
+	for(size_t end=attributes.find(L';');end!=wstring::npos;end=attributes.find(L';',start)) {
+		pairs.push_back(attributes.substr(start,end+1-start));
+		start=end+1;
+	}
+	sort(pairs.begin(),pairs.end());
+	return pairs;
+}
+
+/**
+ * @return markup with the attributes of every tag sorted, as their order does not matter.
+ */
+wstring normalizeMarkup(const wstring& markup) {
+	wstring normalized;
+	size_t pos=0;
+	for(size_t tagStart=markup.find(L'<');tagStart!=wstring::npos;tagStart=markup.find(L'<',pos)) {
+		size_t tagEnd=markup.find(L'>',tagStart);
+		normalized+=markup.substr(pos,tagStart-pos);
+		wstring tag=markup.substr(tagStart,tagEnd-tagStart);
+		size_t attributesStart=tag.find(L' ');
+		if(attributesStart==wstring::npos) {
+			normalized+=tag;
+		} else {
+			vector<wstring> attributes;
+			size_t start=attributesStart+1;
+			for(size_t end=tag.find(L"\" ",start);end!=wstring::npos;end=tag.find(L"\" ",start)) {
+				attributes.push_back(tag.substr(start,end+2-start));
+				start=end+2;
+			}
+			sort(attributes.begin(),attributes.end());
+			normalized+=tag.substr(0,attributesStart+1);
+			for(vector<wstring>::const_iterator i=attributes.begin();i!=attributes.end();++i) normalized+=*i;
+		}
+		normalized+=L">";
+		pos=tagEnd+1;
+	}
+	return normalized+markup.substr(pos);
+}
+
+/**
+ * @return the offsets of every node a search finds, searching forward from the start of the buffer.
+ */
+vector<pair<int,int> > findAll(VBufStorage_buffer_t& buffer, const wchar_t* attribs, const wchar_t* regexp) {
+	vector<pair<int,int> > offsets;
+	int startOffset=-1, endOffset;
+	while(buffer.findNodeByAttributes(startOffset,VBufStorage_findDirection_forward,attribs,regexp,&startOffset,&endOffset)) {
+		offsets.push_back(make_pair(startOffset,endOffset));
+	}
+	return offsets;
+}
+
+/**
+ * @return the offsets of every node in a category of the buffer's outline.
+ */
+vector<pair<int,int> > getOutline(VBufStorage_buffer_t& buffer, int category) {
+	const int maxEntries=paragraphCount+1;
+	VBufStorage_fieldNode_t* entryNodes[maxEntries];
+	unsigned int entryCategories[maxEntries];
+	int startOffsets[maxEntries], endOffsets[maxEntries];
+	int entryCount, totalEntryCount;
+	buffer.getOutline(1u<<category,0,maxEntries,&entryCount,entryNodes,entryCategories,startOffsets,endOffsets,&totalEntryCount);
+	vector<pair<int,int> > offsets;
+	for(int i=0;i<entryCount;++i) offsets.push_back(make_pair(startOffsets[i],endOffsets[i]));
+	return offsets;
+}
+
+int main(int argc, char *argv[]) {
+	VBufStorage_buffer_t typedBuffer, stringBuffer;
+	vector<VBufStorage_fieldNode_t*> typedNodes, stringNodes;
+	fillBuffer(typedBuffer,true,typedNodes);
+	fillBuffer(stringBuffer,false,stringNodes);
+	// Typed attributes are presented exactly as the string attributes.
+	for(size_t i=0;i<typedNodes.size();++i) {
+		test(splitAttributesString(typedNodes[i]->getAttributesString())==splitAttributesString(stringNodes[i]->getAttributesString()), L"node " << i << L" has the same attributes, " << typedNodes[i]->getAttributesString() << L" and " << stringNodes[i]->getAttributesString());
+	}
+	VBufStorage_textContainer_t* typedText=typedBuffer.getTextInRange(0,typedBuffer.getTextLength(),true);
+	VBufStorage_textContainer_t* stringText=stringBuffer.getTextInRange(0,stringBuffer.getTextLength(),true);
+	test(normalizeMarkup(typedText->getString())==normalizeMarkup(stringText->getString()), L"markup is the same");
+	test(typedText->getString().find(L"IAccessible2::state_-2147483648=\"1\"")!=wstring::npos, L"the highest state is presented as a negative number");
+	typedText->destroy();
+	stringText->destroy();
+	// Compiled searches match the same nodes as the regular expression, and typed attributes match as the string attributes do.
+	for(int i=0;i<searchCount;++i) {
+		VBufStorage_attributeQuery_t query(searches[i].attribs,searches[i].regexp);
+		test(query.isCompiled==searches[i].compiled, L"search " << i << L" compiled is " << query.isCompiled);
+		int matchCount=0;
+		for(size_t j=0;j<typedNodes.size();++j) {
+			bool typedMatch=query.matches(typedNodes[j]);
+			bool stringMatch=query.matches(stringNodes[j]);
+			test(typedMatch==typedNodes[j]->matchAttributes(query.attribsList,query.regexObj), L"search " << i << L" matches node " << j << L" with typed attributes as its regular expression does");
+			test(stringMatch==stringNodes[j]->matchAttributes(query.attribsList,query.regexObj), L"search " << i << L" matches node " << j << L" with string attributes as its regular expression does");
+			test(typedMatch==stringMatch, L"search " << i << L" matches node " << j << L" the same with typed and string attributes");
+			if(typedMatch) ++matchCount;
+		}
+		test(matchCount>0&&matchCount<static_cast<int>(typedNodes.size()), L"search " << i << L" matches some nodes, " << matchCount);
+		vector<pair<int,int> > found=findAll(typedBuffer,searches[i].attribs,searches[i].regexp);
+		test(!found.empty()&&found==findAll(stringBuffer,searches[i].attribs,searches[i].regexp), L"search " << i << L" finds the same nodes with typed and string attributes");
+		int typedCategory=typedBuffer.addOutlineCategory(searches[i].attribs,searches[i].regexp);
+		int stringCategory=stringBuffer.addOutlineCategory(searches[i].attribs,searches[i].regexp);
+		test(getOutline(typedBuffer,typedCategory)==found&&getOutline(stringBuffer,stringCategory)==found, L"search " << i << L" outline has the same nodes as searching");
+	}
+	// An invalid regular expression is still refused.
+	int startOffset, endOffset;
+	test(!typedBuffer.findNodeByAttributes(-1,VBufStorage_findDirection_forward,L"name",L"name:(?:two;",&startOffset,&endOffset), L"search with an invalid regular expression finds nothing");
+	// Typed attributes take less memory, and are left as they are by freezing.
+	VBufStorage_memoryUsage_t typedUsage, stringUsage;
+	typedBuffer.getMemoryUsage(&typedUsage);
+	stringBuffer.getMemoryUsage(&stringUsage);
+	test(typedUsage.attributes<stringUsage.attributes, L"typed attributes use less memory, " << typedUsage.attributes << L" of " << stringUsage.attributes);
+	unsigned int nodeCount;
+	unsigned long long textBytes, attributeBytes, frozenTextBytes, frozenAttributeBytes;
+	typedBuffer.getContentSize(&nodeCount,&textBytes,&attributeBytes);
+	typedBuffer.freeze();
+	typedBuffer.getContentSize(&nodeCount,&frozenTextBytes,&frozenAttributeBytes);
+	test(frozenAttributeBytes==attributeBytes, L"content size measured the same while frozen");
+	typedBuffer.thaw();
+	test(findAll(typedBuffer,searches[0].attribs,searches[0].regexp)==findAll(stringBuffer,searches[0].attribs,searches[0].regexp), L"typed attributes are kept after thawing");
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
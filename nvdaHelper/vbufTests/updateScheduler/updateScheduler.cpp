@@ -0,0 +1,124 @@
+/**
+ * tests/updateScheduler/updateScheduler.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007-2017 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ * The scheduler has no Windows dependencies, so this test also builds with g++ on Linux.
+ */
+
+#include <iostream>
+#include <vbufBase/updateScheduler.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define test(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+class fakeClock_t: public VBufUpdateSchedulerClock_t {
+	public:
+	long long now;
+	fakeClock_t(): now(1000) {}
+	virtual long long getTime() { return now; }
+};
+
+void test_isolatedChange() {
+	fakeClock_t clock;
+	VBufUpdateScheduler_t scheduler(&clock,VBufUpdateSchedulerPolicy_t(20,250,2,500,250));
+	int delay=scheduler.requestUpdate();
+	test(delay==20, L"isolated change uses initial delay, got " << delay);
+	clock.now+=20;
+	test(scheduler.timerFired()==0, L"update runs when timer fires");
+	scheduler.updateStarted();
+	scheduler.updateFinished();
+	test(!scheduler.isPending(), L"nothing pending after update");
+	test(scheduler.timerFired()==-1, L"stray timer does nothing");
+	// A second change well after the first is also isolated.
+	clock.now+=5000;
+	delay=scheduler.requestUpdate();
+	test(delay==20, L"quiet page resets window, got " << delay);
+}
+
+void test_coalescing() {
+	fakeClock_t clock;
+	VBufUpdateScheduler_t scheduler(&clock,VBufUpdateSchedulerPolicy_t(20,250,2,500,250));
+	test(scheduler.requestUpdate()==20, L"first request arms timer");
+	clock.now+=5;
+	test(scheduler.requestUpdate()==-1, L"second request coalesced");
+	clock.now+=15;
+	// Window grew to 40 at time 1005, so due at 1045.
+	int delay=scheduler.timerFired();
+	test(delay==25, L"timer re-armed for remainder of grown window, got " << delay);
+	clock.now+=delay;
+	test(scheduler.timerFired()==0, L"update runs after grown window");
+	VBufUpdateSchedulerStats_t stats;
+	scheduler.updateStarted();
+	scheduler.updateFinished();
+	scheduler.getStats(&stats);
+	test(stats.requests==2&&stats.eventsCoalesced==1&&stats.updatesRun==1, L"counters " << stats.requests << L" " << stats.eventsCoalesced << L" " << stats.updatesRun);
+	test(stats.delayMax==45, L"max delay, got " << stats.delayMax);
+}
+
+void test_maxStaleness() {
+	fakeClock_t clock;
+	VBufUpdateScheduler_t scheduler(&clock,VBufUpdateSchedulerPolicy_t(20,250,2,500,250));
+	scheduler.requestUpdate();
+	long long first=clock.now;
+	// A storm of changes every 10 ms never lets the window close.
+	for(int i=0;i<100;++i) {
+		clock.now+=10;
+		scheduler.requestUpdate();
+		int delay=scheduler.timerFired();
+		if(delay==0) break;
+	}
+	test(clock.now-first<=500, L"update not postponed past staleness bound, waited " << (clock.now-first));
+	test(scheduler.timerFired()==0, L"update due at staleness bound");
+	scheduler.updateStarted();
+	scheduler.updateFinished();
+	// Churn continues straight after the update, so the window stays grown.
+	clock.now+=10;
+	int delay=scheduler.requestUpdate();
+	test(delay==250, L"churning page keeps grown window, got " << delay);
+}
+
+void test_cancel() {
+	fakeClock_t clock;
+	VBufUpdateScheduler_t scheduler(&clock);
+	scheduler.requestUpdate();
+	scheduler.cancel();
+	test(!scheduler.isPending(), L"cancel clears pending update");
+	test(scheduler.requestUpdate()>=0, L"request after cancel arms a new timer");
+}
+
+void test_percentiles() {
+	fakeClock_t clock;
+	VBufUpdateScheduler_t scheduler(&clock,VBufUpdateSchedulerPolicy_t(20,250,2,500,0));
+	for(int i=0;i<99;++i) {
+		scheduler.requestUpdate();
+		clock.now+=20;
+		scheduler.updateStarted();
+		scheduler.updateFinished();
+		clock.now+=1000;
+	}
+	scheduler.requestUpdate();
+	clock.now+=400;
+	scheduler.updateStarted();
+	VBufUpdateSchedulerStats_t stats;
+	scheduler.getStats(&stats);
+	test(stats.delayP50==31, L"p50 is upper bound of the 16-31 bucket, got " << stats.delayP50);
+	test(stats.delayP99==31, L"p99, got " << stats.delayP99);
+	test(stats.delayMax==400, L"max, got " << stats.delayMax);
+}
+
+int main(int argc, char *argv[]) {
+	test_isolatedChange();
+	test_coalescing();
+	test_maxStaleness();
+	test_cancel();
+	test_percentiles();
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
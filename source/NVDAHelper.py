@@ -13,7 +13,7 @@ import eventHandler
 import queueHandler
 import api
 import globalVars
-from logHandler import log
+from logHandler import log, RPC_S_SERVER_UNAVAILABLE, RPC_S_CALL_FAILED_DNE, EPT_S_NOT_REGISTERED
 import time
 import globalVars
 
@@ -22,6 +22,9 @@ _remoteLoader64=None
 localLib=None
 generateBeep=None
 VBuf_getTextInRange=None
+VBuf_getMetrics=None
+VBuf_getMemoryUsage=None
+VBuf_batch=None
 lastInputLanguageName=None
 lastInputMethodName=None
 
@@ -112,16 +115,169 @@ def nvdaControllerInternal_drawFocusRectNotify(hwnd, left, top, right, bottom):
 		eventHandler.queueEvent("displayModel_drawFocusRectNotify",focus,rect=(left,top,right,bottom))
 	return 0;
 
+def _getLogCodepath(pid):
+	if pid:
+		from appModuleHandler import getAppNameFromProcessID
+		return "RPC process %s (%s)"%(pid,getAppNameFromProcessID(pid,includeExt=True))
+	else:
+		return "NVDAHelperLocal"
+
 @WINFUNCTYPE(c_long,c_long,c_long,c_wchar_p)
 def nvdaControllerInternal_logMessage(level,pid,message):
 	if not log.isEnabledFor(level):
 		return 0
-	if pid:
-		from appModuleHandler import getAppNameFromProcessID
-		codepath="RPC process %s (%s)"%(pid,getAppNameFromProcessID(pid,includeExt=True))
-	else:
-		codepath="NVDAHelperLocal"
-	log._log(level,message,[],codepath=codepath)
+	log._log(level,message,[],codepath=_getLogCodepath(pid))
+	return 0
+
+class NvdaLogRecord(Structure):
+	_fields_=[
+		('level',c_long),
+		('threadID',c_long),
+		# The system time at which the message was logged, as a FILETIME.
+		('timestamp',c_longlong),
+		('message',c_wchar_p),
+	]
+
+#: Returned by virtual buffer calls which gave up because they ran longer than the buffer's query timeout or were cancelled, matching VBUFREMOTE_TIMEDOUT in nvdaHelper/interfaces/vbuf/vbuf.idl.
+VBUF_TIMEDOUT=-1
+
+class VBufTimeoutError(RuntimeError):
+	"""Raised when a virtual buffer call gives up because it ran longer than the buffer's query timeout or was cancelled.
+	The buffer is unchanged, so the call can be made again.
+	"""
+
+def _vbufErrcheck(result,func,args):
+	if result==VBUF_TIMEDOUT:
+		raise VBufTimeoutError("Virtual buffer call timed out")
+	return args
+
+#: The operations that can be run by VBuf_batch, matching the VBUFREMOTE_BATCHOP_* constants in nvdaHelper/interfaces/vbuf/vbuf.idl.
+VBUF_BATCHOP_GETFIELDNODEOFFSETS=1
+VBUF_BATCHOP_ISFIELDNODEATOFFSET=2
+VBUF_BATCHOP_LOCATETEXTFIELDNODEATOFFSET=3
+VBUF_BATCHOP_LOCATECONTROLFIELDNODEATOFFSET=4
+VBUF_BATCHOP_GETCONTROLFIELDNODEWITHIDENTIFIER=5
+VBUF_BATCHOP_GETIDENTIFIERFROMCONTROLFIELDNODE=6
+VBUF_BATCHOP_GETSELECTIONOFFSETS=7
+VBUF_BATCHOP_GETTEXTLENGTH=8
+VBUF_BATCHOP_GETTEXTINRANGE=9
+VBUF_BATCHOP_GETLINEOFFSETS=10
+
+class VBufBatchOp(Structure):
+	_fields_=[
+		('op',c_int),
+		# Bit n set means args[n] refers to an earlier result, see vbufBatchRef.
+		('argRefs',c_int),
+		('args',c_longlong*4),
+	]
+
+class VBufBatchResult(Structure):
+	_fields_=[
+		('status',c_int),
+		('values',c_longlong*5),
+	]
+
+def vbufBatchRef(opIndex,valueIndex):
+	"""Makes an argument for a VBuf_batch operation that refers to a value given by an earlier operation in the same batch."""
+	return (opIndex<<8)|valueIndex
+
+class VBufOutlineEntry(Structure):
+	_fields_=[
+		('node',c_ulonglong),
+		# A mask of the outline categories the node matches, bit n being set for category n.
+		('categories',c_uint),
+		('startOffset',c_int),
+		('endOffset',c_int),
+	]
+
+class VBufTextSection(object):
+	"""A shared memory section in to which the process holding a virtual buffer copies text, so that large amounts of text need not be marshalled.
+	The section grows as needed and is reused for later calls.
+	Only text with out markup is fetched this way, as it is copied straight from the buffer's nodes and its length is known up front.
+	Markup is still generated in to a string by the buffer, so fetching it through a section saves nothing.
+	"""
+
+	def __init__(self,processID):
+		self._process=winKernel.openProcess(winKernel.PROCESS_DUP_HANDLE,False,processID)
+		if not self._process:
+			raise WinError()
+		self._section=None
+		self._view=None
+		#: The number of characters the section can hold.
+		self.length=0
+
+	def _allocate(self,length):
+		self._free()
+		size=length*sizeof(c_wchar)
+		self._section=winKernel.createFileMapping(None,None,winKernel.PAGE_READWRITE,0,size,None)
+		self._view=winKernel.mapViewOfFile(self._section,winKernel.FILE_MAP_READ,0,0,size)
+		self.length=length
+
+	def _free(self):
+		if self._view:
+			winKernel.unmapViewOfFile(self._view)
+			self._view=None
+		if self._section:
+			winKernel.closeHandle(self._section)
+			self._section=None
+		self.length=0
+
+	def getTextInRange(self,bufferHandle,start,end):
+		"""Fetches text with out markup from a virtual buffer, as VBuf_getTextInRange does.
+		@return: the text, or C{None} if it could not be fetched.
+		"""
+		if end-start>self.length:
+			self._allocate(end-start)
+		remoteSection=winKernel.DuplicateHandle(winKernel.GetCurrentProcess(),self._section,self._process,winKernel.FILE_MAP_WRITE,False,0)
+		textLength=c_int()
+		try:
+			# The buffer's process closes its copy of the handle once the call reaches it.
+			res=localLib.VBuf_getTextInRangeToSection(bufferHandle,start,end,False,remoteSection,self.length,byref(textLength))
+		except WindowsError as e:
+			if e.winerror in (RPC_S_SERVER_UNAVAILABLE,RPC_S_CALL_FAILED_DNE,EPT_S_NOT_REGISTERED):
+				# The call never reached the buffer's process, so close the handle there ourselves.
+				# For other errors the call may have run and closed it already, and the same value may since have been reused.
+				winKernel.kernel32.DuplicateHandle(self._process,remoteSection,None,None,0,False,winKernel.DUPLICATE_CLOSE_SOURCE)
+			raise
+		if not res or textLength.value>self.length:
+			return None
+		return wstring_at(self._view,textLength.value)
+
+	def close(self):
+		self._free()
+		if self._process:
+			winKernel.closeHandle(self._process)
+			self._process=None
+
+#: The categories of nvdaHelper log messages whose level can be changed at runtime, mapped to the LOGCATEGORY_* constants in nvdaHelper/common/log.h.
+LOG_CATEGORIES={
+	"general":0,
+	"storage":1,
+	"backend":2,
+	"gecko":3,
+	"mshtml":4,
+	"gdiHooks":5,
+	"winword":6,
+	"ime":7,
+}
+
+#: The number of 100 nanosecond intervals between the FILETIME epoch (1601) and the Unix epoch (1970).
+FILETIME_UNIX_EPOCH=116444736000000000
+
+@WINFUNCTYPE(c_long,c_long,c_long,POINTER(NvdaLogRecord))
+def nvdaControllerInternal_logMessages(pid,count,records):
+	codepath=None
+	for index in xrange(count):
+		record=records[index]
+		if not log.isEnabledFor(record.level):
+			continue
+		if not codepath:
+			codepath=_getLogCodepath(pid)
+		logRecord=log.makeRecord(log.name,record.level,"",0,record.message,(),None,extra={"codepath":codepath})
+		# Messages are shipped in batches, so record when the message was logged rather than when it arrived.
+		logRecord.created=float(record.timestamp-FILETIME_UNIX_EPOCH)/10000000
+		logRecord.msecs=(logRecord.created-long(logRecord.created))*1000
+		log.handle(logRecord)
 	return 0
 
 def handleInputCompositionEnd(result):
@@ -416,7 +572,7 @@ class RemoteLoader64(object):
 		winKernel.closeHandle(self._process)
 
 def initialize():
-	global _remoteLib, _remoteLoader64, localLib, generateBeep,VBuf_getTextInRange
+	global _remoteLib, _remoteLoader64, localLib, generateBeep,VBuf_getTextInRange,VBuf_getMetrics,VBuf_getMemoryUsage,VBuf_batch
 	localLib=cdll.LoadLibrary('lib/nvdaHelperLocal.dll')
 	for name,func in [
 		("nvdaController_speakText",nvdaController_speakText),
@@ -427,6 +583,7 @@ def initialize():
 		("nvdaControllerInternal_typedCharacterNotify",nvdaControllerInternal_typedCharacterNotify),
 		("nvdaControllerInternal_displayModelTextChangeNotify",nvdaControllerInternal_displayModelTextChangeNotify),
 		("nvdaControllerInternal_logMessage",nvdaControllerInternal_logMessage),
+		("nvdaControllerInternal_logMessages",nvdaControllerInternal_logMessages),
 		("nvdaControllerInternal_inputCompositionUpdate",nvdaControllerInternal_inputCompositionUpdate),
 		("nvdaControllerInternal_inputCandidateListUpdate",nvdaControllerInternal_inputCandidateListUpdate),
 		("nvdaControllerInternal_IMEOpenStatusUpdate",nvdaControllerInternal_IMEOpenStatusUpdate),
@@ -448,6 +605,19 @@ def initialize():
 	VBuf_getTextInRange = CFUNCTYPE(c_int, c_int, c_int, c_int, POINTER(BSTR), c_int)(
 		("VBuf_getTextInRange", localLib),
 		((1,), (1,), (1,), (2,), (1,)))
+	VBuf_getMetrics = CFUNCTYPE(c_int, c_int, POINTER(BSTR))(
+		("VBuf_getMetrics", localLib),
+		((1,), (2,)))
+	VBuf_getMemoryUsage = CFUNCTYPE(c_int, c_int, POINTER(BSTR))(
+		("VBuf_getMemoryUsage", localLib),
+		((1,), (2,)))
+	# VBuf_batch returns the text fetched by its operations and the version of the buffer they saw.
+	VBuf_batch = CFUNCTYPE(c_int, c_int, c_int, POINTER(VBufBatchOp), POINTER(VBufBatchResult), POINTER(BSTR), POINTER(c_int))(
+		("VBuf_batch", localLib),
+		((1,), (1,), (1,), (1,), (2,), (2,)))
+	# Raise VBufTimeoutError from calls which can give up part way through.
+	for func in (VBuf_getTextInRange, VBuf_batch, localLib.VBuf_findNodeByAttributes, localLib.VBuf_findText, localLib.VBuf_getLineOffsets, localLib.VBuf_getTextInRangeToSection):
+		func.errcheck=_vbufErrcheck
 	#Load nvdaHelperRemote.dll but with an altered search path so it can pick up other dlls in lib
 	h=windll.kernel32.LoadLibraryExW(os.path.abspath(ur"lib\nvdaHelperRemote.dll"),0,0x8)
 	if not h:
@@ -464,7 +634,7 @@ def initialize():
 		_remoteLoader64=RemoteLoader64()
 
 def terminate():
-	global _remoteLib, _remoteLoader64, localLib, generateBeep, VBuf_getTextInRange
+	global _remoteLib, _remoteLoader64, localLib, generateBeep, VBuf_getTextInRange, VBuf_getMetrics, VBuf_getMemoryUsage, VBuf_batch
 	if not _remoteLib.uninstallIA2Support():
 		log.debugWarning("Error uninstalling IA2 support")
 	if _remoteLib.injection_terminate() == 0:
@@ -475,6 +645,9 @@ def terminate():
 		_remoteLoader64=None
 	generateBeep=None
 	VBuf_getTextInRange=None
+	VBuf_getMetrics=None
+	VBuf_getMemoryUsage=None
+	VBuf_batch=None
 	localLib.nvdaHelperLocal_terminate()
 	localLib=None
 
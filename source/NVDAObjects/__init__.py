@@ -1108,6 +1108,11 @@ This code is executed if a gain focus event is received by this object.
 		except Exception as e:
 			ret = "exception: %s" % e
 		info.append("appModule.productVersion: %s" % ret)
+		try:
+			ret = repr(getattr(self.treeInterceptor, "memoryUsage", None))
+		except Exception as e:
+			ret = "exception: %s" % e
+		info.append("treeInterceptor memoryUsage: %s" % ret)
 		try:
 			ret = repr(self.TextInfo)
 		except Exception as e:
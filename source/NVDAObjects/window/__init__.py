@@ -367,6 +367,12 @@ An NVDAObject for a window
 		except Exception as e:
 			ret = "exception: %s" % e
 		info.append("displayText: %s" % ret)
+		try:
+			bindingHandle = self.appModule.helperLocalBindingHandle
+			ret = repr(displayModel.getMemoryUsage(bindingHandle) if bindingHandle else None)
+		except Exception as e:
+			ret = "exception: %s" % e
+		info.append("displayModel memoryUsage: %s" % ret)
 		return info
 
 class Desktop(Window):
@@ -460,6 +460,42 @@ class AppModule(baseObject.ScriptableObject):
 			self.helperLocalBindingHandle, path)
 		print "Dump path: %s" % path
 
+	def setHelperLogLevel(self, category, level):
+		"""Change the lowest level of message logged by nvdaHelper in this process for a category of messages.
+		NVDA's own log level must also be low enough for the messages to appear in the log.
+		This should only be called if instructed by a developer.
+		@param category: one of the names in L{NVDAHelper.LOG_CATEGORIES}.
+		@type category: str
+		@param level: the lowest level to log, such as C{log.DEBUG}.
+		@type level: int
+		"""
+		NVDAHelper.localLib.nvdaInProcUtils_setLogLevel(
+			self.helperLocalBindingHandle, NVDAHelper.LOG_CATEGORIES[category], level)
+
+	def startTrace(self):
+		"""Start recording trace events for nvdaHelper in this process, discarding any previously recorded events.
+		Use L{writeTrace} to save them.
+		This should only be called if instructed by a developer.
+		"""
+		NVDAHelper.localLib.nvdaInProcUtils_trace_setEnabled(
+			self.helperLocalBindingHandle, True)
+
+	def writeTrace(self, stop=True):
+		"""Write the trace events recorded for nvdaHelper in this process to a file in Chrome's trace event format.
+		The file can be loaded in chrome://tracing.
+		This should only be called if instructed by a developer.
+		@param stop: whether to stop recording.
+		@type stop: bool
+		"""
+		if stop:
+			NVDAHelper.localLib.nvdaInProcUtils_trace_setEnabled(
+				self.helperLocalBindingHandle, False)
+		path = os.path.join(tempfile.gettempdir(),
+			"nvda_trace_%s_%d.json" % (self.appName, self.processID)).decode("mbcs")
+		NVDAHelper.localLib.nvdaInProcUtils_trace_writeFile(
+			self.helperLocalBindingHandle, path)
+		print "Trace path: %s" % path
+
 class AppProfileTrigger(config.ProfileTrigger):
 	"""A configuration profile trigger for when a particular application has focus.
 	"""
@@ -135,6 +135,10 @@ schemaVersion = integer(min=0, default={latestSchemaVersion})
 	passThroughAudioIndication = boolean(default=true)
 	autoSayAllOnPageLoad = boolean(default=true)
 	trapNonCommandGestures = boolean(default=true)
+	# Seconds a document may go without being read before its buffer is frozen to save memory, 0 to never freeze buffers.
+	idleFreezeTimeout = integer(default=300,min=0)
+	# Share the text and attributes of repeated parts of documents, such as table rows, to save memory.
+	shareRepeatedSubtrees = boolean(default=false)
 
 #Settings for document reading (such as MS Word and wordpad)
 [documentFormatting]
@@ -180,6 +180,19 @@ def getFocusRect(obj):
 		return left.value,top.value,right.value,bottom.value
 	return None
 
+def getMemoryUsage(bindingHandle):
+	"""Fetches the memory used by the display models and glyph tables in a process, in bytes.
+	@param bindingHandle: the helper binding handle of the process's app module.
+	@return: the memory used, mapping "displayChunks" and "glyphTables" to bytes.
+	@rtype: dict
+	"""
+	displayChunkBytes=c_ulonglong()
+	glyphTableBytes=c_ulonglong()
+	res=watchdog.cancellableExecute(NVDAHelper.localLib.displayModel_getMemoryUsage, bindingHandle, byref(displayChunkBytes), byref(glyphTableBytes))
+	if res!=0:
+		raise RuntimeError("displayModel_getMemoryUsage failed with res %d"%res)
+	return {"displayChunks":displayChunkBytes.value,"glyphTables":glyphTableBytes.value}
+
 def requestTextChangeNotifications(obj, enable):
 	"""Request or cancel notifications for when the display text changes in an NVDAObject.
 	A textChange event (event_textChange) will be fired on the object when its text changes.
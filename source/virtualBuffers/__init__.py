@@ -92,6 +92,15 @@ def _prepareForFindByAttributes(attribs):
 		regexp.append("".join(optRegexp))
 	return u" ".join(reqAttrs), u"|".join(regexp)
 
+def cancelQueries():
+	"""Makes long running searches, line offset calculations and fetches of text with markup give up in all running virtual buffers.
+	Used by the watchdog when the core may be frozen waiting for one, so this may be called from any thread.
+	"""
+	for ti in list(treeInterceptorHandler.runningTable):
+		VBufHandle=getattr(ti,"VBufHandle",None)
+		if VBufHandle:
+			NVDAHelper.localLib.VBuf_cancelQueries(VBufHandle)
+
 class VirtualBufferQuickNavItem(browseMode.TextInfoQuickNavItem):
 
 	def __init__(self,itemType,document,vbufNode,startOffset,endOffset):
@@ -156,14 +165,23 @@ class VirtualBufferTextInfo(browseMode.BrowseModeDocumentTextInfo,textInfos.offs
 		return docHandle.value, ID.value
 
 	def _getOffsetsFromFieldIdentifier(self, docHandle, ID):
-		node=VBufRemote_nodeHandle_t()
-		NVDAHelper.localLib.VBuf_getControlFieldNodeWithIdentifier(self.obj.VBufHandle, docHandle, ID,ctypes.byref(node))
-		if not node:
+		# Find the node and its offsets in one call, so the node can not be removed in between.
+		ops=(NVDAHelper.VBufBatchOp*2)()
+		ops[0].op=NVDAHelper.VBUF_BATCHOP_GETCONTROLFIELDNODEWITHIDENTIFIER
+		ops[0].args[0]=docHandle
+		ops[0].args[1]=ID
+		ops[1].op=NVDAHelper.VBUF_BATCHOP_GETFIELDNODEOFFSETS
+		ops[1].argRefs=1
+		ops[1].args[0]=NVDAHelper.vbufBatchRef(0,0)
+		results=(NVDAHelper.VBufBatchResult*2)()
+		try:
+			NVDAHelper.VBuf_batch(self.obj.VBufHandle,len(ops),ops,results)
+		except NVDAHelper.VBufTimeoutError:
+			log.debugWarning("Gave up finding the offsets of field %d in document %d"%(ID,docHandle))
 			raise LookupError
-		start = ctypes.c_int()
-		end = ctypes.c_int()
-		NVDAHelper.localLib.VBuf_getFieldNodeOffsets(self.obj.VBufHandle, node, ctypes.byref(start), ctypes.byref(end))
-		return start.value, end.value
+		if not results[0].status:
+			raise LookupError
+		return results[1].values[0], results[1].values[1]
 
 	def _getPointFromOffset(self,offset):
 		o = self._getNVDAObjectFromOffset(offset)
@@ -216,7 +234,23 @@ class VirtualBufferTextInfo(browseMode.BrowseModeDocumentTextInfo,textInfos.offs
 	def _getTextRange(self,start,end):
 		if start==end:
 			return u""
-		return NVDAHelper.VBuf_getTextInRange(self.obj.VBufHandle,start,end,False) or u""
+		return self.obj._getTextInRange(start,end,False) or u""
+
+	def find(self,text,caseSensitive=False,reverse=False):
+		# The buffer searches its own text, so the text of the whole document is not fetched.
+		# As for other text, searching forward starts one past the start to avoid finding the current match.
+		offset=self._startOffset if reverse else self._startOffset+1
+		startOffset=ctypes.c_int()
+		endOffset=ctypes.c_int()
+		try:
+			found=NVDAHelper.localLib.VBuf_findText(self.obj.VBufHandle,offset,text,reverse,caseSensitive,ctypes.byref(startOffset),ctypes.byref(endOffset))
+		except NVDAHelper.VBufTimeoutError:
+			log.debugWarning("Gave up finding text in the buffer, searching its text instead")
+			return super(VirtualBufferTextInfo,self).find(text,caseSensitive=caseSensitive,reverse=reverse)
+		if not found:
+			return False
+		self._startOffset=self._endOffset=startOffset.value
+		return True
 
 	def _getPlaceholderAttribute(self, attrs, placeholderAttrsKey):
 		"""Gets the placeholder attribute to be used.
@@ -255,7 +289,7 @@ class VirtualBufferTextInfo(browseMode.BrowseModeDocumentTextInfo,textInfos.offs
 		end=self._endOffset
 		if start==end:
 			return ""
-		text=NVDAHelper.VBuf_getTextInRange(self.obj.VBufHandle,start,end,True)
+		text=self.obj._getTextInRange(start,end,True)
 		if not text:
 			return ""
 		commandList=XMLFormatting.XMLTextParser().parse(text)
@@ -268,25 +302,30 @@ class VirtualBufferTextInfo(browseMode.BrowseModeDocumentTextInfo,textInfos.offs
 					commandList[index].field=self._normalizeFormatField(field)
 		return commandList
 
-	def _getWordOffsets(self,offset):
-		#Use VBuf_getBufferLineOffsets with out screen layout to find out the range of the current field
+	def _getBufferLineOffsets(self,offset,maxLineLength,useScreenLayout):
+		"""Fetches the offsets of the line containing the given offset, as calculated by the buffer.
+		If the buffer gives up because the calculation takes too long, the line is just the character at the offset, so that the document can still be moved through.
+		"""
 		lineStart=ctypes.c_int()
 		lineEnd=ctypes.c_int()
-		NVDAHelper.localLib.VBuf_getLineOffsets(self.obj.VBufHandle,offset,0,False,ctypes.byref(lineStart),ctypes.byref(lineEnd))
+		try:
+			NVDAHelper.localLib.VBuf_getLineOffsets(self.obj.VBufHandle,offset,maxLineLength,useScreenLayout,ctypes.byref(lineStart),ctypes.byref(lineEnd))
+		except NVDAHelper.VBufTimeoutError:
+			log.debugWarning("Gave up calculating line offsets at offset %d"%offset)
+			return offset,offset+1
+		return lineStart.value,lineEnd.value
+
+	def _getWordOffsets(self,offset):
+		#Use VBuf_getBufferLineOffsets with out screen layout to find out the range of the current field
+		lineStart,lineEnd=self._getBufferLineOffsets(offset,0,False)
 		word_startOffset,word_endOffset=super(VirtualBufferTextInfo,self)._getWordOffsets(offset)
-		return (max(lineStart.value,word_startOffset),min(lineEnd.value,word_endOffset))
+		return (max(lineStart,word_startOffset),min(lineEnd,word_endOffset))
 
 	def _getLineOffsets(self,offset):
-		lineStart=ctypes.c_int()
-		lineEnd=ctypes.c_int()
-		NVDAHelper.localLib.VBuf_getLineOffsets(self.obj.VBufHandle,offset,config.conf["virtualBuffers"]["maxLineLength"],config.conf["virtualBuffers"]["useScreenLayout"],ctypes.byref(lineStart),ctypes.byref(lineEnd))
-		return lineStart.value,lineEnd.value
+		return self._getBufferLineOffsets(offset,config.conf["virtualBuffers"]["maxLineLength"],config.conf["virtualBuffers"]["useScreenLayout"])
  
 	def _getParagraphOffsets(self,offset):
-		lineStart=ctypes.c_int()
-		lineEnd=ctypes.c_int()
-		NVDAHelper.localLib.VBuf_getLineOffsets(self.obj.VBufHandle,offset,0,True,ctypes.byref(lineStart),ctypes.byref(lineEnd))
-		return lineStart.value,lineEnd.value
+		return self._getBufferLineOffsets(offset,0,True)
 
 	def _normalizeControlField(self,attrs):
 		tableLayout=attrs.get('table-layout')
@@ -397,6 +436,10 @@ class VirtualBuffer(browseMode.BrowseModeDocumentTreeInterceptor):
 	def _get_isReady(self):
 		return bool(self.VBufHandle and not self.isLoading)
 
+	#: The longest, in milliseconds, that a single search, line offset calculation or fetch of text with markup may hold the buffer before giving up.
+	#: The watchdog also cancels running queries when it tries to recover from a freeze, see L{cancelQueries}.
+	QUERY_TIMEOUT=2000
+
 	def loadBuffer(self):
 		self.isLoading = True
 		self._loadProgressCallLater = wx.CallLater(1000, self._loadProgress)
@@ -407,6 +450,11 @@ class VirtualBuffer(browseMode.BrowseModeDocumentTreeInterceptor):
 			self.VBufHandle=NVDAHelper.localLib.VBuf_createBuffer(self.rootNVDAObject.appModule.helperLocalBindingHandle,self.rootDocHandle,self.rootID,unicode(self.backendName))
 			if not self.VBufHandle:
 				raise RuntimeError("Could not remotely create virtualBuffer")
+			NVDAHelper.localLib.VBuf_setQueryTimeout(self.VBufHandle,self.QUERY_TIMEOUT)
+			# Buffers of documents left in the background, such as other browser tabs, are frozen until they are next read.
+			NVDAHelper.localLib.VBuf_setIdleFreezeTimeout(self.VBufHandle,config.conf["virtualBuffers"]["idleFreezeTimeout"]*1000)
+			if config.conf["virtualBuffers"]["shareRepeatedSubtrees"]:
+				NVDAHelper.localLib.VBuf_setSubtreeSharing(self.VBufHandle,True)
 		except:
 			log.error("", exc_info=True)
 			queueHandler.queueFunction(queueHandler.eventQueue, self._loadBufferDone, success=False)
@@ -431,8 +479,79 @@ class VirtualBuffer(browseMode.BrowseModeDocumentTreeInterceptor):
 		# Translators: Reported while loading a document.
 		ui.message(_("Loading document..."))
 
+	def _get_metrics(self):
+		"""Metrics about the rendering work done for this buffer, for diagnosing slow buffers.
+		Times are in microseconds, except for update delays which are in milliseconds.
+		@return: the metrics, mapping names to values, or an empty dict if the buffer is not loaded.
+		@rtype: dict
+		"""
+		if not self.VBufHandle:
+			return {}
+		return self._parseNameValuePairs(NVDAHelper.VBuf_getMetrics(self.VBufHandle))
+
+	def _get_memoryUsage(self):
+		"""The memory used by this buffer in the host process, in bytes, by category: nodes, text, attributes, identifierIndex and otherIndexes, along with their total.
+		@return: the memory used, mapping categories to bytes, or an empty dict if the buffer is not loaded.
+		@rtype: dict
+		"""
+		if not self.VBufHandle:
+			return {}
+		return self._parseNameValuePairs(NVDAHelper.VBuf_getMemoryUsage(self.VBufHandle))
+
+	@staticmethod
+	def _parseNameValuePairs(text):
+		"""Parses name:value pairs separated by semi colons, as returned by the buffer, converting integer values.
+		@rtype: dict
+		"""
+		pairs={}
+		for item in (text or u"").split(u";"):
+			name,sep,value=item.partition(u":")
+			if not sep:
+				continue
+			try:
+				pairs[name]=int(value)
+			except ValueError:
+				pairs[name]=value
+		return pairs
+
+	#: Ranges of text with out markup at least this many characters long are fetched through a shared memory section, rather than being marshalled as a string.
+	TEXT_SECTION_MIN_LENGTH=16384
+
+	#: The section used to fetch large ranges, C{False} if one could not be created.
+	_textSection=None
+
+	def _getTextInRange(self,start,end,useMarkup):
+		"""Fetches the text between the given offsets, with markup if useMarkup is C{True}.
+		@return: the text, or C{None} if it could not be fetched, including if the buffer gave up because fetching took too long.
+		"""
+		try:
+			if not useMarkup and end-start>=self.TEXT_SECTION_MIN_LENGTH and self._textSection is not False:
+				try:
+					if not self._textSection:
+						self._textSection=NVDAHelper.VBufTextSection(self.rootNVDAObject.processID)
+					text=self._textSection.getTextInRange(self.VBufHandle,start,end)
+					if text is not None:
+						return text
+				except WindowsError:
+					log.debugWarning("Could not fetch text through a shared memory section",exc_info=True)
+					if self._textSection:
+						self._textSection.close()
+					self._textSection=False
+			return NVDAHelper.VBuf_getTextInRange(self.VBufHandle,start,end,useMarkup)
+		except NVDAHelper.VBufTimeoutError:
+			log.debugWarning("Gave up fetching text between offsets %d and %d"%(start,end))
+			return None
+
 	def unloadBuffer(self):
+		if self._textSection:
+			self._textSection.close()
+			self._textSection=None
 		if self.VBufHandle is not None:
+			if log.isEnabledFor(log.DEBUG):
+				try:
+					log.debug("Metrics for %s: %s"%(self.backendName,", ".join("%s: %s"%item for item in sorted(self.metrics.iteritems()))))
+				except WindowsError:
+					log.debugWarning("Could not fetch buffer metrics",exc_info=True)
 			try:
 				watchdog.cancellableExecute(NVDAHelper.localLib.VBuf_destroyBuffer, ctypes.byref(ctypes.c_int(self.VBufHandle)))
 			except WindowsError:
@@ -513,8 +632,64 @@ class VirtualBuffer(browseMode.BrowseModeDocumentTreeInterceptor):
 		attribs=self._searchableAttribsForNodeType(nodeType)
 		if not attribs:
 			raise NotImplementedError
+		if nodeType in self.OUTLINE_NODE_TYPES and direction=="next" and not pos:
+			return self._iterOutlineNodes(attribs,nodeType)
 		return self._iterNodesByAttribs(attribs, direction, pos,nodeType)
 
+	#: Node types kept in the buffer's outline, so that all nodes of these types, such as for the elements list, are fetched without searching the buffer.
+	OUTLINE_NODE_TYPES=frozenset(("heading","landmark","link","formField"))
+
+	#: The number of outline nodes fetched by each call.
+	OUTLINE_CHUNK_SIZE=256
+
+	def _iterOutlineNodes(self,attribs,nodeType):
+		"""Yields all nodes matching the given attributes, in the order they appear in the buffer, as for L{_iterNodesByAttribs} from the start of the buffer.
+		The buffer keeps the matching nodes up to date as it changes, so they are fetched without searching.
+		"""
+		reqAttrs, regexp = _prepareForFindByAttributes(attribs)
+		try:
+			category=NVDAHelper.localLib.VBuf_addOutlineCategory(self.VBufHandle,reqAttrs,regexp)
+		except WindowsError:
+			category=-1
+		nodes=self._getOutlineNodes(category) if category>=0 else None
+		if nodes is None:
+			log.debugWarning("Could not fetch outline for %s, searching instead"%nodeType)
+			for item in self._iterNodesByAttribs(attribs,nodeType=nodeType):
+				yield item
+			return
+		for node,startOffset,endOffset in nodes:
+			yield VirtualBufferQuickNavItem(nodeType,self,VBufRemote_nodeHandle_t(node),startOffset,endOffset)
+
+	def _getOutlineNodes(self,category):
+		"""Fetches the nodes of an outline category, in several parts if there are many.
+		@return: the node handle, start offset and end offset of each node, or C{None} if they could not be fetched, such as if the buffer kept changing while they were fetched.
+		@rtype: list of tuples
+		"""
+		entries=(NVDAHelper.VBufOutlineEntry*self.OUTLINE_CHUNK_SIZE)()
+		entryCount=ctypes.c_int()
+		totalEntryCount=ctypes.c_int()
+		version=ctypes.c_uint()
+		categories=ctypes.c_uint(1<<category)
+		# Start again if the buffer changes part way through.
+		for attempt in xrange(3):
+			nodes=[]
+			firstVersion=None
+			while True:
+				try:
+					res=NVDAHelper.localLib.VBuf_getOutline(self.VBufHandle,categories,len(nodes),len(entries),ctypes.byref(entryCount),entries,ctypes.byref(totalEntryCount),ctypes.byref(version))
+				except WindowsError:
+					return None
+				if not res:
+					return None
+				if firstVersion is None:
+					firstVersion=version.value
+				elif version.value!=firstVersion:
+					break
+				nodes.extend((entry.node,entry.startOffset,entry.endOffset) for entry in entries[:entryCount.value])
+				if entryCount.value==0 or len(nodes)>=totalEntryCount.value:
+					return nodes
+		return None
+
 	def _iterNodesByAttribs(self, attribs, direction="next", pos=None,nodeType=None):
 		offset=pos._startOffset if pos else -1
 		reqAttrs, regexp = _prepareForFindByAttributes(attribs)
@@ -532,6 +707,9 @@ class VirtualBuffer(browseMode.BrowseModeDocumentTreeInterceptor):
 			try:
 				node=VBufRemote_nodeHandle_t()
 				NVDAHelper.localLib.VBuf_findNodeByAttributes(self.VBufHandle,offset,direction,reqAttrs,regexp,ctypes.byref(startOffset),ctypes.byref(endOffset),ctypes.byref(node))
+			except NVDAHelper.VBufTimeoutError:
+				log.debugWarning("Gave up searching for %s"%attribs)
+				return
 			except:
 				return
 			if not node:
@@ -540,10 +718,23 @@ class VirtualBuffer(browseMode.BrowseModeDocumentTreeInterceptor):
 			offset=startOffset
 
 	def _getTableCellAt(self,tableID,startPos,row,column):
+		# The buffer keeps a grid of each table's cells, so this does not depend on the size of the table.
+		# The grid also finds cells which span the row or column without starting at it.
+		startOffset=ctypes.c_int()
+		endOffset=ctypes.c_int()
+		node=VBufRemote_nodeHandle_t()
 		try:
-			return next(self._iterTableCells(tableID,row=row,column=column))
-		except StopIteration:
+			found=NVDAHelper.localLib.VBuf_getTableCell(self.VBufHandle,unicode(tableID),row,column,ctypes.byref(startOffset),ctypes.byref(endOffset),ctypes.byref(node))
+		except WindowsError:
+			log.debugWarning("Could not get table cell from the buffer, searching the table instead",exc_info=True)
+			for info in self._iterTableCells(tableID):
+				_ignore, cellRow, cellCol, rowSpan, colSpan = self._getTableCellCoords(info)
+				if cellRow <= row < cellRow + rowSpan and cellCol <= column < cellCol + colSpan:
+					return info
+			raise LookupError
+		if not found:
 			raise LookupError
+		return self.makeTextInfo(textInfos.offsets.Offsets(startOffset.value,endOffset.value))
 
 	def _iterTableCells(self, tableID, startPos=None, direction="next", row=None, column=None):
 		attrs = {"table-id": [str(tableID)]}
@@ -572,37 +763,8 @@ class VirtualBuffer(browseMode.BrowseModeDocumentTreeInterceptor):
 			# Optimisation: We're definitely at the edge of the column.
 			raise LookupError
 
-		# Optimisation: Try searching for exact destination coordinates.
-		# This won't work if they are covered by a cell spanning multiple rows/cols, but this won't be true in the majority of cases.
-		try:
-			return self._getTableCellAt(tableID,startPos,destRow,destCol)
-		except LookupError:
-			pass
-
-		# Cells are grouped by row, so in most cases, we simply need to search in the right direction.
-		for info in self._iterTableCells(tableID, direction=movement, startPos=startPos):
-			_ignore, row, col, rowSpan, colSpan = self._getTableCellCoords(info)
-			if row <= destRow < row + rowSpan and col <= destCol < col + colSpan:
-				return info
-			elif row > destRow and movement == "next":
-				# Optimisation: We've gone forward past destRow, so we know we won't find the cell.
-				# We can't reverse this logic when moving backwards because there might be a prior cell on an earlier row which spans multiple rows.
-				break
-
-		if axis == "row" or (axis == "column" and movement == "previous"):
-			# In most cases, there's nothing more to try.
-			raise LookupError
-
-		else:
-			# We're moving forward by column.
-			# In this case, there might be a cell on an earlier row which spans multiple rows.
-			# Therefore, try searching backwards.
-			for info in self._iterTableCells(tableID, direction="previous", startPos=startPos):
-				_ignore, row, col, rowSpan, colSpan = self._getTableCellCoords(info)
-				if row <= destRow < row + rowSpan and col <= destCol < col + colSpan:
-					return info
-			else:
-				raise LookupError
+		# A cell covered by a cell spanning multiple rows or columns is found as that cell, so there is no need to search for it.
+		return self._getTableCellAt(tableID,startPos,destRow,destCol)
 
 	def _isSuitableNotLinkBlock(self,range):
 		return (range._endOffset-range._startOffset)>=self.NOT_LINK_BLOCK_MIN_LEN
@@ -138,6 +138,13 @@ def _recoverAttempt():
 		oledll.ole32.CoCancelCall(core.mainThreadId,0)
 	except:
 		pass
+	# The core may be waiting for a long running virtual buffer query.
+	try:
+		# Import late to avoid circular import.
+		import virtualBuffers
+		virtualBuffers.cancelQueries()
+	except:
+		pass
 
 class MINIDUMP_EXCEPTION_INFORMATION(ctypes.Structure):
 	_fields_ = (
@@ -20,6 +20,7 @@ PROCESS_TERMINATE=0x1
 PROCESS_VM_OPERATION=0x8
 PROCESS_VM_READ=0x10
 PROCESS_VM_WRITE=0X20
+PROCESS_DUP_HANDLE=0x40
 SYNCHRONIZE=0x100000
 PROCESS_QUERY_INFORMATION=0x400
 READ_CONTROL=0x20000
@@ -129,6 +130,27 @@ def writeProcessMemory(*args):
 def waitForSingleObject(handle,timeout):
 	return kernel32.WaitForSingleObject(handle,timeout)
 
+FILE_MAP_WRITE=0x2
+FILE_MAP_READ=0x4
+
+def createFileMapping(fileHandle,securityAttributes,protect,maximumSizeHigh,maximumSizeLow,name):
+	"""Creates a file mapping, backed by the paging file if fileHandle is None."""
+	if fileHandle is None:
+		fileHandle=HANDLE(-1)
+	res=kernel32.CreateFileMappingW(fileHandle,securityAttributes,protect,maximumSizeHigh,maximumSizeLow,name)
+	if res==0:
+		raise WinError()
+	return res
+
+def mapViewOfFile(fileMappingObject,desiredAccess,fileOffsetHigh,fileOffsetLow,numberOfBytesToMap):
+	res=c_void_p(kernel32.MapViewOfFile(fileMappingObject,desiredAccess,fileOffsetHigh,fileOffsetLow,numberOfBytesToMap)).value
+	if not res:
+		raise WinError()
+	return res
+
+def unmapViewOfFile(baseAddress):
+	return kernel32.UnmapViewOfFile(c_void_p(baseAddress))
+
 SHUTDOWN_NORETRY = 0x00000001
 
 def SetProcessShutdownParameters(level, flags):
@@ -219,6 +241,7 @@ def OpenProcessToken(ProcessHandle, DesiredAccess):
 		raise WinError()
 	return token.value
 
+DUPLICATE_CLOSE_SOURCE = 0x00000001
 DUPLICATE_SAME_ACCESS = 0x00000002
 
 def DuplicateHandle(sourceProcessHandle, sourceHandle, targetProcessHandle, desiredAccess, inheritHandle, options):